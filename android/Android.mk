@@ -414,6 +414,7 @@ include $(CLEAR_VARS)
 
 LOCAL_SRC_FILES := \
 	bluez/android/hal-audio.c \
+	bluez/android/hal-audio-stage.c \
 	bluez/android/hal-audio-sbc.c \
 	bluez/android/hal-audio-aptx.c \
 
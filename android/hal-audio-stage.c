@@ -0,0 +1,82 @@
+// SPDX-License-Identifier: Apache-2.0
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "audio-msg.h"
+#include "hal-audio.h"
+#include "hal-log.h"
+
+/*
+ * Return the PCM to encode into the next media packet of packet_len bytes.
+ * Complete packets are encoded straight from the AudioFlinger buffer, only a
+ * tail too short to fill a packet is staged and completed with data from the
+ * next write, so every packet sent carries as many frames as the MTU allows.
+ */
+const uint8_t *audio_pcm_stage_get(struct audio_pcm_stage *stage,
+					size_t packet_len,
+					const uint8_t *buffer, size_t bytes,
+					size_t *consumed, size_t *len)
+{
+	size_t avail, count;
+
+	avail = bytes - *consumed;
+
+	if (!stage->len && (!packet_len || avail >= packet_len)) {
+		if (!avail)
+			return NULL;
+
+		*len = packet_len ? packet_len : avail;
+		return buffer + *consumed;
+	}
+
+	if (stage->size < packet_len) {
+		uint8_t *buf;
+
+		buf = realloc(stage->buf, packet_len);
+		if (!buf) {
+			error("audio: failed to allocate staging buffer");
+			return NULL;
+		}
+
+		stage->buf = buf;
+		stage->size = packet_len;
+	}
+
+	count = packet_len > stage->len ? packet_len - stage->len : 0;
+	if (count > avail)
+		count = avail;
+
+	memcpy(stage->buf + stage->len, buffer + *consumed, count);
+	stage->len += count;
+	*consumed += count;
+
+	if (stage->len < packet_len)
+		return NULL;
+
+	*len = stage->len;
+
+	return stage->buf;
+}
+
+/* Account for the read bytes of in, as returned by audio_pcm_stage_get() */
+void audio_pcm_stage_consume(struct audio_pcm_stage *stage,
+					const uint8_t *in, size_t read,
+					size_t *consumed)
+{
+	if (in != stage->buf) {
+		*consumed += read;
+		return;
+	}
+
+	stage->len -= read;
+	memmove(stage->buf, stage->buf + read, stage->len);
+}
+
+void audio_pcm_stage_free(struct audio_pcm_stage *stage)
+{
+	free(stage->buf);
+	memset(stage, 0, sizeof(*stage));
+}
@@ -16,6 +16,7 @@
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <fcntl.h>
+#include <inttypes.h>
 
 #include <hardware/audio.h>
 #include <hardware/hardware.h>
@@ -112,6 +113,13 @@ struct audio_endpoint {
 	uint32_t samples;
 	struct timespec start;
 
+	struct audio_pcm_stage stage;
+
+	unsigned int packets;
+	unsigned int wakeups;
+	uint64_t late_total;
+	uint64_t late_max;
+
 	bool resync;
 };
 
@@ -551,6 +559,8 @@ static void close_endpoint(struct audio_endpoint *ep)
 
 	free(ep->mp);
 
+	audio_pcm_stage_free(&ep->stage);
+
 	ep->codec->cleanup(ep->codec_data);
 	ep->codec_data = NULL;
 }
@@ -563,6 +573,12 @@ static bool resume_endpoint(struct audio_endpoint *ep)
 	ep->samples = 0;
 	ep->resync = false;
 
+	ep->stage.len = 0;
+	ep->packets = 0;
+	ep->wakeups = 0;
+	ep->late_total = 0;
+	ep->late_max = 0;
+
 	ep->codec->update_qos(ep->codec_data, QOS_POLICY_DEFAULT);
 
 	return true;
@@ -654,8 +670,10 @@ static bool write_data(struct a2dp_stream_out *out, const void *buffer,
 	size_t free_space = ep->mp_data_len;
 	size_t consumed = 0;
 
-	while (consumed < bytes) {
+	while (true) {
 		size_t written = 0;
+		const uint8_t *in;
+		size_t in_len;
 		ssize_t read;
 		uint32_t samples;
 		int ret;
@@ -663,6 +681,12 @@ static bool write_data(struct a2dp_stream_out *out, const void *buffer,
 		uint64_t audio_sent, audio_passed;
 		bool do_write = false;
 
+		in = audio_pcm_stage_get(&ep->stage,
+				ep->codec->get_buffer_size(ep->codec_data),
+				buffer, bytes, &consumed, &in_len);
+		if (!in)
+			break;
+
 		/*
 		 * prepare media packet in advance so we don't waste time after
 		 * wakeup
@@ -671,17 +695,20 @@ static bool write_data(struct a2dp_stream_out *out, const void *buffer,
 			mp_rtp->hdr.sequence_number = htons(ep->seq++);
 			mp_rtp->hdr.timestamp = htonl(ep->samples);
 		}
-		read = ep->codec->encode_mediapacket(ep->codec_data,
-						buffer + consumed,
-						bytes - consumed, mp,
-						free_space, &written);
+		read = ep->codec->encode_mediapacket(ep->codec_data, in,
+						in_len, mp, free_space,
+						&written);
 
 		/*
 		 * not much we can do here, let's just ignore remaining
 		 * data and continue
 		 */
-		if (read <= 0)
+		if (read <= 0) {
+			ep->stage.len = 0;
 			return true;
+		}
+
+		audio_pcm_stage_consume(&ep->stage, in, read, &consumed);
 
 		/* calculate where are we and where we should be */
 		clock_gettime(CLOCK_MONOTONIC, &current);
@@ -697,6 +724,7 @@ static bool write_data(struct a2dp_stream_out *out, const void *buffer,
 		 */
 		if (audio_sent > audio_passed) {
 			struct timespec anchor;
+			uint64_t late;
 
 			ep->resync = false;
 
@@ -716,6 +744,15 @@ static bool write_data(struct a2dp_stream_out *out, const void *buffer,
 					return false;
 				}
 			}
+
+			/* keep track of how late we are woken up */
+			clock_gettime(CLOCK_MONOTONIC, &current);
+			late = timespec_diff_us(&current, &anchor);
+
+			ep->wakeups++;
+			ep->late_total += late;
+			if (late > ep->late_max)
+				ep->late_max = late;
 		} else if (!ep->resync) {
 			uint64_t diff = audio_passed - audio_sent;
 
@@ -746,6 +783,8 @@ static bool write_data(struct a2dp_stream_out *out, const void *buffer,
 
 				if (!write_to_endpoint(ep, written))
 					return false;
+
+				ep->packets++;
 			}
 		}
 
@@ -756,7 +795,6 @@ static bool write_data(struct a2dp_stream_out *out, const void *buffer,
 		 */
 		samples = read / (2 * popcount(out->cfg.channels));
 		ep->samples += samples;
-		consumed += read;
 	}
 
 	return true;
@@ -890,6 +928,14 @@ static int out_standby(struct audio_stream *stream)
 	DBG("");
 
 	if (out->audio_state == AUDIO_A2DP_STATE_STARTED) {
+		struct audio_endpoint *ep = out->ep;
+
+		DBG("packets=%u wakeups=%u late avg=%" PRIu64 "us max=%"
+				PRIu64 "us",
+				ep->packets, ep->wakeups,
+				ep->wakeups ? ep->late_total / ep->wakeups : 0,
+				ep->late_max);
+
 		if (ipc_suspend_stream_cmd(out->ep->id) != AUDIO_STATUS_SUCCESS)
 			return -1;
 		out->audio_state = AUDIO_A2DP_STATE_STANDBY;
@@ -89,3 +89,18 @@ typedef const struct audio_codec * (*audio_codec_get_t) (void);
 
 const struct audio_codec *codec_sbc(void);
 const struct audio_codec *codec_aptx(void);
+
+struct audio_pcm_stage {
+	uint8_t *buf;
+	size_t size;
+	size_t len;
+};
+
+const uint8_t *audio_pcm_stage_get(struct audio_pcm_stage *stage,
+					size_t packet_len,
+					const uint8_t *buffer, size_t bytes,
+					size_t *consumed, size_t *len);
+void audio_pcm_stage_consume(struct audio_pcm_stage *stage,
+					const uint8_t *in, size_t read,
+					size_t *consumed);
+void audio_pcm_stage_free(struct audio_pcm_stage *stage);
@@ -0,0 +1,325 @@
+// SPDX-License-Identifier: Apache-2.0
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "audio-msg.h"
+#include "hal-audio.h"
+#include "../profiles/audio/a2dp-codecs.h"
+
+/* A2DP SBC frames in the HAL are always 16 blocks of 8 subbands */
+#define SBC_FRAME_SAMPLES	128
+
+/* Size of the AudioFlinger writes to the HAL */
+#define WRITE_SIZE		(20 * 512)
+
+struct timing {
+	unsigned int count;
+	double total;
+	double total_sq;
+	double max;
+};
+
+static void timing_add(struct timing *t, double usec)
+{
+	t->count++;
+	t->total += usec;
+	t->total_sq += usec * usec;
+
+	if (usec > t->max)
+		t->max = usec;
+}
+
+static void timing_print(const char *label, const struct timing *t)
+{
+	double mean, dev;
+
+	if (!t->count)
+		return;
+
+	mean = t->total / t->count;
+	dev = sqrt(fabs(t->total_sq / t->count - mean * mean));
+
+	printf("%-16s avg %8.2f us  max %8.2f us  jitter %8.2f us\n",
+							label, mean, t->max, dev);
+}
+
+static double timespec_us(const struct timespec *a, const struct timespec *b)
+{
+	return (a->tv_sec - b->tv_sec) * 1000000.0 +
+					(a->tv_nsec - b->tv_nsec) / 1000.0;
+}
+
+static void timespec_add_us(const struct timespec *base, uint64_t usec,
+							struct timespec *res)
+{
+	res->tv_sec = base->tv_sec + usec / 1000000;
+	res->tv_nsec = base->tv_nsec + (usec % 1000000) * 1000;
+
+	if (res->tv_nsec >= 1000000000) {
+		res->tv_sec++;
+		res->tv_nsec -= 1000000000;
+	}
+}
+
+static bool setup_codec(const struct audio_codec *codec, unsigned int rate,
+				unsigned int channels, uint8_t bitpool,
+				uint16_t payload_len, void **codec_data)
+{
+	uint8_t buf[sizeof(struct audio_preset) + sizeof(a2dp_sbc_t)];
+	struct audio_preset *preset = (void *) buf;
+	a2dp_sbc_t *sbc = (void *) preset->data;
+
+	memset(buf, 0, sizeof(buf));
+	preset->len = sizeof(*sbc);
+
+	switch (rate) {
+	case 44100:
+		sbc->frequency = SBC_SAMPLING_FREQ_44100;
+		break;
+	case 48000:
+		sbc->frequency = SBC_SAMPLING_FREQ_48000;
+		break;
+	default:
+		fprintf(stderr, "Unsupported rate %u\n", rate);
+		return false;
+	}
+
+	sbc->channel_mode = channels == 1 ? SBC_CHANNEL_MODE_MONO :
+						SBC_CHANNEL_MODE_JOINT_STEREO;
+	sbc->subbands = SBC_SUBBANDS_8;
+	sbc->block_length = SBC_BLOCK_LENGTH_16;
+	sbc->allocation_method = SBC_ALLOCATION_LOUDNESS;
+	sbc->min_bitpool = SBC_MIN_BITPOOL;
+	sbc->max_bitpool = bitpool;
+
+	return codec->init(preset, payload_len, codec_data);
+}
+
+static void usage(void)
+{
+	printf("sbc-bench - A2DP SBC encoder benchmark\n");
+	printf("Usage:\n"
+		"\tsbc-bench [options] <file>\n");
+	printf("options:\n"
+		"\t-r <rate>          sample rate (44100, 48000)\n"
+		"\t-c <channels>      channels in file (1, 2)\n"
+		"\t-b <bitpool>       bitpool\n"
+		"\t-m <mtu>           transport MTU\n"
+		"\t-l <loops>         encode the file this many times\n"
+		"\t-w <bytes>         size of each write to the HAL\n"
+		"\t-p                 pace packets in real time\n"
+		"\t-h                 show this help\n");
+}
+
+static struct option main_options[] = {
+	{ "rate",	1, 0, 'r' },
+	{ "channels",	1, 0, 'c' },
+	{ "bitpool",	1, 0, 'b' },
+	{ "mtu",	1, 0, 'm' },
+	{ "loops",	1, 0, 'l' },
+	{ "write",	1, 0, 'w' },
+	{ "paced",	0, 0, 'p' },
+	{ "help",	0, 0, 'h' },
+	{ 0, 0, 0, 0 }
+};
+
+int main(int argc, char *argv[])
+{
+	const struct audio_codec *codec = codec_sbc();
+	unsigned int rate = 44100, channels = 2, loops = 1, i;
+	unsigned int mtu = 895;
+	size_t write_size = WRITE_SIZE;
+	uint8_t bitpool = SBC_BITPOOL_HQ_JOINT_STEREO_44100;
+	bool paced = false;
+	struct timing encode = {}, wakeup = {};
+	struct timespec start, end, now, anchor;
+	uint64_t samples = 0, frames = 0, packets = 0, staged = 0;
+	struct audio_pcm_stage stage = {};
+	struct media_packet *mp;
+	void *codec_data;
+	const uint8_t *pcm;
+	struct stat st;
+	double elapsed;
+	int fd, opt;
+
+	while ((opt = getopt_long(argc, argv, "r:c:b:m:l:w:ph",
+						main_options, NULL)) != EOF) {
+		switch (opt) {
+		case 'r':
+			rate = atoi(optarg);
+			break;
+		case 'c':
+			channels = atoi(optarg);
+			if (channels != 1 && channels != 2) {
+				usage();
+				exit(1);
+			}
+			break;
+		case 'b':
+			bitpool = atoi(optarg);
+			break;
+		case 'm':
+			mtu = atoi(optarg);
+			break;
+		case 'l':
+			loops = atoi(optarg);
+			break;
+		case 'w':
+			write_size = atoi(optarg);
+			break;
+		case 'p':
+			paced = true;
+			break;
+		case 'h':
+			usage();
+			exit(0);
+		default:
+			usage();
+			exit(1);
+		}
+	}
+
+	if (optind + 1 != argc || mtu <= sizeof(struct rtp_header) ||
+							!write_size) {
+		usage();
+		exit(1);
+	}
+
+	fd = open(argv[optind], O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		fprintf(stderr, "Failed to open %s: %s\n", argv[optind],
+							strerror(errno));
+		exit(1);
+	}
+
+	pcm = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (pcm == MAP_FAILED) {
+		fprintf(stderr, "Failed to map %s: %s\n", argv[optind],
+							strerror(errno));
+		exit(1);
+	}
+
+	if (!setup_codec(codec, rate, channels, bitpool,
+				mtu - sizeof(struct rtp_header), &codec_data))
+		exit(1);
+
+	mp = calloc(mtu, 1);
+	if (!mp)
+		exit(1);
+
+	printf("%s: %u Hz, %u channel(s), bitpool %u, MTU %u, %zu byte "
+				"writes, %u loop(s)%s\n", argv[optind], rate,
+				channels, bitpool, mtu, write_size, loops,
+				paced ? ", paced" : "");
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (i = 0; i < loops; i++) {
+		size_t offset;
+
+		/* Feed the encoder the way the HAL write_data() does */
+		for (offset = 0; offset < (size_t) st.st_size;
+							offset += write_size) {
+			const uint8_t *buffer = pcm + offset;
+			size_t bytes = st.st_size - offset;
+			size_t consumed = 0;
+
+			if (bytes > write_size)
+				bytes = write_size;
+
+			while (true) {
+				struct timespec t0, t1;
+				const uint8_t *in;
+				size_t in_len, written = 0;
+				ssize_t len;
+
+				clock_gettime(CLOCK_MONOTONIC, &t0);
+
+				in = audio_pcm_stage_get(&stage,
+					codec->get_buffer_size(codec_data),
+					buffer, bytes, &consumed, &in_len);
+				if (!in)
+					break;
+
+				len = codec->encode_mediapacket(codec_data,
+						in, in_len, mp,
+						mtu - sizeof(struct rtp_header),
+						&written);
+				if (len <= 0)
+					break;
+
+				if (in == stage.buf)
+					staged++;
+
+				audio_pcm_stage_consume(&stage, in, len,
+								&consumed);
+
+				clock_gettime(CLOCK_MONOTONIC, &t1);
+
+				timing_add(&encode, timespec_us(&t1, &t0));
+
+				samples += len / (2 * channels);
+				packets++;
+
+				if (!paced)
+					continue;
+
+				/* Same pacing as the HAL audio thread */
+				timespec_add_us(&start,
+						samples * 1000000ull / rate,
+						&anchor);
+
+				while (clock_nanosleep(CLOCK_MONOTONIC,
+						TIMER_ABSTIME, &anchor,
+						NULL) == EINTR)
+					;
+
+				clock_gettime(CLOCK_MONOTONIC, &now);
+				timing_add(&wakeup, timespec_us(&now, &anchor));
+			}
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	frames = samples / SBC_FRAME_SAMPLES;
+	elapsed = timespec_us(&end, &start);
+
+	printf("%" PRIu64 " frames in %" PRIu64 " packets (%" PRIu64
+				" staged), %.0f ms audio\n", frames, packets,
+				staged, samples * 1000.0 / rate);
+	printf("%-16s %.0f frames/s, %.1fx real time\n", "encoder",
+				frames * 1000000.0 / encode.total,
+				samples * 1000000.0 / rate / encode.total);
+	timing_print("encode/packet", &encode);
+	timing_print("wakeup late", &wakeup);
+
+	if (paced)
+		printf("%-16s %.0f ms\n", "wall clock", elapsed / 1000);
+
+	audio_pcm_stage_free(&stage);
+	codec->cleanup(codec_data);
+	free(mp);
+	munmap((void *) pcm, st.st_size);
+	close(fd);
+
+	return 0;
+}
@@ -26,6 +26,7 @@
 
 #include "lib/bluetooth.h"
 #include "lib/hci.h"
+#include "lib/mgmt.h"
 
 #include "monitor/bt.h"
 #include "emulator/vhci.h"
@@ -45,6 +46,7 @@ struct hciemu_client {
 
 struct hciemu {
 	int ref_count;
+	enum hciemu_type type;
 	enum btdev_type btdev_type;
 	struct vhci *vhci;
 	struct queue *clients;
@@ -242,6 +244,51 @@ struct vhci *hciemu_get_vhci(struct hciemu *hciemu)
 	return hciemu->vhci;
 }
 
+uint16_t hciemu_get_index(struct hciemu *hciemu)
+{
+	if (!hciemu)
+		return HCI_DEV_NONE;
+
+	return vhci_get_index(hciemu->vhci);
+}
+
+/*
+ * Testers running in parallel each create their own controller and every
+ * one of them is announced to all mgmt sockets. Only the index of this
+ * emulator is of interest, anything goes until it has been created.
+ */
+bool hciemu_owns_index(struct hciemu *hciemu, uint16_t index)
+{
+	if (!hciemu)
+		return true;
+
+	return index == hciemu_get_index(hciemu);
+}
+
+/* Check a Read Index List reply for a controller announced before it */
+bool hciemu_index_listed(struct hciemu *hciemu, const void *param,
+							uint16_t length)
+{
+	const struct mgmt_rp_read_index_list *rp = param;
+	uint16_t i, num, index;
+
+	if (!hciemu || length < sizeof(*rp))
+		return false;
+
+	num = le16_to_cpu(rp->num_controllers);
+	if (length < sizeof(*rp) + num * sizeof(uint16_t))
+		return false;
+
+	index = hciemu_get_index(hciemu);
+
+	for (i = 0; i < num; i++) {
+		if (le16_to_cpu(rp->index[i]) == index)
+			return true;
+	}
+
+	return false;
+}
+
 struct hciemu_client *hciemu_get_client(struct hciemu *hciemu, int num)
 {
 	const struct queue_entry *entry;
@@ -357,6 +404,8 @@ struct hciemu *hciemu_new_num(enum hciemu_type type, uint8_t num)
 	if (!hciemu)
 		return NULL;
 
+	hciemu->type = type;
+
 	switch (type) {
 	case HCIEMU_TYPE_BREDRLE:
 		hciemu->btdev_type = BTDEV_TYPE_BREDRLE;
@@ -439,6 +488,131 @@ void hciemu_unref(struct hciemu *hciemu)
 	free(hciemu);
 }
 
+/*
+ * Controllers kept in the pool are registered with the kernel ahead of time
+ * so that its initialization overlaps with the running test case instead of
+ * delaying the setup of the next one. Used controllers are never put back:
+ * the kernel keeps settings, keys and other state per index that can only
+ * be reset by removing the index altogether.
+ */
+struct hciemu_pool {
+	unsigned int size;
+	pid_t pid;
+	struct queue *controllers;
+	enum hciemu_type refill_type;
+	guint refill_source;
+	unsigned int hits;
+	unsigned int misses;
+};
+
+static void pool_entry_free(void *data)
+{
+	hciemu_unref(data);
+}
+
+static bool match_type(const void *data, const void *match_data)
+{
+	const struct hciemu *hciemu = data;
+	enum hciemu_type type = PTR_TO_UINT(match_data);
+
+	return hciemu->type == type;
+}
+
+static gboolean refill_pool(gpointer user_data)
+{
+	struct hciemu_pool *pool = user_data;
+	struct hciemu *hciemu;
+
+	pool->refill_source = 0;
+
+	if (queue_find(pool->controllers, match_type,
+					UINT_TO_PTR(pool->refill_type)))
+		return FALSE;
+
+	/* Make room by dropping the least recently created controller */
+	if (queue_length(pool->controllers) >= pool->size)
+		hciemu_unref(queue_pop_head(pool->controllers));
+
+	hciemu = hciemu_new(pool->refill_type);
+	if (hciemu)
+		queue_push_tail(pool->controllers, hciemu);
+
+	return FALSE;
+}
+
+struct hciemu_pool *hciemu_pool_new(unsigned int size)
+{
+	struct hciemu_pool *pool;
+
+	if (!size)
+		return NULL;
+
+	pool = new0(struct hciemu_pool, 1);
+	if (!pool)
+		return NULL;
+
+	pool->size = size;
+	pool->pid = getpid();
+	pool->controllers = queue_new();
+
+	return pool;
+}
+
+void hciemu_pool_free(struct hciemu_pool *pool)
+{
+	if (!pool)
+		return;
+
+	if (pool->refill_source)
+		g_source_remove(pool->refill_source);
+
+	queue_destroy(pool->controllers, pool_entry_free);
+
+	free(pool);
+}
+
+struct hciemu *hciemu_pool_get(struct hciemu_pool *pool,
+						enum hciemu_type type)
+{
+	struct hciemu *hciemu;
+
+	/* Never share controllers with a forked test process */
+	if (!pool || pool->pid != getpid())
+		return hciemu_new(type);
+
+	hciemu = queue_remove_if(pool->controllers, match_type,
+							UINT_TO_PTR(type));
+	if (hciemu)
+		pool->hits++;
+	else {
+		pool->misses++;
+
+		hciemu = hciemu_new(type);
+		if (!hciemu)
+			return NULL;
+	}
+
+	/* Assume the next test case wants the same type of controller */
+	pool->refill_type = type;
+
+	if (!pool->refill_source)
+		pool->refill_source = g_idle_add(refill_pool, pool);
+
+	return hciemu;
+}
+
+void hciemu_pool_print_stats(struct hciemu_pool *pool,
+				hciemu_debug_func_t callback, void *user_data)
+{
+	if (!pool || (!pool->hits && !pool->misses))
+		return;
+
+	util_debug(callback, user_data,
+			"Controller pool: %u hits, %u misses (%.1f%% hit rate)",
+			pool->hits, pool->misses,
+			pool->hits * 100.0 / (pool->hits + pool->misses));
+}
+
 static void bthost_print(const char *str, void *user_data)
 {
 	struct hciemu *hciemu = user_data;
@@ -13,6 +13,7 @@
 
 struct hciemu;
 struct hciemu_client;
+struct hciemu_pool;
 
 enum hciemu_type {
 	HCIEMU_TYPE_BREDRLE,
@@ -36,16 +37,28 @@ struct hciemu *hciemu_new_num(enum hciemu_type type, uint8_t num);
 struct hciemu *hciemu_ref(struct hciemu *hciemu);
 void hciemu_unref(struct hciemu *hciemu);
 
+typedef void (*hciemu_debug_func_t)(const char *str, void *user_data);
+typedef void (*hciemu_destroy_func_t)(void *user_data);
+
+struct hciemu_pool *hciemu_pool_new(unsigned int size);
+void hciemu_pool_free(struct hciemu_pool *pool);
+struct hciemu *hciemu_pool_get(struct hciemu_pool *pool,
+						enum hciemu_type type);
+void hciemu_pool_print_stats(struct hciemu_pool *pool,
+				hciemu_debug_func_t callback, void *user_data);
+
 struct hciemu_client *hciemu_get_client(struct hciemu *hciemu, int num);
 struct bthost *hciemu_client_host(struct hciemu_client *client);
 const uint8_t *hciemu_client_bdaddr(struct hciemu_client *client);
 
-typedef void (*hciemu_debug_func_t)(const char *str, void *user_data);
-typedef void (*hciemu_destroy_func_t)(void *user_data);
 bool hciemu_set_debug(struct hciemu *hciemu, hciemu_debug_func_t callback,
 			void *user_data, hciemu_destroy_func_t destroy);
 
 struct vhci *hciemu_get_vhci(struct hciemu *hciemu);
+uint16_t hciemu_get_index(struct hciemu *hciemu);
+bool hciemu_owns_index(struct hciemu *hciemu, uint16_t index);
+bool hciemu_index_listed(struct hciemu *hciemu, const void *param,
+							uint16_t length);
 struct bthost *hciemu_client_get_host(struct hciemu *hciemu);
 
 const char *hciemu_get_address(struct hciemu *hciemu);
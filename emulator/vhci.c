@@ -184,6 +184,14 @@ struct btdev *vhci_get_btdev(struct vhci *vhci)
 	return vhci->btdev;
 }
 
+uint16_t vhci_get_index(struct vhci *vhci)
+{
+	if (!vhci)
+		return HCI_DEV_NONE;
+
+	return vhci->index;
+}
+
 static int vhci_debugfs_write(struct vhci *vhci, char *option, void *data,
 			      size_t len)
 {
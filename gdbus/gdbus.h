@@ -308,6 +308,26 @@ void g_dbus_emit_property_changed_full(DBusConnection *connection,
 gboolean g_dbus_get_properties(DBusConnection *connection, const char *path,
 				const char *interface, DBusMessageIter *iter);
 
+typedef struct {
+	unsigned long changes;		/* Property changes requested */
+	unsigned long coalesced;	/* Merged into an already pending change */
+	unsigned long deferred;		/* Held back by a minimum interval */
+	unsigned long signals;		/* PropertiesChanged signals emitted */
+} GDBusPropertyStats;
+
+/*
+ * Enables batching of property changes on the connection: changes to a
+ * property which is already pending are merged and, with a non-zero interval
+ * (in milliseconds), PropertiesChanged for the given interface property is
+ * emitted at most once per interval for each object. An interval of 0
+ * removes the limit.
+ */
+gboolean g_dbus_set_property_interval(DBusConnection *connection,
+					const char *interface,
+					const char *name, guint interval);
+gboolean g_dbus_get_property_stats(DBusConnection *connection,
+					GDBusPropertyStats *stats);
+
 gboolean g_dbus_attach_object_manager(DBusConnection *connection);
 gboolean g_dbus_detach_object_manager(DBusConnection *connection);
 
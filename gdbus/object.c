@@ -44,6 +44,8 @@ struct generic_data {
 	GSList *removed;
 	guint process_id;
 	gboolean pending_prop;
+	guint deferred_id;
+	gint64 deferred_due;
 	char *introspect;
 	struct generic_data *parent;
 };
@@ -54,10 +56,29 @@ struct interface_data {
 	const GDBusSignalTable *signals;
 	const GDBusPropertyTable *properties;
 	GSList *pending_prop;
+	GSList *deferred_prop;
+	GSList *emitted;
 	void *user_data;
 	GDBusDestroyFunction destroy;
 };
 
+struct property_limit {
+	char *interface;
+	char *name;
+	gint64 interval;
+};
+
+struct property_conn {
+	DBusConnection *conn;
+	GSList *limits;
+	GDBusPropertyStats stats;
+};
+
+struct property_emitted {
+	const GDBusPropertyTable *property;
+	gint64 time;
+};
+
 struct security_data {
 	GDBusPendingReply pending;
 	DBusMessage *message;
@@ -74,11 +95,13 @@ struct property_data {
 static int global_flags = 0;
 static struct generic_data *root;
 static GSList *pending = NULL;
+static GSList *property_conns = NULL;
 
 static gboolean process_changes(gpointer user_data);
 static void process_properties_from_interface(struct generic_data *data,
 						struct interface_data *iface);
 static void process_property_changes(struct generic_data *data);
+static void remove_deferred(struct interface_data *iface);
 
 static void print_arguments(GString *gstr, const GDBusArgInfo *args,
 						const char *direction)
@@ -653,6 +676,7 @@ static gboolean remove_interface(struct generic_data *data, const char *name)
 		return FALSE;
 
 	process_properties_from_interface(data, iface);
+	remove_deferred(iface);
 
 	data->interfaces = g_slist_remove(data->interfaces, iface);
 
@@ -1027,6 +1051,11 @@ static void generic_unregister(DBusConnection *connection, void *user_data)
 		process_changes(data);
 	}
 
+	if (data->deferred_id > 0) {
+		g_source_remove(data->deferred_id);
+		data->deferred_id = 0;
+	}
+
 	g_slist_foreach(data->objects, reset_parent, data->parent);
 	g_slist_free(data->objects);
 
@@ -1660,6 +1689,99 @@ fail:
 	return ret;
 }
 
+static struct property_conn *find_property_conn(DBusConnection *conn)
+{
+	GSList *l;
+
+	for (l = property_conns; l != NULL; l = l->next) {
+		struct property_conn *pc = l->data;
+
+		if (pc->conn == conn)
+			return pc;
+	}
+
+	return NULL;
+}
+
+static void property_limit_free(void *data)
+{
+	struct property_limit *limit = data;
+
+	g_free(limit->interface);
+	g_free(limit->name);
+	g_free(limit);
+}
+
+static void property_conn_free(struct property_conn *pc)
+{
+	property_conns = g_slist_remove(property_conns, pc);
+	g_slist_free_full(pc->limits, property_limit_free);
+	g_free(pc);
+}
+
+static struct property_limit *find_property_limit(struct property_conn *pc,
+						struct interface_data *iface,
+						const GDBusPropertyTable *p)
+{
+	GSList *l;
+
+	if (pc == NULL)
+		return NULL;
+
+	for (l = pc->limits; l != NULL; l = l->next) {
+		struct property_limit *limit = l->data;
+
+		if (g_str_equal(limit->name, p->name) &&
+				g_str_equal(limit->interface, iface->name))
+			return limit;
+	}
+
+	return NULL;
+}
+
+static struct property_emitted *find_emitted(struct interface_data *iface,
+						const GDBusPropertyTable *p)
+{
+	GSList *l;
+
+	for (l = iface->emitted; l != NULL; l = l->next) {
+		struct property_emitted *emitted = l->data;
+
+		if (emitted->property == p)
+			return emitted;
+	}
+
+	return NULL;
+}
+
+static void update_emitted(struct property_conn *pc,
+				struct interface_data *iface,
+				const GDBusPropertyTable *p, gint64 now)
+{
+	struct property_emitted *emitted;
+
+	if (find_property_limit(pc, iface, p) == NULL)
+		return;
+
+	emitted = find_emitted(iface, p);
+	if (emitted == NULL) {
+		emitted = g_new0(struct property_emitted, 1);
+		emitted->property = p;
+		iface->emitted = g_slist_prepend(iface->emitted, emitted);
+	}
+
+	emitted->time = now;
+}
+
+static void remove_deferred(struct interface_data *iface)
+{
+	g_slist_free(iface->deferred_prop);
+	iface->deferred_prop = NULL;
+
+	g_slist_free_full(iface->emitted, g_free);
+	iface->emitted = NULL;
+}
+
 static void process_properties_from_interface(struct generic_data *data,
 						struct interface_data *iface)
 {
@@ -1667,10 +1789,15 @@ static void process_properties_from_interface(struct generic_data *data,
 	DBusMessage *signal;
 	DBusMessageIter iter, dict, array;
 	GSList *invalidated;
+	struct property_conn *pc;
+	gint64 now;
 
 	if (iface->pending_prop == NULL)
 		return;
 
+	pc = find_property_conn(data->conn);
+	now = pc ? g_get_monotonic_time() : 0;
+
 	signal = dbus_message_new_signal(data->path,
 			DBUS_INTERFACE_PROPERTIES, "PropertiesChanged");
 	if (signal == NULL) {
@@ -1696,6 +1823,9 @@ static void process_properties_from_interface(struct generic_data *data,
 		if (p->get == NULL)
 			continue;
 
+		if (pc)
+			update_emitted(pc, iface, p, now);
+
 		if (p->exists != NULL && !p->exists(p, iface->user_data)) {
 			invalidated = g_slist_prepend(invalidated, p);
 			continue;
@@ -1720,6 +1850,9 @@ static void process_properties_from_interface(struct generic_data *data,
 	g_slist_free(iface->pending_prop);
 	iface->pending_prop = NULL;
 
+	if (pc)
+		pc->stats.signals++;
+
 	/* Use dbus_connection_send to avoid recursive calls to g_dbus_flush */
 	dbus_connection_send(data->conn, signal, NULL);
 	dbus_message_unref(signal);
@@ -1738,6 +1871,187 @@ static void process_property_changes(struct generic_data *data)
 	}
 }
 
+static gboolean process_deferred(gpointer user_data);
+
+static void schedule_deferred(struct generic_data *data, gint64 due)
+{
+	gint64 now = g_get_monotonic_time();
+
+	if (data->deferred_id > 0) {
+		if (data->deferred_due <= due)
+			return;
+
+		g_source_remove(data->deferred_id);
+	}
+
+	data->deferred_due = due;
+	data->deferred_id = g_timeout_add(due > now ? (due - now + 999) / 1000
+							: 0,
+							process_deferred, data);
+}
+
+/*
+ * Move the rate limited properties whose interval has expired to the pending
+ * set, so they go out together in a single flush of the object, and
+ * reschedule for the ones which are still held back.
+ */
+static gboolean process_deferred(gpointer user_data)
+{
+	struct generic_data *data = user_data;
+	struct property_conn *pc = find_property_conn(data->conn);
+	gint64 now = g_get_monotonic_time();
+	gint64 next = G_MAXINT64;
+	GSList *l;
+
+	data->deferred_id = 0;
+
+	for (l = data->interfaces; l != NULL; l = l->next) {
+		struct interface_data *iface = l->data;
+		GSList *d = iface->deferred_prop;
+
+		while (d != NULL) {
+			const GDBusPropertyTable *p = d->data;
+			struct property_limit *limit;
+			struct property_emitted *emitted;
+			GSList *next_link = d->next;
+			gint64 due = now;
+
+			limit = find_property_limit(pc, iface, p);
+			emitted = find_emitted(iface, p);
+			if (limit && emitted)
+				due = emitted->time + limit->interval;
+
+			if (due > now) {
+				next = MIN(next, due);
+				d = next_link;
+				continue;
+			}
+
+			iface->deferred_prop = g_slist_delete_link(
+						iface->deferred_prop, d);
+			iface->pending_prop = g_slist_prepend(
+						iface->pending_prop, (void *) p);
+			data->pending_prop = TRUE;
+			d = next_link;
+		}
+	}
+
+	if (data->pending_prop)
+		process_property_changes(data);
+
+	if (next != G_MAXINT64)
+		schedule_deferred(data, next);
+
+	return FALSE;
+}
+
+/* Returns TRUE if the change has been held back by a rate limit */
+static gboolean defer_property(struct generic_data *data,
+				struct interface_data *iface,
+				const GDBusPropertyTable *property)
+{
+	struct property_conn *pc = find_property_conn(data->conn);
+	struct property_limit *limit;
+	struct property_emitted *emitted;
+	gint64 due;
+
+	if (pc == NULL)
+		return FALSE;
+
+	pc->stats.changes++;
+
+	if (g_slist_find(iface->pending_prop, (void *) property) ||
+			g_slist_find(iface->deferred_prop, (void *) property)) {
+		pc->stats.coalesced++;
+		return TRUE;
+	}
+
+	limit = find_property_limit(pc, iface, property);
+	if (limit == NULL)
+		return FALSE;
+
+	emitted = find_emitted(iface, property);
+	if (emitted == NULL)
+		return FALSE;
+
+	due = emitted->time + limit->interval;
+	if (due <= g_get_monotonic_time())
+		return FALSE;
+
+	pc->stats.deferred++;
+	iface->deferred_prop = g_slist_prepend(iface->deferred_prop,
+							(void *) property);
+	schedule_deferred(data, due);
+
+	return TRUE;
+}
+
+gboolean g_dbus_set_property_interval(DBusConnection *connection,
+					const char *interface,
+					const char *name, guint interval)
+{
+	struct property_conn *pc;
+	struct property_limit *limit = NULL;
+	GSList *l;
+
+	if (connection == NULL || interface == NULL || name == NULL)
+		return FALSE;
+
+	pc = find_property_conn(connection);
+	if (pc == NULL) {
+		pc = g_new0(struct property_conn, 1);
+		pc->conn = connection;
+		property_conns = g_slist_prepend(property_conns, pc);
+	}
+
+	for (l = pc->limits; l != NULL; l = l->next) {
+		struct property_limit *entry = l->data;
+
+		if (g_str_equal(entry->interface, interface) &&
+					g_str_equal(entry->name, name)) {
+			limit = entry;
+			break;
+		}
+	}
+
+	if (interval == 0) {
+		if (limit != NULL) {
+			pc->limits = g_slist_remove(pc->limits, limit);
+			property_limit_free(limit);
+		}
+
+		/* Without limits the connection goes back to plain emission */
+		if (pc->limits == NULL)
+			property_conn_free(pc);
+
+		return TRUE;
+	}
+
+	if (limit == NULL) {
+		limit = g_new0(struct property_limit, 1);
+		limit->interface = g_strdup(interface);
+		limit->name = g_strdup(name);
+		pc->limits = g_slist_prepend(pc->limits, limit);
+	}
+
+	limit->interval = (gint64) interval * 1000;
+
+	return TRUE;
+}
+
+gboolean g_dbus_get_property_stats(DBusConnection *connection,
+						GDBusPropertyStats *stats)
+{
+	struct property_conn *pc = find_property_conn(connection);
+
+	if (pc == NULL || stats == NULL)
+		return FALSE;
+
+	*stats = pc->stats;
+
+	return TRUE;
+}
+
 void g_dbus_emit_property_changed_full(DBusConnection *connection,
 				const char *path, const char *interface,
 				const char *name,
@@ -1772,9 +2086,16 @@ void g_dbus_emit_property_changed_full(DBusConnection *connection,
 		return;
 	}
 
+	if (!(flags & G_DBUS_PROPERTY_CHANGED_FLAG_FLUSH) &&
+				defer_property(data, iface, property))
+		return;
+
 	if (g_slist_find(iface->pending_prop, (void *) property) != NULL)
 		return;
 
+	iface->deferred_prop = g_slist_remove(iface->deferred_prop,
+							(void *) property);
+
 	data->pending_prop = TRUE;
 	iface->pending_prop = g_slist_prepend(iface->pending_prop,
 						(void *) property);
@@ -1831,12 +2152,18 @@ gboolean g_dbus_attach_object_manager(DBusConnection *connection)
 
 gboolean g_dbus_detach_object_manager(DBusConnection *connection)
 {
+	struct property_conn *pc;
+
 	if (!g_dbus_unregister_interface(connection, "/",
 					DBUS_INTERFACE_OBJECT_MANAGER))
 		return FALSE;
 
 	root = NULL;
 
+	pc = find_property_conn(connection);
+	if (pc)
+		property_conn_free(pc);
+
 	return TRUE;
 }
 
@@ -10,6 +10,7 @@
 #ifndef __GOBEX_DEFS_H
 #define __GOBEX_DEFS_H
 
+#include <sys/types.h>
 #include <glib.h>
 
 typedef enum {
@@ -31,6 +32,10 @@ typedef enum {
 } GObexError;
 
 typedef gssize (*GObexDataProducer) (void *buf, gsize len, gpointer user_data);
+/* Returns the number of body bytes (at most len) to be sent from fd starting
+ * at offset, 0 on end of body or a negative errno on failure. */
+typedef gssize (*GObexFdProducer) (int *fd, off_t *offset, gsize len,
+							gpointer user_data);
 typedef gboolean (*GObexDataConsumer) (const void *buf, gsize len,
 							gpointer user_data);
 
@@ -37,7 +37,13 @@ struct _GObexPacket {
 	GSList *headers;
 
 	GObexDataProducer get_body;
+	GObexFdProducer get_body_fd;
 	gpointer get_body_data;
+
+	/* Body range left in the file by the last encode */
+	int body_fd;
+	off_t body_offset;
+	gsize body_len;
 };
 
 GObexHeader *g_obex_packet_get_header(GObexPacket *pkt, guint8 id)
@@ -104,7 +110,7 @@ gboolean g_obex_packet_add_body(GObexPacket *pkt, GObexDataProducer func,
 {
 	g_obex_debug(G_OBEX_DEBUG_PACKET, "opcode 0x%02x", pkt->opcode);
 
-	if (pkt->get_body != NULL)
+	if (pkt->get_body != NULL || pkt->get_body_fd != NULL)
 		return FALSE;
 
 	pkt->get_body = func;
@@ -113,6 +119,33 @@ gboolean g_obex_packet_add_body(GObexPacket *pkt, GObexDataProducer func,
 	return TRUE;
 }
 
+gboolean g_obex_packet_add_body_fd(GObexPacket *pkt, GObexFdProducer func,
+							gpointer user_data)
+{
+	g_obex_debug(G_OBEX_DEBUG_PACKET, "opcode 0x%02x", pkt->opcode);
+
+	if (pkt->get_body != NULL || pkt->get_body_fd != NULL)
+		return FALSE;
+
+	pkt->get_body_fd = func;
+	pkt->get_body_data = user_data;
+
+	return TRUE;
+}
+
+gssize g_obex_packet_get_body_fd(GObexPacket *pkt, int *fd, off_t *offset)
+{
+	g_obex_debug(G_OBEX_DEBUG_PACKET, "opcode 0x%02x", pkt->opcode);
+
+	if (pkt->body_len == 0)
+		return 0;
+
+	*fd = pkt->body_fd;
+	*offset = pkt->body_offset;
+
+	return pkt->body_len;
+}
+
 gboolean g_obex_packet_add_unicode(GObexPacket *pkt, guint8 id,
 							const char *str)
 {
@@ -397,6 +430,42 @@ static gssize get_body(GObexPacket *pkt, guint8 *buf, gsize len)
 	return ret;
 }
 
+static gssize get_body_fd(GObexPacket *pkt, guint8 *buf, gsize len)
+{
+	guint16 u16;
+	gssize ret;
+
+	g_obex_debug(G_OBEX_DEBUG_PACKET, "opcode 0x%02x", pkt->opcode);
+
+	if (len < 3)
+		return -ENOBUFS;
+
+	ret = pkt->get_body_fd(&pkt->body_fd, &pkt->body_offset, len - 3,
+							pkt->get_body_data);
+	if (ret < 0)
+		return ret;
+
+	if ((gsize) ret > len - 3)
+		return -EINVAL;
+
+	pkt->body_len = ret;
+
+	if (ret > 0)
+		buf[0] = G_OBEX_HDR_BODY;
+	else
+		buf[0] = G_OBEX_HDR_BODY_END;
+
+	u16 = g_htons(ret + 3);
+	memcpy(&buf[1], &u16, sizeof(u16));
+
+	return ret;
+}
+
+/*
+ * For packets with a fd body only the headers are encoded into buf, the
+ * returned length excludes the body which is left for the caller to send
+ * directly from the file, see g_obex_packet_get_body_fd().
+ */
 gssize g_obex_packet_encode(GObexPacket *pkt, guint8 *buf, gsize len)
 {
 	gssize ret;
@@ -448,7 +517,22 @@ gssize g_obex_packet_encode(GObexPacket *pkt, guint8 *buf, gsize len)
 		count += ret + 3;
 	}
 
-	u16 = g_htons(count);
+	pkt->body_len = 0;
+
+	if (pkt->get_body_fd) {
+		ret = get_body_fd(pkt, buf + count, len - count);
+		if (ret < 0)
+			return ret;
+		if (ret == 0) {
+			if (pkt->opcode == G_OBEX_RSP_CONTINUE)
+				buf[0] = G_OBEX_RSP_SUCCESS;
+			buf[0] |= FINAL_BIT;
+		}
+
+		count += 3;
+	}
+
+	u16 = g_htons(count + pkt->body_len);
 	memcpy(&buf[1], &u16, sizeof(u16));
 
 	return count;
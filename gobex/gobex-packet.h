@@ -75,6 +75,9 @@ gboolean g_obex_packet_prepend_header(GObexPacket *pkt, GObexHeader *header);
 gboolean g_obex_packet_add_header(GObexPacket *pkt, GObexHeader *header);
 gboolean g_obex_packet_add_body(GObexPacket *pkt, GObexDataProducer func,
 							gpointer user_data);
+gboolean g_obex_packet_add_body_fd(GObexPacket *pkt, GObexFdProducer func,
+							gpointer user_data);
+gssize g_obex_packet_get_body_fd(GObexPacket *pkt, int *fd, off_t *offset);
 gboolean g_obex_packet_add_unicode(GObexPacket *pkt, guint8 id,
 							const char *str);
 gboolean g_obex_packet_add_bytes(GObexPacket *pkt, guint8 id,
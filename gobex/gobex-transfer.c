@@ -37,6 +37,7 @@ struct transfer {
 	guint abort_id;
 
 	GObexDataProducer data_producer;
+	GObexFdProducer fd_producer;
 	GObexDataConsumer data_consumer;
 	GObexFunc complete_func;
 
@@ -64,6 +65,10 @@ static void transfer_free(struct transfer *transfer)
 		g_obex_remove_request_function(transfer->obex,
 							transfer->abort_id);
 
+	/* Don't keep the file open past the end of the transfer */
+	if (transfer->fd_producer)
+		g_obex_drop_tx_fd(transfer->obex);
+
 	g_obex_unref(transfer->obex);
 	g_free(transfer);
 }
@@ -118,14 +123,13 @@ static void transfer_abort_response(GObex *obex, GError *err, GObexPacket *rsp,
 }
 
 
-static gssize put_get_data(void *buf, gsize len, gpointer user_data)
+static void transfer_add_body(struct transfer *transfer, GObexPacket *pkt);
+
+static gssize put_data_produced(struct transfer *transfer, gssize ret)
 {
-	struct transfer *transfer = user_data;
 	GObexPacket *req;
 	GError *err = NULL;
-	gssize ret;
 
-	ret = transfer->data_producer(buf, len, transfer->user_data);
 	if (ret == 0 || ret == -EAGAIN)
 		return ret;
 
@@ -137,7 +141,7 @@ static gssize put_get_data(void *buf, gsize len, gpointer user_data)
 		/* Generate next packet */
 		req = g_obex_packet_new(transfer->opcode, FALSE,
 							G_OBEX_HDR_INVALID);
-		g_obex_packet_add_body(req, put_get_data, transfer);
+		transfer_add_body(transfer, req);
 		transfer->req_id = g_obex_send_req(transfer->obex, req, -1,
 						transfer_response, transfer,
 						&err);
@@ -155,6 +159,27 @@ done:
 	return ret;
 }
 
+static gssize put_get_data(void *buf, gsize len, gpointer user_data)
+{
+	struct transfer *transfer = user_data;
+	gssize ret;
+
+	ret = transfer->data_producer(buf, len, transfer->user_data);
+
+	return put_data_produced(transfer, ret);
+}
+
+static gssize put_get_fd(int *fd, off_t *offset, gsize len,
+							gpointer user_data)
+{
+	struct transfer *transfer = user_data;
+	gssize ret;
+
+	ret = transfer->fd_producer(fd, offset, len, transfer->user_data);
+
+	return put_data_produced(transfer, ret);
+}
+
 static gboolean handle_get_body(struct transfer *transfer, GObexPacket *rsp,
 								GError **err)
 {
@@ -217,7 +242,7 @@ static void transfer_response(GObex *obex, GError *err, GObexPacket *rsp,
 	if (transfer->opcode == G_OBEX_OP_PUT) {
 		req = g_obex_packet_new(transfer->opcode, FALSE,
 							G_OBEX_HDR_INVALID);
-		g_obex_packet_add_body(req, put_get_data, transfer);
+		transfer_add_body(transfer, req);
 	} else if (!g_obex_srm_active(transfer->obex)) {
 		req = g_obex_packet_new(transfer->opcode, TRUE,
 							G_OBEX_HDR_INVALID);
@@ -258,6 +283,24 @@ static struct transfer *transfer_new(GObex *obex, guint8 opcode,
 	return transfer;
 }
 
+static guint put_req_pkt(struct transfer *transfer, GObexPacket *req,
+								GError **err)
+{
+	transfer_add_body(transfer, req);
+
+	transfer->req_id = g_obex_send_req(transfer->obex, req,
+					FIRST_PACKET_TIMEOUT,
+					transfer_response, transfer, err);
+	if (transfer->req_id == 0) {
+		transfer_free(transfer);
+		return 0;
+	}
+
+	g_obex_debug(G_OBEX_DEBUG_TRANSFER, "transfer %u", transfer->id);
+
+	return transfer->id;
+}
+
 guint g_obex_put_req_pkt(GObex *obex, GObexPacket *req,
 			GObexDataProducer data_func, GObexFunc complete_func,
 			gpointer user_data, GError **err)
@@ -272,18 +315,24 @@ guint g_obex_put_req_pkt(GObex *obex, GObexPacket *req,
 	transfer = transfer_new(obex, G_OBEX_OP_PUT, complete_func, user_data);
 	transfer->data_producer = data_func;
 
-	g_obex_packet_add_body(req, put_get_data, transfer);
+	return put_req_pkt(transfer, req, err);
+}
 
-	transfer->req_id = g_obex_send_req(obex, req, FIRST_PACKET_TIMEOUT,
-					transfer_response, transfer, err);
-	if (transfer->req_id == 0) {
-		transfer_free(transfer);
+guint g_obex_put_req_pkt_fd(GObex *obex, GObexPacket *req,
+			GObexFdProducer fd_func, GObexFunc complete_func,
+			gpointer user_data, GError **err)
+{
+	struct transfer *transfer;
+
+	g_obex_debug(G_OBEX_DEBUG_TRANSFER, "obex %p", obex);
+
+	if (g_obex_packet_get_operation(req, NULL) != G_OBEX_OP_PUT)
 		return 0;
-	}
 
-	g_obex_debug(G_OBEX_DEBUG_TRANSFER, "transfer %u", transfer->id);
+	transfer = transfer_new(obex, G_OBEX_OP_PUT, complete_func, user_data);
+	transfer->fd_producer = fd_func;
 
-	return transfer->id;
+	return put_req_pkt(transfer, req, err);
 }
 
 guint g_obex_put_req(GObex *obex, GObexDataProducer data_func,
@@ -491,17 +540,12 @@ guint g_obex_get_req(GObex *obex, GObexDataConsumer data_func,
 	return transfer->id;
 }
 
-static gssize get_get_data(void *buf, gsize len, gpointer user_data)
+static gssize get_data_produced(struct transfer *transfer, gssize ret)
 {
-	struct transfer *transfer = user_data;
 	GObexPacket *req, *rsp;
 	GError *err = NULL;
-	gssize ret;
 	guint8 op;
 
-	g_obex_debug(G_OBEX_DEBUG_TRANSFER, "transfer %u", transfer->id);
-
-	ret = transfer->data_producer(buf, len, transfer->user_data);
 	if (ret > 0) {
 		if (!g_obex_srm_active(transfer->obex))
 			return ret;
@@ -509,7 +553,7 @@ static gssize get_get_data(void *buf, gsize len, gpointer user_data)
 		/* Generate next response */
 		rsp = g_obex_packet_new(G_OBEX_RSP_CONTINUE, TRUE,
 							G_OBEX_HDR_INVALID);
-		g_obex_packet_add_body(rsp, get_get_data, transfer);
+		transfer_add_body(transfer, rsp);
 
 		if (!g_obex_send(transfer->obex, rsp, &err)) {
 			transfer_complete(transfer, err);
@@ -541,6 +585,47 @@ static gssize get_get_data(void *buf, gsize len, gpointer user_data)
 	return ret;
 }
 
+static gssize get_get_data(void *buf, gsize len, gpointer user_data)
+{
+	struct transfer *transfer = user_data;
+	gssize ret;
+
+	g_obex_debug(G_OBEX_DEBUG_TRANSFER, "transfer %u", transfer->id);
+
+	ret = transfer->data_producer(buf, len, transfer->user_data);
+
+	return get_data_produced(transfer, ret);
+}
+
+static gssize get_get_fd(int *fd, off_t *offset, gsize len,
+							gpointer user_data)
+{
+	struct transfer *transfer = user_data;
+	gssize ret;
+
+	g_obex_debug(G_OBEX_DEBUG_TRANSFER, "transfer %u", transfer->id);
+
+	ret = transfer->fd_producer(fd, offset, len, transfer->user_data);
+
+	return get_data_produced(transfer, ret);
+}
+
+static void transfer_add_body(struct transfer *transfer, GObexPacket *pkt)
+{
+	if (transfer->opcode == G_OBEX_OP_PUT) {
+		if (transfer->fd_producer)
+			g_obex_packet_add_body_fd(pkt, put_get_fd, transfer);
+		else
+			g_obex_packet_add_body(pkt, put_get_data, transfer);
+		return;
+	}
+
+	if (transfer->fd_producer)
+		g_obex_packet_add_body_fd(pkt, get_get_fd, transfer);
+	else
+		g_obex_packet_add_body(pkt, get_get_data, transfer);
+}
+
 static gboolean transfer_get_req_first(struct transfer *transfer,
 							GObexPacket *rsp)
 {
@@ -548,7 +633,7 @@ static gboolean transfer_get_req_first(struct transfer *transfer,
 
 	g_obex_debug(G_OBEX_DEBUG_TRANSFER, "transfer %u", transfer->id);
 
-	g_obex_packet_add_body(rsp, get_get_data, transfer);
+	transfer_add_body(transfer, rsp);
 
 	if (!g_obex_send(transfer->obex, rsp, &err)) {
 		transfer_complete(transfer, err);
@@ -568,7 +653,7 @@ static void transfer_get_req(GObex *obex, GObexPacket *req, gpointer user_data)
 	g_obex_debug(G_OBEX_DEBUG_TRANSFER, "transfer %u", transfer->id);
 
 	rsp = g_obex_packet_new(G_OBEX_RSP_CONTINUE, TRUE, G_OBEX_HDR_INVALID);
-	g_obex_packet_add_body(rsp, get_get_data, transfer);
+	transfer_add_body(transfer, rsp);
 
 	if (!g_obex_send(obex, rsp, &err)) {
 		transfer_complete(transfer, err);
@@ -576,29 +661,21 @@ static void transfer_get_req(GObex *obex, GObexPacket *req, gpointer user_data)
 	}
 }
 
-guint g_obex_get_rsp_pkt(GObex *obex, GObexPacket *rsp,
-			GObexDataProducer data_func, GObexFunc complete_func,
-			gpointer user_data, GError **err)
+static guint get_rsp_pkt(struct transfer *transfer, GObexPacket *rsp)
 {
-	struct transfer *transfer;
 	guint id;
 
-	g_obex_debug(G_OBEX_DEBUG_TRANSFER, "obex %p", obex);
-
-	transfer = transfer_new(obex, G_OBEX_OP_GET, complete_func, user_data);
-	transfer->data_producer = data_func;
-
 	if (!transfer_get_req_first(transfer, rsp))
 		return 0;
 
 	if (!g_slist_find(transfers, transfer))
 		return 0;
 
-	id = g_obex_add_request_function(obex, G_OBEX_OP_GET, transfer_get_req,
-								transfer);
+	id = g_obex_add_request_function(transfer->obex, G_OBEX_OP_GET,
+						transfer_get_req, transfer);
 	transfer->get_id = id;
 
-	id = g_obex_add_request_function(obex, G_OBEX_OP_ABORT,
+	id = g_obex_add_request_function(transfer->obex, G_OBEX_OP_ABORT,
 						transfer_abort_req, transfer);
 	transfer->abort_id = id;
 
@@ -607,6 +684,34 @@ guint g_obex_get_rsp_pkt(GObex *obex, GObexPacket *rsp,
 	return transfer->id;
 }
 
+guint g_obex_get_rsp_pkt(GObex *obex, GObexPacket *rsp,
+			GObexDataProducer data_func, GObexFunc complete_func,
+			gpointer user_data, GError **err)
+{
+	struct transfer *transfer;
+
+	g_obex_debug(G_OBEX_DEBUG_TRANSFER, "obex %p", obex);
+
+	transfer = transfer_new(obex, G_OBEX_OP_GET, complete_func, user_data);
+	transfer->data_producer = data_func;
+
+	return get_rsp_pkt(transfer, rsp);
+}
+
+guint g_obex_get_rsp_pkt_fd(GObex *obex, GObexPacket *rsp,
+			GObexFdProducer fd_func, GObexFunc complete_func,
+			gpointer user_data, GError **err)
+{
+	struct transfer *transfer;
+
+	g_obex_debug(G_OBEX_DEBUG_TRANSFER, "obex %p", obex);
+
+	transfer = transfer_new(obex, G_OBEX_OP_GET, complete_func, user_data);
+	transfer->fd_producer = fd_func;
+
+	return get_rsp_pkt(transfer, rsp);
+}
+
 guint g_obex_get_rsp(GObex *obex, GObexDataProducer data_func,
 			GObexFunc complete_func, gpointer user_data,
 			GError **err, guint first_hdr_id, ...)
@@ -14,6 +14,12 @@
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 
 #include "gobex.h"
 #include "gobex-debug.h"
@@ -22,6 +28,8 @@
 #define G_OBEX_MINIMUM_MTU	255
 #define G_OBEX_MAXIMUM_MTU	65535
 
+#define G_OBEX_MAP_WINDOW	(1024 * 1024)
+
 #define G_OBEX_DEFAULT_TIMEOUT	10
 #define G_OBEX_ABORT_TIMEOUT	5
 
@@ -65,6 +73,18 @@ struct _GObex {
 	size_t tx_data;
 	size_t tx_sent;
 
+	/* Body of the current packet still to be sent from a file */
+	int tx_fd;
+	dev_t tx_fd_dev;
+	ino_t tx_fd_ino;
+	off_t tx_fd_offset;
+	size_t tx_fd_data;
+
+	/* Window of tx_fd mapped for packet based transports */
+	void *tx_map;
+	size_t tx_map_len;
+	off_t tx_map_offset;
+
 	gboolean suspended;
 	gboolean use_srm;
 
@@ -254,12 +274,128 @@ static gboolean req_timeout(gpointer user_data)
 	return FALSE;
 }
 
+static void unmap_tx(GObex *obex)
+{
+	if (obex->tx_map == NULL)
+		return;
+
+	munmap(obex->tx_map, obex->tx_map_len);
+	obex->tx_map = NULL;
+	obex->tx_map_len = 0;
+}
+
+static void release_tx_fd(GObex *obex)
+{
+	unmap_tx(obex);
+
+	if (obex->tx_fd < 0)
+		return;
+
+	close(obex->tx_fd);
+	obex->tx_fd = -1;
+}
+
+/*
+ * The producer only lends its fd while the packet is encoded, so the body
+ * is sent from a duplicate that is kept, along with its mapping, for as
+ * long as the following bodies come from the same file.
+ */
+static gboolean hold_tx_fd(GObex *obex, int fd)
+{
+	struct stat st;
+
+	if (fstat(fd, &st) < 0)
+		return FALSE;
+
+	if (obex->tx_fd >= 0 && obex->tx_fd_dev == st.st_dev &&
+						obex->tx_fd_ino == st.st_ino)
+		return TRUE;
+
+	release_tx_fd(obex);
+
+	obex->tx_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+	if (obex->tx_fd < 0)
+		return FALSE;
+
+	obex->tx_fd_dev = st.st_dev;
+	obex->tx_fd_ino = st.st_ino;
+
+	return TRUE;
+}
+
+/* Copy the remaining file body into tx_buf, behind the encoded headers */
+static gboolean read_tx_fd(GObex *obex, GError **err)
+{
+	guint8 *buf = &obex->tx_buf[obex->tx_sent + obex->tx_data];
+	ssize_t ret;
+
+	while (obex->tx_fd_data > 0) {
+		ret = pread(obex->tx_fd, buf, obex->tx_fd_data,
+							obex->tx_fd_offset);
+		if (ret < 0 && errno == EINTR)
+			continue;
+
+		if (ret <= 0) {
+			g_set_error(err, G_OBEX_ERROR, G_OBEX_ERROR_FAILED,
+					"Unable to read body: %s",
+					ret < 0 ? strerror(errno) :
+					"Unexpected end of file");
+			return FALSE;
+		}
+
+		buf += ret;
+		obex->tx_data += ret;
+		obex->tx_fd_offset += ret;
+		obex->tx_fd_data -= ret;
+	}
+
+	return TRUE;
+}
+
+static gboolean write_stream_fd(GObex *obex, GError **err)
+{
+	int sk = g_io_channel_unix_get_fd(obex->io);
+	ssize_t ret;
+
+	ret = sendfile(sk, obex->tx_fd, &obex->tx_fd_offset,
+							obex->tx_fd_data);
+	if (ret < 0) {
+		if (errno == EAGAIN || errno == EINTR)
+			return TRUE;
+
+		/* Not all file types support sendfile, fallback to copy */
+		if (errno == EINVAL || errno == ENOSYS)
+			return read_tx_fd(obex, err);
+
+		g_set_error(err, G_OBEX_ERROR, G_OBEX_ERROR_FAILED,
+					"sendfile: %s", strerror(errno));
+		return FALSE;
+	}
+
+	if (ret == 0) {
+		g_set_error(err, G_OBEX_ERROR, G_OBEX_ERROR_FAILED,
+					"Unable to read body: "
+					"Unexpected end of file");
+		return FALSE;
+	}
+
+	g_obex_debug(G_OBEX_DEBUG_DATA, "< %zd bytes from fd %d", ret,
+								obex->tx_fd);
+
+	obex->tx_fd_data -= ret;
+
+	return TRUE;
+}
+
 static gboolean write_stream(GObex *obex, GError **err)
 {
 	GIOStatus status;
 	gsize bytes_written;
 	char *buf;
 
+	if (obex->tx_data == 0)
+		return write_stream_fd(obex, err);
+
 	buf = (char *) &obex->tx_buf[obex->tx_sent];
 	status = g_io_channel_write_chars(obex->io, buf, obex->tx_data,
 							&bytes_written, err);
@@ -271,6 +407,108 @@ static gboolean write_stream(GObex *obex, GError **err)
 	obex->tx_sent += bytes_written;
 	obex->tx_data -= bytes_written;
 
+	/* Headers are out, continue straight with the file body */
+	if (obex->tx_data == 0 && obex->tx_fd_data > 0)
+		return write_stream_fd(obex, err);
+
+	return TRUE;
+}
+
+static gboolean map_tx_fd(GObex *obex)
+{
+	long page = sysconf(_SC_PAGESIZE);
+	struct stat st;
+	off_t start;
+	size_t len;
+	void *map;
+
+	if (fstat(obex->tx_fd, &st) < 0 || !S_ISREG(st.st_mode))
+		return FALSE;
+
+	/*
+	 * Pages past the end of a file that shrank can't be touched, such a
+	 * body is read instead so that it fails with a short read.
+	 */
+	if (obex->tx_fd_offset + (off_t) obex->tx_fd_data > st.st_size) {
+		unmap_tx(obex);
+		return FALSE;
+	}
+
+	if (obex->tx_map && obex->tx_fd_offset >= obex->tx_map_offset &&
+				obex->tx_fd_offset + (off_t) obex->tx_fd_data <=
+				obex->tx_map_offset + (off_t) obex->tx_map_len)
+		return TRUE;
+
+	unmap_tx(obex);
+
+	start = obex->tx_fd_offset & ~((off_t) page - 1);
+
+	len = MIN(st.st_size - start, G_OBEX_MAP_WINDOW);
+	len = MAX(len, obex->tx_fd_offset - start + obex->tx_fd_data);
+
+	map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, obex->tx_fd, start);
+	if (map == MAP_FAILED)
+		return FALSE;
+
+	obex->tx_map = map;
+	obex->tx_map_len = len;
+	obex->tx_map_offset = start;
+
+	return TRUE;
+}
+
+/*
+ * Packet based transports need the whole packet in a single write, so the
+ * headers and the file body are gathered from tx_buf and a mapping of the
+ * file.
+ */
+static gboolean write_packet_fd(GObex *obex, GError **err)
+{
+	int sk = g_io_channel_unix_get_fd(obex->io);
+	struct iovec iov[2];
+	struct msghdr msg;
+	ssize_t ret;
+
+	iov[0].iov_base = &obex->tx_buf[obex->tx_sent];
+	iov[0].iov_len = obex->tx_data;
+	iov[1].iov_base = (guint8 *) obex->tx_map +
+				(obex->tx_fd_offset - obex->tx_map_offset);
+	iov[1].iov_len = obex->tx_fd_data;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 2;
+
+	ret = sendmsg(sk, &msg, MSG_NOSIGNAL);
+	if (ret < 0) {
+		if (errno == EAGAIN || errno == EINTR)
+			return TRUE;
+
+		/* The file shrank after it was checked, copy what is left */
+		if (errno == EFAULT) {
+			unmap_tx(obex);
+			return read_tx_fd(obex, err);
+		}
+
+		g_set_error(err, G_OBEX_ERROR, G_OBEX_ERROR_FAILED,
+					"sendmsg: %s", strerror(errno));
+		return FALSE;
+	}
+
+	if ((size_t) ret != obex->tx_data + obex->tx_fd_data) {
+		g_set_error(err, G_OBEX_ERROR, G_OBEX_ERROR_FAILED,
+					"Packet truncated: %zd bytes written",
+					ret);
+		return FALSE;
+	}
+
+	g_obex_dump(G_OBEX_DEBUG_DATA, "<", iov[0].iov_base, iov[0].iov_len);
+
+	obex->tx_sent += obex->tx_data;
+	obex->tx_data = 0;
+	obex->tx_fd_offset += obex->tx_fd_data;
+	obex->tx_fd_data = 0;
+
 	return TRUE;
 }
 
@@ -280,6 +518,15 @@ static gboolean write_packet(GObex *obex, GError **err)
 	gsize bytes_written;
 	char *buf;
 
+	if (obex->tx_fd_data > 0) {
+		if (map_tx_fd(obex))
+			return write_packet_fd(obex, err);
+
+		/* Mapping not possible, fallback to copy */
+		if (!read_tx_fd(obex, err))
+			return FALSE;
+	}
+
 	buf = (char *) &obex->tx_buf[obex->tx_sent];
 	status = g_io_channel_write_chars(obex->io, buf, obex->tx_data,
 							&bytes_written, err);
@@ -425,11 +672,15 @@ static gboolean write_data(GIOChannel *io, GIOCondition cond,
 	if (cond & G_IO_NVAL)
 		return FALSE;
 
-	if (cond & (G_IO_HUP | G_IO_ERR))
+	if (cond & (G_IO_HUP | G_IO_ERR)) {
+		release_tx_fd(obex);
 		goto stop_tx;
+	}
 
-	if (obex->tx_data == 0) {
-		ssize_t len;
+	if (obex->tx_data == 0 && obex->tx_fd_data == 0) {
+		ssize_t len, fd_len;
+		off_t offset = 0;
+		int fd = -1;
 
 		p = g_queue_pop_head(obex->tx_queue);
 		if (p == NULL)
@@ -459,6 +710,20 @@ encode:
 			goto done;
 		}
 
+		fd_len = g_obex_packet_get_body_fd(p->pkt, &fd, &offset);
+		if (fd_len == 0) {
+			/* The file body, if any, is complete */
+			release_tx_fd(obex);
+		} else if (!hold_tx_fd(obex, fd)) {
+			g_obex_debug(G_OBEX_DEBUG_ERROR, "body fd: %s",
+							strerror(errno));
+			pending_pkt_free(p);
+			goto done;
+		}
+
+		obex->tx_fd_offset = offset;
+		obex->tx_fd_data = fd_len;
+
 		if (p->id > 0) {
 			if (obex->pending_req != NULL)
 				pending_pkt_free(obex->pending_req);
@@ -487,6 +752,8 @@ encode:
 	if (!obex->write(obex, &err)) {
 		g_obex_debug(G_OBEX_DEBUG_ERROR, "%s", err->message);
 
+		release_tx_fd(obex);
+
 		if (p) {
 			if (p->rsp_func)
 				p->rsp_func(obex, err, NULL, p->rsp_data);
@@ -499,12 +766,14 @@ encode:
 	}
 
 done:
-	if (obex->tx_data > 0 || g_queue_get_length(obex->tx_queue) > 0)
+	if (obex->tx_data > 0 || obex->tx_fd_data > 0 ||
+				g_queue_get_length(obex->tx_queue) > 0)
 		return TRUE;
 
 stop_tx:
 	obex->rx_last_op = G_OBEX_OP_NONE;
 	obex->tx_data = 0;
+	obex->tx_fd_data = 0;
 	obex->write_source = 0;
 	return FALSE;
 }
@@ -531,6 +800,17 @@ void g_obex_drop_tx_queue(GObex *obex)
 
 	while ((p = g_queue_pop_head(obex->tx_queue)))
 		pending_pkt_free(p);
+
+	g_obex_drop_tx_fd(obex);
+}
+
+void g_obex_drop_tx_fd(GObex *obex)
+{
+	/* A packet body still being sent needs the file until it is out */
+	if (obex->tx_fd_data > 0)
+		return;
+
+	release_tx_fd(obex);
 }
 
 static gboolean g_obex_send_internal(GObex *obex, struct pending_pkt *p,
@@ -1007,7 +1287,8 @@ void g_obex_resume(GObex *obex)
 		g_obex_srm_resume(obex);
 
 done:
-	if (g_queue_get_length(obex->tx_queue) > 0 || obex->tx_data > 0)
+	if (g_queue_get_length(obex->tx_queue) > 0 || obex->tx_data > 0 ||
+							obex->tx_fd_data > 0)
 		enable_tx(obex);
 }
 
@@ -1466,6 +1747,7 @@ GObex *g_obex_new(GIOChannel *io, GObexTransportType transport_type,
 	obex->ref_count = 1;
 	obex->conn_id = CONNID_INVALID;
 	obex->rx_last_op = G_OBEX_OP_NONE;
+	obex->tx_fd = -1;
 
 	obex->io_rx_mtu = io_rx_mtu;
 	obex->io_tx_mtu = io_tx_mtu;
@@ -1550,6 +1832,8 @@ void g_obex_unref(GObex *obex)
 	if (obex->write_source > 0)
 		g_source_remove(obex->write_source);
 
+	release_tx_fd(obex);
+
 	g_free(obex->rx_buf);
 	g_free(obex->tx_buf);
 	g_free(obex->srm);
@@ -51,6 +51,7 @@ void g_obex_suspend(GObex *obex);
 void g_obex_resume(GObex *obex);
 gboolean g_obex_srm_active(GObex *obex);
 void g_obex_drop_tx_queue(GObex *obex);
+void g_obex_drop_tx_fd(GObex *obex);
 
 GObex *g_obex_new(GIOChannel *io, GObexTransportType transport_type,
 						gssize rx_mtu, gssize tx_mtu);
@@ -96,6 +97,10 @@ guint g_obex_put_req_pkt(GObex *obex, GObexPacket *req,
 			GObexDataProducer data_func, GObexFunc complete_func,
 			gpointer user_data, GError **err);
 
+guint g_obex_put_req_pkt_fd(GObex *obex, GObexPacket *req,
+			GObexFdProducer fd_func, GObexFunc complete_func,
+			gpointer user_data, GError **err);
+
 guint g_obex_get_req(GObex *obex, GObexDataConsumer data_func,
 			GObexFunc complete_func, gpointer user_data,
 			GError **err, guint first_hdr_id, ...);
@@ -117,6 +122,10 @@ guint g_obex_get_rsp_pkt(GObex *obex, GObexPacket *rsp,
 			GObexDataProducer data_func, GObexFunc complete_func,
 			gpointer user_data, GError **err);
 
+guint g_obex_get_rsp_pkt_fd(GObex *obex, GObexPacket *rsp,
+			GObexFdProducer fd_func, GObexFunc complete_func,
+			gpointer user_data, GError **err);
+
 gboolean g_obex_cancel_transfer(guint id, GObexFunc complete_func,
 							gpointer user_data);
 
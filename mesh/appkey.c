@@ -32,6 +32,8 @@ struct mesh_app_key {
 	uint8_t key_aid;
 	uint8_t new_key[16];
 	uint8_t new_key_aid;
+	uint8_t idx_aid;
+	uint8_t idx_new_aid;
 };
 
 static bool match_key_index(const void *a, const void *b)
@@ -50,33 +52,74 @@ static bool match_bound_key(const void *a, const void *b)
 	return key->net_idx == idx;
 }
 
-static void finalize_key(void *a, void *b)
+/*
+ * Keys are also kept in per AID lists of the net, so that incoming access
+ * messages are only tried against the keys their AID can belong to.
+ */
+static void unindex_key(struct mesh_net *net, struct mesh_app_key *key)
 {
-	struct mesh_app_key *key = a;
-	uint16_t net_idx = L_PTR_TO_UINT(b);
+	if (key->idx_aid != APP_AID_INVALID)
+		l_queue_remove(mesh_net_get_app_aid_keys(net, key->idx_aid),
+									key);
 
-	if (key->net_idx != net_idx)
-		return;
+	if (key->idx_new_aid != APP_AID_INVALID)
+		l_queue_remove(mesh_net_get_app_aid_keys(net,
+							key->idx_new_aid), key);
+
+	key->idx_aid = APP_AID_INVALID;
+	key->idx_new_aid = APP_AID_INVALID;
+}
+
+static void index_key(struct mesh_net *net, struct mesh_app_key *key)
+{
+	unindex_key(net, key);
+
+	key->idx_aid = key->key_aid;
+	l_queue_push_tail(mesh_net_get_app_aid_keys(net, key->idx_aid), key);
 
 	if (key->new_key_aid == APP_AID_INVALID)
 		return;
 
+	if ((key->new_key_aid & KEY_AID_MASK) == (key->key_aid & KEY_AID_MASK))
+		return;
+
+	key->idx_new_aid = key->new_key_aid;
+	l_queue_push_tail(mesh_net_get_app_aid_keys(net, key->idx_new_aid),
+									key);
+}
+
+static bool finalize_key(struct mesh_app_key *key, uint16_t net_idx)
+{
+	if (key->net_idx != net_idx)
+		return false;
+
+	if (key->new_key_aid == APP_AID_INVALID)
+		return false;
+
 	key->key_aid = key->new_key_aid;
 
 	key->new_key_aid = APP_AID_INVALID;
 
 	memcpy(key->key, key->new_key, 16);
+
+	return true;
 }
 
 void appkey_finalize(struct mesh_net *net, uint16_t net_idx)
 {
+	const struct l_queue_entry *entry;
 	struct l_queue *app_keys;
 
 	app_keys = mesh_net_get_app_keys(net);
 	if (!app_keys)
 		return;
 
-	l_queue_foreach(app_keys, finalize_key, L_UINT_TO_PTR(net_idx));
+	entry = l_queue_get_entries(app_keys);
+
+	for (; entry; entry = entry->next) {
+		if (finalize_key(entry->data, net_idx))
+			index_key(net, entry->data);
+	}
 }
 
 static struct mesh_app_key *app_key_new(void)
@@ -84,6 +127,8 @@ static struct mesh_app_key *app_key_new(void)
 	struct mesh_app_key *key = l_new(struct mesh_app_key, 1);
 
 	key->new_key_aid = APP_AID_INVALID;
+	key->idx_aid = APP_AID_INVALID;
+	key->idx_new_aid = APP_AID_INVALID;
 	return key;
 }
 
@@ -146,6 +191,7 @@ bool appkey_key_init(struct mesh_net *net, uint16_t net_idx, uint16_t app_idx,
 		return false;
 
 	l_queue_push_tail(app_keys, key);
+	index_key(net, key);
 
 	return true;
 }
@@ -270,6 +316,8 @@ int appkey_key_update(struct mesh_net *net, uint16_t net_idx, uint16_t app_idx,
 	if (!set_key(key, app_idx, new_key, true))
 		return MESH_STATUS_INSUFF_RESOURCES;
 
+	index_key(net, key);
+
 	node = mesh_net_node_get(net);
 
 	if (!mesh_config_app_key_update(node_config_get(node), app_idx,
@@ -322,6 +370,7 @@ int appkey_key_add(struct mesh_net *net, uint16_t net_idx, uint16_t app_idx,
 	key->net_idx = net_idx;
 	key->app_idx = app_idx;
 	l_queue_push_tail(app_keys, key);
+	index_key(net, key);
 
 	return MESH_STATUS_SUCCESS;
 }
@@ -350,6 +399,7 @@ int appkey_key_delete(struct mesh_net *net, uint16_t net_idx,
 	node_app_key_delete(node, net_idx, app_idx);
 
 	l_queue_remove(app_keys, key);
+	unindex_key(net, key);
 	appkey_key_free(key);
 
 	if (!mesh_config_app_key_del(node_config_get(node), net_idx, app_idx))
@@ -377,6 +427,7 @@ void appkey_delete_bound_keys(struct mesh_net *net, uint16_t net_idx)
 		node_app_key_delete(node, net_idx, key->app_idx);
 		mesh_config_app_key_del(node_config_get(node), net_idx,
 								key->app_idx);
+		unindex_key(net, key);
 		appkey_key_free(key);
 
 		key = l_queue_remove_if(app_keys, match_bound_key,
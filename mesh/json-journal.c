@@ -0,0 +1,556 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include <ell/ell.h>
+#include <json-c/json.h>
+
+#include "mesh/json-journal.h"
+
+/*
+ * The journal lives next to the JSON snapshot it applies to and holds one
+ * compact JSON record per line. The first line identifies the snapshot
+ * (inode and size) so that a journal left behind by an interrupted
+ * compaction is never replayed on top of the snapshot that already
+ * contains its changes:
+ *
+ *	{"snapshot":1234,"size":5678}
+ *	{"key":"defaultTTL","value":5}
+ *	{"members":{"IVindex":5,"IVupdate":0}}
+ *	{"key":"nodes","idx":3,"value":{...}}
+ *	{"key":"nodes","idx":7}
+ *
+ * A record without "idx" replaces (or, without "value", removes) a member
+ * of the root object. A "members" record replaces several members at once,
+ * so that they are never replayed apart. A record with "idx" replaces,
+ * appends or removes an entry of the array stored under "key". Records are
+ * replayed in order, so array indices always refer to the state left by the
+ * previous record.
+ *
+ * Once an append fails the journal may be missing records, so nothing is
+ * appended again until a new snapshot has been written and the journal has
+ * been reset against it.
+ *
+ * Records are not synced one at a time. Appends made while handling one
+ * event share a single fsync() from idle context, so frequent records such
+ * as the sequence number cache don't each wait for the disk. A crash can
+ * only lose the tail of the journal, which replay treats like a torn record.
+ */
+
+/* Don't bother compacting a journal smaller than this */
+#define JOURNAL_MIN_COMPACT	(16 * 1024)
+
+struct json_journal {
+	char *fname;
+	char *cfg_fname;
+	int fd;
+	off_t size;
+	off_t cfg_size;
+	unsigned int records;
+	struct l_idle *sync;
+	bool stale;
+	bool failed;
+};
+
+static const char *journal_ext = ".journal";
+static const char *tmp_ext = ".tmp";
+
+static char *read_file(const char *fname, size_t *len)
+{
+	struct stat st;
+	char *str;
+	int fd;
+
+	fd = open(fname, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	if (fstat(fd, &st) == -1) {
+		close(fd);
+		return NULL;
+	}
+
+	str = l_new(char, st.st_size + 1);
+
+	if (read(fd, str, st.st_size) != st.st_size) {
+		l_error("Failed to read journal %s", fname);
+		l_free(str);
+		str = NULL;
+	} else
+		*len = st.st_size;
+
+	close(fd);
+
+	return str;
+}
+
+static bool check_header(struct json_journal *journal, const char *line)
+{
+	json_object *jhdr, *jval;
+	struct stat st;
+	bool result = false;
+
+	if (stat(journal->cfg_fname, &st) < 0)
+		return false;
+
+	jhdr = json_tokener_parse(line);
+	if (!jhdr)
+		return false;
+
+	if (!json_object_object_get_ex(jhdr, "snapshot", &jval) ||
+			(uint64_t) json_object_get_int64(jval) != st.st_ino)
+		goto done;
+
+	if (!json_object_object_get_ex(jhdr, "size", &jval) ||
+				json_object_get_int64(jval) != st.st_size)
+		goto done;
+
+	journal->cfg_size = st.st_size;
+	result = true;
+
+done:
+	json_object_put(jhdr);
+	return result;
+}
+
+static bool apply_members(json_object *jroot, json_object *jmembers)
+{
+	if (json_object_get_type(jmembers) != json_type_object)
+		return false;
+
+	json_object_object_foreach(jmembers, key, jvalue) {
+		json_object_object_del(jroot, key);
+		json_object_object_add(jroot, key, json_object_get(jvalue));
+	}
+
+	return true;
+}
+
+static bool apply_record(json_object *jroot, json_object *jrec)
+{
+	json_object *jkey, *jidx, *jarray, *jvalue = NULL;
+	const char *key;
+	int idx, len;
+
+	if (json_object_object_get_ex(jrec, "members", &jvalue))
+		return apply_members(jroot, jvalue);
+
+	if (!json_object_object_get_ex(jrec, "key", &jkey))
+		return false;
+
+	key = json_object_get_string(jkey);
+	if (!key)
+		return false;
+
+	json_object_object_get_ex(jrec, "value", &jvalue);
+
+	if (!json_object_object_get_ex(jrec, "idx", &jidx)) {
+		json_object_object_del(jroot, key);
+
+		if (jvalue)
+			json_object_object_add(jroot, key,
+						json_object_get(jvalue));
+
+		return true;
+	}
+
+	if (!json_object_object_get_ex(jroot, key, &jarray) ||
+			json_object_get_type(jarray) != json_type_array)
+		return false;
+
+	idx = json_object_get_int(jidx);
+	len = json_object_array_length(jarray);
+
+	if (idx < 0 || idx > len || (!jvalue && idx == len))
+		return false;
+
+	if (!jvalue)
+		json_object_array_del_idx(jarray, idx, 1);
+	else if (idx == len)
+		json_object_array_add(jarray, json_object_get(jvalue));
+	else
+		json_object_array_put_idx(jarray, idx, json_object_get(jvalue));
+
+	return true;
+}
+
+static void replay(struct json_journal *journal, json_object *jroot)
+{
+	char *str, *line, *end;
+	size_t len;
+
+	str = read_file(journal->fname, &len);
+	if (!str)
+		return;
+
+	end = memchr(str, '\n', len);
+	if (!end)
+		goto done;
+
+	*end = '\0';
+
+	if (!check_header(journal, str))
+		goto done;
+
+	line = end + 1;
+
+	/* Stop at the first torn or otherwise unusable record */
+	while ((end = memchr(line, '\n', len - (line - str)))) {
+		json_object *jrec;
+		bool applied;
+
+		*end = '\0';
+
+		jrec = json_tokener_parse(line);
+		if (!jrec)
+			break;
+
+		applied = apply_record(jroot, jrec);
+		json_object_put(jrec);
+
+		if (!applied)
+			break;
+
+		journal->records++;
+		line = end + 1;
+	}
+
+	journal->size = line - str;
+	journal->stale = false;
+
+	l_debug("Replayed %u records from %s", journal->records,
+							journal->fname);
+
+done:
+	l_free(str);
+}
+
+struct json_journal *json_journal_open(const char *cfg_fname,
+							json_object *jroot)
+{
+	struct json_journal *journal;
+
+	journal = l_new(struct json_journal, 1);
+	journal->cfg_fname = l_strdup(cfg_fname);
+	journal->fname = l_strdup_printf("%s%s", cfg_fname, journal_ext);
+	journal->fd = -1;
+	journal->stale = true;
+
+	if (jroot)
+		replay(journal, jroot);
+
+	return journal;
+}
+
+static void journal_sync(struct json_journal *journal)
+{
+	if (journal->sync) {
+		l_idle_remove(journal->sync);
+		journal->sync = NULL;
+	}
+
+	if (journal->fd >= 0 && fsync(journal->fd) < 0)
+		l_error("Failed to sync journal %s", journal->fname);
+}
+
+static void idle_sync(struct l_idle *idle, void *user_data)
+{
+	journal_sync(user_data);
+}
+
+void json_journal_close(struct json_journal *journal)
+{
+	if (!journal)
+		return;
+
+	journal_sync(journal);
+
+	if (journal->fd >= 0)
+		close(journal->fd);
+
+	l_free(journal->fname);
+	l_free(journal->cfg_fname);
+	l_free(journal);
+}
+
+static bool write_line(int fd, const char *str)
+{
+	struct iovec iov[2];
+	size_t len = strlen(str);
+
+	iov[0].iov_base = (void *) str;
+	iov[0].iov_len = len;
+	iov[1].iov_base = "\n";
+	iov[1].iov_len = 1;
+
+	return writev(fd, iov, 2) == (ssize_t) len + 1;
+}
+
+static void sync_dir(const char *fname)
+{
+	char *dir, *sep;
+	int fd;
+
+	dir = l_strdup(fname);
+
+	sep = strrchr(dir, '/');
+	if (sep)
+		*sep = '\0';
+
+	fd = open(sep ? dir : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd >= 0) {
+		fsync(fd);
+		close(fd);
+	}
+
+	l_free(dir);
+}
+
+bool json_journal_reset(struct json_journal *journal)
+{
+	json_object *jhdr;
+	struct stat st;
+	char *fname_tmp;
+	const char *str;
+	bool result = false;
+	int fd;
+
+	if (!journal)
+		return false;
+
+	/*
+	 * The caller has the snapshot on disk holding every change, but until
+	 * a new header is in place nothing may be appended.
+	 */
+	journal->stale = true;
+	journal->failed = false;
+
+	if (stat(journal->cfg_fname, &st) < 0)
+		return false;
+
+	fname_tmp = l_strdup_printf("%s%s", journal->fname, tmp_ext);
+
+	fd = open(fname_tmp, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND |
+							O_CLOEXEC, 0644);
+	if (fd < 0) {
+		l_error("Failed to create journal %s: %s", fname_tmp,
+							strerror(errno));
+		l_free(fname_tmp);
+		return false;
+	}
+
+	jhdr = json_object_new_object();
+	json_object_object_add(jhdr, "snapshot",
+					json_object_new_int64(st.st_ino));
+	json_object_object_add(jhdr, "size",
+					json_object_new_int64(st.st_size));
+
+	str = json_object_to_json_string_ext(jhdr, JSON_C_TO_STRING_PLAIN);
+
+	/* The header must be on disk before it replaces the old journal */
+	if (write_line(fd, str) && !fsync(fd) &&
+					!rename(fname_tmp, journal->fname))
+		result = true;
+
+	if (!result) {
+		close(fd);
+		remove(fname_tmp);
+		goto done;
+	}
+
+	/* Make the rename itself durable */
+	sync_dir(journal->fname);
+
+	/* The snapshot holds whatever the old journal had left to sync */
+	if (journal->sync) {
+		l_idle_remove(journal->sync);
+		journal->sync = NULL;
+	}
+
+	if (journal->fd >= 0)
+		close(journal->fd);
+
+	journal->fd = fd;
+	journal->size = strlen(str) + 1;
+	journal->cfg_size = st.st_size;
+	journal->records = 0;
+	journal->stale = false;
+
+done:
+	json_object_put(jhdr);
+	l_free(fname_tmp);
+
+	return result;
+}
+
+static bool journal_write(struct json_journal *journal, json_object *jrec)
+{
+	const char *str;
+
+	/* Only a new snapshot may bring back a journal that lost records */
+	if (journal->failed)
+		return false;
+
+	/*
+	 * A journal without a valid header is empty, so the snapshot on disk
+	 * still holds every change made before this one.
+	 */
+	if (journal->stale) {
+		if (!json_journal_reset(journal))
+			return false;
+	} else if (journal->fd < 0) {
+		journal->fd = open(journal->fname, O_WRONLY | O_APPEND |
+								O_CLOEXEC);
+		if (journal->fd < 0)
+			return false;
+
+		/* Drop whatever torn record replay stopped at */
+		if (ftruncate(journal->fd, journal->size) < 0) {
+			close(journal->fd);
+			journal->fd = -1;
+			return false;
+		}
+	}
+
+	str = json_object_to_json_string_ext(jrec, JSON_C_TO_STRING_PLAIN);
+
+	if (!write_line(journal->fd, str)) {
+		l_error("Failed to append to journal %s, disabled until the"
+					" next snapshot", journal->fname);
+
+		/* Never append behind a partial or missing record */
+		journal->failed = true;
+		return false;
+	}
+
+	journal->size += strlen(str) + 1;
+	journal->records++;
+
+	if (!journal->sync) {
+		journal->sync = l_idle_create(idle_sync, journal, NULL);
+
+		/* Without a main loop there is nothing to batch with */
+		if (!journal->sync)
+			journal_sync(journal);
+	}
+
+	return true;
+}
+
+static bool write_record(struct json_journal *journal, const char *key,
+						int idx, json_object *jvalue)
+{
+	json_object *jrec;
+	bool result;
+
+	if (!journal || !key)
+		return false;
+
+	jrec = json_object_new_object();
+	json_object_object_add(jrec, "key", json_object_new_string(key));
+
+	if (idx >= 0)
+		json_object_object_add(jrec, "idx", json_object_new_int(idx));
+
+	if (jvalue)
+		json_object_object_add(jrec, "value", json_object_get(jvalue));
+
+	result = journal_write(journal, jrec);
+
+	json_object_put(jrec);
+
+	return result;
+}
+
+bool json_journal_set_member(struct json_journal *journal, json_object *jroot,
+							const char *key)
+{
+	json_object *jvalue = NULL;
+
+	json_object_object_get_ex(jroot, key, &jvalue);
+
+	return write_record(journal, key, -1, jvalue);
+}
+
+bool json_journal_set_members(struct json_journal *journal,
+					json_object *jroot, const char **keys)
+{
+	json_object *jrec, *jmembers, *jvalue;
+	bool result;
+
+	if (!journal || !keys)
+		return false;
+
+	jmembers = json_object_new_object();
+
+	for (; *keys; keys++) {
+		if (!json_object_object_get_ex(jroot, *keys, &jvalue)) {
+			json_object_put(jmembers);
+			return false;
+		}
+
+		json_object_object_add(jmembers, *keys,
+						json_object_get(jvalue));
+	}
+
+	jrec = json_object_new_object();
+	json_object_object_add(jrec, "members", jmembers);
+
+	result = journal_write(journal, jrec);
+
+	json_object_put(jrec);
+
+	return result;
+}
+
+bool json_journal_set_entry(struct json_journal *journal, json_object *jroot,
+						const char *key, int idx)
+{
+	json_object *jarray, *jvalue;
+
+	if (idx < 0 || !json_object_object_get_ex(jroot, key, &jarray))
+		return false;
+
+	jvalue = json_object_array_get_idx(jarray, idx);
+	if (!jvalue)
+		return false;
+
+	return write_record(journal, key, idx, jvalue);
+}
+
+bool json_journal_del_entry(struct json_journal *journal, const char *key,
+								int idx)
+{
+	if (idx < 0)
+		return false;
+
+	return write_record(journal, key, idx, NULL);
+}
+
+bool json_journal_need_compact(struct json_journal *journal)
+{
+	if (!journal)
+		return false;
+
+	/* Replaying the journal should never cost more than the snapshot */
+	return journal->size > JOURNAL_MIN_COMPACT &&
+					journal->size >= journal->cfg_size;
+}
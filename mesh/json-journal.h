@@ -0,0 +1,25 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+struct json_object;
+struct json_journal;
+
+struct json_journal *json_journal_open(const char *cfg_fname,
+						struct json_object *jroot);
+void json_journal_close(struct json_journal *journal);
+bool json_journal_set_member(struct json_journal *journal,
+				struct json_object *jroot, const char *key);
+bool json_journal_set_members(struct json_journal *journal,
+				struct json_object *jroot, const char **keys);
+bool json_journal_set_entry(struct json_journal *journal,
+					struct json_object *jroot,
+					const char *key, int idx);
+bool json_journal_del_entry(struct json_journal *journal, const char *key,
+								int idx);
+bool json_journal_reset(struct json_journal *journal);
+bool json_journal_need_compact(struct json_journal *journal);
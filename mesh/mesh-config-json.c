@@ -30,6 +30,7 @@
 
 #include "mesh/mesh-defs.h"
 #include "mesh/util.h"
+#include "mesh/json-journal.h"
 #include "mesh/mesh-config.h"
 
 /* To prevent local node JSON cache thrashing, minimum update times */
@@ -46,6 +47,7 @@ struct mesh_config {
 	uint32_t write_seq;
 	struct timeval write_time;
 	struct l_queue *idles;
+	struct json_journal *journal;
 };
 
 struct write_info {
@@ -82,6 +84,101 @@ static bool save_config(json_object *jnode, const char *fname)
 	return result;
 }
 
+static bool write_snapshot(struct mesh_config *cfg)
+{
+	char *fname_tmp, *fname_bak, *fname_cfg;
+	bool result = false;
+
+	fname_cfg = cfg->node_dir_path;
+	fname_tmp = l_strdup_printf("%s%s", fname_cfg, tmp_ext);
+	fname_bak = l_strdup_printf("%s%s", fname_cfg, bak_ext);
+	remove(fname_tmp);
+
+	result = save_config(cfg->jnode, fname_tmp);
+
+	if (result) {
+		remove(fname_bak);
+
+		if (rename(fname_cfg, fname_bak) < 0 ||
+					rename(fname_tmp, fname_cfg) < 0)
+			result = false;
+	}
+
+	remove(fname_tmp);
+
+	l_free(fname_tmp);
+	l_free(fname_bak);
+
+	/* The snapshot now holds everything the journal recorded */
+	if (result && !json_journal_reset(cfg->journal))
+		l_warn("Failed to reset journal for %s", fname_cfg);
+
+	return result;
+}
+
+/*
+ * Record the current value of a top level member of the node object in the
+ * journal instead of rewriting the whole node.json file. The journal is
+ * folded back into the snapshot from idle context once it grows past the
+ * snapshot size.
+ */
+static bool journal_recorded(struct mesh_config *cfg, bool recorded)
+{
+	if (!recorded)
+		return write_snapshot(cfg);
+
+	if (json_journal_need_compact(cfg->journal) &&
+						l_queue_isempty(cfg->idles))
+		mesh_config_save(cfg, false, NULL, NULL);
+
+	return true;
+}
+
+static bool journal_config(struct mesh_config *cfg, const char *key)
+{
+	return journal_recorded(cfg, json_journal_set_member(cfg->journal,
+							cfg->jnode, key));
+}
+
+/* Record a single entry of an array member, such as one element */
+static bool journal_entry(struct mesh_config *cfg, const char *key, int idx)
+{
+	return journal_recorded(cfg, json_journal_set_entry(cfg->journal,
+							cfg->jnode, key, idx));
+}
+
+static bool journal_appended(struct mesh_config *cfg, const char *key)
+{
+	json_object *jarray;
+	int len;
+
+	if (!json_object_object_get_ex(cfg->jnode, key, &jarray))
+		return false;
+
+	/* Replay needs the array itself before it can append to it */
+	len = json_object_array_length(jarray);
+	if (len == 1)
+		return journal_config(cfg, key);
+
+	return journal_entry(cfg, key, len - 1);
+}
+
+static bool journal_key_del(struct mesh_config *cfg, const char *key,
+						json_object *jarray, int pos)
+{
+	if (!json_object_array_length(jarray)) {
+		json_object_object_del(cfg->jnode, key);
+		return journal_config(cfg, key);
+	}
+
+	/* Nothing was removed */
+	if (pos < 0)
+		return true;
+
+	return journal_recorded(cfg, json_journal_del_entry(cfg->journal,
+								key, pos));
+}
+
 static bool get_int(json_object *jobj, const char *keyword, int *value)
 {
 	json_object *jvalue;
@@ -255,7 +352,7 @@ static bool get_key_index(json_object *jobj, const char *keyword,
 	return true;
 }
 
-static json_object *get_key_object(json_object *jarray, uint16_t idx)
+static int get_key_pos(json_object *jarray, uint16_t idx)
 {
 	int i, sz = json_object_array_length(jarray);
 
@@ -265,16 +362,26 @@ static json_object *get_key_object(json_object *jarray, uint16_t idx)
 
 		jentry = json_object_array_get_idx(jarray, i);
 		if (!get_key_index(jentry, "index", &jidx))
-			return NULL;
+			return -1;
 
 		if (jidx == idx)
-			return jentry;
+			return i;
 	}
 
-	return NULL;
+	return -1;
+}
+
+static json_object *get_key_object(json_object *jarray, uint16_t idx)
+{
+	int pos = get_key_pos(jarray, idx);
+
+	if (pos < 0)
+		return NULL;
+
+	return json_object_array_get_idx(jarray, pos);
 }
 
-static void jarray_key_del(json_object *jarray, int16_t idx)
+static int jarray_key_del(json_object *jarray, int16_t idx)
 {
 	int i, sz = json_object_array_length(jarray);
 
@@ -286,9 +393,11 @@ static void jarray_key_del(json_object *jarray, int16_t idx)
 
 		if (get_key_index(jentry, "index", &nidx) && nidx == idx) {
 			json_object_array_del_idx(jarray, i, 1);
-			return;
+			return i;
 		}
 	}
+
+	return -1;
 }
 
 static bool read_unicast_address(json_object *jobj, uint16_t *unicast)
@@ -626,7 +735,7 @@ bool mesh_config_net_key_add(struct mesh_config *cfg, uint16_t idx,
 
 	json_object_array_add(jarray, jentry);
 
-	return save_config(jnode, cfg->node_dir_path);
+	return journal_appended(cfg, "netKeys");
 
 fail:
 	if (jentry)
@@ -640,6 +749,7 @@ bool mesh_config_net_key_update(struct mesh_config *cfg, uint16_t idx,
 {
 	json_object *jnode, *jarray, *jentry, *jstring;
 	const char *str;
+	int pos;
 
 	if (!cfg)
 		return false;
@@ -649,11 +759,13 @@ bool mesh_config_net_key_update(struct mesh_config *cfg, uint16_t idx,
 	if (!json_object_object_get_ex(jnode, "netKeys", &jarray))
 		return false;
 
-	jentry = get_key_object(jarray, idx);
+	pos = get_key_pos(jarray, idx);
 	/* Net key must be already recorded */
-	if (!jentry)
+	if (pos < 0)
 		return false;
 
+	jentry = json_object_array_get_idx(jarray, pos);
+
 	if (!json_object_object_get_ex(jentry, "key", &jstring))
 		return false;
 
@@ -668,27 +780,23 @@ bool mesh_config_net_key_update(struct mesh_config *cfg, uint16_t idx,
 	json_object_object_add(jentry, "keyRefresh",
 				json_object_new_int(KEY_REFRESH_PHASE_ONE));
 
-	return save_config(jnode, cfg->node_dir_path);
+	return journal_entry(cfg, "netKeys", pos);
 }
 
 bool mesh_config_net_key_del(struct mesh_config *cfg, uint16_t idx)
 {
-	json_object *jnode, *jarray;
+	json_object *jarray;
+	int pos;
 
 	if (!cfg)
 		return false;
 
-	jnode = cfg->jnode;
-
-	if (!json_object_object_get_ex(jnode, "netKeys", &jarray))
+	if (!json_object_object_get_ex(cfg->jnode, "netKeys", &jarray))
 		return true;
 
-	jarray_key_del(jarray, idx);
+	pos = jarray_key_del(jarray, idx);
 
-	if (!json_object_array_length(jarray))
-		json_object_object_del(jnode, "netKeys");
-
-	return save_config(jnode, cfg->node_dir_path);
+	return journal_key_del(cfg, "netKeys", jarray, pos);
 }
 
 bool mesh_config_write_device_key(struct mesh_config *cfg, uint8_t *key)
@@ -696,7 +804,7 @@ bool mesh_config_write_device_key(struct mesh_config *cfg, uint8_t *key)
 	if (!cfg || !add_key_value(cfg->jnode, "deviceKey", key))
 		return false;
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return journal_config(cfg, "deviceKey");
 }
 
 bool mesh_config_write_token(struct mesh_config *cfg, uint8_t *token)
@@ -704,7 +812,7 @@ bool mesh_config_write_token(struct mesh_config *cfg, uint8_t *token)
 	if (!cfg || !add_u64_value(cfg->jnode, "token", token))
 		return false;
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return journal_config(cfg, "token");
 }
 
 bool mesh_config_app_key_add(struct mesh_config *cfg, uint16_t net_idx,
@@ -747,7 +855,7 @@ bool mesh_config_app_key_add(struct mesh_config *cfg, uint16_t net_idx,
 
 	json_object_array_add(jarray, jentry);
 
-	return save_config(jnode, cfg->node_dir_path);
+	return journal_appended(cfg, "appKeys");
 
 fail:
 
@@ -762,6 +870,7 @@ bool mesh_config_app_key_update(struct mesh_config *cfg, uint16_t app_idx,
 {
 	json_object *jnode, *jarray, *jentry = NULL, *jstring = NULL;
 	const char *str;
+	int pos;
 
 	if (!cfg)
 		return false;
@@ -772,10 +881,12 @@ bool mesh_config_app_key_update(struct mesh_config *cfg, uint16_t app_idx,
 		return false;
 
 	/* The key entry should exist if the key is updated */
-	jentry = get_key_object(jarray, app_idx);
-	if (!jentry)
+	pos = get_key_pos(jarray, app_idx);
+	if (pos < 0)
 		return false;
 
+	jentry = json_object_array_get_idx(jarray, pos);
+
 	if (!json_object_object_get_ex(jentry, "key", &jstring))
 		return false;
 
@@ -789,28 +900,24 @@ bool mesh_config_app_key_update(struct mesh_config *cfg, uint16_t app_idx,
 	if (!add_key_value(jentry, "key", key))
 		return false;
 
-	return save_config(jnode, cfg->node_dir_path);
+	return journal_entry(cfg, "appKeys", pos);
 }
 
 bool mesh_config_app_key_del(struct mesh_config *cfg, uint16_t net_idx,
 								uint16_t idx)
 {
-	json_object *jnode, *jarray;
+	json_object *jarray;
+	int pos;
 
 	if (!cfg)
 		return false;
 
-	jnode = cfg->jnode;
-
-	if (!json_object_object_get_ex(jnode, "appKeys", &jarray))
+	if (!json_object_object_get_ex(cfg->jnode, "appKeys", &jarray))
 		return true;
 
-	jarray_key_del(jarray, idx);
+	pos = jarray_key_del(jarray, idx);
 
-	if (!json_object_array_length(jarray))
-		json_object_object_del(jnode, "appKeys");
-
-	return save_config(jnode, cfg->node_dir_path);
+	return journal_key_del(cfg, "appKeys", jarray, pos);
 }
 
 bool mesh_config_model_binding_add(struct mesh_config *cfg, uint16_t ele_addr,
@@ -855,7 +962,7 @@ bool mesh_config_model_binding_add(struct mesh_config *cfg, uint16_t ele_addr,
 
 	json_object_array_add(jarray, jstring);
 
-	return save_config(jnode, cfg->node_dir_path);
+	return journal_entry(cfg, "elements", ele_idx);
 }
 
 bool mesh_config_model_binding_del(struct mesh_config *cfg, uint16_t ele_addr,
@@ -889,7 +996,7 @@ bool mesh_config_model_binding_del(struct mesh_config *cfg, uint16_t ele_addr,
 	if (!json_object_array_length(jarray))
 		json_object_object_del(jmodel, "bind");
 
-	return save_config(jnode, cfg->node_dir_path);
+	return journal_entry(cfg, "elements", ele_idx);
 }
 
 static void free_model(void *data)
@@ -1475,7 +1582,7 @@ bool mesh_config_write_mode(struct mesh_config *cfg, const char *keyword,
 	if (!cfg || !write_mode(cfg->jnode, keyword, value))
 		return false;
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return journal_config(cfg, keyword);
 }
 
 static bool write_relay_mode(json_object *jobj, uint8_t mode,
@@ -1511,7 +1618,7 @@ bool mesh_config_write_unicast(struct mesh_config *cfg, uint16_t unicast)
 	if (!cfg || !write_uint16_hex(cfg->jnode, "unicastAddress", unicast))
 		return false;
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return journal_config(cfg, "unicastAddress");
 }
 
 bool mesh_config_write_relay_mode(struct mesh_config *cfg, uint8_t mode,
@@ -1521,7 +1628,7 @@ bool mesh_config_write_relay_mode(struct mesh_config *cfg, uint8_t mode,
 	if (!cfg || !write_relay_mode(cfg->jnode, mode, count, interval))
 		return false;
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return journal_config(cfg, "relay");
 }
 
 bool mesh_config_write_net_transmit(struct mesh_config *cfg, uint8_t cnt,
@@ -1547,7 +1654,7 @@ bool mesh_config_write_net_transmit(struct mesh_config *cfg, uint8_t cnt,
 	json_object_object_del(jnode, "retransmit");
 	json_object_object_add(jnode, "retransmit", jrtx);
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return journal_config(cfg, "retransmit");
 
 fail:
 	json_object_put(jrtx);
@@ -1555,6 +1662,9 @@ fail:
 
 }
 
+/* Replayed together, so the IV Index and its update state never disagree */
+static const char *iv_keys[] = { "IVindex", "IVupdate", NULL };
+
 bool mesh_config_write_iv_index(struct mesh_config *cfg, uint32_t idx,
 								bool update)
 {
@@ -1572,7 +1682,8 @@ bool mesh_config_write_iv_index(struct mesh_config *cfg, uint32_t idx,
 	if (!write_int(jnode, "IVupdate", tmp))
 		return false;
 
-	return save_config(jnode, cfg->node_dir_path);
+	return journal_recorded(cfg, json_journal_set_members(cfg->journal,
+							jnode, iv_keys));
 }
 
 static void add_model(void *a, void *b)
@@ -1701,6 +1812,7 @@ static struct mesh_config *create_config(const char *cfg_path,
 	cfg->node_dir_path = l_strdup(cfg_path);
 	cfg->write_seq = node->seq_number;
 	cfg->idles = l_queue_new();
+	cfg->journal = json_journal_open(cfg_path, NULL);
 	gettimeofday(&cfg->write_time, NULL);
 
 	return cfg;
@@ -1777,10 +1889,14 @@ static void finish_key_refresh(json_object *jobj, uint16_t net_idx)
 
 }
 
+/* Replayed together, so no app key outlives the old net key it is bound to */
+static const char *key_refresh_keys[] = { "netKeys", "appKeys", NULL };
+
 bool mesh_config_net_key_set_phase(struct mesh_config *cfg, uint16_t idx,
 								uint8_t phase)
 {
-	json_object *jnode, *jarray, *jentry = NULL;
+	json_object *jnode, *jarray, *jentry;
+	int pos = -1;
 
 	if (!cfg)
 		return false;
@@ -1788,11 +1904,13 @@ bool mesh_config_net_key_set_phase(struct mesh_config *cfg, uint16_t idx,
 	jnode = cfg->jnode;
 
 	if (json_object_object_get_ex(jnode, "netKeys", &jarray))
-		jentry = get_key_object(jarray, idx);
+		pos = get_key_pos(jarray, idx);
 
-	if (!jentry)
+	if (pos < 0)
 		return false;
 
+	jentry = json_object_array_get_idx(jarray, pos);
+
 	json_object_object_del(jentry, "keyRefresh");
 	json_object_object_add(jentry, "keyRefresh",
 					json_object_new_int(phase));
@@ -1800,9 +1918,14 @@ bool mesh_config_net_key_set_phase(struct mesh_config *cfg, uint16_t idx,
 	if (phase == KEY_REFRESH_PHASE_NONE) {
 		json_object_object_del(jentry, "oldKey");
 		finish_key_refresh(jnode, idx);
+
+		if (json_object_object_get_ex(jnode, "appKeys", NULL))
+			return journal_recorded(cfg,
+				json_journal_set_members(cfg->journal, jnode,
+							key_refresh_keys));
 	}
 
-	return save_config(jnode, cfg->node_dir_path);
+	return journal_entry(cfg, "netKeys", pos);
 }
 
 bool mesh_config_model_pub_add(struct mesh_config *cfg, uint16_t ele_addr,
@@ -1865,14 +1988,14 @@ bool mesh_config_model_pub_add(struct mesh_config *cfg, uint16_t ele_addr,
 	json_object_object_add(jpub, "retransmit", jrtx);
 	json_object_object_add(jmodel, "publish", jpub);
 
-	return save_config(jnode, cfg->node_dir_path);
+	return journal_entry(cfg, "elements", ele_idx);
 
 fail:
 	json_object_put(jpub);
 	return false;
 }
 
-static bool delete_model_property(json_object *jnode, uint16_t ele_addr,
+static int delete_model_property(json_object *jnode, uint16_t ele_addr,
 			uint32_t mod_id, bool vendor, const char *keyword)
 {
 	json_object *jmodel;
@@ -1880,25 +2003,31 @@ static bool delete_model_property(json_object *jnode, uint16_t ele_addr,
 
 	ele_idx = get_element_index(jnode, ele_addr);
 	if (ele_idx < 0)
-		return false;
+		return -1;
 
 	jmodel = get_element_model(jnode, ele_idx, mod_id, vendor);
 	if (!jmodel)
-		return false;
+		return -1;
 
 	json_object_object_del(jmodel, keyword);
 
-	return true;
+	return ele_idx;
 }
 
 bool mesh_config_model_pub_del(struct mesh_config *cfg, uint16_t addr,
 						uint32_t mod_id, bool vendor)
 {
-	if (!cfg || !delete_model_property(cfg->jnode, addr, mod_id, vendor,
-								"publish"))
+	int ele_idx;
+
+	if (!cfg)
+		return false;
+
+	ele_idx = delete_model_property(cfg->jnode, addr, mod_id, vendor,
+								"publish");
+	if (ele_idx < 0)
 		return false;
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return journal_entry(cfg, "elements", ele_idx);
 }
 
 static void del_page(json_object *jarray, uint8_t page)
@@ -1958,7 +2087,7 @@ bool mesh_config_comp_page_add(struct mesh_config *cfg, uint8_t page,
 	json_object_array_add(jarray, jstring);
 	l_free(buf);
 
-	return save_config(jnode, cfg->node_dir_path);
+	return journal_config(cfg, "pages");
 }
 
 bool mesh_config_comp_page_mv(struct mesh_config *cfg, uint8_t old, uint8_t nw)
@@ -2056,7 +2185,7 @@ bool mesh_config_model_sub_add(struct mesh_config *cfg, uint16_t ele_addr,
 
 	json_object_array_add(jarray, jstring);
 
-	return save_config(jnode, cfg->node_dir_path);
+	return journal_entry(cfg, "elements", ele_idx);
 }
 
 bool mesh_config_model_sub_del(struct mesh_config *cfg, uint16_t ele_addr,
@@ -2096,17 +2225,23 @@ bool mesh_config_model_sub_del(struct mesh_config *cfg, uint16_t ele_addr,
 	if (!json_object_array_length(jarray))
 		json_object_object_del(jmodel, "subscribe");
 
-	return save_config(jnode, cfg->node_dir_path);
+	return journal_entry(cfg, "elements", ele_idx);
 }
 
 bool mesh_config_model_sub_del_all(struct mesh_config *cfg, uint16_t addr,
 						uint32_t mod_id, bool vendor)
 {
-	if (!cfg || !delete_model_property(cfg->jnode, addr, mod_id, vendor,
-								"subscribe"))
+	int ele_idx;
+
+	if (!cfg)
 		return false;
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	ele_idx = delete_model_property(cfg->jnode, addr, mod_id, vendor,
+								"subscribe");
+	if (ele_idx < 0)
+		return false;
+
+	return journal_entry(cfg, "elements", ele_idx);
 }
 
 bool mesh_config_model_pub_enable(struct mesh_config *cfg, uint16_t ele_addr,
@@ -2135,7 +2270,7 @@ bool mesh_config_model_pub_enable(struct mesh_config *cfg, uint16_t ele_addr,
 	if (!enable)
 		json_object_object_del(jmodel, "publish");
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return journal_entry(cfg, "elements", ele_idx);
 }
 
 bool mesh_config_model_sub_enable(struct mesh_config *cfg, uint16_t ele_addr,
@@ -2164,7 +2299,7 @@ bool mesh_config_model_sub_enable(struct mesh_config *cfg, uint16_t ele_addr,
 	if (!enable)
 		json_object_object_del(jmodel, "subscribe");
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return journal_entry(cfg, "elements", ele_idx);
 }
 
 bool mesh_config_write_seq_number(struct mesh_config *cfg, uint32_t seq,
@@ -2206,9 +2341,9 @@ bool mesh_config_write_seq_number(struct mesh_config *cfg, uint32_t seq,
 		elapsed_ms = elapsed.tv_sec * 1000 + elapsed.tv_usec / 1000;
 
 		/*
-		 * If time since last write is zero, this means that
-		 * idle_save_config is already pending, so we don't need to do
-		 * anything.
+		 * If time since last write is zero, this means that the
+		 * cached value has just been committed, so we don't need to
+		 * do anything.
 		 */
 		if (!elapsed_ms)
 			return true;
@@ -2237,7 +2372,9 @@ bool mesh_config_write_seq_number(struct mesh_config *cfg, uint32_t seq,
 		if (!write_int(cfg->jnode, "sequenceNumber", cached))
 		    return false;
 
-		return mesh_config_save(cfg, false, NULL, NULL);
+		gettimeofday(&cfg->write_time, NULL);
+
+		return journal_config(cfg, "sequenceNumber");
 	}
 
 	return true;
@@ -2248,7 +2385,7 @@ bool mesh_config_write_ttl(struct mesh_config *cfg, uint8_t ttl)
 	if (!cfg || !write_int(cfg->jnode, "defaultTTL", ttl))
 		return false;
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return journal_config(cfg, "defaultTTL");
 }
 
 bool mesh_config_update_company_id(struct mesh_config *cfg, uint16_t cid)
@@ -2256,7 +2393,7 @@ bool mesh_config_update_company_id(struct mesh_config *cfg, uint16_t cid)
 	if (!cfg || !write_uint16_hex(cfg->jnode, "cid", cid))
 		return false;
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return journal_config(cfg, "cid");
 }
 
 bool mesh_config_update_product_id(struct mesh_config *cfg, uint16_t pid)
@@ -2264,7 +2401,7 @@ bool mesh_config_update_product_id(struct mesh_config *cfg, uint16_t pid)
 	if (!cfg || !write_uint16_hex(cfg->jnode, "pid", pid))
 		return false;
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return journal_config(cfg, "pid");
 }
 
 bool mesh_config_update_version_id(struct mesh_config *cfg, uint16_t vid)
@@ -2272,7 +2409,7 @@ bool mesh_config_update_version_id(struct mesh_config *cfg, uint16_t vid)
 	if (!cfg || !write_uint16_hex(cfg->jnode, "vid", vid))
 		return false;
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return journal_config(cfg, "vid");
 }
 
 bool mesh_config_update_crpl(struct mesh_config *cfg, uint16_t crpl)
@@ -2280,7 +2417,7 @@ bool mesh_config_update_crpl(struct mesh_config *cfg, uint16_t crpl)
 	if (!cfg || !write_uint16_hex(cfg->jnode, "crpl", crpl))
 		return false;
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return journal_config(cfg, "crpl");
 }
 
 static bool load_node(const char *fname, const uint8_t uuid[16],
@@ -2292,6 +2429,7 @@ static bool load_node(const char *fname, const uint8_t uuid[16],
 	ssize_t sz;
 	bool result = false;
 	json_object *jnode;
+	struct json_journal *journal;
 	struct mesh_config_node node;
 
 	if (!cb) {
@@ -2326,6 +2464,9 @@ static bool load_node(const char *fname, const uint8_t uuid[16],
 	if (!jnode)
 		goto done;
 
+	/* Bring the snapshot up to date before parsing it */
+	journal = json_journal_open(fname, jnode);
+
 	memset(&node, 0, sizeof(node));
 
 	node.elements = l_queue_new();
@@ -2343,6 +2484,7 @@ static bool load_node(const char *fname, const uint8_t uuid[16],
 		cfg->node_dir_path = l_strdup(fname);
 		cfg->write_seq = node.seq_number;
 		cfg->idles = l_queue_new();
+		cfg->journal = journal;
 		gettimeofday(&cfg->write_time, NULL);
 
 		result = cb(&node, uuid, cfg, user_data);
@@ -2361,8 +2503,10 @@ static bool load_node(const char *fname, const uint8_t uuid[16],
 	l_queue_destroy(node.pages, l_free);
 	l_queue_destroy(node.elements, free_element);
 
-	if (!result)
+	if (!result) {
+		json_journal_close(journal);
 		json_object_put(jnode);
+	}
 
 done:
 	close(fd);
@@ -2385,6 +2529,7 @@ void mesh_config_release(struct mesh_config *cfg)
 		return;
 
 	l_queue_destroy(cfg->idles, release_idle);
+	json_journal_close(cfg->journal);
 
 	l_free(cfg->node_dir_path);
 	json_object_put(cfg->jnode);
@@ -2394,28 +2539,9 @@ void mesh_config_release(struct mesh_config *cfg)
 static void idle_save_config(struct l_idle *idle, void *user_data)
 {
 	struct write_info *info = user_data;
-	char *fname_tmp, *fname_bak, *fname_cfg;
-	bool result = false;
-
-	fname_cfg = info->cfg->node_dir_path;
-	fname_tmp = l_strdup_printf("%s%s", fname_cfg, tmp_ext);
-	fname_bak = l_strdup_printf("%s%s", fname_cfg, bak_ext);
-	remove(fname_tmp);
-
-	result = save_config(info->cfg->jnode, fname_tmp);
-
-	if (result) {
-		remove(fname_bak);
-
-		if (rename(fname_cfg, fname_bak) < 0 ||
-					rename(fname_tmp, fname_cfg) < 0)
-			result = false;
-	}
-
-	remove(fname_tmp);
+	bool result;
 
-	l_free(fname_tmp);
-	l_free(fname_bak);
+	result = write_snapshot(info->cfg);
 
 	gettimeofday(&info->cfg->write_time, NULL);
 
@@ -28,6 +28,19 @@
 #include "mesh/mesh-io-api.h"
 #include "mesh/mesh-io-generic.h"
 
+/* Upper bound on extended advertising sets used for mesh TX */
+#define MAX_ADV_SETS		4
+
+/* Advertising events an unlimited packet gets before it is rotated */
+#define UNLIMITED_ADV_EVENTS	4
+
+struct adv_set {
+	struct tx_pkt *tx;
+	uint16_t interval;
+	uint8_t handle;
+	bool new_addr;
+};
+
 struct mesh_io_private {
 	struct bt_hci *hci;
 	void *user_data;
@@ -36,10 +49,18 @@ struct mesh_io_private {
 	struct l_queue *rx_regs;
 	struct l_queue *tx_pkts;
 	struct tx_pkt *tx;
+	struct adv_set sets[MAX_ADV_SETS];
+	uint32_t burst_start;
+	uint32_t burst_pdus;
+	uint32_t burst_cmds;
 	uint16_t index;
 	uint16_t interval;
+	uint8_t num_sets;
 	bool sending;
 	bool active;
+	bool ext_adv;
+	bool bursting;
+	bool restarted;
 };
 
 struct pvt_rx_reg {
@@ -58,6 +79,7 @@ struct process_data {
 
 struct tx_pkt {
 	struct mesh_io_send_info	info;
+	uint32_t			due;
 	bool				delete;
 	uint8_t				len;
 	uint8_t				pkt[30];
@@ -112,26 +134,11 @@ static void process_rx(struct mesh_io_private *pvt, int8_t rssi,
 	l_queue_foreach(pvt->rx_regs, process_rx_callbacks, &rx);
 }
 
-static void event_adv_report(struct mesh_io *io, const void *buf, uint8_t size)
+static void process_adv_data(struct mesh_io *io, int8_t rssi,
+					uint32_t instant, const uint8_t *addr,
+					const uint8_t *adv, uint8_t adv_len)
 {
-	const struct bt_hci_evt_le_adv_report *evt = buf;
-	const uint8_t *adv;
-	const uint8_t *addr;
-	uint32_t instant;
-	uint8_t adv_len;
 	uint16_t len = 0;
-	int8_t rssi;
-
-	if (evt->event_type != 0x03)
-		return;
-
-	instant = get_instant();
-	adv = evt->data;
-	adv_len = evt->data_len;
-	addr = evt->addr;
-
-	/* rssi is just beyond last byte of data */
-	rssi = (int8_t) adv[adv_len];
 
 	while (len < adv_len - 1) {
 		uint8_t field_len = adv[0];
@@ -153,6 +160,59 @@ static void event_adv_report(struct mesh_io *io, const void *buf, uint8_t size)
 	}
 }
 
+static void event_adv_report(struct mesh_io *io, const void *buf, uint8_t size)
+{
+	const struct bt_hci_evt_le_adv_report *evt = buf;
+	int8_t rssi;
+
+	if (evt->event_type != 0x03)
+		return;
+
+	/* rssi is just beyond last byte of data */
+	rssi = (int8_t) evt->data[evt->data_len];
+
+	process_adv_data(io, rssi, get_instant(), evt->addr, evt->data,
+								evt->data_len);
+}
+
+static void event_ext_adv_report(struct mesh_io *io, const void *buf,
+								uint8_t size)
+{
+	const struct bt_hci_evt_le_ext_adv_report *evt = buf;
+	const uint8_t *ptr = buf + sizeof(*evt);
+	uint32_t instant = get_instant();
+	uint16_t remaining;
+	uint8_t i;
+
+	if (size < sizeof(*evt))
+		return;
+
+	remaining = size - sizeof(*evt);
+
+	for (i = 0; i < evt->num_reports; i++) {
+		const struct bt_hci_le_ext_adv_report *rpt = (void *) ptr;
+		uint16_t rpt_len;
+
+		if (remaining < sizeof(*rpt))
+			break;
+
+		rpt_len = sizeof(*rpt) + rpt->data_len;
+		if (remaining < rpt_len)
+			break;
+
+		/* Mesh traffic is carried by legacy ADV_NONCONN_IND only */
+		if (L_LE16_TO_CPU(rpt->event_type) == 0x0010)
+			process_adv_data(io, rpt->rssi, instant, rpt->addr,
+						rpt->data, rpt->data_len);
+
+		ptr += rpt_len;
+		remaining -= rpt_len;
+	}
+}
+
+static void event_adv_set_term(struct mesh_io *io, const void *buf,
+								uint8_t size);
+
 static void event_callback(const void *buf, uint8_t size, void *user_data)
 {
 	uint8_t event = l_get_u8(buf);
@@ -163,18 +223,115 @@ static void event_callback(const void *buf, uint8_t size, void *user_data)
 		event_adv_report(io, buf + 1, size - 1);
 		break;
 
+	case BT_HCI_EVT_LE_EXT_ADV_REPORT:
+		event_ext_adv_report(io, buf + 1, size - 1);
+		break;
+
+	case BT_HCI_EVT_LE_ADV_SET_TERM:
+		event_adv_set_term(io, buf + 1, size - 1);
+		break;
+
 	default:
 		l_debug("Other Meta Evt - %d", event);
 	}
 }
 
+static void hci_generic_callback(const void *data, uint8_t size,
+								void *user_data)
+{
+	uint8_t status = l_get_u8(data);
+
+	if (status)
+		l_error("Failed to initialize HCI");
+}
+
+static void restart_scan(struct mesh_io_private *pvt);
+static void ext_tx_fill(struct mesh_io_private *pvt);
+
+static void init_done(struct mesh_io_private *pvt)
+{
+	if (pvt->restarted)
+		restart_scan(pvt);
+
+	if (pvt->ext_adv)
+		ext_tx_fill(pvt);
+
+	if (pvt->ready_callback)
+		pvt->ready_callback(pvt->user_data, true);
+}
+
+static void set_legacy_scan_params(struct mesh_io_private *pvt)
+{
+	struct bt_hci_cmd_le_set_scan_parameters cmd;
+
+	/* Set scan parameters */
+	cmd.type = 0x00; /* Passive Scanning. No scanning PDUs shall be sent */
+	cmd.interval = 0x0030; /* Scan Interval = N * 0.625ms */
+	cmd.window = 0x0030; /* Scan Window = N * 0.625ms */
+	cmd.own_addr_type = 0x00; /* Public Device Address */
+	/* Accept all advertising packets except directed advertising packets
+	 * not addressed to this device (default).
+	 */
+	cmd.filter_policy = 0x00;
+
+	bt_hci_send(pvt->hci, BT_HCI_CMD_LE_SET_SCAN_PARAMETERS, &cmd,
+				sizeof(cmd), hci_generic_callback, NULL, NULL);
+}
+
+static void read_num_adv_sets_callback(const void *data, uint8_t size,
+							void *user_data)
+{
+	const struct bt_hci_rsp_le_read_num_supported_adv_sets *rsp = data;
+	struct mesh_io_private *pvt = user_data;
+	uint8_t i;
+
+	if (rsp->status || !rsp->num_of_sets) {
+		l_error("Failed to read number of advertising sets");
+		set_legacy_scan_params(pvt);
+		goto done;
+	}
+
+	pvt->num_sets = rsp->num_of_sets < MAX_ADV_SETS ?
+					rsp->num_of_sets : MAX_ADV_SETS;
+	pvt->ext_adv = true;
+
+	for (i = 0; i < pvt->num_sets; i++) {
+		pvt->sets[i].handle = i;
+		pvt->sets[i].interval = 0;
+		pvt->sets[i].new_addr = true;
+	}
+
+	l_debug("Using %u extended advertising sets", pvt->num_sets);
+
+done:
+	init_done(pvt);
+}
+
 static void local_commands_callback(const void *data, uint8_t size,
 							void *user_data)
 {
 	const struct bt_hci_rsp_read_local_commands *rsp = data;
+	struct mesh_io_private *pvt = user_data;
 
 	if (rsp->status)
 		l_error("Failed to read local commands");
+	else if ((rsp->commands[36] & 0xae) == 0xae &&
+				(rsp->commands[37] & 0x60) == 0x60) {
+		/*
+		 * Set Advertising Set Random Address, Set Extended
+		 * Advertising Parameters/Data/Enable, Read Number of
+		 * Supported Advertising Sets and Set Extended Scan
+		 * Parameters/Enable are all supported.
+		 */
+		bt_hci_send(pvt->hci, BT_HCI_CMD_LE_READ_NUM_SUPPORTED_ADV_SETS,
+					NULL, 0, read_num_adv_sets_callback,
+					pvt, NULL);
+		return;
+	}
+
+	/* Legacy and extended commands may not be mixed, so stay legacy */
+	set_legacy_scan_params(pvt);
+	init_done(pvt);
 }
 
 static void local_features_callback(const void *data, uint8_t size,
@@ -186,32 +343,12 @@ static void local_features_callback(const void *data, uint8_t size,
 		l_error("Failed to read local features");
 }
 
-static void hci_generic_callback(const void *data, uint8_t size,
-								void *user_data)
-{
-	uint8_t status = l_get_u8(data);
-
-	if (status)
-		l_error("Failed to initialize HCI");
-}
-
 static void configure_hci(struct mesh_io_private *io)
 {
-	struct bt_hci_cmd_le_set_scan_parameters cmd;
 	struct bt_hci_cmd_set_event_mask cmd_sem;
 	struct bt_hci_cmd_le_set_event_mask cmd_slem;
 	struct bt_hci_cmd_le_set_random_address cmd_raddr;
 
-	/* Set scan parameters */
-	cmd.type = 0x00; /* Passive Scanning. No scanning PDUs shall be sent */
-	cmd.interval = 0x0030; /* Scan Interval = N * 0.625ms */
-	cmd.window = 0x0030; /* Scan Window = N * 0.625ms */
-	cmd.own_addr_type = 0x00; /* Public Device Address */
-	/* Accept all advertising packets except directed advertising packets
-	 * not addressed to this device (default).
-	 */
-	cmd.filter_policy = 0x00;
-
 	/* Set event mask
 	 *
 	 * Mask: 0x2000800002008890
@@ -234,7 +371,7 @@ static void configure_hci(struct mesh_io_private *io)
 
 	/* Set LE event mask
 	 *
-	 * Mask: 0x000000000000087f
+	 * Mask: 0x000000000002187f
 	 *   LE Connection Complete
 	 *   LE Advertising Report
 	 *   LE Connection Update Complete
@@ -243,10 +380,12 @@ static void configure_hci(struct mesh_io_private *io)
 	 *   LE Remote Connection Parameter Request
 	 *   LE Data Length Change
 	 *   LE PHY Update Complete
+	 *   LE Extended Advertising Report
+	 *   LE Advertising Set Terminated
 	 */
 	cmd_slem.mask[0] = 0x7f;
-	cmd_slem.mask[1] = 0x08;
-	cmd_slem.mask[2] = 0x00;
+	cmd_slem.mask[1] = 0x18;
+	cmd_slem.mask[2] = 0x02;
 	cmd_slem.mask[3] = 0x00;
 	cmd_slem.mask[4] = 0x00;
 	cmd_slem.mask[5] = 0x00;
@@ -262,10 +401,6 @@ static void configure_hci(struct mesh_io_private *io)
 	bt_hci_send(io->hci, BT_HCI_CMD_RESET, NULL, 0, hci_generic_callback,
 								NULL, NULL);
 
-	/* Read local supported commands */
-	bt_hci_send(io->hci, BT_HCI_CMD_READ_LOCAL_COMMANDS, NULL, 0,
-					local_commands_callback, NULL, NULL);
-
 	/* Read local supported features */
 	bt_hci_send(io->hci, BT_HCI_CMD_READ_LOCAL_FEATURES, NULL, 0,
 					local_features_callback, NULL, NULL);
@@ -282,9 +417,12 @@ static void configure_hci(struct mesh_io_private *io)
 	bt_hci_send(io->hci, BT_HCI_CMD_LE_SET_RANDOM_ADDRESS, &cmd_raddr,
 			sizeof(cmd_raddr), hci_generic_callback, NULL, NULL);
 
-	/* Scan Params */
-	bt_hci_send(io->hci, BT_HCI_CMD_LE_SET_SCAN_PARAMETERS, &cmd,
-				sizeof(cmd), hci_generic_callback, NULL, NULL);
+	/*
+	 * Read local supported commands last, its callback picks legacy or
+	 * extended advertising and finishes initialization.
+	 */
+	bt_hci_send(io->hci, BT_HCI_CMD_READ_LOCAL_COMMANDS, NULL, 0,
+					local_commands_callback, io, NULL);
 }
 
 static void scan_enable_rsp(const void *buf, uint8_t size,
@@ -296,16 +434,51 @@ static void scan_enable_rsp(const void *buf, uint8_t size,
 		l_error("LE Scan enable failed (0x%02x)", status);
 }
 
+static void send_scan_enable(struct mesh_io_private *pvt, bool enable,
+						bt_hci_callback_func_t callback)
+{
+	if (pvt->ext_adv) {
+		struct bt_hci_cmd_le_set_ext_scan_enable cmd;
+
+		memset(&cmd, 0, sizeof(cmd));
+		cmd.enable = enable ? 0x01 : 0x00;
+		cmd.filter_dup = 0x00;	/* Report duplicates */
+		bt_hci_send(pvt->hci, BT_HCI_CMD_LE_SET_EXT_SCAN_ENABLE,
+				&cmd, sizeof(cmd), callback, pvt, NULL);
+	} else {
+		struct bt_hci_cmd_le_set_scan_enable cmd;
+
+		cmd.enable = enable ? 0x01 : 0x00;
+		cmd.filter_dup = 0x00;	/* Report duplicates */
+		bt_hci_send(pvt->hci, BT_HCI_CMD_LE_SET_SCAN_ENABLE,
+				&cmd, sizeof(cmd), callback, pvt, NULL);
+	}
+}
+
 static void set_recv_scan_enable(const void *buf, uint8_t size,
 							void *user_data)
 {
 	struct mesh_io_private *pvt = user_data;
-	struct bt_hci_cmd_le_set_scan_enable cmd;
 
-	cmd.enable = 0x01;	/* Enable scanning */
-	cmd.filter_dup = 0x00;	/* Report duplicates */
-	bt_hci_send(pvt->hci, BT_HCI_CMD_LE_SET_SCAN_ENABLE,
-			&cmd, sizeof(cmd), scan_enable_rsp, pvt, NULL);
+	send_scan_enable(pvt, true, scan_enable_rsp);
+}
+
+static void set_ext_scan_params(struct mesh_io_private *pvt)
+{
+	uint8_t buf[sizeof(struct bt_hci_cmd_le_set_ext_scan_params) +
+					sizeof(struct bt_hci_le_scan_phy)];
+	struct bt_hci_cmd_le_set_ext_scan_params *cmd = (void *) buf;
+	struct bt_hci_le_scan_phy *phy = (void *) cmd->data;
+
+	cmd->own_addr_type = 0x01;	/* ADDR_TYPE_RANDOM */
+	cmd->filter_policy = 0x00;	/* Accept all */
+	cmd->num_phys = 0x01;		/* LE 1M */
+	phy->type = pvt->active ? 0x01 : 0x00;	/* Passive/Active scanning */
+	phy->interval = L_CPU_TO_LE16(0x0010);	/* 10 ms */
+	phy->window = L_CPU_TO_LE16(0x0010);	/* 10 ms */
+
+	bt_hci_send(pvt->hci, BT_HCI_CMD_LE_SET_EXT_SCAN_PARAMS,
+			buf, sizeof(buf), set_recv_scan_enable, pvt, NULL);
 }
 
 static void scan_disable_rsp(const void *buf, uint8_t size,
@@ -318,6 +491,11 @@ static void scan_disable_rsp(const void *buf, uint8_t size,
 	if (status)
 		l_error("LE Scan disable failed (0x%02x)", status);
 
+	if (pvt->ext_adv) {
+		set_ext_scan_params(pvt);
+		return;
+	}
+
 	cmd.type = pvt->active ? 0x01 : 0x00;	/* Passive/Active scanning */
 	cmd.interval = L_CPU_TO_LE16(0x0010);	/* 10 ms */
 	cmd.window = L_CPU_TO_LE16(0x0010);	/* 10 ms */
@@ -369,16 +547,33 @@ static bool find_active(const void *a, const void *b)
 
 static void restart_scan(struct mesh_io_private *pvt)
 {
-	struct bt_hci_cmd_le_set_scan_enable cmd;
-
 	if (l_queue_isempty(pvt->rx_regs))
 		return;
 
 	pvt->active = l_queue_find(pvt->rx_regs, find_active, NULL);
-	cmd.enable = 0x00;	/* Disable scanning */
-	cmd.filter_dup = 0x00;	/* Report duplicates */
-	bt_hci_send(pvt->hci, BT_HCI_CMD_LE_SET_SCAN_ENABLE,
-				&cmd, sizeof(cmd), scan_disable_rsp, pvt, NULL);
+	send_scan_enable(pvt, false, scan_disable_rsp);
+}
+
+static void reset_adv_sets(struct mesh_io_private *pvt)
+{
+	uint8_t i;
+
+	/* The controller is reset, resend whatever was in flight */
+	for (i = 0; i < pvt->num_sets; i++) {
+		if (pvt->sets[i].tx)
+			l_queue_push_head(pvt->tx_pkts, pvt->sets[i].tx);
+
+		pvt->sets[i].tx = NULL;
+	}
+
+	if (pvt->ext_adv) {
+		l_timeout_remove(pvt->tx_timeout);
+		pvt->tx_timeout = NULL;
+	}
+
+	pvt->num_sets = 0;
+	pvt->ext_adv = false;
+	pvt->bursting = false;
 }
 
 static void hci_init(void *user_data)
@@ -400,6 +595,11 @@ static void hci_init(void *user_data)
 	}
 
 	if (result) {
+		if (restarted)
+			reset_adv_sets(io->pvt);
+
+		io->pvt->restarted = restarted;
+
 		configure_hci(io->pvt);
 
 		bt_hci_register(io->pvt->hci, BT_HCI_EVT_LE_META_EVENT,
@@ -407,8 +607,8 @@ static void hci_init(void *user_data)
 
 		l_debug("Started mesh on hci %u", io->pvt->index);
 
-		if (restarted)
-			restart_scan(io->pvt);
+		/* Ready is reported once the supported commands are known */
+		return;
 	}
 
 	if (io->pvt->ready_callback)
@@ -455,6 +655,7 @@ static bool dev_init(struct mesh_io *io, void *opts,
 static bool dev_destroy(struct mesh_io *io)
 {
 	struct mesh_io_private *pvt = io->pvt;
+	uint8_t i;
 
 	if (!pvt)
 		return true;
@@ -465,6 +666,10 @@ static bool dev_destroy(struct mesh_io *io)
 	l_queue_remove_if(pvt->tx_pkts, simple_match, pvt->tx);
 	l_queue_destroy(pvt->tx_pkts, l_free);
 	l_free(pvt->tx);
+
+	for (i = 0; i < pvt->num_sets; i++)
+		l_free(pvt->sets[i].tx);
+
 	l_free(pvt);
 	io->pvt = NULL;
 
@@ -617,6 +822,378 @@ static void send_pkt(struct mesh_io_private *pvt, struct tx_pkt *tx,
 				set_send_adv_params, pvt, NULL);
 }
 
+static struct adv_set *get_free_set(struct mesh_io_private *pvt)
+{
+	uint8_t i;
+
+	for (i = 0; i < pvt->num_sets; i++) {
+		if (!pvt->sets[i].tx)
+			return &pvt->sets[i];
+	}
+
+	return NULL;
+}
+
+static bool sets_idle(struct mesh_io_private *pvt)
+{
+	uint8_t i;
+
+	for (i = 0; i < pvt->num_sets; i++) {
+		if (pvt->sets[i].tx)
+			return false;
+	}
+
+	return true;
+}
+
+static void set_cmd_rsp(const void *data, uint8_t size, void *user_data)
+{
+	struct adv_set *set = user_data;
+	uint8_t status = l_get_u8(data);
+
+	if (!status)
+		return;
+
+	l_error("Failed to configure advertising set %u: 0x%02x",
+							set->handle, status);
+
+	/* Send the parameters again the next time the set is used */
+	set->interval = 0;
+}
+
+static void send_set_cmd(struct mesh_io_private *pvt, struct adv_set *set,
+				uint16_t opcode, const void *data, uint8_t size)
+{
+	bt_hci_send(pvt->hci, opcode, data, size, set_cmd_rsp, set, NULL);
+	pvt->burst_cmds++;
+}
+
+static void set_ext_adv_params(struct mesh_io_private *pvt,
+						struct adv_set *set)
+{
+	struct bt_hci_cmd_le_set_ext_adv_params cmd;
+	uint32_t hci_interval;
+
+	memset(&cmd, 0, sizeof(cmd));
+
+	hci_interval = (set->interval * 16) / 10;
+	cmd.handle = set->handle;
+	cmd.evt_properties = L_CPU_TO_LE16(0x0010); /* ADV_NONCONN_IND */
+	cmd.min_interval[0] = hci_interval;
+	cmd.min_interval[1] = hci_interval >> 8;
+	cmd.min_interval[2] = hci_interval >> 16;
+	memcpy(cmd.max_interval, cmd.min_interval, 3);
+	cmd.channel_map = 0x07;
+	cmd.own_addr_type = 0x01; /* ADDR_TYPE_RANDOM */
+	cmd.filter_policy = 0x03;
+	cmd.tx_power = 0x7f; /* No preference */
+	cmd.primary_phy = 0x01; /* LE 1M */
+	cmd.secondary_phy = 0x01; /* LE 1M */
+	cmd.sid = set->handle;
+
+	send_set_cmd(pvt, set, BT_HCI_CMD_LE_SET_EXT_ADV_PARAMS, &cmd,
+								sizeof(cmd));
+}
+
+static void set_ext_adv_data(struct mesh_io_private *pvt,
+						struct adv_set *set)
+{
+	uint8_t buf[sizeof(struct bt_hci_cmd_le_set_ext_adv_data) + 31];
+	struct bt_hci_cmd_le_set_ext_adv_data *cmd = (void *) buf;
+	struct tx_pkt *tx = set->tx;
+
+	cmd->handle = set->handle;
+	cmd->operation = 0x03; /* Complete data */
+	cmd->fragment_preference = 0x01; /* No fragmentation */
+	cmd->data_len = tx->len + 1;
+	cmd->data[0] = tx->len;
+	memcpy(cmd->data + 1, tx->pkt, tx->len);
+
+	send_set_cmd(pvt, set, BT_HCI_CMD_LE_SET_EXT_ADV_DATA, buf,
+						sizeof(*cmd) + cmd->data_len);
+}
+
+static void assign_set(struct mesh_io_private *pvt, struct adv_set *set,
+			struct tx_pkt *tx, struct bt_hci_cmd_ext_adv_set *eas)
+{
+	struct bt_hci_cmd_le_set_adv_set_rand_addr cmd_raddr;
+	uint32_t duration;
+	uint16_t interval;
+	uint8_t events;
+
+	if (tx->info.type == MESH_IO_TIMING_TYPE_GENERAL) {
+		interval = tx->info.u.gen.interval;
+		events = tx->info.u.gen.cnt;
+		if (events == MESH_IO_TX_COUNT_UNLIMITED)
+			events = UNLIMITED_ADV_EVENTS;
+	} else {
+		interval = 25;
+		events = 1;
+	}
+
+	set->tx = tx;
+
+	if (set->interval != interval) {
+		set->interval = interval;
+		set_ext_adv_params(pvt, set);
+	}
+
+	/* Each set changes its random address once per burst of ADVs */
+	if (set->new_addr) {
+		cmd_raddr.handle = set->handle;
+		l_getrandom(cmd_raddr.bdaddr, 6);
+		cmd_raddr.bdaddr[5] |= 0xc0;
+		send_set_cmd(pvt, set, BT_HCI_CMD_LE_SET_ADV_SET_RAND_ADDR,
+					&cmd_raddr, sizeof(cmd_raddr));
+		set->new_addr = false;
+	}
+
+	set_ext_adv_data(pvt, set);
+
+	/*
+	 * The controller stops the set after max_events, the duration (in
+	 * 10 ms units, allowing for advDelay) is only a backstop for
+	 * controllers that do not count events.
+	 */
+	duration = (events * (interval + 10) + 9) / 10;
+	if (duration > 0xffff)
+		duration = 0xffff;
+
+	eas->handle = set->handle;
+	eas->duration = L_CPU_TO_LE16(duration);
+	eas->max_events = events;
+}
+
+/* Sets started by one LE Set Extended Advertising Enable command */
+struct ext_enable {
+	struct mesh_io_private *pvt;
+	uint8_t num;
+	uint8_t handles[MAX_ADV_SETS];
+	struct tx_pkt *tx[MAX_ADV_SETS];
+};
+
+static void ext_tx_done(struct mesh_io_private *pvt);
+
+static void ext_enable_rsp(const void *data, uint8_t size, void *user_data)
+{
+	struct ext_enable *req = user_data;
+	struct mesh_io_private *pvt = req->pvt;
+	uint8_t status = l_get_u8(data);
+	uint8_t i;
+
+	if (!status)
+		return;
+
+	l_error("Failed to enable %u advertising sets: 0x%02x", req->num,
+									status);
+
+	/* No set terminated event will come, drop the packets */
+	for (i = 0; i < req->num; i++) {
+		struct adv_set *set = &pvt->sets[req->handles[i]];
+
+		if (set->tx != req->tx[i])
+			continue;
+
+		l_free(set->tx);
+		set->tx = NULL;
+	}
+
+	ext_tx_fill(pvt);
+	ext_tx_done(pvt);
+}
+
+static bool match_due(const void *a, const void *b)
+{
+	const struct tx_pkt *tx = a;
+	uint32_t now = L_PTR_TO_UINT(b);
+
+	return (int32_t) (tx->due - now) <= 0;
+}
+
+static void find_next_due(void *data, void *user_data)
+{
+	struct tx_pkt *tx = data;
+	uint32_t *next = user_data;
+
+	if ((int32_t) (tx->due - *next) < 0)
+		*next = tx->due;
+}
+
+static void tx_to(struct l_timeout *timeout, void *user_data);
+
+/*
+ * Wake up when the earliest queued packet is due, unless every set is busy
+ * in which case the next set terminated event refills them.
+ */
+static void ext_tx_schedule(struct mesh_io_private *pvt, uint32_t now)
+{
+	uint32_t next = now + UINT16_MAX;
+	uint32_t ms;
+
+	if (l_queue_isempty(pvt->tx_pkts) || !get_free_set(pvt)) {
+		l_timeout_remove(pvt->tx_timeout);
+		pvt->tx_timeout = NULL;
+		return;
+	}
+
+	l_queue_foreach(pvt->tx_pkts, find_next_due, &next);
+
+	ms = (int32_t) (next - now) > 0 ? next - now : 1;
+
+	if (pvt->tx_timeout)
+		l_timeout_modify_ms(pvt->tx_timeout, ms);
+	else
+		pvt->tx_timeout = l_timeout_create_ms(ms, tx_to, pvt, NULL);
+}
+
+static void ext_tx_fill(struct mesh_io_private *pvt)
+{
+	uint8_t buf[sizeof(struct bt_hci_cmd_le_set_ext_adv_enable) +
+			MAX_ADV_SETS * sizeof(struct bt_hci_cmd_ext_adv_set)];
+	struct bt_hci_cmd_le_set_ext_adv_enable *cmd = (void *) buf;
+	struct bt_hci_cmd_ext_adv_set *eas = (void *) (buf + sizeof(*cmd));
+	struct ext_enable *req;
+	struct adv_set *set;
+	uint32_t now = get_instant();
+	uint8_t num = 0;
+
+	req = l_new(struct ext_enable, 1);
+	req->pvt = pvt;
+
+	/* Packets wait in the queue until their transmit delay has passed */
+	while ((set = get_free_set(pvt))) {
+		struct tx_pkt *tx = l_queue_remove_if(pvt->tx_pkts, match_due,
+							L_UINT_TO_PTR(now));
+
+		if (!tx)
+			break;
+
+		if (!pvt->bursting) {
+			pvt->bursting = true;
+			pvt->burst_start = get_instant();
+			pvt->burst_pdus = 0;
+			pvt->burst_cmds = 0;
+		}
+
+		req->handles[num] = set->handle;
+		req->tx[num] = tx;
+		assign_set(pvt, set, tx, &eas[num++]);
+	}
+
+	ext_tx_schedule(pvt, now);
+
+	if (!num) {
+		l_free(req);
+		return;
+	}
+
+	/* A single command starts every set filled in this round */
+	req->num = num;
+	cmd->enable = 0x01;
+	cmd->num_of_sets = num;
+	bt_hci_send(pvt->hci, BT_HCI_CMD_LE_SET_EXT_ADV_ENABLE, buf,
+				sizeof(*cmd) + num * sizeof(*eas),
+				ext_enable_rsp, req, l_free);
+	pvt->burst_cmds++;
+}
+
+static void ext_tx_done(struct mesh_io_private *pvt)
+{
+	uint32_t elapsed;
+	uint8_t i;
+
+	if (!pvt->bursting || !sets_idle(pvt) ||
+					!l_queue_isempty(pvt->tx_pkts))
+		return;
+
+	elapsed = get_instant() - pvt->burst_start;
+
+	l_debug("TX burst: %u PDUs in %u ms (%u PDU/s) on %u sets, %u HCI cmds",
+			pvt->burst_pdus, elapsed,
+			elapsed ? pvt->burst_pdus * 1000 / elapsed : 0,
+			pvt->num_sets, pvt->burst_cmds);
+
+	pvt->bursting = false;
+
+	/* At end of any burst of ADVs, change random addresses */
+	for (i = 0; i < pvt->num_sets; i++)
+		pvt->sets[i].new_addr = true;
+}
+
+static void event_adv_set_term(struct mesh_io *io, const void *buf,
+								uint8_t size)
+{
+	const struct bt_hci_evt_le_adv_set_term *evt = buf;
+	struct mesh_io_private *pvt = io->pvt;
+	struct adv_set *set;
+	struct tx_pkt *tx;
+
+	if (!pvt || size < sizeof(*evt) || evt->handle >= pvt->num_sets)
+		return;
+
+	set = &pvt->sets[evt->handle];
+	tx = set->tx;
+	if (!tx)
+		return;
+
+	set->tx = NULL;
+	pvt->burst_pdus++;
+
+	/* Unlimited packets rotate with the rest of the queue */
+	if (tx->info.type == MESH_IO_TIMING_TYPE_GENERAL &&
+			tx->info.u.gen.cnt == MESH_IO_TX_COUNT_UNLIMITED) {
+		tx->due = get_instant();
+		l_queue_push_tail(pvt->tx_pkts, tx);
+	} else
+		l_free(tx);
+
+	ext_tx_fill(pvt);
+	ext_tx_done(pvt);
+}
+
+static void ext_disable_rsp(const void *data, uint8_t size, void *user_data)
+{
+	uint8_t status = l_get_u8(data);
+
+	if (status)
+		l_error("Failed to disable advertising sets: 0x%02x", status);
+}
+
+static void ext_tx_cancel(struct mesh_io_private *pvt,
+				l_queue_match_func_t match, const void *data)
+{
+	uint8_t buf[sizeof(struct bt_hci_cmd_le_set_ext_adv_enable) +
+			MAX_ADV_SETS * sizeof(struct bt_hci_cmd_ext_adv_set)];
+	struct bt_hci_cmd_le_set_ext_adv_enable *cmd = (void *) buf;
+	struct bt_hci_cmd_ext_adv_set *eas = (void *) (buf + sizeof(*cmd));
+	uint8_t i, num = 0;
+
+	memset(buf, 0, sizeof(buf));
+
+	for (i = 0; i < pvt->num_sets; i++) {
+		struct adv_set *set = &pvt->sets[i];
+
+		if (!set->tx || !match(set->tx, data))
+			continue;
+
+		l_free(set->tx);
+		set->tx = NULL;
+		eas[num++].handle = set->handle;
+	}
+
+	if (num) {
+		cmd->enable = 0x00;
+		cmd->num_of_sets = num;
+		bt_hci_send(pvt->hci, BT_HCI_CMD_LE_SET_EXT_ADV_ENABLE, buf,
+					sizeof(*cmd) + num * sizeof(*eas),
+					ext_disable_rsp, NULL, NULL);
+		pvt->burst_cmds++;
+	}
+
+	ext_tx_fill(pvt);
+	ext_tx_done(pvt);
+}
+
 static void tx_to(struct l_timeout *timeout, void *user_data)
 {
 	struct mesh_io_private *pvt = user_data;
@@ -627,6 +1204,11 @@ static void tx_to(struct l_timeout *timeout, void *user_data)
 	if (!pvt)
 		return;
 
+	if (pvt->ext_adv) {
+		ext_tx_fill(pvt);
+		return;
+	}
+
 	tx = l_queue_pop_head(pvt->tx_pkts);
 	if (!tx) {
 		l_timeout_remove(timeout);
@@ -667,16 +1249,10 @@ static void tx_to(struct l_timeout *timeout, void *user_data)
 		pvt->tx_timeout = l_timeout_create_ms(ms, tx_to, pvt, NULL);
 }
 
-static void tx_worker(void *user_data)
+static uint32_t tx_delay(const struct tx_pkt *tx)
 {
-	struct mesh_io_private *pvt = user_data;
-	struct tx_pkt *tx;
 	uint32_t delay;
 
-	tx = l_queue_peek_head(pvt->tx_pkts);
-	if (!tx)
-		return;
-
 	switch (tx->info.type) {
 	case MESH_IO_TIMING_TYPE_GENERAL:
 		if (tx->info.u.gen.min_delay == tx->info.u.gen.max_delay)
@@ -709,9 +1285,25 @@ static void tx_worker(void *user_data)
 		break;
 
 	default:
-		return;
+		delay = 0;
+		break;
 	}
 
+	return delay;
+}
+
+static void tx_worker(void *user_data)
+{
+	struct mesh_io_private *pvt = user_data;
+	struct tx_pkt *tx;
+	uint32_t delay;
+
+	tx = l_queue_peek_head(pvt->tx_pkts);
+	if (!tx)
+		return;
+
+	delay = tx_delay(tx);
+
 	if (!delay)
 		tx_to(pvt->tx_timeout, pvt);
 	else if (pvt->tx_timeout)
@@ -720,6 +1312,11 @@ static void tx_worker(void *user_data)
 		pvt->tx_timeout = l_timeout_create_ms(delay, tx_to, pvt, NULL);
 }
 
+static void ext_tx_worker(void *user_data)
+{
+	ext_tx_fill(user_data);
+}
+
 static bool send_tx(struct mesh_io *io, struct mesh_io_send_info *info,
 					const uint8_t *data, uint16_t len)
 {
@@ -736,6 +1333,22 @@ static bool send_tx(struct mesh_io *io, struct mesh_io_send_info *info,
 	memcpy(&tx->pkt, data, len);
 	tx->len = len;
 
+	if (pvt->ext_adv) {
+		/* Same timing as the legacy path applies to its head packet */
+		tx->due = get_instant() + tx_delay(tx);
+
+		if (info->type == MESH_IO_TIMING_TYPE_POLL_RSP)
+			l_queue_push_head(pvt->tx_pkts, tx);
+		else
+			l_queue_push_tail(pvt->tx_pkts, tx);
+
+		/* Busy sets pick up queued packets as they terminate */
+		if (get_free_set(pvt))
+			l_idle_oneshot(ext_tx_worker, pvt, NULL);
+
+		return true;
+	}
+
 	if (info->type == MESH_IO_TIMING_TYPE_POLL_RSP)
 		l_queue_push_head(pvt->tx_pkts, tx);
 	else {
@@ -767,36 +1380,37 @@ static bool send_tx(struct mesh_io *io, struct mesh_io_send_info *info,
 static bool tx_cancel(struct mesh_io *io, const uint8_t *data, uint8_t len)
 {
 	struct mesh_io_private *pvt = io->pvt;
+	struct tx_pattern pattern = {
+		.data = data,
+		.len = len
+	};
+	l_queue_match_func_t match;
+	const void *match_data;
 	struct tx_pkt *tx;
 
 	if (!data)
 		return false;
 
 	if (len == 1) {
-		do {
-			tx = l_queue_remove_if(pvt->tx_pkts, find_by_ad_type,
-							L_UINT_TO_PTR(data[0]));
-			l_free(tx);
-
-			if (tx == pvt->tx)
-				pvt->tx = NULL;
-
-		} while (tx);
+		match = find_by_ad_type;
+		match_data = L_UINT_TO_PTR(data[0]);
 	} else {
-		struct tx_pattern pattern = {
-			.data = data,
-			.len = len
-		};
+		match = find_by_pattern;
+		match_data = &pattern;
+	}
 
-		do {
-			tx = l_queue_remove_if(pvt->tx_pkts, find_by_pattern,
-								&pattern);
-			l_free(tx);
+	do {
+		tx = l_queue_remove_if(pvt->tx_pkts, match, match_data);
+		l_free(tx);
+
+		if (tx == pvt->tx)
+			pvt->tx = NULL;
 
-			if (tx == pvt->tx)
-				pvt->tx = NULL;
+	} while (tx);
 
-		} while (tx);
+	if (pvt->ext_adv) {
+		ext_tx_cancel(pvt, match, match_data);
+		return true;
 	}
 
 	if (l_queue_isempty(pvt->tx_pkts)) {
@@ -819,7 +1433,6 @@ static bool find_by_filter(const void *a, const void *b)
 static bool recv_register(struct mesh_io *io, const uint8_t *filter,
 			uint8_t len, mesh_io_recv_func_t cb, void *user_data)
 {
-	struct bt_hci_cmd_le_set_scan_enable cmd;
 	struct mesh_io_private *pvt = io->pvt;
 	struct pvt_rx_reg *rx_reg;
 	bool already_scanning;
@@ -848,11 +1461,7 @@ static bool recv_register(struct mesh_io *io, const uint8_t *filter,
 
 	if (!already_scanning || pvt->active != active) {
 		pvt->active = active;
-		cmd.enable = 0x00;	/* Disable scanning */
-		cmd.filter_dup = 0x00;	/* Report duplicates */
-		bt_hci_send(pvt->hci, BT_HCI_CMD_LE_SET_SCAN_ENABLE,
-				&cmd, sizeof(cmd), scan_disable_rsp, pvt, NULL);
-
+		send_scan_enable(pvt, false, scan_disable_rsp);
 	}
 
 	return true;
@@ -861,7 +1470,6 @@ static bool recv_register(struct mesh_io *io, const uint8_t *filter,
 static bool recv_deregister(struct mesh_io *io, const uint8_t *filter,
 								uint8_t len)
 {
-	struct bt_hci_cmd_le_set_scan_enable cmd = {0, 0};
 	struct mesh_io_private *pvt = io->pvt;
 	struct pvt_rx_reg *rx_reg;
 	bool active = false;
@@ -876,13 +1484,11 @@ static bool recv_deregister(struct mesh_io *io, const uint8_t *filter,
 		active = true;
 
 	if (l_queue_isempty(pvt->rx_regs)) {
-		bt_hci_send(pvt->hci, BT_HCI_CMD_LE_SET_SCAN_ENABLE,
-					&cmd, sizeof(cmd), NULL, NULL, NULL);
+		send_scan_enable(pvt, false, NULL);
 
 	} else if (active != pvt->active) {
 		pvt->active = active;
-		bt_hci_send(pvt->hci, BT_HCI_CMD_LE_SET_SCAN_ENABLE,
-				&cmd, sizeof(cmd), scan_disable_rsp, pvt, NULL);
+		send_scan_enable(pvt, false, scan_disable_rsp);
 	}
 
 	return true;
@@ -71,6 +71,16 @@ struct mod_forward {
 
 static struct l_queue *mesh_virtuals;
 
+/* Virtual labels by 16-bit virtual address, several labels may share one */
+static struct l_hashmap *virtual_addrs;
+
+/* Trial decryptions of access payloads, to spot key lookup regressions */
+static struct {
+	uint32_t msgs;
+	uint32_t attempts;
+	uint32_t max_attempts;
+} decrypt_stats;
+
 static bool is_internal(uint32_t id)
 {
 	if (id == CONFIG_SRV_MODEL || id == CONFIG_CLI_MODEL)
@@ -79,6 +89,36 @@ static bool is_internal(uint32_t id)
 	return false;
 }
 
+static void add_virt_addr(struct mesh_virtual *virt)
+{
+	struct l_queue *virts;
+
+	virts = l_hashmap_lookup(virtual_addrs, L_UINT_TO_PTR(virt->addr));
+	if (!virts) {
+		virts = l_queue_new();
+		l_hashmap_insert(virtual_addrs, L_UINT_TO_PTR(virt->addr),
+									virts);
+	}
+
+	l_queue_push_tail(virts, virt);
+}
+
+static void remove_virt_addr(struct mesh_virtual *virt)
+{
+	struct l_queue *virts;
+
+	virts = l_hashmap_lookup(virtual_addrs, L_UINT_TO_PTR(virt->addr));
+	if (!virts)
+		return;
+
+	l_queue_remove(virts, virt);
+
+	if (l_queue_isempty(virts)) {
+		l_hashmap_remove(virtual_addrs, L_UINT_TO_PTR(virt->addr));
+		l_queue_destroy(virts, NULL);
+	}
+}
+
 static void unref_virt(void *data)
 {
 	struct mesh_virtual *virt = data;
@@ -90,6 +130,7 @@ static void unref_virt(void *data)
 		return;
 
 	l_queue_remove(mesh_virtuals, virt);
+	remove_virt_addr(virt);
 	l_free(virt);
 }
 
@@ -389,9 +430,10 @@ static int app_packet_decrypt(struct mesh_net *net, const uint8_t *data,
 				uint16_t size, bool szmict, uint16_t src,
 				uint16_t dst, uint8_t *virt, uint16_t virt_size,
 				uint8_t key_aid, uint32_t seq,
-				uint32_t iv_idx, uint8_t *out)
+				uint32_t iv_idx, uint8_t *out,
+				uint32_t *attempts)
 {
-	struct l_queue *app_keys = mesh_net_get_app_keys(net);
+	struct l_queue *app_keys = mesh_net_get_app_aid_keys(net, key_aid);
 	const struct l_queue_entry *entry;
 
 	if (!app_keys)
@@ -412,6 +454,7 @@ static int app_packet_decrypt(struct mesh_net *net, const uint8_t *data,
 			continue;
 
 		if (old_key && old_key_aid == key_aid) {
+			(*attempts)++;
 			decrypted = mesh_crypto_payload_decrypt(virt, virt_size,
 					data, size, szmict, src, dst, key_aid,
 						seq, iv_idx, out, old_key);
@@ -425,6 +468,7 @@ static int app_packet_decrypt(struct mesh_net *net, const uint8_t *data,
 		}
 
 		if (new_key && new_key_aid == key_aid) {
+			(*attempts)++;
 			decrypted = mesh_crypto_payload_decrypt(virt, virt_size,
 					data, size, szmict, src, dst, key_aid,
 						seq, iv_idx, out, new_key);
@@ -444,7 +488,8 @@ static int app_packet_decrypt(struct mesh_net *net, const uint8_t *data,
 static int dev_packet_decrypt(struct mesh_node *node, const uint8_t *data,
 				uint16_t size, bool szmict, uint16_t src,
 				uint16_t dst, uint8_t key_aid, uint32_t seq,
-				uint32_t iv_idx, uint8_t *out)
+				uint32_t iv_idx, uint8_t *out,
+				uint32_t *attempts)
 {
 	uint8_t dev_key[16];
 	const uint8_t *key;
@@ -453,6 +498,7 @@ static int dev_packet_decrypt(struct mesh_node *node, const uint8_t *data,
 	if (!key)
 		return -1;
 
+	(*attempts)++;
 	if (mesh_crypto_payload_decrypt(NULL, 0, data, size, szmict, src,
 					dst, key_aid, seq, iv_idx, out, key))
 		return APP_IDX_DEV_LOCAL;
@@ -461,6 +507,7 @@ static int dev_packet_decrypt(struct mesh_node *node, const uint8_t *data,
 		return -1;
 
 	key = dev_key;
+	(*attempts)++;
 	if (mesh_crypto_payload_decrypt(NULL, 0, data, size, szmict, src,
 					dst, key_aid, seq, iv_idx, out, key))
 		return APP_IDX_DEV_REMOTE;
@@ -472,21 +519,22 @@ static int virt_packet_decrypt(struct mesh_net *net, const uint8_t *data,
 				uint16_t size, bool szmict, uint16_t src,
 				uint16_t dst, uint8_t key_aid, uint32_t seq,
 				uint32_t iv_idx, uint8_t *out,
-				struct mesh_virtual **decrypt_virt)
+				struct mesh_virtual **decrypt_virt,
+				uint32_t *attempts)
 {
 	const struct l_queue_entry *v;
+	struct l_queue *virts;
 
-	for (v = l_queue_get_entries(mesh_virtuals); v; v = v->next) {
+	virts = l_hashmap_lookup(virtual_addrs, L_UINT_TO_PTR(dst));
+
+	for (v = l_queue_get_entries(virts); v; v = v->next) {
 		struct mesh_virtual *virt = v->data;
 		int decrypt_idx;
 
-		if (virt->addr != dst)
-			continue;
-
 		decrypt_idx = app_packet_decrypt(net, data, size, szmict, src,
 							dst, virt->label, 16,
 							key_aid, seq, iv_idx,
-							out);
+							out, attempts);
 
 		if (decrypt_idx >= 0) {
 			*decrypt_virt = virt;
@@ -687,6 +735,7 @@ static struct mesh_virtual *add_virtual(const uint8_t *v)
 	memcpy(virt->label, v, 16);
 	virt->ref_cnt = 1;
 	l_queue_push_head(mesh_virtuals, virt);
+	add_virt_addr(virt);
 
 	return virt;
 }
@@ -868,6 +917,7 @@ bool mesh_model_rx(struct mesh_node *node, bool szmict, uint32_t seq0,
 	int decrypt_idx, i, ele_idx;
 	uint16_t addr;
 	struct mesh_virtual *decrypt_virt = NULL;
+	uint32_t attempts = 0;
 	bool result = false;
 	bool is_subscription;
 
@@ -891,17 +941,27 @@ bool mesh_model_rx(struct mesh_node *node, bool szmict, uint32_t seq0,
 	if (key_aid == APP_AID_DEV)
 		decrypt_idx = dev_packet_decrypt(node, data, size, szmict, src,
 						dst, key_aid, seq0, iv_index,
-						clear_text);
+						clear_text, &attempts);
 	else if ((dst & 0xc000) == 0x8000)
 		decrypt_idx = virt_packet_decrypt(net, data, size, szmict, src,
 							dst, key_aid, seq0,
 							iv_index, clear_text,
-							&decrypt_virt);
+							&decrypt_virt,
+							&attempts);
 	else
 		decrypt_idx = app_packet_decrypt(net, data, size, szmict, src,
 						dst, NULL, 0,
 						key_aid, seq0, iv_index,
-						clear_text);
+						clear_text, &attempts);
+
+	decrypt_stats.msgs++;
+	decrypt_stats.attempts += attempts;
+	if (attempts > decrypt_stats.max_attempts)
+		decrypt_stats.max_attempts = attempts;
+
+	l_debug("decrypt attempts %u (total %u in %u msgs, max %u)", attempts,
+				decrypt_stats.attempts, decrypt_stats.msgs,
+				decrypt_stats.max_attempts);
 
 	if (decrypt_idx < 0) {
 		l_error("model.c - Failed to decrypt application payload");
@@ -1955,13 +2015,22 @@ done:
 	return n;
 }
 
+static void destroy_virt_addr(void *data)
+{
+	l_queue_destroy(data, NULL);
+}
+
 void mesh_model_init(void)
 {
 	mesh_virtuals = l_queue_new();
+	virtual_addrs = l_hashmap_new();
 }
 
 void mesh_model_cleanup(void)
 {
+	l_hashmap_destroy(virtual_addrs, destroy_virt_addr);
+	virtual_addrs = NULL;
+
 	l_queue_destroy(mesh_virtuals, l_free);
 	mesh_virtuals = NULL;
 }
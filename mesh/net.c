@@ -95,6 +95,7 @@ struct mesh_net {
 	struct mesh_node *node;
 	struct mesh_prov *prov;
 	struct l_queue *app_keys;
+	struct l_queue *app_aid_keys[KEY_AID_MASK + 1];
 	unsigned int pkt_id;
 	unsigned int bea_id;
 	unsigned int beacon_id;
@@ -638,6 +639,7 @@ struct mesh_net *mesh_net_new(struct mesh_node *node)
 void mesh_net_free(void *user_data)
 {
 	struct mesh_net *net = user_data;
+	int i;
 
 	if (!net)
 		return;
@@ -654,6 +656,9 @@ void mesh_net_free(void *user_data)
 	l_queue_destroy(net->destinations, l_free);
 	l_queue_destroy(net->app_keys, appkey_key_free);
 
+	for (i = 0; i <= KEY_AID_MASK; i++)
+		l_queue_destroy(net->app_aid_keys[i], NULL);
+
 	l_free(net);
 }
 
@@ -3467,6 +3472,22 @@ struct l_queue *mesh_net_get_app_keys(struct mesh_net *net)
 	return net->app_keys;
 }
 
+/* App keys whose current or updated AID matches key_aid */
+struct l_queue *mesh_net_get_app_aid_keys(struct mesh_net *net,
+							uint8_t key_aid)
+{
+	struct l_queue **keys;
+
+	if (!net)
+		return NULL;
+
+	keys = &net->app_aid_keys[key_aid & KEY_AID_MASK];
+	if (!*keys)
+		*keys = l_queue_new();
+
+	return *keys;
+}
+
 bool mesh_net_have_key(struct mesh_net *net, uint16_t idx)
 {
 	if (!net)
@@ -754,6 +754,33 @@ static gssize put_xfer_progress(void *buf, gsize len, gpointer user_data)
 	return size;
 }
 
+static gssize put_xfer_progress_fd(int *fd, off_t *offset, gsize len,
+							gpointer user_data)
+{
+	struct obc_transfer *transfer = user_data;
+	gssize size;
+	off_t pos;
+
+	pos = lseek(transfer->fd, 0, SEEK_CUR);
+	if (pos < 0)
+		return -errno;
+
+	if (pos >= transfer->size)
+		return 0;
+
+	size = MIN((gint64) len, transfer->size - pos);
+
+	if (lseek(transfer->fd, size, SEEK_CUR) < 0)
+		return -errno;
+
+	*fd = transfer->fd;
+	*offset = pos;
+
+	transfer->transferred += size;
+
+	return size;
+}
+
 gboolean obc_transfer_set_callback(struct obc_transfer *transfer,
 					transfer_callback_t func,
 					void *user_data)
@@ -842,6 +869,7 @@ static gboolean transfer_start_put(struct obc_transfer *transfer, GError **err)
 {
 	GObexPacket *req;
 	GObexHeader *hdr;
+	struct stat st;
 
 	if (transfer->xfer > 0) {
 		g_set_error(err, OBC_TRANSFER_ERROR, -EALREADY,
@@ -867,7 +895,13 @@ static gboolean transfer_start_put(struct obc_transfer *transfer, GError **err)
 		g_obex_packet_add_header(req, hdr);
 	}
 
-	transfer->xfer = g_obex_put_req_pkt(transfer->obex, req,
+	/* Regular files are sent straight from the page cache */
+	if (fstat(transfer->fd, &st) == 0 && S_ISREG(st.st_mode))
+		transfer->xfer = g_obex_put_req_pkt_fd(transfer->obex, req,
+					put_xfer_progress_fd, xfer_complete,
+					transfer, err);
+	else
+		transfer->xfer = g_obex_put_req_pkt(transfer->obex, req,
 					put_xfer_progress, xfer_complete,
 					transfer, err);
 	if (transfer->xfer == 0)
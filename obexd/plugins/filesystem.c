@@ -230,6 +230,52 @@ static ssize_t filesystem_read(void *object, void *buf, size_t count)
 	return ret;
 }
 
+/* Only regular files can be sent with read_fd */
+static gboolean filesystem_has_fd(void *object)
+{
+	struct stat st;
+
+	if (fstat(GPOINTER_TO_INT(object), &st) < 0)
+		return FALSE;
+
+	return S_ISREG(st.st_mode);
+}
+
+/*
+ * Hands out the next range of the file instead of its contents so the body
+ * can be sent without copying it through userspace buffers.
+ */
+static ssize_t filesystem_read_fd(void *object, int *fd, off_t *offset,
+								size_t count)
+{
+	int f = GPOINTER_TO_INT(object);
+	struct stat st;
+	off_t pos;
+
+	if (fstat(f, &st) < 0)
+		return -errno;
+
+	if (!S_ISREG(st.st_mode))
+		return -ENOTSUP;
+
+	pos = lseek(f, 0, SEEK_CUR);
+	if (pos < 0)
+		return -errno;
+
+	if (pos >= st.st_size)
+		return 0;
+
+	count = MIN(count, (size_t) (st.st_size - pos));
+
+	if (lseek(f, count, SEEK_CUR) < 0)
+		return -errno;
+
+	*fd = f;
+	*offset = pos;
+
+	return count;
+}
+
 static ssize_t filesystem_write(void *object, const void *buf, size_t count)
 {
 	ssize_t ret;
@@ -646,6 +692,8 @@ static struct obex_mime_type_driver file = {
 	.open = filesystem_open,
 	.close = filesystem_close,
 	.read = filesystem_read,
+	.has_fd = filesystem_has_fd,
+	.read_fd = filesystem_read_fd,
 	.write = filesystem_write,
 	.remove = remove,
 	.move = filesystem_rename,
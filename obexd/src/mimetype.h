@@ -23,6 +23,9 @@ struct obex_mime_type_driver {
 	ssize_t (*get_next_header)(void *object, void *buf, size_t mtu,
 								uint8_t *hi);
 	ssize_t (*read) (void *object, void *buf, size_t count);
+	gboolean (*has_fd) (void *object);
+	ssize_t (*read_fd) (void *object, int *fd, off_t *offset,
+							size_t count);
 	ssize_t (*write) (void *object, const void *buf, size_t count);
 	int (*flush) (void *object);
 	int (*copy) (const char *name, const char *destname);
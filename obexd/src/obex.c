@@ -381,6 +381,46 @@ static gssize send_data(void *buf, gsize size, gpointer user_data)
 	return driver_read(os, buf, size);
 }
 
+static gssize send_fd(int *fd, off_t *offset, gsize size,
+							gpointer user_data)
+{
+	struct obex_session *os = user_data;
+	gssize len;
+
+	DBG("name=%s type=%s file=%p size=%zu", os->name, os->type, os->object,
+									size);
+
+	if (os->aborted)
+		return os->err < 0 ? os->err : -EPERM;
+
+	if (os->object == NULL)
+		return -EIO;
+
+	if (os->service->progress != NULL)
+		os->service->progress(os, os->service_data);
+
+	len = os->driver->read_fd(os->object, fd, offset, size);
+	if (len < 0) {
+		error("read_fd(): %s (%zd)", strerror(-len), -len);
+		return len;
+	}
+
+	os->offset += len;
+
+	DBG("%zd read", len);
+
+	return len;
+}
+
+/* Check if the object body can be sent directly from its file */
+static gboolean driver_has_fd(struct obex_session *os)
+{
+	if (os->driver->read_fd == NULL || os->driver->has_fd == NULL)
+		return FALSE;
+
+	return os->driver->has_fd(os->object);
+}
+
 static void transfer_complete(GObex *obex, GError *err, gpointer user_data)
 {
 	struct obex_session *os = user_data;
@@ -456,8 +496,12 @@ done:
 		g_obex_packet_add_header(rsp, hdr);
 	}
 
-	g_obex_get_rsp_pkt(os->obex, rsp, send_data, transfer_complete, os,
-									NULL);
+	if (driver_has_fd(os))
+		g_obex_get_rsp_pkt_fd(os->obex, rsp, send_fd,
+						transfer_complete, os, NULL);
+	else
+		g_obex_get_rsp_pkt(os->obex, rsp, send_data,
+						transfer_complete, os, NULL);
 
 	os->headers_sent = TRUE;
 
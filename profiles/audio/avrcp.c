@@ -222,7 +222,7 @@ struct pending_pdu {
 };
 
 struct pending_list_items {
-	GSList *items;
+	GPtrArray *items;
 	uint32_t start;
 	uint32_t end;
 	uint64_t total;
@@ -2664,12 +2664,12 @@ static gboolean avrcp_list_items_rsp(struct avctp *conn, uint8_t *operands,
 			item = parse_media_folder(session, &operands[i], len);
 
 		if (item)
-			p->items = g_slist_append(p->items, item);
+			g_ptr_array_add(p->items, item);
 
 		i += len;
 	}
 
-	items = g_slist_length(p->items);
+	items = p->items->len;
 
 	DBG("start %u end %u items %" PRIu64 " total %" PRIu64 "", p->start,
 						p->end, items, p->total);
@@ -2682,7 +2682,7 @@ static gboolean avrcp_list_items_rsp(struct avctp *conn, uint8_t *operands,
 done:
 	media_player_list_complete(player->user_data, p->items, err);
 
-	g_slist_free(p->items);
+	g_ptr_array_free(p->items, TRUE);
 	g_free(p);
 	player->p = NULL;
 
@@ -3169,6 +3169,7 @@ static int ct_list_items(struct media_player *mp, const char *name,
 	avrcp_list_items(session, start, end);
 
 	p = g_new0(struct pending_list_items, 1);
+	p->items = g_ptr_array_new();
 	p->start = start;
 	p->end = end;
 	p->total = (uint64_t) (p->end - p->start) + 1;
@@ -3837,8 +3838,13 @@ static void avrcp_addressed_player_changed(struct avrcp *session,
 static void avrcp_uids_changed(struct avrcp *session, struct avrcp_header *pdu)
 {
 	struct avrcp_player *player = session->controller->player;
+	uint16_t uid_counter = get_be16(&pdu->params[1]);
 
-	player->uid_counter = get_be16(&pdu->params[1]);
+	/* Cached listings refer to the previous UIDs */
+	if (player->uid_counter != uid_counter)
+		media_player_flush_items(player->user_data);
+
+	player->uid_counter = uid_counter;
 }
 
 static gboolean avrcp_handle_event(struct avctp *conn, uint8_t code,
@@ -0,0 +1,253 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <glib.h>
+
+#include "item-cache.h"
+
+/*
+ * Folder items are kept in fixed size pages indexed by page number, so any
+ * index is found in constant time no matter how large the folder is. Only
+ * max_pages pages are resident at a time: the least recently used page is
+ * evicted once a new page is needed.
+ *
+ * Every slot holds a reference on its item, taken with the ref callback when
+ * the item is stored and dropped with unref when the slot is overwritten or
+ * its page is evicted or flushed. The same item may sit at several indexes,
+ * so the owner must only release it once the last reference is gone.
+ */
+
+struct cache_page {
+	uint32_t number;
+	unsigned int count;
+	GList link;
+	void *items[];
+};
+
+struct item_cache {
+	unsigned int page_size;
+	unsigned int max_pages;
+	GHashTable *pages;
+	GQueue lru;
+	item_cache_ref_func_t ref;
+	item_cache_ref_func_t unref;
+	void *user_data;
+};
+
+struct item_cache *item_cache_new(unsigned int page_size,
+					unsigned int max_pages,
+					item_cache_ref_func_t ref,
+					item_cache_ref_func_t unref,
+					void *user_data)
+{
+	struct item_cache *cache;
+
+	if (!page_size || !max_pages)
+		return NULL;
+
+	cache = g_new0(struct item_cache, 1);
+	cache->page_size = page_size;
+	cache->max_pages = max_pages;
+	cache->pages = g_hash_table_new(NULL, NULL);
+	cache->ref = ref;
+	cache->unref = unref;
+	cache->user_data = user_data;
+	g_queue_init(&cache->lru);
+
+	return cache;
+}
+
+static void page_free(struct item_cache *cache, struct cache_page *page)
+{
+	unsigned int i;
+
+	g_hash_table_remove(cache->pages, GUINT_TO_POINTER(page->number));
+	g_queue_unlink(&cache->lru, &page->link);
+
+	for (i = 0; i < cache->page_size && page->count; i++) {
+		if (!page->items[i])
+			continue;
+
+		page->count--;
+
+		if (cache->unref)
+			cache->unref(page->items[i], cache->user_data);
+	}
+
+	g_free(page);
+}
+
+void item_cache_flush(struct item_cache *cache)
+{
+	GList *link;
+
+	if (!cache)
+		return;
+
+	while ((link = g_queue_peek_tail_link(&cache->lru)))
+		page_free(cache, link->data);
+}
+
+void item_cache_free(struct item_cache *cache)
+{
+	if (!cache)
+		return;
+
+	item_cache_flush(cache);
+	g_hash_table_destroy(cache->pages);
+	g_free(cache);
+}
+
+static struct cache_page *page_lookup(struct item_cache *cache,
+							uint32_t number)
+{
+	struct cache_page *page;
+
+	page = g_hash_table_lookup(cache->pages, GUINT_TO_POINTER(number));
+	if (!page)
+		return NULL;
+
+	/* Move to the front of the LRU list */
+	if (cache->lru.head != &page->link) {
+		g_queue_unlink(&cache->lru, &page->link);
+		g_queue_push_head_link(&cache->lru, &page->link);
+	}
+
+	return page;
+}
+
+static struct cache_page *page_new(struct item_cache *cache, uint32_t number)
+{
+	struct cache_page *page;
+
+	if (g_queue_get_length(&cache->lru) >= cache->max_pages)
+		page_free(cache, g_queue_peek_tail(&cache->lru));
+
+	page = g_malloc0(sizeof(*page) + cache->page_size * sizeof(void *));
+	page->number = number;
+	page->link.data = page;
+
+	g_hash_table_insert(cache->pages, GUINT_TO_POINTER(number), page);
+	g_queue_push_head_link(&cache->lru, &page->link);
+
+	return page;
+}
+
+bool item_cache_set(struct item_cache *cache, uint32_t index, void *item)
+{
+	struct cache_page *page;
+	uint32_t number;
+	unsigned int offset;
+
+	if (!cache || !item)
+		return false;
+
+	number = index / cache->page_size;
+	offset = index % cache->page_size;
+
+	page = page_lookup(cache, number);
+	if (!page)
+		page = page_new(cache, number);
+
+	if (page->items[offset] == item)
+		return true;
+
+	if (cache->ref)
+		cache->ref(item, cache->user_data);
+
+	if (page->items[offset]) {
+		if (cache->unref)
+			cache->unref(page->items[offset], cache->user_data);
+	} else
+		page->count++;
+
+	page->items[offset] = item;
+
+	return true;
+}
+
+void *item_cache_get(struct item_cache *cache, uint32_t index)
+{
+	struct cache_page *page;
+
+	if (!cache)
+		return NULL;
+
+	page = page_lookup(cache, index / cache->page_size);
+	if (!page)
+		return NULL;
+
+	return page->items[index % cache->page_size];
+}
+
+bool item_cache_contains(struct item_cache *cache, uint32_t start,
+							uint32_t end)
+{
+	uint32_t i;
+
+	if (!cache || end < start)
+		return false;
+
+	/* A range that doesn't fit can't be resident all at once */
+	if ((uint64_t) end - start >=
+			(uint64_t) cache->page_size * cache->max_pages)
+		return false;
+
+	for (i = start; ; i++) {
+		if (!item_cache_get(cache, i))
+			return false;
+
+		if (i == end)
+			break;
+	}
+
+	return true;
+}
+
+bool item_cache_next_page(struct item_cache *cache, uint32_t index,
+					uint32_t total, uint32_t *start,
+					uint32_t *end)
+{
+	uint64_t first, last;
+
+	if (!cache)
+		return false;
+
+	/* First page after the one holding index */
+	first = ((uint64_t) index / cache->page_size + 1) * cache->page_size;
+	if (first >= total)
+		return false;
+
+	if (g_hash_table_lookup(cache->pages,
+			GUINT_TO_POINTER(first / cache->page_size)))
+		return false;
+
+	last = first + cache->page_size - 1;
+	if (last >= total)
+		last = total - 1;
+
+	*start = first;
+	*end = last;
+
+	return true;
+}
+
+unsigned int item_cache_get_num_pages(struct item_cache *cache)
+{
+	if (!cache)
+		return 0;
+
+	return g_queue_get_length(&cache->lru);
+}
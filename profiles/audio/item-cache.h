@@ -0,0 +1,27 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+struct item_cache;
+
+typedef void (*item_cache_ref_func_t)(void *item, void *user_data);
+
+struct item_cache *item_cache_new(unsigned int page_size,
+					unsigned int max_pages,
+					item_cache_ref_func_t ref,
+					item_cache_ref_func_t unref,
+					void *user_data);
+void item_cache_free(struct item_cache *cache);
+void item_cache_flush(struct item_cache *cache);
+bool item_cache_set(struct item_cache *cache, uint32_t index, void *item);
+void *item_cache_get(struct item_cache *cache, uint32_t index);
+bool item_cache_contains(struct item_cache *cache, uint32_t start,
+							uint32_t end);
+bool item_cache_next_page(struct item_cache *cache, uint32_t index,
+					uint32_t total, uint32_t *start,
+					uint32_t *end);
+unsigned int item_cache_get_num_pages(struct item_cache *cache);
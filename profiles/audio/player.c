@@ -32,11 +32,16 @@
 #include "src/error.h"
 
 #include "player.h"
+#include "item-cache.h"
 
 #define MEDIA_PLAYER_INTERFACE "org.bluez.MediaPlayer1"
 #define MEDIA_FOLDER_INTERFACE "org.bluez.MediaFolder1"
 #define MEDIA_ITEM_INTERFACE "org.bluez.MediaItem1"
 
+/* Listed items are cached in pages, at most 2048 items per folder */
+#define FOLDER_CACHE_PAGE_SIZE	64
+#define FOLDER_CACHE_MAX_PAGES	32
+
 struct player_callback {
 	const struct media_player_callback *cbs;
 	void *user_data;
@@ -57,6 +62,7 @@ struct media_item {
 	bool			playable;	/* Item playable flag */
 	uint64_t		uid;		/* Item uid */
 	GHashTable		*metadata;	/* Item metadata */
+	unsigned int		refs;		/* Cache slots and listings */
 };
 
 struct media_folder {
@@ -64,7 +70,13 @@ struct media_folder {
 	struct media_item	*item;		/* Folder item */
 	uint32_t		number_of_items;/* Number of items */
 	GSList			*subfolders;
-	GSList			*items;
+	GHashTable		*items;		/* Items owned by folder */
+	GHashTable		*uids;		/* Items by uid */
+	struct item_cache	*cache;		/* Listed items, referenced */
+	uint32_t		start;		/* Pending ListItems range */
+	uint32_t		end;
+	uint32_t		fetch_start;	/* Start of list_items request */
+	bool			prefetch;	/* Prefetching next page */
 	DBusMessage		*msg;
 };
 
@@ -635,22 +647,15 @@ static void parse_folder_list(gpointer data, gpointer user_data)
 	dbus_message_iter_close_container(array, &entry);
 }
 
-void media_player_list_complete(struct media_player *mp, GSList *items,
-								int err)
+static struct media_folder *media_folder_new(struct media_item *item);
+static void media_folder_unref_item(void *data, void *user_data);
+
+static DBusMessage *list_items_reply(DBusMessage *msg, GPtrArray *items)
 {
-	struct media_folder *folder = mp->scope;
 	DBusMessage *reply;
 	DBusMessageIter iter, array;
 
-	if (folder == NULL || folder->msg == NULL)
-		return;
-
-	if (err < 0) {
-		reply = btd_error_failed(folder->msg, strerror(-err));
-		goto done;
-	}
-
-	reply = dbus_message_new_method_return(folder->msg);
+	reply = dbus_message_new_method_return(msg);
 
 	dbus_message_iter_init_append(reply, &iter);
 
@@ -665,13 +670,143 @@ void media_player_list_complete(struct media_player *mp, GSList *items,
 					DBUS_DICT_ENTRY_END_CHAR_AS_STRING,
 					&array);
 
-	g_slist_foreach(items, parse_folder_list, &array);
+	if (items)
+		g_ptr_array_foreach(items, parse_folder_list, &array);
+
 	dbus_message_iter_close_container(&iter, &array);
 
+	return reply;
+}
+
+static uint32_t folder_last_index(struct media_folder *folder, uint32_t end)
+{
+	if (folder->number_of_items && end >= folder->number_of_items)
+		return folder->number_of_items - 1;
+
+	return end;
+}
+
+static DBusMessage *folder_cached_reply(struct media_folder *folder,
+					DBusMessage *msg, uint32_t start,
+					uint32_t end)
+{
+	DBusMessage *reply;
+	GPtrArray *items;
+	uint32_t i;
+
+	end = folder_last_index(folder, end);
+
+	if (!item_cache_contains(folder->cache, start, end))
+		return NULL;
+
+	items = g_ptr_array_sized_new(end - start + 1);
+
+	for (i = 0; i <= end - start; i++)
+		g_ptr_array_add(items, item_cache_get(folder->cache, start + i));
+
+	DBG("%u-%u from cache", start, end);
+
+	reply = list_items_reply(msg, items);
+	g_ptr_array_free(items, TRUE);
+
+	return reply;
+}
+
+static int folder_fetch(struct media_player *mp, struct media_folder *folder,
+						uint32_t start, uint32_t end)
+{
+	struct player_callback *cb = mp->cb;
+	int err;
+
+	err = cb->cbs->list_items(mp, folder->item->name, start, end,
+							cb->user_data);
+	if (err < 0)
+		return err;
+
+	folder->fetch_start = start;
+
+	return 0;
+}
+
+static void folder_prefetch(struct media_player *mp,
+				struct media_folder *folder, uint32_t index)
+{
+	uint32_t start, end;
+
+	if (!folder->number_of_items)
+		return;
+
+	if (!item_cache_next_page(folder->cache, index,
+					folder->number_of_items, &start, &end))
+		return;
+
+	if (folder_fetch(mp, folder, start, end) < 0)
+		return;
+
+	DBG("prefetch %u-%u", start, end);
+
+	folder->prefetch = true;
+}
+
+void media_player_list_complete(struct media_player *mp, GPtrArray *items,
+								int err)
+{
+	struct media_folder *folder = mp->scope;
+	DBusMessage *reply = NULL;
+	bool prefetch;
+	guint i;
+
+	if (folder == NULL)
+		return;
+
+	if (folder->msg == NULL && !folder->prefetch)
+		goto unref;
+
+	prefetch = folder->prefetch;
+	folder->prefetch = false;
+
+	if (!prefetch) {
+		if (err < 0)
+			reply = btd_error_failed(folder->msg, strerror(-err));
+		else
+			reply = list_items_reply(folder->msg, items);
+	}
+
+	for (i = 0; err == 0 && items && i < items->len; i++)
+		item_cache_set(folder->cache, folder->fetch_start + i,
+							items->pdata[i]);
+
+	/* ListItems received while prefetching */
+	if (prefetch && folder->msg) {
+		reply = folder_cached_reply(folder, folder->msg, folder->start,
+								folder->end);
+		if (reply)
+			goto done;
+
+		err = folder_fetch(mp, folder, folder->start, folder->end);
+		if (err == 0)
+			goto unref;
+
+		reply = btd_error_failed(folder->msg, strerror(-err));
+		goto done;
+	}
+
+	if (reply == NULL)
+		goto unref;
+
 done:
 	g_dbus_send_message(btd_get_dbus_connection(), reply);
 	dbus_message_unref(folder->msg);
 	folder->msg = NULL;
+
+	if (err == 0 && items && items->len)
+		folder_prefetch(mp, folder, folder->fetch_start +
+							items->len - 1);
+
+unref:
+	/* Release the listing, items no page kept are dropped */
+	for (i = 0; items && i < items->len; i++)
+		media_folder_unref_item(items->pdata[i], folder);
 }
 
 static struct media_item *
@@ -708,8 +843,8 @@ void media_player_search_complete(struct media_player *mp, int ret)
 	}
 
 	if (search == NULL) {
-		search = g_new0(struct media_folder, 1);
-		search->item = media_player_create_subfolder(mp, "search", 0);
+		search = media_folder_new(media_player_create_subfolder(mp,
+								"search", 0));
 		mp->search = search;
 		mp->folders = g_slist_prepend(mp->folders, search);
 	}
@@ -736,6 +871,7 @@ void media_player_total_items_complete(struct media_player *mp,
 
 	if (folder->number_of_items != num_of_items) {
 		folder->number_of_items = num_of_items;
+		item_cache_flush(folder->cache);
 
 		g_dbus_emit_property_changed(btd_get_dbus_connection(),
 				mp->path, MEDIA_FOLDER_INTERFACE,
@@ -873,6 +1009,7 @@ static DBusMessage *media_folder_list_items(DBusConnection *conn,
 	struct media_player *mp = data;
 	struct media_folder *folder = mp->scope;
 	struct player_callback *cb = mp->cb;
+	DBusMessage *reply;
 	DBusMessageIter iter;
 	uint32_t start, end;
 	int err;
@@ -888,12 +1025,20 @@ static DBusMessage *media_folder_list_items(DBusConnection *conn,
 	if (folder->msg != NULL)
 		return btd_error_failed(msg, strerror(EBUSY));
 
-	err = cb->cbs->list_items(mp, folder->item->name, start, end,
-							cb->user_data);
-	if (err < 0)
-		return btd_error_failed(msg, strerror(-err));
+	reply = folder_cached_reply(folder, msg, start, end);
+	if (reply)
+		return reply;
+
+	/* Wait for the prefetch, it may well cover the range */
+	if (!folder->prefetch) {
+		err = folder_fetch(mp, folder, start, end);
+		if (err < 0)
+			return btd_error_failed(msg, strerror(-err));
+	}
 
 	folder->msg = dbus_message_ref(msg);
+	folder->start = start;
+	folder->end = end;
 
 	return NULL;
 }
@@ -920,12 +1065,79 @@ static void media_item_destroy(void *data)
 	media_item_free(item);
 }
 
+static void media_folder_remove_item(struct media_folder *folder,
+						struct media_item *item)
+{
+	if (item->uid && g_hash_table_lookup(folder->uids, &item->uid) == item)
+		g_hash_table_remove(folder->uids, &item->uid);
+
+	g_hash_table_remove(folder->items, item);
+}
+
+/*
+ * Folder items are owned by their folder object, only listed items are
+ * released once no cache slot or pending listing references them.
+ */
+static void media_folder_ref_item(void *data, void *user_data)
+{
+	struct media_item *item = data;
+
+	if (item->type == PLAYER_ITEM_TYPE_FOLDER)
+		return;
+
+	item->refs++;
+}
+
+static void media_folder_unref_item(void *data, void *user_data)
+{
+	struct media_folder *folder = user_data;
+	struct media_item *item = data;
+
+	if (item->type == PLAYER_ITEM_TYPE_FOLDER)
+		return;
+
+	if (--item->refs)
+		return;
+
+	/* Keep the current track object around */
+	if (item->metadata == item->player->track)
+		return;
+
+	media_folder_remove_item(folder, item);
+}
+
+static void media_folder_clear_items(struct media_folder *folder)
+{
+	item_cache_flush(folder->cache);
+	g_hash_table_remove_all(folder->uids);
+	g_hash_table_remove_all(folder->items);
+}
+
+static struct media_folder *media_folder_new(struct media_item *item)
+{
+	struct media_folder *folder;
+
+	folder = g_new0(struct media_folder, 1);
+	folder->item = item;
+	folder->items = g_hash_table_new_full(NULL, NULL, NULL,
+							media_item_destroy);
+	folder->uids = g_hash_table_new(g_int64_hash, g_int64_equal);
+	folder->cache = item_cache_new(FOLDER_CACHE_PAGE_SIZE,
+					FOLDER_CACHE_MAX_PAGES,
+					media_folder_ref_item,
+					media_folder_unref_item, folder);
+
+	return folder;
+}
+
 static void media_folder_destroy(void *data)
 {
 	struct media_folder *folder = data;
 
+	item_cache_free(folder->cache);
 	g_slist_free_full(folder->subfolders, media_folder_destroy);
-	g_slist_free_full(folder->items, media_item_destroy);
+	g_hash_table_destroy(folder->uids);
+	g_hash_table_destroy(folder->items);
 
 	if (folder->msg != NULL)
 		dbus_message_unref(folder->msg);
@@ -956,8 +1168,7 @@ static void media_player_change_scope(struct media_player *mp,
 		goto done;
 
 cleanup:
-	g_slist_free_full(mp->scope->items, media_item_destroy);
-	mp->scope->items = NULL;
+	media_folder_clear_items(mp->scope);
 
 	/* Destroy search folder if it exists and is not being set as scope */
 	if (mp->search != NULL && folder != mp->search) {
@@ -967,6 +1178,8 @@ cleanup:
 	}
 
 done:
+	/* A pending prefetch will complete on the new scope, drop it */
+	mp->scope->prefetch = false;
 	mp->scope = folder;
 
 	if (cb->cbs->total_items) {
@@ -1400,6 +1613,16 @@ static gboolean remove_metadata(void *key, void *value, void *user_data)
 	return strcmp(key, "Item") ? TRUE : FALSE;
 }
 
+void media_player_flush_items(struct media_player *mp)
+{
+	if (mp->scope == NULL)
+		return;
+
+	DBG("%s", mp->scope->item->name);
+
+	item_cache_flush(mp->scope->cache);
+}
+
 void media_player_clear_metadata(struct media_player *mp)
 {
 	if (!mp)
@@ -1563,19 +1786,10 @@ void media_player_set_playlist(struct media_player *mp, const char *name)
 static struct media_item *media_folder_find_item(struct media_folder *folder,
 								uint64_t uid)
 {
-	GSList *l;
-
 	if (uid == 0)
 		return NULL;
 
-	for (l = folder->items; l; l = l->next) {
-		struct media_item *item = l->data;
-
-		if (item->uid == uid)
-			return item;
-	}
-
-	return NULL;
+	return g_hash_table_lookup(folder->uids, &uid);
 }
 
 static DBusMessage *media_item_play(DBusConnection *conn, DBusMessage *msg,
@@ -1884,7 +2098,11 @@ static struct media_item *media_folder_create_item(struct media_player *mp,
 	}
 
 	if (type != PLAYER_ITEM_TYPE_FOLDER) {
-		folder->items = g_slist_prepend(folder->items, item);
+		g_hash_table_insert(folder->items, item, item);
+
+		if (uid)
+			g_hash_table_insert(folder->uids, &item->uid, item);
+
 		item->metadata = g_hash_table_new_full(g_str_hash, g_str_equal,
 							g_free, g_free);
 	}
@@ -1894,12 +2112,22 @@ static struct media_item *media_folder_create_item(struct media_player *mp,
 	return item;
 }
 
+/*
+ * Items are created for a listing and stay referenced until it is passed to
+ * media_player_list_complete.
+ */
 struct media_item *media_player_create_item(struct media_player *mp,
 						const char *name,
 						player_item_type_t type,
 						uint64_t uid)
 {
-	return media_folder_create_item(mp, mp->scope, name, type, uid);
+	struct media_item *item;
+
+	item = media_folder_create_item(mp, mp->scope, name, type, uid);
+	if (item)
+		media_folder_ref_item(item, mp->scope);
+
+	return item;
 }
 
 struct media_item *media_player_create_folder(struct media_player *mp,
@@ -1927,8 +2155,7 @@ struct media_item *media_player_create_folder(struct media_player *mp,
 	if (item == NULL)
 		return NULL;
 
-	folder = g_new0(struct media_folder, 1);
-	folder->item = item;
+	folder = media_folder_new(item);
 
 	item->folder_type = type;
 
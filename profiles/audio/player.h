@@ -71,6 +71,7 @@ void media_player_set_setting(struct media_player *mp, const char *key,
 const char *media_player_get_status(struct media_player *mp);
 void media_player_set_status(struct media_player *mp, const char *status);
 void media_player_clear_metadata(struct media_player *mp);
+void media_player_flush_items(struct media_player *mp);
 void media_player_set_metadata(struct media_player *mp,
 				struct media_item *item, const char *key,
 				void *data, size_t len);
@@ -98,7 +99,7 @@ struct media_item *media_player_create_item(struct media_player *mp,
 
 void media_player_play_item_complete(struct media_player *mp, int err);
 void media_item_set_playable(struct media_item *item, bool value);
-void media_player_list_complete(struct media_player *mp, GSList *items,
+void media_player_list_complete(struct media_player *mp, GPtrArray *items,
 								int err);
 void media_player_change_folder_complete(struct media_player *player,
 						const char *path, uint64_t uid,
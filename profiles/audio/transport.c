@@ -15,6 +15,8 @@
 
 #define _GNU_SOURCE
 #include <errno.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
 
 #include <glib.h>
 
@@ -30,8 +32,11 @@
 
 #include "src/log.h"
 #include "src/error.h"
+#include "src/btd.h"
 #include "src/shared/queue.h"
+#include "src/shared/timeout.h"
 
+#include "a2dp-codecs.h"
 #include "avdtp.h"
 #include "media.h"
 #include "transport.h"
@@ -42,6 +47,9 @@
 
 #define MEDIA_TRANSPORT_INTERFACE "org.bluez.MediaTransport1"
 
+#define STATS_INTERVAL		100		/* msec */
+#define DEFAULT_BITRATE		512000		/* bit/s, covers aptX HD */
+
 typedef enum {
 	TRANSPORT_STATE_IDLE,		/* Not acquired and suspended */
 	TRANSPORT_STATE_PENDING,	/* Playing but not acquired */
@@ -70,10 +78,24 @@ struct media_owner {
 	guint			watch;
 };
 
+/* Send queue occupancy of an outgoing stream, sampled while active */
+struct a2dp_stats {
+	unsigned int		timer;
+	uint32_t		samples;
+	uint32_t		queued;		/* Bytes, last sample */
+	uint32_t		queued_max;
+	uint64_t		queued_sum;
+	uint32_t		full;		/* Samples with no room left */
+	uint32_t		empty;		/* Samples with nothing queued */
+	uint32_t		sndbuf;
+};
+
 struct a2dp_transport {
 	struct avdtp		*session;
 	uint16_t		delay;
 	int8_t			volume;
+	unsigned int		bitrate;
+	struct a2dp_stats	stats;
 };
 
 struct media_transport {
@@ -134,6 +156,181 @@ static gboolean state_in_use(transport_state_t state)
 	return FALSE;
 }
 
+static unsigned int sbc_bitrate(const a2dp_sbc_t *sbc)
+{
+	unsigned int freq, blocks, subbands, channels, len;
+
+	switch (sbc->frequency) {
+	case SBC_SAMPLING_FREQ_16000:
+		freq = 16000;
+		break;
+	case SBC_SAMPLING_FREQ_32000:
+		freq = 32000;
+		break;
+	case SBC_SAMPLING_FREQ_44100:
+		freq = 44100;
+		break;
+	case SBC_SAMPLING_FREQ_48000:
+		freq = 48000;
+		break;
+	default:
+		return 0;
+	}
+
+	switch (sbc->block_length) {
+	case SBC_BLOCK_LENGTH_4:
+		blocks = 4;
+		break;
+	case SBC_BLOCK_LENGTH_8:
+		blocks = 8;
+		break;
+	case SBC_BLOCK_LENGTH_12:
+		blocks = 12;
+		break;
+	case SBC_BLOCK_LENGTH_16:
+		blocks = 16;
+		break;
+	default:
+		return 0;
+	}
+
+	subbands = sbc->subbands == SBC_SUBBANDS_4 ? 4 : 8;
+	channels = sbc->channel_mode == SBC_CHANNEL_MODE_MONO ? 1 : 2;
+
+	/* Frame length at the highest bitpool the stream may use */
+	len = 4 + (4 * subbands * channels) / 8;
+
+	switch (sbc->channel_mode) {
+	case SBC_CHANNEL_MODE_MONO:
+	case SBC_CHANNEL_MODE_DUAL_CHANNEL:
+		len += (blocks * channels * sbc->max_bitpool + 7) / 8;
+		break;
+	case SBC_CHANNEL_MODE_JOINT_STEREO:
+		len += (subbands + blocks * sbc->max_bitpool + 7) / 8;
+		break;
+	default:
+		len += (blocks * sbc->max_bitpool + 7) / 8;
+		break;
+	}
+
+	return len * 8 * freq / (subbands * blocks);
+}
+
+static unsigned int transport_get_bitrate(struct media_transport *transport)
+{
+	uint8_t codec = media_endpoint_get_codec(transport->endpoint);
+	unsigned int bitrate = 0;
+
+	switch (codec) {
+	case A2DP_CODEC_SBC:
+		if (transport->size >= (int) sizeof(a2dp_sbc_t))
+			bitrate = sbc_bitrate((void *) transport->configuration);
+		break;
+	case A2DP_CODEC_MPEG24:
+		if (transport->size >= (int) sizeof(a2dp_aac_t)) {
+			a2dp_aac_t *aac = (void *) transport->configuration;
+
+			bitrate = AAC_GET_BITRATE(*aac);
+		}
+		break;
+	}
+
+	return bitrate ? bitrate : DEFAULT_BITRATE;
+}
+
+/* Only outgoing streams queue data on the local side */
+static bool transport_is_source(struct media_transport *transport)
+{
+	return transport->sink_watch != 0;
+}
+
+static void transport_update_send_buffer(struct media_transport *transport)
+{
+	struct a2dp_transport *a2dp = transport->data;
+	uint16_t latency = btd_opts.avdtp.stream_latency;
+	int size;
+
+	if (!transport_is_source(transport) || transport->fd < 0)
+		return;
+
+	a2dp->bitrate = transport_get_bitrate(transport);
+
+	if (!latency)
+		return;
+
+	/*
+	 * Hold no more than the configured latency of audio, but never less
+	 * than the two packets avdtp.c guarantees.
+	 */
+	size = MAX(a2dp->bitrate / 8 * latency / 1000,
+					transport->omtu * 2u);
+
+	if (setsockopt(transport->fd, SOL_SOCKET, SO_SNDBUF, &size,
+							sizeof(size)) < 0) {
+		error("setsockopt(SO_SNDBUF) failed: %s (%d)",
+						strerror(errno), errno);
+		return;
+	}
+
+	DBG("%s: %u bit/s, %u ms, send buffer %d", transport->path,
+					a2dp->bitrate, latency, size);
+}
+
+static bool sample_queue(void *user_data)
+{
+	struct media_transport *transport = user_data;
+	struct a2dp_transport *a2dp = transport->data;
+	struct a2dp_stats *stats = &a2dp->stats;
+	socklen_t len = sizeof(int);
+	int sndbuf, avail;
+
+	/* The ioctl reports free space, not queued bytes, on L2CAP */
+	if (getsockopt(transport->fd, SOL_SOCKET, SO_SNDBUF, &sndbuf,
+								&len) < 0 ||
+			ioctl(transport->fd, TIOCOUTQ, &avail) < 0) {
+		stats->timer = 0;
+		return false;
+	}
+
+	stats->sndbuf = sndbuf;
+	stats->queued = sndbuf > avail ? sndbuf - avail : 0;
+	stats->queued_sum += stats->queued;
+	stats->queued_max = MAX(stats->queued_max, stats->queued);
+	stats->samples++;
+
+	if (!stats->queued)
+		stats->empty++;
+	else if (avail < transport->omtu)
+		stats->full++;
+
+	return true;
+}
+
+static void stats_start(struct media_transport *transport)
+{
+	struct a2dp_transport *a2dp = transport->data;
+	struct a2dp_stats *stats = &a2dp->stats;
+
+	if (!transport_is_source(transport) || transport->fd < 0 ||
+								stats->timer)
+		return;
+
+	memset(stats, 0, sizeof(*stats));
+	stats->timer = timeout_add(STATS_INTERVAL, sample_queue, transport,
+									NULL);
+}
+
+static void stats_stop(struct media_transport *transport)
+{
+	struct a2dp_transport *a2dp = transport->data;
+
+	if (!a2dp || !a2dp->stats.timer)
+		return;
+
+	timeout_remove(a2dp->stats.timer);
+	a2dp->stats.timer = 0;
+}
+
 static void transport_set_state(struct media_transport *transport,
 							transport_state_t state)
 {
@@ -148,6 +345,11 @@ static void transport_set_state(struct media_transport *transport,
 	DBG("State changed %s: %s -> %s", transport->path, str_state[old_state],
 							str_state[state]);
 
+	if (state == TRANSPORT_STATE_ACTIVE)
+		stats_start(transport);
+	else if (old_state == TRANSPORT_STATE_ACTIVE)
+		stats_stop(transport);
+
 	str = state2str(state);
 
 	if (g_strcmp0(str, state2str(old_state)) != 0)
@@ -269,6 +471,8 @@ static gboolean media_transport_set_fd(struct media_transport *transport,
 
 	info("%s: fd(%d) ready", transport->path, fd);
 
+	transport_update_send_buffer(transport);
+
 	return TRUE;
 }
 
@@ -535,6 +739,59 @@ static DBusMessage *release(DBusConnection *conn, DBusMessage *msg,
 	return NULL;
 }
 
+static DBusMessage *get_statistics(DBusConnection *conn, DBusMessage *msg,
+								void *data)
+{
+	struct media_transport *transport = data;
+	struct a2dp_transport *a2dp = transport->data;
+	struct a2dp_stats *stats = &a2dp->stats;
+	DBusMessage *reply;
+	DBusMessageIter iter, dict;
+	uint32_t avg = 0;
+	uint16_t latency = 0;
+
+	if (!transport_is_source(transport))
+		return btd_error_not_supported(msg);
+
+	reply = dbus_message_new_method_return(msg);
+	if (!reply)
+		return NULL;
+
+	if (stats->samples)
+		avg = stats->queued_sum / stats->samples;
+
+	/* Socket accounting doubles the payload, see socket(7) SO_SNDBUF */
+	if (a2dp->bitrate)
+		latency = (uint64_t) stats->queued / 2 * 8 * 1000 /
+								a2dp->bitrate;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+					DBUS_TYPE_STRING_AS_STRING
+					DBUS_TYPE_VARIANT_AS_STRING
+					DBUS_DICT_ENTRY_END_CHAR_AS_STRING,
+					&dict);
+
+	dict_append_entry(&dict, "Samples", DBUS_TYPE_UINT32,
+							&stats->samples);
+	dict_append_entry(&dict, "SendBuffer", DBUS_TYPE_UINT32,
+							&stats->sndbuf);
+	dict_append_entry(&dict, "Queued", DBUS_TYPE_UINT32, &stats->queued);
+	dict_append_entry(&dict, "QueuedMax", DBUS_TYPE_UINT32,
+							&stats->queued_max);
+	dict_append_entry(&dict, "QueuedAverage", DBUS_TYPE_UINT32, &avg);
+	dict_append_entry(&dict, "QueueFull", DBUS_TYPE_UINT32, &stats->full);
+	dict_append_entry(&dict, "QueueEmpty", DBUS_TYPE_UINT32,
+							&stats->empty);
+	dict_append_entry(&dict, "Bitrate", DBUS_TYPE_UINT32, &a2dp->bitrate);
+	dict_append_entry(&dict, "Latency", DBUS_TYPE_UINT16, &latency);
+
+	dbus_message_iter_close_container(&iter, &dict);
+
+	return reply;
+}
+
 static gboolean get_device(const GDBusPropertyTable *property,
 					DBusMessageIter *iter, void *data)
 {
@@ -706,6 +963,9 @@ static const GDBusMethodTable transport_methods[] = {
 							{ "mtu_w", "q" }),
 			try_acquire) },
 	{ GDBUS_ASYNC_METHOD("Release", NULL, NULL, release) },
+	{ GDBUS_EXPERIMENTAL_METHOD("GetStatistics", NULL,
+			GDBUS_ARGS({ "statistics", "a{sv}" }),
+			get_statistics) },
 	{ },
 };
 
@@ -741,6 +1001,8 @@ static void media_transport_free(void *data)
 	if (transport->owner)
 		media_transport_remove_owner(transport);
 
+	stats_stop(transport);
+
 	if (transport->destroy != NULL)
 		transport->destroy(transport->data);
 
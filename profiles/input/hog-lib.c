@@ -24,6 +24,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <time.h>
 
 #include <glib.h>
 
@@ -67,6 +68,7 @@
 #define HOG_REPORT_MAP_MAX_SIZE        512
 #define HID_INFO_SIZE			4
 #define ATT_NOTIFICATION_HEADER_SIZE	3
+#define HOG_INPUT_STATS_INTERVAL	1000
 
 struct bt_hog {
 	int			ref_count;
@@ -101,6 +103,8 @@ struct bt_hog {
 	struct gatt_db		*gatt_db;
 	struct gatt_db_attribute	*report_map_attr;
 	struct queue		*input;
+	unsigned int		notify_id;
+	struct bt_hog_input_stats	input_stats;
 };
 
 struct report_map {
@@ -117,7 +121,7 @@ struct report {
 	uint16_t		value_handle;
 	uint8_t			properties;
 	uint16_t		ccc_handle;
-	guint			notifyid;
+	bool			notify;
 	uint16_t		len;
 	uint8_t			*value;
 };
@@ -328,21 +332,12 @@ static void find_included(struct bt_hog *hog, GAttrib *attrib,
 	}
 }
 
-static void report_value_cb(const guint8 *pdu, guint16 len, gpointer user_data)
+static void report_value_queue(struct report *report, const uint8_t *pdu,
+								uint16_t len)
 {
-	struct report *report = user_data;
 	struct bt_hog *hog = report->hog;
 	struct uhid_event ev;
 	uint8_t *buf;
-	int err;
-
-	if (len < ATT_NOTIFICATION_HEADER_SIZE) {
-		error("Malformed ATT notification");
-		return;
-	}
-
-	pdu += ATT_NOTIFICATION_HEADER_SIZE;
-	len -= ATT_NOTIFICATION_HEADER_SIZE;
 
 	memset(&ev, 0, sizeof(ev));
 	ev.type = UHID_INPUT;
@@ -359,18 +354,120 @@ static void report_value_cb(const guint8 *pdu, guint16 len, gpointer user_data)
 		ev.u.input.size = len;
 	}
 
+	if (!hog->input)
+		hog->input = queue_new();
+
+	queue_push_tail(hog->input, util_memdup(&ev, sizeof(ev)));
+}
+
+static uint64_t input_time_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static void input_stats_update(struct bt_hog *hog, uint64_t start, int err)
+{
+	struct bt_hog_input_stats *stats = &hog->input_stats;
+	uint32_t latency;
+
+	if (err < 0) {
+		stats->errors++;
+		return;
+	}
+
+	latency = input_time_usec() - start;
+
+	stats->reports++;
+	stats->total_usec += latency;
+	if (latency > stats->max_usec)
+		stats->max_usec = latency;
+
+	if (stats->reports % HOG_INPUT_STATS_INTERVAL)
+		return;
+
+	DBG("Input reports %" PRIu64 " errors %" PRIu64 " latency avg %"
+			PRIu64 " us max %u us", stats->reports, stats->errors,
+			stats->total_usec / stats->reports, stats->max_usec);
+}
+
+/*
+ * Notifications are taken directly from bt_att, without going through
+ * GAttrib, so the PDU is not copied and the UHID event is written with only
+ * the bytes the report actually uses.
+ */
+static void report_value_cb(struct bt_att_chan *chan, uint8_t opcode,
+					const void *pdu, uint16_t len,
+					void *user_data)
+{
+	struct bt_hog *hog = user_data;
+	struct report *report = NULL;
+	uint16_t handle;
+	uint64_t start;
+	GSList *l;
+	int err;
+
+	if (len < 2)
+		return;
+
+	start = input_time_usec();
+	handle = get_le16(pdu);
+
+	for (l = hog->reports; l; l = l->next) {
+		struct report *r = l->data;
+
+		if (r->notify && r->value_handle == handle) {
+			report = r;
+			break;
+		}
+	}
+
+	if (!report)
+		return;
+
+	pdu += 2;
+	len -= 2;
+
 	/* If uhid had not sent UHID_START yet queue up the input */
 	if (!hog->uhid_created || !hog->uhid_start) {
-		if (!hog->input)
-			hog->input = queue_new();
-
-		queue_push_tail(hog->input, util_memdup(&ev, sizeof(ev)));
+		report_value_queue(report, pdu, len);
 		return;
 	}
 
-	err = bt_uhid_send(hog->uhid, &ev);
+	err = bt_uhid_input(hog->uhid, report->numbered ? report->id : 0,
+								pdu, len);
 	if (err < 0)
-		error("bt_uhid_send: %s (%d)", strerror(-err), -err);
+		error("bt_uhid_input: %s (%d)", strerror(-err), -err);
+
+	input_stats_update(hog, start, err);
+}
+
+static void report_notify_enable(struct report *report)
+{
+	struct bt_hog *hog = report->hog;
+
+	report->notify = true;
+
+	if (hog->notify_id)
+		return;
+
+	hog->notify_id = bt_att_register(g_attrib_get_att(hog->attrib),
+					BT_ATT_OP_HANDLE_NFY, report_value_cb,
+					hog, NULL);
+}
+
+bool bt_hog_get_input_stats(struct bt_hog *hog,
+					struct bt_hog_input_stats *stats)
+{
+	if (!hog || !stats)
+		return false;
+
+	memcpy(stats, &hog->input_stats, sizeof(*stats));
+
+	return true;
 }
 
 static void report_ccc_written_cb(guint8 status, const guint8 *pdu,
@@ -378,7 +475,6 @@ static void report_ccc_written_cb(guint8 status, const guint8 *pdu,
 {
 	struct gatt_request *req = user_data;
 	struct report *report = req->user_data;
-	struct bt_hog *hog = report->hog;
 
 	if (status != 0) {
 		error("Write report characteristic descriptor failed: %s",
@@ -386,13 +482,10 @@ static void report_ccc_written_cb(guint8 status, const guint8 *pdu,
 		goto remove;
 	}
 
-	if (report->notifyid)
+	if (report->notify)
 		goto remove;
 
-	report->notifyid = g_attrib_register(hog->attrib,
-					ATT_OP_HANDLE_NOTIFY,
-					report->value_handle,
-					report_value_cb, report, NULL);
+	report_notify_enable(report);
 
 	DBG("Report characteristic descriptor written: notifications enabled");
 
@@ -1774,13 +1867,10 @@ bool bt_hog_attach(struct bt_hog *hog, void *gatt)
 	for (l = hog->reports; l; l = l->next) {
 		struct report *r = l->data;
 
-		if (r->notifyid)
+		if (r->notify)
 			continue;
 
-		r->notifyid = g_attrib_register(hog->attrib,
-					ATT_OP_HANDLE_NOTIFY,
-					r->value_handle,
-					report_value_cb, r, NULL);
+		report_notify_enable(r);
 	}
 
 	return true;
@@ -1827,10 +1917,13 @@ void bt_hog_detach(struct bt_hog *hog)
 	for (l = hog->reports; l; l = l->next) {
 		struct report *r = l->data;
 
-		if (r->notifyid > 0) {
-			g_attrib_unregister(hog->attrib, r->notifyid);
-			r->notifyid = 0;
-		}
+		r->notify = false;
+	}
+
+	if (hog->notify_id) {
+		bt_att_unregister(g_attrib_get_att(hog->attrib),
+							hog->notify_id);
+		hog->notify_id = 0;
 	}
 
 	if (hog->scpp)
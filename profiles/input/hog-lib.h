@@ -10,6 +10,13 @@
 
 struct bt_hog;
 
+struct bt_hog_input_stats {
+	uint64_t reports;
+	uint64_t errors;
+	uint64_t total_usec;
+	uint32_t max_usec;
+};
+
 struct bt_hog *bt_hog_new_default(const char *name, uint16_t vendor,
 					uint16_t product, uint16_t version,
 					struct gatt_db *db);
@@ -26,3 +33,5 @@ void bt_hog_detach(struct bt_hog *hog);
 
 int bt_hog_set_control_point(struct bt_hog *hog, bool suspend);
 int bt_hog_send_report(struct bt_hog *hog, void *data, size_t size, int type);
+bool bt_hog_get_input_stats(struct bt_hog *hog,
+					struct bt_hog_input_stats *stats);
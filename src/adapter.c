@@ -63,6 +63,7 @@
 #include "attrib/att.h"
 #include "attrib/gatt.h"
 #include "gatt-database.h"
+#include "gatt-client.h"
 #include "advertising.h"
 #include "adv_monitor.h"
 #include "eir.h"
@@ -277,6 +278,17 @@ struct btd_adapter {
 	struct discovery_client *client;	/* active discovery client */
 
 	GSList *discovery_found;	/* list of found devices */
+	unsigned int adv_parsed;	/* reports parsed */
+	unsigned int adv_skipped;	/* reports matching fingerprint */
+	GHashTable *pre_devices;	/* devices found but not created */
+	GQueue pre_lru;			/* pre_devices, most recent first */
+	unsigned int pre_promoted;	/* pre_devices turned into devices */
+	unsigned int pre_evicted;	/* pre_devices dropped by the limit */
+	GHashTable *reports;		/* last forwarded passive reports */
+	GQueue report_lru;		/* reports, most recent first */
+	unsigned int reports_received;	/* device found events */
+	unsigned int reports_coalesced;	/* events dropped as repeated */
+	unsigned int reports_forwarded;	/* events passed on for parsing */
 	unsigned int discovery_idle_timeout; /* timeout between discovery
 					      * runs
 					      */
@@ -1251,16 +1263,176 @@ void adapter_service_remove(struct btd_adapter *adapter, uint32_t handle)
 static void adapter_add_device(struct btd_adapter *adapter,
 						struct btd_device *device);
 
+/*
+ * Compact record of a device that was found but not reported to any client,
+ * kept instead of a full device object until the device is needed.
+ */
+struct pre_device {
+	bdaddr_t bdaddr;
+	uint8_t bdaddr_type;
+	int8_t rssi;
+	uint64_t fingerprint;
+	GList link;
+};
+
+static guint addr_hash(const bdaddr_t *bdaddr, uint8_t bdaddr_type)
+{
+	guint hash = bdaddr_type;
+	int i;
+
+	for (i = 0; i < 6; i++)
+		hash = hash * 31 + bdaddr->b[i];
+
+	return hash;
+}
+
+static guint pre_device_hash(gconstpointer key)
+{
+	const struct pre_device *pre = key;
+
+	return addr_hash(&pre->bdaddr, pre->bdaddr_type);
+}
+
+static gboolean pre_device_equal(gconstpointer a, gconstpointer b)
+{
+	const struct pre_device *pre1 = a;
+	const struct pre_device *pre2 = b;
+
+	return pre1->bdaddr_type == pre2->bdaddr_type &&
+				!bacmp(&pre1->bdaddr, &pre2->bdaddr);
+}
+
+static struct pre_device *pre_device_find(struct btd_adapter *adapter,
+						const bdaddr_t *bdaddr,
+						uint8_t bdaddr_type)
+{
+	struct pre_device key;
+
+	if (!adapter->pre_devices)
+		return NULL;
+
+	bacpy(&key.bdaddr, bdaddr);
+	key.bdaddr_type = bdaddr_type;
+
+	return g_hash_table_lookup(adapter->pre_devices, &key);
+}
+
+static void pre_device_remove(struct btd_adapter *adapter,
+						struct pre_device *pre)
+{
+	g_queue_unlink(&adapter->pre_lru, &pre->link);
+	g_hash_table_remove(adapter->pre_devices, pre);
+}
+
+static void pre_device_update(struct btd_adapter *adapter,
+					const bdaddr_t *bdaddr,
+					uint8_t bdaddr_type, int8_t rssi,
+					uint64_t fingerprint)
+{
+	struct pre_device *pre;
+
+	if (!btd_opts.tmp_cache_size)
+		return;
+
+	pre = pre_device_find(adapter, bdaddr, bdaddr_type);
+	if (pre) {
+		g_queue_unlink(&adapter->pre_lru, &pre->link);
+	} else {
+		if (g_queue_get_length(&adapter->pre_lru) >=
+						btd_opts.tmp_cache_size) {
+			pre_device_remove(adapter,
+					g_queue_peek_tail(&adapter->pre_lru));
+			adapter->pre_evicted++;
+		}
+
+		pre = g_new0(struct pre_device, 1);
+		bacpy(&pre->bdaddr, bdaddr);
+		pre->bdaddr_type = bdaddr_type;
+		pre->link.data = pre;
+
+		g_hash_table_add(adapter->pre_devices, pre);
+	}
+
+	pre->rssi = rssi;
+	pre->fingerprint = fingerprint;
+
+	g_queue_push_head_link(&adapter->pre_lru, &pre->link);
+}
+
+static void pre_device_clear(struct btd_adapter *adapter)
+{
+	struct pre_device *pre;
+
+	while ((pre = g_queue_peek_head(&adapter->pre_lru)))
+		pre_device_remove(adapter, pre);
+}
+
+#define REPORT_CACHE_SIZE	1024
+
+/*
+ * Last device found event forwarded for an address while passive scanning,
+ * used to drop repeated events before they are parsed.
+ */
+struct report_record {
+	bdaddr_t bdaddr;
+	uint8_t bdaddr_type;
+	int8_t rssi;
+	uint32_t flags;
+	uint64_t fingerprint;
+	bool monitored;			/* data matched a monitor */
+	unsigned int monitor_gen;	/* monitors monitored refers to */
+	gint64 time;			/* milliseconds */
+	GList link;
+};
+
+static guint report_record_hash(gconstpointer key)
+{
+	const struct report_record *rec = key;
+
+	return addr_hash(&rec->bdaddr, rec->bdaddr_type);
+}
+
+static gboolean report_record_equal(gconstpointer a, gconstpointer b)
+{
+	const struct report_record *rec1 = a;
+	const struct report_record *rec2 = b;
+
+	return rec1->bdaddr_type == rec2->bdaddr_type &&
+				!bacmp(&rec1->bdaddr, &rec2->bdaddr);
+}
+
+static void report_record_remove(struct btd_adapter *adapter,
+						struct report_record *rec)
+{
+	g_queue_unlink(&adapter->report_lru, &rec->link);
+	g_hash_table_remove(adapter->reports, rec);
+}
+
+static void report_record_clear(struct btd_adapter *adapter)
+{
+	struct report_record *rec;
+
+	while ((rec = g_queue_peek_head(&adapter->report_lru)))
+		report_record_remove(adapter, rec);
+}
+
 static struct btd_device *adapter_create_device(struct btd_adapter *adapter,
 						const bdaddr_t *bdaddr,
 						uint8_t bdaddr_type)
 {
 	struct btd_device *device;
+	struct pre_device *pre;
 
 	device = device_create(adapter, bdaddr, bdaddr_type);
 	if (!device)
 		return NULL;
 
+	pre = pre_device_find(adapter, bdaddr, bdaddr_type);
+	if (pre) {
+		pre_device_remove(adapter, pre);
+		adapter->pre_promoted++;
+	}
+
 	adapter_add_device(adapter, device);
 	return device;
 }
@@ -1550,6 +1722,7 @@ static void invalidate_rssi_and_tx_power(gpointer a)
 
 	device_set_rssi(dev, 0);
 	device_set_tx_power(dev, 127);
+	device_set_adv_fingerprint(dev, 0);
 }
 
 static void discovery_cleanup(struct btd_adapter *adapter, int timeout)
@@ -1939,6 +2112,23 @@ static void discovering_callback(uint16_t index, uint16_t length,
 	adapter->discovery_type = ev->type;
 	adapter->discovery_enable = ev->discovering;
 
+	if (!ev->discovering) {
+		DBG("hci%u device found events: %u received, %u coalesced, "
+				"%u forwarded", adapter->dev_id,
+				adapter->reports_received,
+				adapter->reports_coalesced,
+				adapter->reports_forwarded);
+		DBG("hci%u advertising reports: %u parsed, %u skipped",
+					adapter->dev_id, adapter->adv_parsed,
+					adapter->adv_skipped);
+		DBG("hci%u cached devices: %u (%zu bytes), %u promoted, "
+				"%u evicted", adapter->dev_id,
+				g_queue_get_length(&adapter->pre_lru),
+				g_queue_get_length(&adapter->pre_lru) *
+						sizeof(struct pre_device),
+				adapter->pre_promoted, adapter->pre_evicted);
+	}
+
 	/*
 	 * Check for existing discoveries triggered by client applications
 	 * and ignore all others.
@@ -3571,6 +3761,329 @@ static DBusMessage *connect_device(DBusConnection *conn,
 	return NULL;
 }
 
+static struct btd_device *find_device_by_child_path(
+						struct btd_adapter *adapter,
+						const char *path)
+{
+	GSList *l;
+
+	for (l = adapter->devices; l; l = g_slist_next(l)) {
+		struct btd_device *device = l->data;
+		const char *dev_path = device_get_path(device);
+		size_t len = strlen(dev_path);
+
+		if (!strncmp(path, dev_path, len) && path[len] == '/')
+			return device;
+	}
+
+	return NULL;
+}
+
+static DBusMessage *acquire_notifications(DBusConnection *conn,
+					DBusMessage *msg, void *user_data)
+{
+	struct btd_adapter *adapter = user_data;
+	struct btd_gatt_notify_mux *mux;
+	DBusMessageIter iter, array;
+	DBusMessage *reply;
+	unsigned int count = 0;
+	int fd, err;
+
+	DBG("sender %s", dbus_message_get_sender(msg));
+
+	dbus_message_iter_init(msg, &iter);
+	if (dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_ARRAY ||
+		dbus_message_iter_get_element_type(&iter) !=
+							DBUS_TYPE_OBJECT_PATH)
+		return btd_error_invalid_args(msg);
+
+	mux = btd_gatt_notify_mux_new(dbus_message_get_sender(msg), &fd);
+	if (!mux)
+		return btd_error_failed(msg, strerror(EIO));
+
+	dbus_message_iter_recurse(&iter, &array);
+
+	while (dbus_message_iter_get_arg_type(&array) ==
+						DBUS_TYPE_OBJECT_PATH) {
+		struct btd_device *device;
+		const char *path;
+
+		dbus_message_iter_get_basic(&array, &path);
+
+		device = find_device_by_child_path(adapter, path);
+		err = btd_device_add_gatt_notify_mux(device, path, mux);
+		if (err < 0)
+			goto fail;
+
+		count++;
+		dbus_message_iter_next(&array);
+	}
+
+	if (!count) {
+		err = -ENOENT;
+		goto fail;
+	}
+
+	reply = g_dbus_create_reply(msg, DBUS_TYPE_UNIX_FD, &fd,
+							DBUS_TYPE_INVALID);
+	close(fd);
+
+	return reply;
+
+fail:
+	close(fd);
+	btd_gatt_notify_mux_free(mux);
+
+	switch (-err) {
+	case ENOENT:
+		return btd_error_invalid_args(msg);
+	case ENOTSUP:
+		return btd_error_not_supported(msg);
+	case EPERM:
+		return btd_error_not_permitted(msg, "Notify acquired");
+	default:
+		return btd_error_failed(msg, strerror(-err));
+	}
+}
+
+#define GET_DEVICES_MAX_FIELDS	32
+
+struct get_devices_opts {
+	uint32_t offset;
+	uint32_t count;
+	const char *fields[GET_DEVICES_MAX_FIELDS];
+	unsigned int num_fields;
+};
+
+static const char *get_devices_default_fields[] = {
+	"Address", "AddressType", "Name", "RSSI", "Paired", "Connected",
+	NULL
+};
+
+static bool parse_get_devices_fields(DBusMessageIter *value,
+					struct get_devices_opts *opts)
+{
+	DBusMessageIter array;
+
+	if (dbus_message_iter_get_arg_type(value) != DBUS_TYPE_ARRAY ||
+		dbus_message_iter_get_element_type(value) != DBUS_TYPE_STRING)
+		return false;
+
+	dbus_message_iter_recurse(value, &array);
+
+	while (dbus_message_iter_get_arg_type(&array) == DBUS_TYPE_STRING) {
+		const char *name;
+		unsigned int i;
+
+		dbus_message_iter_get_basic(&array, &name);
+
+		for (i = 0; i < opts->num_fields; i++) {
+			if (!strcmp(opts->fields[i], name))
+				return false;
+		}
+
+		if (opts->num_fields == GET_DEVICES_MAX_FIELDS ||
+					!btd_device_has_property(name))
+			return false;
+
+		opts->fields[opts->num_fields++] = name;
+		dbus_message_iter_next(&array);
+	}
+
+	return true;
+}
+
+static bool parse_get_devices_opts(DBusMessage *msg,
+					struct get_devices_opts *opts)
+{
+	DBusMessageIter iter, dict;
+
+	dbus_message_iter_init(msg, &iter);
+	if (dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_ARRAY ||
+		dbus_message_iter_get_element_type(&iter) !=
+							DBUS_TYPE_DICT_ENTRY)
+		return false;
+
+	dbus_message_iter_recurse(&iter, &dict);
+
+	while (dbus_message_iter_get_arg_type(&dict) == DBUS_TYPE_DICT_ENTRY) {
+		DBusMessageIter entry, value;
+		const char *key;
+
+		dbus_message_iter_recurse(&dict, &entry);
+		dbus_message_iter_get_basic(&entry, &key);
+
+		dbus_message_iter_next(&entry);
+		if (dbus_message_iter_get_arg_type(&entry) != DBUS_TYPE_VARIANT)
+			return false;
+
+		dbus_message_iter_recurse(&entry, &value);
+
+		if (!strcmp(key, "Offset")) {
+			if (dbus_message_iter_get_arg_type(&value) !=
+							DBUS_TYPE_UINT32)
+				return false;
+			dbus_message_iter_get_basic(&value, &opts->offset);
+		} else if (!strcmp(key, "Count")) {
+			if (dbus_message_iter_get_arg_type(&value) !=
+							DBUS_TYPE_UINT32)
+				return false;
+			dbus_message_iter_get_basic(&value, &opts->count);
+		} else if (!strcmp(key, "Fields")) {
+			if (!parse_get_devices_fields(&value, opts))
+				return false;
+		} else
+			return false;
+
+		dbus_message_iter_next(&dict);
+	}
+
+	if (!opts->num_fields) {
+		const char **field;
+
+		for (field = get_devices_default_fields; *field; field++)
+			opts->fields[opts->num_fields++] = *field;
+	}
+
+	return true;
+}
+
+static DBusMessage *get_devices(DBusConnection *conn,
+					DBusMessage *msg, void *user_data)
+{
+	struct btd_adapter *adapter = user_data;
+	struct get_devices_opts opts;
+	DBusMessageIter iter, array;
+	DBusMessage *reply;
+	uint32_t index, next = 0;
+	GSList *l;
+
+	memset(&opts, 0, sizeof(opts));
+
+	if (!parse_get_devices_opts(msg, &opts))
+		return btd_error_invalid_args(msg);
+
+	reply = dbus_message_new_method_return(msg);
+	if (!reply)
+		return NULL;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					DBUS_STRUCT_BEGIN_CHAR_AS_STRING
+					DBUS_TYPE_OBJECT_PATH_AS_STRING
+					DBUS_TYPE_ARRAY_AS_STRING
+					DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+					DBUS_TYPE_STRING_AS_STRING
+					DBUS_TYPE_VARIANT_AS_STRING
+					DBUS_DICT_ENTRY_END_CHAR_AS_STRING
+					DBUS_STRUCT_END_CHAR_AS_STRING,
+					&array);
+
+	/*
+	 * Devices are appended to the list as they are created so an index
+	 * makes a stable enough cursor: pages only shift when devices are
+	 * removed in between calls.
+	 */
+	l = g_slist_nth(adapter->devices, opts.offset);
+
+	for (index = opts.offset; l; l = l->next, index++) {
+		struct btd_device *device = l->data;
+		const char *path = device_get_path(device);
+		DBusMessageIter entry, dict;
+		unsigned int i;
+
+		if (opts.count && index - opts.offset == opts.count) {
+			next = index;
+			break;
+		}
+
+		dbus_message_iter_open_container(&array, DBUS_TYPE_STRUCT,
+							NULL, &entry);
+		dbus_message_iter_append_basic(&entry, DBUS_TYPE_OBJECT_PATH,
+								&path);
+		dbus_message_iter_open_container(&entry, DBUS_TYPE_ARRAY,
+					DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+					DBUS_TYPE_STRING_AS_STRING
+					DBUS_TYPE_VARIANT_AS_STRING
+					DBUS_DICT_ENTRY_END_CHAR_AS_STRING,
+					&dict);
+
+		for (i = 0; i < opts.num_fields; i++)
+			btd_device_append_property(device, opts.fields[i],
+									&dict);
+
+		dbus_message_iter_close_container(&entry, &dict);
+		dbus_message_iter_close_container(&array, &entry);
+	}
+
+	dbus_message_iter_close_container(&iter, &array);
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_UINT32, &next);
+
+	return reply;
+}
+
+static DBusMessage *get_statistics(DBusConnection *conn,
+					DBusMessage *msg, void *user_data)
+{
+	struct btd_adapter *adapter = user_data;
+	GDBusPropertyStats stats;
+	DBusMessageIter iter, dict;
+	DBusMessage *reply;
+	uint32_t cached;
+
+	reply = dbus_message_new_method_return(msg);
+	if (!reply)
+		return NULL;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+					DBUS_TYPE_STRING_AS_STRING
+					DBUS_TYPE_VARIANT_AS_STRING
+					DBUS_DICT_ENTRY_END_CHAR_AS_STRING,
+					&dict);
+
+	dict_append_entry(&dict, "ReportsParsed", DBUS_TYPE_UINT32,
+							&adapter->adv_parsed);
+	dict_append_entry(&dict, "ReportsSkipped", DBUS_TYPE_UINT32,
+							&adapter->adv_skipped);
+
+	cached = g_queue_get_length(&adapter->pre_lru);
+	dict_append_entry(&dict, "CachedDevices", DBUS_TYPE_UINT32, &cached);
+	dict_append_entry(&dict, "CachedDevicesPromoted", DBUS_TYPE_UINT32,
+							&adapter->pre_promoted);
+	dict_append_entry(&dict, "CachedDevicesEvicted", DBUS_TYPE_UINT32,
+							&adapter->pre_evicted);
+
+	dict_append_entry(&dict, "FoundEventsReceived", DBUS_TYPE_UINT32,
+						&adapter->reports_received);
+	dict_append_entry(&dict, "FoundEventsCoalesced", DBUS_TYPE_UINT32,
+						&adapter->reports_coalesced);
+	dict_append_entry(&dict, "FoundEventsForwarded", DBUS_TYPE_UINT32,
+						&adapter->reports_forwarded);
+
+	if (g_dbus_get_property_stats(btd_get_dbus_connection(), &stats)) {
+		dbus_uint64_t value;
+
+		value = stats.changes;
+		dict_append_entry(&dict, "PropertyChanges", DBUS_TYPE_UINT64,
+								&value);
+		value = stats.coalesced;
+		dict_append_entry(&dict, "PropertyChangesCoalesced",
+						DBUS_TYPE_UINT64, &value);
+		value = stats.deferred;
+		dict_append_entry(&dict, "PropertyChangesDeferred",
+						DBUS_TYPE_UINT64, &value);
+		value = stats.signals;
+		dict_append_entry(&dict, "PropertiesChangedSignals",
+						DBUS_TYPE_UINT64, &value);
+	}
+
+	dbus_message_iter_close_container(&iter, &dict);
+
+	return reply;
+}
+
 static void update_device_allowed_services(void *data, void *user_data)
 {
 	struct btd_device *device = data;
@@ -3672,6 +4185,18 @@ static const GDBusMethodTable adapter_methods[] = {
 	{ GDBUS_EXPERIMENTAL_ASYNC_METHOD("ConnectDevice",
 				GDBUS_ARGS({ "properties", "a{sv}" }), NULL,
 				connect_device) },
+	{ GDBUS_EXPERIMENTAL_METHOD("AcquireNotifications",
+				GDBUS_ARGS({ "characteristics", "ao" }),
+				GDBUS_ARGS({ "fd", "h" }),
+				acquire_notifications) },
+	{ GDBUS_EXPERIMENTAL_METHOD("GetDevices",
+				GDBUS_ARGS({ "options", "a{sv}" }),
+				GDBUS_ARGS({ "devices", "a(oa{sv})" },
+						{ "next", "u" }),
+				get_devices) },
+	{ GDBUS_EXPERIMENTAL_METHOD("GetStatistics", NULL,
+				GDBUS_ARGS({ "statistics", "a{sv}" }),
+				get_statistics) },
 	{ }
 };
 
@@ -5481,11 +6006,19 @@ void adapter_auto_connect_remove(struct btd_adapter *adapter,
 
 static void adapter_start(struct btd_adapter *adapter)
 {
+	struct mgmt_stats stats;
+
 	g_dbus_emit_property_changed(dbus_conn, adapter->path,
 						ADAPTER_INTERFACE, "Powered");
 
 	DBG("adapter %s has been enabled", adapter->path);
 
+	if (mgmt_get_stats(adapter->mgmt, &stats))
+		DBG("mgmt: %u commands, %u in flight (max %u), "
+			"latency %u us (max %u us)", stats.completed,
+			stats.in_flight, stats.max_in_flight,
+			stats.avg_latency, stats.max_latency);
+
 	trigger_passive_scanning(adapter);
 }
 
@@ -5611,6 +6144,12 @@ static void adapter_free(gpointer user_data)
 	if (adapter->allowed_uuid_set)
 		g_hash_table_destroy(adapter->allowed_uuid_set);
 
+	pre_device_clear(adapter);
+	g_hash_table_destroy(adapter->pre_devices);
+
+	report_record_clear(adapter);
+	g_hash_table_destroy(adapter->reports);
+
 	g_free(adapter);
 }
 
@@ -6636,6 +7175,14 @@ static struct btd_adapter *btd_adapter_new(uint16_t index)
 	DBG("Pairable timeout: %u seconds", adapter->pairable_timeout);
 
 	adapter->auths = g_queue_new();
+	adapter->pre_devices = g_hash_table_new_full(pre_device_hash,
+							pre_device_equal,
+							g_free, NULL);
+	g_queue_init(&adapter->pre_lru);
+	adapter->reports = g_hash_table_new_full(report_record_hash,
+							report_record_equal,
+							g_free, NULL);
+	g_queue_init(&adapter->report_lru);
 	adapter->exps = queue_new();
 
 	return btd_adapter_ref(adapter);
@@ -6742,32 +7289,50 @@ static void confirm_name(struct btd_adapter *adapter, const bdaddr_t *bdaddr,
 }
 
 static void adapter_msd_notify(struct btd_adapter *adapter,
-							struct btd_device *dev,
-							GSList *msd_list)
+						struct btd_device *dev,
+						const struct eir_view *view)
 {
 	GSList *cb_l, *cb_next;
-	GSList *msd_l, *msd_next;
+	struct eir_iter iter;
+	uint16_t company;
+	const uint8_t *data;
+	uint8_t len;
 
 	for (cb_l = adapter->msd_callbacks; cb_l != NULL; cb_l = cb_next) {
 		btd_msd_cb_t cb = cb_l->data;
 
 		cb_next = g_slist_next(cb_l);
 
-		for (msd_l = msd_list; msd_l != NULL; msd_l = msd_next) {
-			const struct eir_msd *msd = msd_l->data;
+		eir_iter_init(&iter, view);
 
-			msd_next = g_slist_next(msd_l);
+		while (eir_iter_next_msd(&iter, &company, &data, &len))
+			cb(adapter, dev, company, data, len);
+	}
+}
 
-			cb(adapter, dev, msd->company, msd->data,
-								msd->data_len);
-		}
+static bool is_uuid_match(GSList *uuids, const struct eir_view *view)
+{
+	struct eir_iter iter;
+	bt_uuid_t uuid;
+	char str[MAX_LEN_UUID_STR];
+
+	eir_iter_init(&iter, view);
+
+	while (eir_iter_next_uuid(&iter, &uuid)) {
+		bt_uuid_to_string(&uuid, str, sizeof(str));
+
+		/* uuids contains string representations of uuids */
+		if (g_slist_find_custom(uuids, str, g_strcmp) != NULL)
+			return true;
 	}
+
+	return false;
 }
 
-static bool is_filter_match(GSList *discovery_filter, struct eir_data *eir_data,
-								int8_t rssi)
+static bool is_filter_match(GSList *discovery_filter,
+					const struct eir_view *view, int8_t rssi)
 {
-	GSList *l, *m;
+	GSList *l;
 	bool got_match = false;
 
 	for (l = discovery_filter; l != NULL && got_match != true;
@@ -6789,26 +7354,16 @@ static bool is_filter_match(GSList *discovery_filter, struct eir_data *eir_data,
 		 */
 		if (!item->uuids)
 			got_match = true;
-		else {
-			for (m = item->uuids; m != NULL && got_match != true;
-							m = g_slist_next(m)) {
-				/* m->data contains string representation of
-				 * uuid.
-				 */
-				if (g_slist_find_custom(eir_data->services,
-							m->data,
-							g_strcmp) != NULL)
-					got_match = true;
-			}
-		}
+		else
+			got_match = is_uuid_match(item->uuids, view);
 
 		if (got_match) {
 			/* we have service match, check proximity */
 			if (item->rssi == DISTANCE_VAL_INVALID ||
 			    item->rssi <= rssi ||
 			    item->pathloss == DISTANCE_VAL_INVALID ||
-			    (eir_data->tx_power != 127 &&
-			     eir_data->tx_power - rssi <= item->pathloss))
+			    (view->tx_power != 127 &&
+			     view->tx_power - rssi <= item->pathloss))
 				return true;
 
 			got_match = false;
@@ -6830,8 +7385,8 @@ static void filter_duplicate_data(void *data, void *user_data)
 }
 
 static bool device_is_discoverable(struct btd_adapter *adapter,
-					struct eir_data *eir, const char *addr,
-					uint8_t bdaddr_type)
+					unsigned int flags, const char *name,
+					const char *addr, uint8_t bdaddr_type)
 {
 	GSList *l;
 	bool discoverable;
@@ -6839,7 +7394,7 @@ static bool device_is_discoverable(struct btd_adapter *adapter,
 	if (bdaddr_type == BDADDR_BREDR || adapter->filtered_discovery)
 		discoverable = true;
 	else
-		discoverable = eir->flags & (EIR_LIM_DISC | EIR_GEN_DISC);
+		discoverable = flags & (EIR_LIM_DISC | EIR_GEN_DISC);
 
 	/*
 	 * Mark as not discoverable if no client has requested discovery and
@@ -6867,63 +7422,170 @@ static bool device_is_discoverable(struct btd_adapter *adapter,
 		if (!strncmp(filter->pattern, addr, pattern_len))
 			return true;
 
-		if (eir->name && !strncmp(filter->pattern, eir->name,
-							pattern_len))
+		if (name && !strncmp(filter->pattern, name, pattern_len))
 			return true;
 	}
 
 	return discoverable;
 }
 
-void btd_adapter_update_found_device(struct btd_adapter *adapter,
+/*
+ * Identifies a report by its data and by everything else that decides how the
+ * data is applied to the device, so a match means that parsing the data again
+ * would not change anything.
+ */
+static uint64_t adv_fingerprint(struct btd_adapter *adapter,
+					uint8_t bdaddr_type, bool legacy,
+					bool monitoring, const uint8_t *data,
+					uint8_t data_len)
+{
+	uint8_t state[] = { bdaddr_type, legacy, monitoring,
+				adapter->discovery_list != NULL,
+				adapter->filtered_discovery, data_len };
+	uint64_t hash = 0xcbf29ce484222325ull;
+	size_t i;
+
+	/* FNV-1a */
+	for (i = 0; i < sizeof(state); i++)
+		hash = (hash ^ state[i]) * 0x100000001b3ull;
+
+	for (i = 0; i < data_len; i++)
+		hash = (hash ^ data[i]) * 0x100000001b3ull;
+
+	/* Zero is reserved for no fingerprint */
+	return hash ? hash : 1;
+}
+
+static bool can_skip_unchanged(struct btd_adapter *adapter)
+{
+	GSList *l;
+
+	/*
+	 * Filters are matched against the RSSI, while manufacturer data
+	 * callbacks and clients asking for duplicate data see every report.
+	 */
+	if (adapter->filtered_discovery || adapter->msd_callbacks)
+		return false;
+
+	for (l = adapter->discovery_list; l; l = g_slist_next(l)) {
+		struct discovery_client *client = l->data;
+
+		if (client->discovery_filter)
+			return false;
+	}
+
+	return true;
+}
+
+static bool content_filter_needed(struct btd_adapter *adapter,
+					uint8_t bdaddr_type,
+					const uint8_t *data, uint8_t data_len)
+{
+	return !btd_adv_monitor_offload_enabled(adapter->adv_monitor_manager)
+			&& bdaddr_type != BDADDR_BREDR && data && data_len;
+}
+
+/*
+ * When filtered is set the caller already ran the content filter and
+ * matched_monitors is its result, which is consumed here.
+ */
+static void update_found_device(struct btd_adapter *adapter,
 					const bdaddr_t *bdaddr,
 					uint8_t bdaddr_type, int8_t rssi,
 					bool confirm, bool legacy,
 					bool not_connectable,
 					bool name_resolve_failed,
 					const uint8_t *data, uint8_t data_len,
-					bool monitoring)
+					bool monitoring, bool filtered,
+					struct queue *matched_monitors)
 {
 	struct btd_device *dev;
-	struct bt_ad *ad = NULL;
-	struct eir_data eir_data;
+	struct eir_view view;
+	char name_buf[HCI_MAX_NAME_LENGTH + 1];
+	const char *name = NULL;
+	unsigned int flags;
 	bool name_known, discoverable;
 	char addr[18];
 	bool duplicate = false;
-	struct queue *matched_monitors = NULL;
-
-	if (!btd_adv_monitor_offload_enabled(adapter->adv_monitor_manager)) {
-		if (bdaddr_type != BDADDR_BREDR)
-			ad = bt_ad_new_with_data(data_len, data);
+	bool unchanged;
+	uint64_t fingerprint;
 
+	if (content_filter_needed(adapter, bdaddr_type, data, data_len)) {
 		/* During the background scanning, update the device only when
 		 * the data match at least one Adv monitor
 		 */
-		if (ad) {
+		if (!filtered)
 			matched_monitors = btd_adv_monitor_content_filter(
 						adapter->adv_monitor_manager,
-						ad);
-			bt_ad_unref(ad);
-			ad = NULL;
-			monitoring = matched_monitors ? true : false;
-		}
+						data, data_len);
+		monitoring = matched_monitors ? true : false;
 	}
 
 	if (!adapter->discovering && !monitoring)
 		return;
 
-	memset(&eir_data, 0, sizeof(eir_data));
-	eir_parse(&eir_data, data, data_len);
-
 	ba2str(bdaddr, addr);
 
-	discoverable = device_is_discoverable(adapter, &eir_data, addr,
-							bdaddr_type);
-
 	dev = btd_adapter_find_device(adapter, bdaddr, bdaddr_type);
+
+	fingerprint = adv_fingerprint(adapter, bdaddr_type, legacy, monitoring,
+							data, data_len);
+
+	/* The same data was not reported last time either */
+	if (!dev && can_skip_unchanged(adapter)) {
+		struct pre_device *pre;
+
+		pre = pre_device_find(adapter, bdaddr, bdaddr_type);
+		if (pre && pre->fingerprint == fingerprint) {
+			adapter->adv_skipped++;
+			pre_device_update(adapter, bdaddr, bdaddr_type, rssi,
+								fingerprint);
+			return;
+		}
+	}
+
+	unchanged = can_skip_unchanged(adapter) &&
+			device_match_adv_fingerprint(dev, fingerprint);
+
+	/*
+	 * Data identical to what was last applied to the device passed the
+	 * same checks before, only the flags are needed from it again.
+	 */
+	if (unchanged) {
+		adapter->adv_skipped++;
+		flags = device_get_flags(dev);
+		discoverable = true;
+	} else {
+		adapter->adv_parsed++;
+
+		eir_view_parse(&view, data, data_len);
+
+		if (eir_view_get_name(&view, name_buf, sizeof(name_buf)))
+			name = name_buf;
+
+		flags = view.flags;
+		discoverable = device_is_discoverable(adapter, flags, name,
+							addr, bdaddr_type);
+	}
+
 	if (!dev) {
 		if (!discoverable && !monitoring) {
-			eir_data_free(&eir_data);
+			pre_device_update(adapter, bdaddr, bdaddr_type, rssi,
+								fingerprint);
+			return;
+		}
+
+		/*
+		 * Don't create a device that the checks below would not
+		 * report anyway, unless the cache is disabled.
+		 */
+		if (btd_opts.tmp_cache_size && !monitoring &&
+				(!adapter->discovery_list ||
+				(adapter->filtered_discovery &&
+				!is_filter_match(adapter->discovery_list,
+							&view, rssi)))) {
+			pre_device_update(adapter, bdaddr, bdaddr_type, rssi,
+								fingerprint);
 			return;
 		}
 
@@ -6933,7 +7595,6 @@ void btd_adapter_update_found_device(struct btd_adapter *adapter,
 	if (!dev) {
 		btd_error(adapter->dev_id,
 			"Unable to create object for found device %s", addr);
-		eir_data_free(&eir_data);
 		return;
 	}
 
@@ -6945,15 +7606,15 @@ void btd_adapter_update_found_device(struct btd_adapter *adapter,
 	 * kernels send them merged, so once we know which mgmt version
 	 * supports this we can make the non-zero check conditional.
 	 */
-	if (bdaddr_type != BDADDR_BREDR && eir_data.flags &&
-					!(eir_data.flags & EIR_BREDR_UNSUP)) {
+	if (bdaddr_type != BDADDR_BREDR && flags &&
+					!(flags & EIR_BREDR_UNSUP)) {
 		device_set_bredr_support(dev);
 		/* Update last seen for BR/EDR in case its flag is set */
 		device_update_last_seen(dev, BDADDR_BREDR);
 	}
 
-	if (eir_data.name != NULL && eir_data.name_complete)
-		device_store_cached_name(dev, eir_data.name);
+	if (name && view.name_complete)
+		device_store_cached_name(dev, name);
 
 	/*
 	 * Only skip devices that are not connected, are temporary, and there
@@ -6961,20 +7622,16 @@ void btd_adapter_update_found_device(struct btd_adapter *adapter,
 	 */
 	if (!btd_device_is_connected(dev) &&
 		(device_is_temporary(dev) && !adapter->discovery_list) &&
-		!monitoring) {
-		eir_data_free(&eir_data);
+		!monitoring)
 		return;
-	}
 
 	/* If there is no matched Adv monitors, don't continue if not
 	 * discoverable or if active discovery filter don't match.
 	 */
 	if (!monitoring && (!discoverable ||
 		(adapter->filtered_discovery && !is_filter_match(
-				adapter->discovery_list, &eir_data, rssi)))) {
-		eir_data_free(&eir_data);
+				adapter->discovery_list, &view, rssi))))
 		return;
-	}
 
 	device_set_legacy(dev, legacy);
 
@@ -6986,51 +7643,53 @@ void btd_adapter_update_found_device(struct btd_adapter *adapter,
 	else
 		device_set_rssi(dev, rssi);
 
-	if (eir_data.tx_power != 127)
-		device_set_tx_power(dev, eir_data.tx_power);
+	name_known = device_name_known(dev);
 
-	if (eir_data.appearance != 0)
-		device_set_appearance(dev, eir_data.appearance);
+	if (unchanged)
+		goto done;
+
+	if (view.tx_power != 127)
+		device_set_tx_power(dev, view.tx_power);
+
+	if (view.appearance != 0)
+		device_set_appearance(dev, view.appearance);
 
 	/* Report an unknown name to the kernel even if there is a short name
 	 * known, but still update the name with the known short name. */
-	name_known = device_name_known(dev);
-
-	if (eir_data.name && (eir_data.name_complete || !name_known))
-		btd_device_device_set_name(dev, eir_data.name);
+	if (name && (view.name_complete || !name_known))
+		btd_device_device_set_name(dev, name);
 
-	if (eir_data.class != 0)
-		device_set_class(dev, eir_data.class);
+	if (view.class != 0)
+		device_set_class(dev, view.class);
 
-	if (eir_data.did_source || eir_data.did_vendor ||
-			eir_data.did_product || eir_data.did_version)
-		btd_device_set_pnpid(dev, eir_data.did_source,
-							eir_data.did_vendor,
-							eir_data.did_product,
-							eir_data.did_version);
+	if (view.did_source || view.did_vendor ||
+			view.did_product || view.did_version)
+		btd_device_set_pnpid(dev, view.did_source, view.did_vendor,
+					view.did_product, view.did_version);
 
-	device_add_eir_uuids(dev, eir_data.services);
+	device_add_eir_view_uuids(dev, &view);
 
 	if (adapter->discovery_list)
 		g_slist_foreach(adapter->discovery_list, filter_duplicate_data,
 								&duplicate);
 
-	if (eir_data.msd_list) {
-		device_set_manufacturer_data(dev, eir_data.msd_list, duplicate);
-		adapter_msd_notify(adapter, dev, eir_data.msd_list);
+	if (view.has_msd) {
+		device_set_manufacturer_data(dev, &view, duplicate);
+		adapter_msd_notify(adapter, dev, &view);
 	}
 
-	if (eir_data.sd_list)
-		device_set_service_data(dev, eir_data.sd_list, duplicate);
+	if (view.has_sd)
+		device_set_service_data(dev, &view, duplicate);
 
-	if (eir_data.data_list)
-		device_set_data(dev, eir_data.data_list, duplicate);
+	if (view.has_data)
+		device_set_data(dev, &view, duplicate);
 
 	if (bdaddr_type != BDADDR_BREDR)
-		device_set_flags(dev, eir_data.flags);
+		device_set_flags(dev, view.flags);
 
-	eir_data_free(&eir_data);
+	device_set_adv_fingerprint(dev, fingerprint);
 
+done:
 	/* After the device is updated, notify the matched Adv monitors */
 	if (matched_monitors) {
 		btd_adv_monitor_notify_monitors(adapter->adv_monitor_manager,
@@ -7094,6 +7753,115 @@ connect_le:
 	}
 }
 
+void btd_adapter_update_found_device(struct btd_adapter *adapter,
+					const bdaddr_t *bdaddr,
+					uint8_t bdaddr_type, int8_t rssi,
+					bool confirm, bool legacy,
+					bool not_connectable,
+					bool name_resolve_failed,
+					const uint8_t *data, uint8_t data_len,
+					bool monitoring)
+{
+	update_found_device(adapter, bdaddr, bdaddr_type, rssi, confirm,
+				legacy, not_connectable, name_resolve_failed,
+				data, data_len, monitoring, false, NULL);
+}
+
+/*
+ * While passive scanning the controller reports every advertisement of every
+ * device around, and most of them repeat what was reported just before. Drop
+ * an event when the previous one forwarded for the same address carried the
+ * same data and flags, was forwarded less than PassiveReportInterval ago and
+ * its RSSI is within PassiveReportRSSIDelta of the new one.
+ *
+ * Events matching an Advertisement Monitor are never dropped. Whether they
+ * match is kept in the record, as it only changes along with the data or the
+ * monitors, so the content filter runs once per change. When the match is
+ * known, filtered is set and the matching monitors are returned.
+ */
+static bool coalesce_report(struct btd_adapter *adapter,
+					const struct mgmt_ev_device_found *ev,
+					uint32_t flags, const uint8_t *eir,
+					uint16_t eir_len, bool *filtered,
+					struct queue **matched_monitors)
+{
+	struct report_record key, *rec;
+	uint64_t fingerprint;
+	unsigned int gen;
+	gint64 now;
+
+	/* Discovery clients get every report, as they always have */
+	if (!btd_opts.report_interval || adapter->discovery_list ||
+					ev->addr.type == BDADDR_BREDR)
+		return false;
+
+	/* Without kernel connection control reports trigger connections */
+	if (adapter->connect_list &&
+			!btd_has_kernel_features(KERNEL_CONN_CONTROL))
+		return false;
+
+	now = g_get_monotonic_time() / 1000;
+	fingerprint = adv_fingerprint(adapter, ev->addr.type, false, false,
+							eir, eir_len);
+	gen = btd_adv_monitor_generation(adapter->adv_monitor_manager);
+
+	bacpy(&key.bdaddr, &ev->addr.bdaddr);
+	key.bdaddr_type = ev->addr.type;
+
+	rec = g_hash_table_lookup(adapter->reports, &key);
+	if (rec) {
+		g_queue_unlink(&adapter->report_lru, &rec->link);
+		g_queue_push_head_link(&adapter->report_lru, &rec->link);
+
+		if (rec->fingerprint == fingerprint && rec->flags == flags &&
+						rec->monitor_gen == gen) {
+			/* Monitors sample the RSSI of every matching report */
+			if (rec->monitored)
+				return false;
+
+			if (now - rec->time < btd_opts.report_interval &&
+					abs(ev->rssi - rec->rssi) <=
+						btd_opts.report_rssi_delta)
+				return true;
+
+			*filtered = true;
+			rec->rssi = ev->rssi;
+			rec->time = now;
+
+			return false;
+		}
+	} else {
+		if (g_queue_get_length(&adapter->report_lru) >=
+							REPORT_CACHE_SIZE)
+			report_record_remove(adapter,
+				g_queue_peek_tail(&adapter->report_lru));
+
+		rec = g_new0(struct report_record, 1);
+		bacpy(&rec->bdaddr, &ev->addr.bdaddr);
+		rec->bdaddr_type = ev->addr.type;
+		rec->link.data = rec;
+
+		g_hash_table_add(adapter->reports, rec);
+		g_queue_push_head_link(&adapter->report_lru, &rec->link);
+	}
+
+	*filtered = true;
+
+	if (content_filter_needed(adapter, ev->addr.type, eir, eir_len))
+		*matched_monitors = btd_adv_monitor_content_filter(
+						adapter->adv_monitor_manager,
+						eir, eir_len);
+
+	rec->monitored = *matched_monitors != NULL;
+	rec->monitor_gen = gen;
+	rec->rssi = ev->rssi;
+	rec->flags = flags;
+	rec->fingerprint = fingerprint;
+	rec->time = now;
+
+	return false;
+}
+
 static void device_found_callback(uint16_t index, uint16_t length,
 					const void *param, void *user_data)
 {
@@ -7106,6 +7874,8 @@ static void device_found_callback(uint16_t index, uint16_t length,
 	bool legacy;
 	bool not_connectable;
 	bool name_resolve_failed;
+	bool filtered = false;
+	struct queue *matched_monitors = NULL;
 	char addr[18];
 
 	if (length < sizeof(*ev)) {
@@ -7129,6 +7899,16 @@ static void device_found_callback(uint16_t index, uint16_t length,
 
 	flags = btohl(ev->flags);
 
+	adapter->reports_received++;
+
+	if (coalesce_report(adapter, ev, flags, eir, eir_len, &filtered,
+							&matched_monitors)) {
+		adapter->reports_coalesced++;
+		return;
+	}
+
+	adapter->reports_forwarded++;
+
 	ba2str(&ev->addr.bdaddr, addr);
 	DBG("hci%u addr %s, rssi %d flags 0x%04x eir_len %u",
 			index, addr, ev->rssi, flags, eir_len);
@@ -7138,11 +7918,10 @@ static void device_found_callback(uint16_t index, uint16_t length,
 	not_connectable = (flags & MGMT_DEV_FOUND_NOT_CONNECTABLE);
 	name_resolve_failed = (flags & MGMT_DEV_FOUND_NAME_REQUEST_FAILED);
 
-	btd_adapter_update_found_device(adapter, &ev->addr.bdaddr,
-					ev->addr.type, ev->rssi, confirm_name,
-					legacy, not_connectable,
-					name_resolve_failed, eir, eir_len,
-					false);
+	update_found_device(adapter, &ev->addr.bdaddr, ev->addr.type,
+				ev->rssi, confirm_name, legacy, not_connectable,
+				name_resolve_failed, eir, eir_len, false,
+				filtered, matched_monitors);
 }
 
 struct agent *adapter_get_agent(struct btd_adapter *adapter)
@@ -7192,6 +7971,13 @@ static void adapter_stop(struct btd_adapter *adapter)
 	set_discovery_discoverable(adapter, false);
 	adapter->discovering = false;
 
+	DBG("hci%u device found events: %u received, %u coalesced, "
+				"%u forwarded", adapter->dev_id,
+				adapter->reports_received,
+				adapter->reports_coalesced,
+				adapter->reports_forwarded);
+	report_record_clear(adapter);
+
 	while (adapter->connections) {
 		struct btd_device *device = adapter->connections->data;
 		uint8_t addr_type = btd_device_get_bdaddr_type(device);
@@ -9108,7 +9894,9 @@ static void connected_callback(uint16_t index, uint16_t length,
 	const struct mgmt_ev_device_connected *ev = param;
 	struct btd_adapter *adapter = user_data;
 	struct btd_device *device;
-	struct eir_data eir_data;
+	struct eir_view view;
+	char name[HCI_MAX_NAME_LENGTH + 1];
+	bool has_name;
 	uint16_t eir_len;
 	char addr[18];
 	bool name_known;
@@ -9136,26 +9924,23 @@ static void connected_callback(uint16_t index, uint16_t length,
 		return;
 	}
 
-	memset(&eir_data, 0, sizeof(eir_data));
-	if (eir_len > 0)
-		eir_parse(&eir_data, ev->eir, eir_len);
+	eir_view_parse(&view, ev->eir, eir_len);
+	has_name = eir_view_get_name(&view, name, sizeof(name));
 
-	if (eir_data.class != 0)
-		device_set_class(device, eir_data.class);
+	if (view.class != 0)
+		device_set_class(device, view.class);
 
 	adapter_add_connection(adapter, device, ev->addr.type);
 
 	name_known = device_name_known(device);
 
-	if (eir_data.name && (eir_data.name_complete || !name_known)) {
-		device_store_cached_name(device, eir_data.name);
-		btd_device_device_set_name(device, eir_data.name);
+	if (has_name && (view.name_complete || !name_known)) {
+		device_store_cached_name(device, name);
+		btd_device_device_set_name(device, name);
 	}
 
-	if (eir_data.msd_list)
-		adapter_msd_notify(adapter, device, eir_data.msd_list);
-
-	eir_data_free(&eir_data);
+	if (view.has_msd)
+		adapter_msd_notify(adapter, device, &view);
 }
 
 static void controller_resume_notify(struct btd_adapter *adapter)
@@ -16,6 +16,7 @@
 #include <errno.h>
 #include <stdint.h>
 #include <string.h>
+#include <time.h>
 
 #include <glib.h>
 #include <dbus/dbus.h>
@@ -50,6 +51,7 @@
 #define ADV_MONITOR_DEFAULT_HIGH_TIMEOUT 10	/* second */
 #define ADV_MONITOR_UNSET_SAMPLING_PERIOD 256	/* 100 ms */
 #define ADV_MONITOR_MAX_SAMPLING_PERIOD	255	/* 100 ms */
+#define ADV_MONITOR_UNSET_REPORT_INTERVAL 0	/* ms */
 
 struct btd_adv_monitor_manager {
 	struct btd_adapter *adapter;
@@ -63,6 +65,10 @@ struct btd_adv_monitor_manager {
 
 	struct queue *apps;	/* apps who registered for Adv monitoring */
 	struct queue *merged_patterns;
+
+	/* Patterns of all active monitors, rebuilt after changes */
+	struct bt_ad_matcher *matcher;
+	unsigned int matcher_gen;	/* bumped whenever it is dropped */
 };
 
 struct adv_monitor_app {
@@ -118,6 +124,21 @@ struct adv_monitor {
 	struct adv_monitor_merged_pattern *merged_pattern;
 
 	struct queue *devices;		/* List of adv_monitor_device objects */
+
+	uint16_t report_interval;	/* Batching interval of DevicesChanged()
+					 * in ms, unset to report each device
+					 * with DeviceFound()/DeviceLost()
+					 */
+	struct queue *reports;		/* List of adv_monitor_report objects
+					 * waiting for the next batch
+					 */
+	unsigned int report_timer;	/* Timer to send the next batch */
+};
+
+/* Device state change waiting to be reported with DevicesChanged() */
+struct adv_monitor_report {
+	struct btd_device *device;
+	bool found;
 };
 
 /* Some chipsets doesn't support multiple monitors with the same pattern.
@@ -146,13 +167,15 @@ struct adv_monitor_device {
 	struct adv_monitor *monitor;
 	struct btd_device *device;
 
-	time_t high_rssi_first_seen;	/* Start time when RSSI climbs above
-					 * the high RSSI threshold
+	uint64_t high_rssi_first_seen;	/* Start time (ms) when RSSI climbs
+					 * above the high RSSI threshold
+					 */
+	uint64_t low_rssi_first_seen;	/* Start time (ms) when RSSI drops
+					 * below the low RSSI threshold
 					 */
-	time_t low_rssi_first_seen;	/* Start time when RSSI drops below
-					 * the low RSSI threshold
+	uint64_t last_seen;		/* Time (ms) when last Adv was
+					 * received
 					 */
-	time_t last_seen;		/* Time when last Adv was received */
 	bool found;			/* State of the device - lost/found */
 	unsigned int lost_timer;	/* Timer to track if the device goes
 					 * offline/out-of-range
@@ -164,11 +187,6 @@ struct app_match_data {
 	const char *path;
 };
 
-struct adv_content_filter_info {
-	struct bt_ad *ad;
-	struct queue *matched_monitors;	/* List of matched monitors */
-};
-
 struct adv_rssi_filter_info {
 	struct btd_device *device;
 	int8_t rssi;
@@ -489,15 +507,28 @@ print_state:
 			get_merged_pattern_state_name(mp->next_state));
 }
 
+/* Drops the compiled patterns, they are rebuilt on the next match */
+static void matcher_invalidate(struct btd_adv_monitor_manager *manager)
+{
+	bt_ad_matcher_free(manager->matcher);
+	manager->matcher = NULL;
+	manager->matcher_gen++;
+}
+
 /* Frees a monitor object */
 static void monitor_free(struct adv_monitor *monitor)
 {
+	matcher_invalidate(monitor->app->manager);
+
 	g_dbus_proxy_unref(monitor->proxy);
 	g_free(monitor->path);
 
 	queue_destroy(monitor->devices, monitor_device_free);
 	monitor->devices = NULL;
 
+	timeout_remove(monitor->report_timer);
+	queue_destroy(monitor->reports, free);
+
 	free(monitor);
 }
 
@@ -643,6 +674,7 @@ static void monitor_state_active(void *data, void *user_data)
 		return;
 
 	monitor->state = MONITOR_STATE_ACTIVE;
+	matcher_invalidate(monitor->app->manager);
 
 	DBG("Calling Activate() on Adv Monitor of owner %s at path %s",
 		monitor->app->owner, monitor->path);
@@ -704,6 +736,7 @@ static struct adv_monitor *monitor_new(struct adv_monitor_app *app,
 
 	rssi_unset(&monitor->rssi);
 	monitor->devices = queue_new();
+	monitor->reports = queue_new();
 
 	return monitor;
 }
@@ -881,6 +914,36 @@ failed:
 	return false;
 }
 
+/* Retrieves ReportInterval from the remote Adv Monitor object and update the
+ * local Adv Monitor
+ */
+static bool parse_report_interval(struct adv_monitor *monitor,
+							const char *path)
+{
+	DBusMessageIter iter;
+	uint16_t adapter_id = monitor->app->manager->adapter_id;
+
+	monitor->report_interval = ADV_MONITOR_UNSET_REPORT_INTERVAL;
+
+	if (!g_dbus_proxy_get_property(monitor->proxy, "ReportInterval",
+								&iter))
+		return true;
+
+	if (dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_UINT16) {
+		btd_error(adapter_id, "Invalid argument of property "
+				"ReportInterval of the Adv Monitor at path %s",
+				path);
+		return false;
+	}
+
+	dbus_message_iter_get_basic(&iter, &monitor->report_interval);
+
+	DBG("Adv Monitor at %s reports devices every %u ms", path,
+						monitor->report_interval);
+
+	return true;
+}
+
 /* Retrieves Patterns from the remote Adv Monitor object, verifies the values
  * and update the local Adv Monitor
  */
@@ -982,6 +1045,9 @@ static bool monitor_process(struct adv_monitor *monitor)
 	if (!parse_rssi_and_timeout(monitor, path))
 		goto fail;
 
+	if (!parse_report_interval(monitor, path))
+		goto fail;
+
 	if (monitor->merged_pattern->type != MONITOR_TYPE_OR_PATTERNS ||
 					!parse_patterns(monitor, path))
 		goto fail;
@@ -1544,20 +1610,119 @@ static void report_device_state_setup(DBusMessageIter *iter, void *user_data)
 	dbus_message_iter_append_basic(iter, DBUS_TYPE_OBJECT_PATH, &path);
 }
 
+/* Includes the found or lost devices of the batch into the dbus message */
+static void append_reports(DBusMessageIter *iter, struct queue *reports,
+								bool found)
+{
+	DBusMessageIter array;
+	const struct queue_entry *e;
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					DBUS_TYPE_OBJECT_PATH_AS_STRING,
+					&array);
+
+	for (e = queue_get_entries(reports); e; e = e->next) {
+		struct adv_monitor_report *report = e->data;
+		const char *path;
+
+		if (report->found != found)
+			continue;
+
+		path = device_get_path(report->device);
+		dbus_message_iter_append_basic(&array, DBUS_TYPE_OBJECT_PATH,
+									&path);
+	}
+
+	dbus_message_iter_close_container(iter, &array);
+}
+
+static void report_devices_setup(DBusMessageIter *iter, void *user_data)
+{
+	struct adv_monitor *monitor = user_data;
+
+	append_reports(iter, monitor->reports, true);
+	append_reports(iter, monitor->reports, false);
+}
+
+/* Sends the batch of device state changes collected during the interval */
+static bool monitor_report_timeout(gpointer user_data)
+{
+	struct adv_monitor *monitor = user_data;
+
+	monitor->report_timer = 0;
+
+	if (queue_isempty(monitor->reports))
+		return FALSE;
+
+	DBG("Calling DevicesChanged() on Adv Monitor of owner %s at path %s",
+		monitor->app->owner, monitor->path);
+
+	g_dbus_proxy_method_call(monitor->proxy, "DevicesChanged",
+				 report_devices_setup, NULL, monitor, NULL);
+
+	queue_remove_all(monitor->reports, NULL, NULL, free);
+
+	return FALSE;
+}
+
+static bool report_device_match(const void *a, const void *b)
+{
+	const struct adv_monitor_report *report = a;
+
+	return report->device == b;
+}
+
+/* Notifies the monitor of a found or lost device, either right away or with
+ * the next batch if the monitor has a report interval
+ */
+static void monitor_report_device(struct adv_monitor *monitor,
+					struct btd_device *device, bool found)
+{
+	const char *method = found ? "DeviceFound" : "DeviceLost";
+	struct adv_monitor_report *report;
+
+	if (!monitor->report_interval) {
+		DBG("Calling %s() on Adv Monitor of owner %s at path %s",
+			method, monitor->app->owner, monitor->path);
+
+		g_dbus_proxy_method_call(monitor->proxy, method,
+					 report_device_state_setup, NULL,
+					 device, NULL);
+		return;
+	}
+
+	/* Within a batch a repeated state is dropped, while a found/lost
+	 * pair cancels out since the device ends up as it was reported last.
+	 */
+	report = queue_find(monitor->reports, report_device_match, device);
+	if (report) {
+		if (report->found != found) {
+			queue_remove(monitor->reports, report);
+			free(report);
+		}
+
+		return;
+	}
+
+	report = new0(struct adv_monitor_report, 1);
+	report->device = device;
+	report->found = found;
+	queue_push_tail(monitor->reports, report);
+
+	if (!monitor->report_timer)
+		monitor->report_timer = timeout_add(monitor->report_interval,
+						monitor_report_timeout,
+						monitor, NULL);
+}
+
 /* Invokes DeviceFound on the matched monitor */
 static void notify_device_found_per_monitor(void *data, void *user_data)
 {
 	struct adv_monitor *monitor = data;
 	struct monitored_device_info *info = user_data;
 
-	if (monitor->merged_pattern->monitor_handle == info->monitor_handle) {
-		DBG("Calling DeviceFound() on Adv Monitor of owner %s "
-		    "at path %s", monitor->app->owner, monitor->path);
-
-		g_dbus_proxy_method_call(monitor->proxy, "DeviceFound",
-					 report_device_state_setup, NULL,
-					 info->device, NULL);
-	}
+	if (monitor->merged_pattern->monitor_handle == info->monitor_handle)
+		monitor_report_device(monitor, info->device, true);
 }
 
 /* Checks all monitors for match in the app to invoke DeviceFound */
@@ -1647,14 +1812,8 @@ static void notify_device_lost_per_monitor(void *data, void *user_data)
 	struct adv_monitor *monitor = data;
 	struct monitored_device_info *info = user_data;
 
-	if (monitor->merged_pattern->monitor_handle == info->monitor_handle) {
-		DBG("Calling DeviceLost() on Adv Monitor of owner %s "
-		    "at path %s", monitor->app->owner, monitor->path);
-
-		g_dbus_proxy_method_call(monitor->proxy, "DeviceLost",
-					 report_device_state_setup, NULL,
-					 info->device, NULL);
-	}
+	if (monitor->merged_pattern->monitor_handle == info->monitor_handle)
+		monitor_report_device(monitor, info->device, false);
 }
 
 /* Checks all monitors for match in the app to invoke DeviceLost */
@@ -1744,6 +1903,8 @@ static void manager_free(struct btd_adv_monitor_manager *manager)
 	queue_destroy(manager->apps, app_destroy);
 	queue_destroy(manager->merged_patterns, merged_pattern_free);
 
+	bt_ad_matcher_free(manager->matcher);
+
 	free(manager);
 }
 
@@ -1853,50 +2014,61 @@ bool btd_adv_monitor_offload_enabled(struct btd_adv_monitor_manager *manager)
 				MGMT_ADV_MONITOR_FEATURE_MASK_OR_PATTERNS);
 }
 
-/* Processes the content matching based pattern(s) of a monitor */
-static void adv_match_per_monitor(void *data, void *user_data)
+/*
+ * Content filter results stay valid for as long as the generation returned
+ * here is unchanged.
+ */
+unsigned int btd_adv_monitor_generation(struct btd_adv_monitor_manager *manager)
+{
+	if (!manager)
+		return 0;
+
+	return manager->matcher_gen;
+}
+
+/* Adds the patterns of an active monitor to the matcher */
+static void matcher_add_monitor(void *data, void *user_data)
 {
 	struct adv_monitor *monitor = data;
-	struct adv_content_filter_info *info = user_data;
-	struct queue *patterns;
+	struct bt_ad_matcher *matcher = user_data;
 
-	if (!monitor) {
-		error("Unexpected NULL adv_monitor object upon match");
+	if (monitor->state != MONITOR_STATE_ACTIVE || !monitor->merged_pattern)
 		return;
-	}
 
-	if (monitor->state != MONITOR_STATE_ACTIVE)
+	if (monitor->merged_pattern->type != MONITOR_TYPE_OR_PATTERNS)
 		return;
 
-	if (!monitor->merged_pattern)
-		return;
+	bt_ad_matcher_add(matcher, monitor->merged_pattern->patterns, monitor);
+}
 
-	patterns = monitor->merged_pattern->patterns;
-	if (monitor->merged_pattern->type == MONITOR_TYPE_OR_PATTERNS &&
-				bt_ad_pattern_match(info->ad, patterns)) {
-		goto matched;
-	}
+static void matcher_add_app(void *data, void *user_data)
+{
+	struct adv_monitor_app *app = data;
 
-	return;
+	queue_foreach(app->monitors, matcher_add_monitor, user_data);
+}
 
-matched:
-	if (!info->matched_monitors)
-		info->matched_monitors = queue_new();
+static void matcher_build(struct btd_adv_monitor_manager *manager)
+{
+	manager->matcher = bt_ad_matcher_new();
 
-	queue_push_tail(info->matched_monitors, monitor);
+	queue_foreach(manager->apps, matcher_add_app, manager->matcher);
 }
 
-/* Processes the content matching for the monitor(s) of an app */
-static void adv_match_per_app(void *data, void *user_data)
+/* Collects a monitor matched by the compiled patterns */
+static void adv_match_monitor(void *match_data, void *user_data)
 {
-	struct adv_monitor_app *app = data;
+	struct adv_monitor *monitor = match_data;
+	struct queue **matched_monitors = user_data;
 
-	if (!app) {
-		error("Unexpected NULL adv_monitor_app object upon match");
+	/* Monitors may have been removed since the matcher was built */
+	if (monitor->state != MONITOR_STATE_ACTIVE || !monitor->merged_pattern)
 		return;
-	}
 
-	queue_foreach(app->monitors, adv_match_per_monitor, user_data);
+	if (!*matched_monitors)
+		*matched_monitors = queue_new();
+
+	queue_push_tail(*matched_monitors, monitor);
 }
 
 /* Processes the content matching for every app without RSSI filtering and
@@ -1906,19 +2078,20 @@ static void adv_match_per_app(void *data, void *user_data)
  */
 struct queue *btd_adv_monitor_content_filter(
 				struct btd_adv_monitor_manager *manager,
-				struct bt_ad *ad)
+				const uint8_t *data, uint8_t data_len)
 {
-	struct adv_content_filter_info info;
+	struct queue *matched_monitors = NULL;
 
-	if (!manager || !ad)
+	if (!manager || !data || !data_len)
 		return NULL;
 
-	info.ad = ad;
-	info.matched_monitors = NULL;
+	if (!manager->matcher)
+		matcher_build(manager);
 
-	queue_foreach(manager->apps, adv_match_per_app, &info);
+	bt_ad_matcher_match(manager->matcher, data_len, data,
+					adv_match_monitor, &matched_monitors);
 
-	return info.matched_monitors;
+	return matched_monitors;
 }
 
 /* Wraps adv_monitor_filter_rssi() to processes the content-matched monitor with
@@ -2006,6 +2179,8 @@ static void remove_device_from_monitor(void *data, void *user_data)
 		return;
 	}
 
+	queue_remove_all(monitor->reports, report_device_match, device, free);
+
 	dev = queue_remove_if(monitor->devices, monitor_device_match, device);
 	if (dev) {
 		DBG("Device removed from the Adv Monitor at path %s",
@@ -2064,13 +2239,9 @@ static bool handle_device_lost_timeout(gpointer user_data)
 	struct adv_monitor_device *dev = user_data;
 	struct adv_monitor *monitor = dev->monitor;
 
-	DBG("Device Lost timeout triggered for device %p. Calling DeviceLost() "
-	    "on Adv Monitor of owner %s at path %s", dev->device,
-					    monitor->app->owner, monitor->path);
+	DBG("Device Lost timeout triggered for device %p", dev->device);
 
-	g_dbus_proxy_method_call(monitor->proxy, "DeviceLost",
-				 report_device_state_setup,
-				 NULL, dev->device, NULL);
+	monitor_report_device(monitor, dev->device, false);
 
 	dev->lost_timer = 0;
 	dev->found = false;
@@ -2078,12 +2249,24 @@ static bool handle_device_lost_timeout(gpointer user_data)
 	return FALSE;
 }
 
+/* Returns the monotonic time in milliseconds */
+static uint64_t monotonic_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
 /* Filters an Adv based on its RSSI value */
 static void adv_monitor_filter_rssi(struct adv_monitor *monitor,
 				    struct btd_device *device, int8_t rssi)
 {
 	struct adv_monitor_device *dev = NULL;
-	time_t curr_time = time(NULL);
+	uint64_t curr_time = monotonic_ms();
+	uint64_t high_timeout = monitor->rssi.high_rssi_timeout * 1000ULL;
+	uint64_t low_timeout = monitor->rssi.low_rssi_timeout * 1000ULL;
 	uint16_t adapter_id = monitor->app->manager->adapter_id;
 
 	/* If the RSSI thresholds and timeouts are not specified, report the
@@ -2091,13 +2274,7 @@ static void adv_monitor_filter_rssi(struct adv_monitor *monitor,
 	 * already matched the pattern filter.
 	 */
 	if (rssi_is_unset(&monitor->rssi)) {
-		DBG("Calling DeviceFound() on Adv Monitor of owner %s "
-		    "at path %s", monitor->app->owner, monitor->path);
-
-		g_dbus_proxy_method_call(monitor->proxy, "DeviceFound",
-					 report_device_state_setup, NULL,
-					 device, NULL);
-
+		monitor_report_device(monitor, device, true);
 		return;
 	}
 
@@ -2120,33 +2297,22 @@ static void adv_monitor_filter_rssi(struct adv_monitor *monitor,
 	 * longer than the high/low timeouts.
 	 */
 	if (dev->last_seen) {
-		if (difftime(curr_time, dev->last_seen) >
-		    monitor->rssi.high_rssi_timeout) {
+		if (curr_time - dev->last_seen > high_timeout)
 			dev->high_rssi_first_seen = 0;
-		}
 
-		if (difftime(curr_time, dev->last_seen) >
-		    monitor->rssi.low_rssi_timeout) {
+		if (curr_time - dev->last_seen > low_timeout)
 			dev->low_rssi_first_seen = 0;
-		}
 	}
 	dev->last_seen = curr_time;
 
 	/* Check for the found devices (if the device is not already found) */
 	if (!dev->found && rssi > monitor->rssi.high_rssi) {
 		if (dev->high_rssi_first_seen) {
-			if (difftime(curr_time, dev->high_rssi_first_seen) >=
-			    monitor->rssi.high_rssi_timeout) {
+			if (curr_time - dev->high_rssi_first_seen >=
+							high_timeout) {
 				dev->found = true;
-
-				DBG("Calling DeviceFound() on Adv Monitor "
-				    "of owner %s at path %s",
-				    monitor->app->owner, monitor->path);
-
-				g_dbus_proxy_method_call(
-					monitor->proxy, "DeviceFound",
-					report_device_state_setup, NULL,
-					dev->device, NULL);
+				monitor_report_device(monitor, dev->device,
+									true);
 			}
 		} else {
 			dev->high_rssi_first_seen = curr_time;
@@ -2161,18 +2327,11 @@ static void adv_monitor_filter_rssi(struct adv_monitor *monitor,
 	 */
 	if (dev->found && rssi < monitor->rssi.low_rssi) {
 		if (dev->low_rssi_first_seen) {
-			if (difftime(curr_time, dev->low_rssi_first_seen) >=
-			    monitor->rssi.low_rssi_timeout) {
+			if (curr_time - dev->low_rssi_first_seen >=
+							low_timeout) {
 				dev->found = false;
-
-				DBG("Calling DeviceLost() on Adv Monitor "
-				    "of owner %s at path %s",
-				    monitor->app->owner, monitor->path);
-
-				g_dbus_proxy_method_call(
-					monitor->proxy, "DeviceLost",
-					report_device_state_setup, NULL,
-					dev->device, NULL);
+				monitor_report_device(monitor, dev->device,
+									false);
 			}
 		} else {
 			dev->low_rssi_first_seen = curr_time;
@@ -2186,10 +2345,9 @@ static void adv_monitor_filter_rssi(struct adv_monitor *monitor,
 	 * the High RSSI Threshold, nothing needs to be done.
 	 */
 	if (dev->found) {
-		dev->lost_timer =
-			timeout_add_seconds(monitor->rssi.low_rssi_timeout,
-					    handle_device_lost_timeout, dev,
-					    NULL);
+		dev->lost_timer = timeout_add(low_timeout,
+					handle_device_lost_timeout, dev,
+					NULL);
 	}
 }
 
@@ -2205,13 +2363,9 @@ static void clear_device_lost_timer(void *data, void *user_data)
 
 		monitor = dev->monitor;
 
-		DBG("Calling DeviceLost() for device %p on Adv Monitor "
-				"of owner %s at path %s", dev->device,
-				monitor->app->owner, monitor->path);
+		DBG("Device %p lost on power down", dev->device);
 
-		g_dbus_proxy_method_call(monitor->proxy, "DeviceLost",
-				report_device_state_setup,
-				NULL, dev->device, NULL);
+		monitor_report_device(monitor, dev->device, false);
 	}
 }
 
@@ -52,6 +52,10 @@ struct btd_adv_manager {
 	bool extended_add_cmds;
 	int8_t min_tx_power;
 	int8_t max_tx_power;
+	struct queue *rotation;
+	uint8_t rot_instance;
+	struct btd_adv_client *rot_current;
+	unsigned int rot_id;
 };
 
 #define AD_TYPE_BROADCAST 0
@@ -62,6 +66,9 @@ struct btd_adv_manager {
  */
 #define ADV_TX_POWER_NO_PREFERENCE 0x7F
 
+/* Default time slice of a rotated advertisement, same as the kernel's */
+#define ADV_ROTATION_DURATION 2
+
 struct btd_adv_client {
 	struct btd_adv_manager *manager;
 	char *owner;
@@ -86,6 +93,9 @@ struct btd_adv_client {
 	uint32_t max_interval;
 	int8_t tx_power;
 	mgmt_request_func_t refresh_done_func;
+	bool rotated;
+	struct mgmt_cp_add_advertising *rot_cp;
+	uint8_t rot_cp_len;
 };
 
 struct dbus_obj_match {
@@ -107,6 +117,9 @@ static bool match_client(const void *a, const void *b)
 	return true;
 }
 
+static void rotation_leave(struct btd_adv_client *client);
+static void rotation_promote(struct btd_adv_manager *manager);
+
 static void client_free(void *data)
 {
 	struct btd_adv_client *client = data;
@@ -135,9 +148,15 @@ static void client_free(void *data)
 	if (client->add_adv_id)
 		mgmt_cancel(client->manager->mgmt, client->add_adv_id);
 
-	if (client->instance)
+	if (client->rotated)
+		rotation_leave(client);
+	else if (client->instance) {
 		util_clear_uid(&client->manager->instance_bitmap,
 						client->instance);
+		rotation_promote(client->manager);
+	}
+
+	free(client->rot_cp);
 
 	bt_ad_unref(client->data);
 	bt_ad_unref(client->scan);
@@ -202,11 +221,15 @@ static void client_remove(void *data)
 									client);
 	g_dbus_client_set_disconnect_watch(client->client, NULL, NULL);
 
-	cp.instance = client->instance;
+	if (client->rotated) {
+		rotation_leave(client);
+	} else {
+		cp.instance = client->instance;
 
-	mgmt_send(client->manager->mgmt, MGMT_OP_REMOVE_ADVERTISING,
-			client->manager->mgmt_index, sizeof(cp), &cp,
-			NULL, NULL, NULL);
+		mgmt_send(client->manager->mgmt, MGMT_OP_REMOVE_ADVERTISING,
+				client->manager->mgmt_index, sizeof(cp), &cp,
+				NULL, NULL, NULL);
+	}
 
 	queue_remove(client->manager->clients, client);
 
@@ -819,45 +842,42 @@ static int get_adv_flags(struct btd_adv_client *client)
 	return flags;
 }
 
-static int refresh_legacy_adv(struct btd_adv_client *client,
-				mgmt_request_func_t func,
-				unsigned int *mgmt_id)
+static struct mgmt_cp_add_advertising *build_add_adv(
+					struct btd_adv_client *client,
+					uint8_t *param_len)
 {
 	struct mgmt_cp_add_advertising *cp;
-	uint8_t param_len;
 	uint8_t *adv_data;
 	size_t adv_data_len;
 	uint8_t *scan_rsp;
 	size_t scan_rsp_len = -1;
 	uint32_t flags = 0;
-	unsigned int mgmt_ret;
-
-	DBG("Refreshing advertisement: %s", client->path);
 
 	flags = get_adv_flags(client);
 
 	adv_data = generate_adv_data(client, &flags, &adv_data_len);
 	if (!adv_data || (adv_data_len > calc_max_adv_len(client, flags))) {
 		error("Advertising data too long or couldn't be generated.");
-		return -EINVAL;
+		free(adv_data);
+		return NULL;
 	}
 
 	scan_rsp = generate_scan_rsp(client, &flags, &scan_rsp_len);
 	if (!scan_rsp && scan_rsp_len) {
 		error("Scan data couldn't be generated.");
 		free(adv_data);
-		return -EINVAL;
+		return NULL;
 	}
 
-	param_len = sizeof(struct mgmt_cp_add_advertising) + adv_data_len +
+	*param_len = sizeof(struct mgmt_cp_add_advertising) + adv_data_len +
 							scan_rsp_len;
 
-	cp = malloc0(param_len);
+	cp = malloc0(*param_len);
 	if (!cp) {
 		error("Couldn't allocate for MGMT!");
 		free(adv_data);
 		free(scan_rsp);
-		return -ENOMEM;
+		return NULL;
 	}
 
 	cp->flags = htobl(flags);
@@ -871,6 +891,23 @@ static int refresh_legacy_adv(struct btd_adv_client *client,
 	free(adv_data);
 	free(scan_rsp);
 
+	return cp;
+}
+
+static int refresh_legacy_adv(struct btd_adv_client *client,
+				mgmt_request_func_t func,
+				unsigned int *mgmt_id)
+{
+	struct mgmt_cp_add_advertising *cp;
+	uint8_t param_len;
+	unsigned int mgmt_ret;
+
+	DBG("Refreshing advertisement: %s", client->path);
+
+	cp = build_add_adv(client, &param_len);
+	if (!cp)
+		return -EINVAL;
+
 	mgmt_ret = mgmt_send(client->manager->mgmt, MGMT_OP_ADD_ADVERTISING,
 			client->manager->mgmt_index, param_len, cp,
 			func, client, NULL);
@@ -953,9 +990,320 @@ static int refresh_extended_adv(struct btd_adv_client *client,
 	return 0;
 }
 
+/*
+ * Advertisements registered once every instance is in use share a single
+ * instance which is handed to each of them in turn, for as long as their
+ * Duration (ADV_ROTATION_DURATION if unset). The Add Advertising command of
+ * every rotated advertisement is generated up front, so that switching to
+ * the next one takes a single mgmt command.
+ */
+static bool rotation_prepare(struct btd_adv_client *client)
+{
+	free(client->rot_cp);
+
+	client->rot_cp = build_add_adv(client, &client->rot_cp_len);
+
+	return client->rot_cp != NULL;
+}
+
+static void rotation_add_callback(uint8_t status, uint16_t length,
+					const void *param, void *user_data)
+{
+	struct btd_adv_client *client = user_data;
+
+	client->add_adv_id = 0;
+
+	if (!status)
+		return;
+
+	error("Failed to rotate advertisement %s: %s (0x%02x)", client->path,
+						mgmt_errstr(status), status);
+
+	/* Failure ends the advertisement, as it does for registration */
+	client_release(client);
+	client_remove(client);
+}
+
+static void rotation_send(struct btd_adv_manager *manager)
+{
+	struct btd_adv_client *client = manager->rot_current;
+
+	if (!client || !client->rot_cp)
+		return;
+
+	DBG("instance %u: %s", manager->rot_instance, client->path);
+
+	if (client->add_adv_id)
+		mgmt_cancel(manager->mgmt, client->add_adv_id);
+
+	client->add_adv_id = mgmt_send(manager->mgmt, MGMT_OP_ADD_ADVERTISING,
+				manager->mgmt_index, client->rot_cp_len,
+				client->rot_cp, rotation_add_callback, client,
+				NULL);
+	if (!client->add_adv_id)
+		error("Failed to rotate advertisement %s", client->path);
+}
+
+static struct btd_adv_client *rotation_next(struct btd_adv_manager *manager)
+{
+	const struct queue_entry *entry;
+
+	for (entry = queue_get_entries(manager->rotation); entry;
+							entry = entry->next) {
+		if (entry->data == manager->rot_current)
+			break;
+	}
+
+	if (entry && entry->next)
+		return entry->next->data;
+
+	return queue_peek_head(manager->rotation);
+}
+
+static bool rotation_timeout(void *user_data);
+
+static void rotation_schedule(struct btd_adv_manager *manager)
+{
+	struct btd_adv_client *client = manager->rot_current;
+
+	timeout_remove(manager->rot_id);
+	manager->rot_id = 0;
+
+	if (!client || queue_length(manager->rotation) < 2)
+		return;
+
+	manager->rot_id = timeout_add_seconds(client->duration ?
+						client->duration :
+						ADV_ROTATION_DURATION,
+						rotation_timeout, manager,
+						NULL);
+}
+
+static bool rotation_timeout(void *user_data)
+{
+	struct btd_adv_manager *manager = user_data;
+
+	manager->rot_id = 0;
+	manager->rot_current = rotation_next(manager);
+
+	rotation_send(manager);
+	rotation_schedule(manager);
+
+	return FALSE;
+}
+
+static void rotation_stop(struct btd_adv_manager *manager)
+{
+	DBG("instance %u", manager->rot_instance);
+
+	timeout_remove(manager->rot_id);
+	manager->rot_id = 0;
+	manager->rot_current = NULL;
+
+	remove_advertising(manager, manager->rot_instance);
+	util_clear_uid(&manager->instance_bitmap, manager->rot_instance);
+	manager->rot_instance = 0;
+}
+
+static int refresh_advertisement(struct btd_adv_client *client,
+			mgmt_request_func_t func, unsigned int *mgmt_id);
+
+/* Take a member out of the rotation and advertise it on its own instance */
+static void rotation_detach(struct btd_adv_client *client, uint8_t instance)
+{
+	DBG("instance %u: %s", instance, client->path);
+
+	if (client->add_adv_id) {
+		mgmt_cancel(client->manager->mgmt, client->add_adv_id);
+		client->add_adv_id = 0;
+	}
+
+	client->rotated = false;
+	client->instance = instance;
+
+	free(client->rot_cp);
+	client->rot_cp = NULL;
+
+	refresh_advertisement(client, NULL, NULL);
+}
+
+/* The last member of a rotation keeps the shared instance for itself */
+static void rotation_finish(struct btd_adv_manager *manager)
+{
+	struct btd_adv_client *client;
+	uint8_t instance;
+
+	if (queue_isempty(manager->rotation)) {
+		rotation_stop(manager);
+		return;
+	}
+
+	if (queue_length(manager->rotation) > 1)
+		return;
+
+	client = queue_pop_head(manager->rotation);
+	instance = manager->rot_instance;
+
+	timeout_remove(manager->rot_id);
+	manager->rot_id = 0;
+	manager->rot_current = NULL;
+	manager->rot_instance = 0;
+
+	rotation_detach(client, instance);
+}
+
+/* Move the next member of the rotation onto an instance that was freed */
+static void rotation_promote(struct btd_adv_manager *manager)
+{
+	struct btd_adv_client *client;
+	uint8_t instance;
+
+	/* The rotation is gone while the manager is destroyed */
+	if (!manager->rotation || queue_isempty(manager->rotation))
+		return;
+
+	instance = util_get_uid(&manager->instance_bitmap, manager->max_ads);
+	if (!instance)
+		return;
+
+	client = rotation_next(manager);
+
+	rotation_leave(client);
+	rotation_detach(client, instance);
+}
+
+static bool rotation_reserve(struct btd_adv_manager *manager)
+{
+	const struct queue_entry *entry;
+	struct btd_adv_client *victim = NULL;
+
+	if (manager->rot_instance)
+		return true;
+
+	manager->rot_instance = util_get_uid(&manager->instance_bitmap,
+							manager->max_ads);
+	if (manager->rot_instance)
+		return true;
+
+	/*
+	 * Turn the registered advertisement with the highest instance into
+	 * the first member of the rotation; it keeps advertising until its
+	 * slot expires.
+	 */
+	for (entry = queue_get_entries(manager->clients); entry;
+							entry = entry->next) {
+		struct btd_adv_client *client = entry->data;
+
+		if (client->rotated || client->reg || !client->instance)
+			continue;
+
+		if (!victim || client->instance > victim->instance)
+			victim = client;
+	}
+
+	if (!victim || !rotation_prepare(victim))
+		return false;
+
+	DBG("Rotating instance %u", victim->instance);
+
+	victim->rotated = true;
+	manager->rot_instance = victim->instance;
+	manager->rot_current = victim;
+	queue_push_tail(manager->rotation, victim);
+
+	return true;
+}
+
+static int rotation_join(struct btd_adv_client *client)
+{
+	struct btd_adv_manager *manager = client->manager;
+
+	if (!rotation_reserve(manager))
+		return -EBUSY;
+
+	client->instance = manager->rot_instance;
+
+	if (!rotation_prepare(client)) {
+		client->instance = 0;
+		rotation_finish(manager);
+
+		return -EINVAL;
+	}
+
+	queue_push_tail(manager->rotation, client);
+
+	/* An instance was freed since it was reserved, nothing to share */
+	if (queue_length(manager->rotation) < 2) {
+		rotation_finish(manager);
+		return 0;
+	}
+
+	if (!manager->rot_current) {
+		manager->rot_current = client;
+		rotation_send(manager);
+	}
+
+	if (!manager->rot_id)
+		rotation_schedule(manager);
+
+	return 0;
+}
+
+static void rotation_leave(struct btd_adv_client *client)
+{
+	struct btd_adv_manager *manager = client->manager;
+	bool current = manager->rot_current == client;
+
+	client->rotated = false;
+
+	/*
+	 * A registration that never got to join still holds the reservation
+	 * it made, which may have turned another advertisement into a lone
+	 * member of the rotation.
+	 */
+	if (!queue_find(manager->rotation, NULL, client)) {
+		if (manager->rotation && manager->rot_instance)
+			rotation_finish(manager);
+
+		return;
+	}
+
+	if (current)
+		manager->rot_current = rotation_next(manager);
+
+	queue_remove(manager->rotation, client);
+	client->instance = 0;
+
+	if (queue_length(manager->rotation) < 2) {
+		rotation_finish(manager);
+		return;
+	}
+
+	if (current) {
+		rotation_send(manager);
+		rotation_schedule(manager);
+	}
+}
+
+static int rotation_refresh(struct btd_adv_client *client)
+{
+	DBG("Refreshing rotated advertisement: %s", client->path);
+
+	if (!rotation_prepare(client))
+		return -EINVAL;
+
+	if (client->manager->rot_current == client)
+		rotation_send(client->manager);
+
+	return 0;
+}
+
 static int refresh_advertisement(struct btd_adv_client *client,
 			mgmt_request_func_t func, unsigned int *mgmt_id)
 {
+	if (client->rotated)
+		return rotation_refresh(client);
+
 	if (client->manager->extended_add_cmds)
 		return refresh_extended_adv(client, func, mgmt_id);
 
@@ -1195,6 +1543,24 @@ static void add_client_complete(struct btd_adv_client *client, uint8_t status)
 	client->reg = NULL;
 }
 
+static void client_added(struct btd_adv_client *client)
+{
+	g_dbus_client_set_disconnect_watch(client->client, client_disconnect_cb,
+									client);
+	DBG("Advertisement registered: %s", client->path);
+
+	g_dbus_emit_property_changed(btd_get_dbus_connection(),
+				adapter_get_path(client->manager->adapter),
+				LE_ADVERTISING_MGR_IFACE, "SupportedInstances");
+
+	g_dbus_emit_property_changed(btd_get_dbus_connection(),
+				adapter_get_path(client->manager->adapter),
+				LE_ADVERTISING_MGR_IFACE, "ActiveInstances");
+
+	g_dbus_proxy_set_property_watch(client->proxy, properties_changed,
+								client);
+}
+
 static void add_adv_callback(uint8_t status, uint16_t length,
 					  const void *param, void *user_data)
 {
@@ -1213,20 +1579,7 @@ static void add_adv_callback(uint8_t status, uint16_t length,
 
 	client->instance = rp->instance;
 
-	g_dbus_client_set_disconnect_watch(client->client, client_disconnect_cb,
-									client);
-	DBG("Advertisement registered: %s", client->path);
-
-	g_dbus_emit_property_changed(btd_get_dbus_connection(),
-				adapter_get_path(client->manager->adapter),
-				LE_ADVERTISING_MGR_IFACE, "SupportedInstances");
-
-	g_dbus_emit_property_changed(btd_get_dbus_connection(),
-				adapter_get_path(client->manager->adapter),
-				LE_ADVERTISING_MGR_IFACE, "ActiveInstances");
-
-	g_dbus_proxy_set_property_watch(client->proxy, properties_changed,
-								client);
+	client_added(client);
 
 done:
 	add_client_complete(client, status);
@@ -1396,8 +1749,16 @@ static DBusMessage *parse_advertisement(struct btd_adv_client *client)
 		goto fail;
 	}
 
-	err = refresh_advertisement(client, add_adv_callback,
-					&client->add_adv_id);
+	if (client->rotated) {
+		err = rotation_join(client);
+		if (!err) {
+			client_added(client);
+			add_client_complete(client, MGMT_STATUS_SUCCESS);
+			return NULL;
+		}
+	} else
+		err = refresh_advertisement(client, add_adv_callback,
+						&client->add_adv_id);
 
 	if (!err)
 		return NULL;
@@ -1522,7 +1883,10 @@ static DBusMessage *register_advertisement(DBusConnection *conn,
 
 	client->instance = util_get_uid(&manager->instance_bitmap,
 							manager->max_ads);
-	if (!client->instance) {
+	if (!client->instance)
+		client->rotated = rotation_reserve(manager);
+
+	if (!client->instance && !client->rotated) {
 		client_free(client);
 		return btd_error_not_permitted(msg,
 					"Maximum advertisements reached");
@@ -1571,9 +1935,13 @@ static gboolean get_instances(const GDBusPropertyTable *property,
 					DBusMessageIter *iter, void *data)
 {
 	struct btd_adv_manager *manager = data;
-	uint8_t instances;
+	uint8_t instances = 0;
+	uint8_t i;
 
-	instances = manager->max_ads - queue_length(manager->clients);
+	for (i = 0; i < manager->max_ads; i++) {
+		if (!(manager->instance_bitmap & (1ULL << i)))
+			instances++;
+	}
 
 	dbus_message_iter_append_basic(iter, DBUS_TYPE_BYTE, &instances);
 
@@ -1757,6 +2125,10 @@ static void manager_destroy(void *user_data)
 {
 	struct btd_adv_manager *manager = user_data;
 
+	timeout_remove(manager->rot_id);
+	queue_destroy(manager->rotation, NULL);
+	manager->rotation = NULL;
+
 	queue_destroy(manager->clients, client_destroy);
 
 	mgmt_unref(manager->mgmt);
@@ -1862,6 +2234,7 @@ static struct btd_adv_manager *manager_create(struct btd_adapter *adapter,
 
 	manager->mgmt_index = btd_adapter_get_index(adapter);
 	manager->clients = queue_new();
+	manager->rotation = queue_new();
 	manager->supported_flags = MGMT_ADV_FLAG_LOCAL_NAME;
 	manager->extended_add_cmds =
 			btd_has_kernel_features(KERNEL_HAS_EXT_ADV_ADD_CMDS);
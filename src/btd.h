@@ -89,6 +89,7 @@ struct btd_defaults {
 struct btd_avdtp_opts {
 	uint8_t  session_mode;
 	uint8_t  stream_mode;
+	uint16_t stream_latency;
 };
 
 struct btd_advmon_opts {
@@ -102,6 +103,10 @@ struct btd_opts {
 	uint32_t	pairto;
 	uint32_t	discovto;
 	uint32_t	tmpto;
+	uint32_t	tmp_cache_size;
+	uint32_t	prop_interval;
+	uint32_t	report_interval;
+	uint8_t		report_rssi_delta;
 	uint8_t		privacy;
 	bool		device_privacy;
 	uint32_t	name_request_retry_delay;
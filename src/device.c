@@ -269,6 +269,7 @@ struct btd_device {
 	bool		legacy;
 	int8_t		rssi;
 	int8_t		tx_power;
+	uint64_t	adv_fingerprint;	/* Last applied report */
 
 	GIOChannel	*att_io;
 	guint		store_id;
@@ -1938,74 +1939,102 @@ void device_add_eir_uuids(struct btd_device *dev, GSList *uuids)
 						DEVICE_INTERFACE, "UUIDs");
 }
 
-static void add_manufacturer_data(void *data, void *user_data)
+void device_add_eir_view_uuids(struct btd_device *dev,
+						const struct eir_view *view)
 {
-	struct eir_msd *msd = data;
-	struct btd_device *dev = user_data;
+	struct eir_iter iter;
+	bt_uuid_t uuid;
+	char str[MAX_LEN_UUID_STR];
+	bool added = false;
 
-	if (!bt_ad_add_manufacturer_data(dev->ad, msd->company, msd->data,
-								msd->data_len))
+	if (dev->bredr_state.svc_resolved || dev->le_state.svc_resolved)
 		return;
 
-	g_dbus_emit_property_changed(dbus_conn, dev->path,
-					DEVICE_INTERFACE, "ManufacturerData");
-}
+	eir_iter_init(&iter, view);
 
-void device_set_manufacturer_data(struct btd_device *dev, GSList *list,
-								bool duplicate)
-{
-	if (duplicate)
-		bt_ad_clear_manufacturer_data(dev->ad);
+	while (eir_iter_next_uuid(&iter, &uuid)) {
+		bt_uuid_to_string(&uuid, str, sizeof(str));
+		if (g_slist_find_custom(dev->eir_uuids, str, bt_uuid_strcmp))
+			continue;
+		added = true;
+		dev->eir_uuids = g_slist_append(dev->eir_uuids, g_strdup(str));
+	}
 
-	g_slist_foreach(list, add_manufacturer_data, dev);
+	if (added)
+		g_dbus_emit_property_changed(dbus_conn, dev->path,
+						DEVICE_INTERFACE, "UUIDs");
 }
 
-static void add_service_data(void *data, void *user_data)
+void device_set_manufacturer_data(struct btd_device *dev,
+					const struct eir_view *view,
+					bool duplicate)
 {
-	struct eir_sd *sd = data;
-	struct btd_device *dev = user_data;
-	bt_uuid_t uuid;
+	struct eir_iter iter;
+	uint16_t company;
+	const uint8_t *data;
+	uint8_t len;
 
-	if (bt_string_to_uuid(&uuid, sd->uuid) < 0)
-		return;
+	if (duplicate)
+		bt_ad_clear_manufacturer_data(dev->ad);
 
-	if (!bt_ad_add_service_data(dev->ad, &uuid, sd->data, sd->data_len))
-		return;
+	eir_iter_init(&iter, view);
 
-	g_dbus_emit_property_changed(dbus_conn, dev->path,
-					DEVICE_INTERFACE, "ServiceData");
+	while (eir_iter_next_msd(&iter, &company, &data, &len)) {
+		if (!bt_ad_add_manufacturer_data(dev->ad, company,
+							(void *) data, len))
+			continue;
+
+		g_dbus_emit_property_changed(dbus_conn, dev->path,
+					DEVICE_INTERFACE, "ManufacturerData");
+	}
 }
 
-void device_set_service_data(struct btd_device *dev, GSList *list,
-							bool duplicate)
+void device_set_service_data(struct btd_device *dev,
+					const struct eir_view *view,
+					bool duplicate)
 {
+	struct eir_iter iter;
+	bt_uuid_t uuid;
+	const uint8_t *data;
+	uint8_t len;
+
 	if (duplicate)
 		bt_ad_clear_service_data(dev->ad);
 
-	g_slist_foreach(list, add_service_data, dev);
-}
-
-static void add_data(void *data, void *user_data)
-{
-	struct eir_ad *ad = data;
-	struct btd_device *dev = user_data;
+	eir_iter_init(&iter, view);
 
-	if (!bt_ad_add_data(dev->ad, ad->type, ad->data, ad->len))
-		return;
+	while (eir_iter_next_sd(&iter, &uuid, &data, &len)) {
+		if (!bt_ad_add_service_data(dev->ad, &uuid, (void *) data,
+									len))
+			continue;
 
-	if (ad->type == EIR_TRANSPORT_DISCOVERY)
 		g_dbus_emit_property_changed(dbus_conn, dev->path,
-						DEVICE_INTERFACE,
-						"AdvertisingData");
+					DEVICE_INTERFACE, "ServiceData");
+	}
 }
 
-void device_set_data(struct btd_device *dev, GSList *list,
+void device_set_data(struct btd_device *dev, const struct eir_view *view,
 							bool duplicate)
 {
+	struct eir_iter iter;
+	uint8_t type;
+	const uint8_t *data;
+	uint8_t len;
+
 	if (duplicate)
 		bt_ad_clear_data(dev->ad);
 
-	g_slist_foreach(list, add_data, dev);
+	eir_iter_init(&iter, view);
+
+	while (eir_iter_next_data(&iter, &type, &data, &len)) {
+		if (!bt_ad_add_data(dev->ad, type, (void *) data, len))
+			continue;
+
+		if (type == EIR_TRANSPORT_DISCOVERY)
+			g_dbus_emit_property_changed(dbus_conn, dev->path,
+							DEVICE_INTERFACE,
+							"AdvertisingData");
+	}
 }
 
 static struct btd_service *find_connectable_service(struct btd_device *dev,
@@ -2796,6 +2825,7 @@ static void device_svc_resolved(struct btd_device *dev, uint8_t browse_type,
 
 	g_slist_free_full(dev->eir_uuids, g_free);
 	dev->eir_uuids = NULL;
+	dev->adv_fingerprint = 0;
 
 	if (dev->pending_paired) {
 		g_dbus_emit_property_changed(dbus_conn, dev->path,
@@ -3148,6 +3178,53 @@ static const GDBusPropertyTable device_properties[] = {
 	{ }
 };
 
+static const GDBusPropertyTable *find_property(const char *name)
+{
+	const GDBusPropertyTable *p;
+
+	for (p = device_properties; p->name; p++) {
+		if (strcmp(p->name, name))
+			continue;
+
+		if ((p->flags & G_DBUS_PROPERTY_FLAG_EXPERIMENTAL) &&
+				!(g_dbus_get_flags() &
+					G_DBUS_FLAG_ENABLE_EXPERIMENTAL))
+			return NULL;
+
+		return p;
+	}
+
+	return NULL;
+}
+
+bool btd_device_has_property(const char *name)
+{
+	return find_property(name) != NULL;
+}
+
+/*
+ * Append a single Device1 property as a dict entry, using the same getter
+ * as the object itself. Properties that currently don't exist are skipped.
+ */
+void btd_device_append_property(struct btd_device *device, const char *name,
+							DBusMessageIter *dict)
+{
+	const GDBusPropertyTable *p = find_property(name);
+	DBusMessageIter entry, value;
+
+	if (!p || (p->exists && !p->exists(p, device)))
+		return;
+
+	dbus_message_iter_open_container(dict, DBUS_TYPE_DICT_ENTRY, NULL,
+								&entry);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &p->name);
+	dbus_message_iter_open_container(&entry, DBUS_TYPE_VARIANT, p->type,
+								&value);
+	p->get(p, &value, device);
+	dbus_message_iter_close_container(&entry, &value);
+	dbus_message_iter_close_container(dict, &entry);
+}
+
 uint8_t btd_device_get_bdaddr_type(struct btd_device *dev)
 {
 	return dev->bdaddr_type;
@@ -3302,6 +3379,7 @@ void device_remove_connection(struct btd_device *device, uint8_t bdaddr_type)
 
 	g_slist_free_full(device->eir_uuids, g_free);
 	device->eir_uuids = NULL;
+	device->adv_fingerprint = 0;
 
 	g_dbus_emit_property_changed(dbus_conn, device->path,
 						DEVICE_INTERFACE, "Connected");
@@ -6311,6 +6389,32 @@ void device_set_flags(struct btd_device *device, uint8_t flags)
 					DEVICE_INTERFACE, "AdvertisingFlags");
 }
 
+uint8_t device_get_flags(struct btd_device *device)
+{
+	if (!device)
+		return 0;
+
+	return device->ad_flags[0];
+}
+
+void device_set_adv_fingerprint(struct btd_device *device,
+							uint64_t fingerprint)
+{
+	if (!device)
+		return;
+
+	device->adv_fingerprint = fingerprint;
+}
+
+bool device_match_adv_fingerprint(struct btd_device *device,
+							uint64_t fingerprint)
+{
+	if (!device || !device->adv_fingerprint)
+		return false;
+
+	return device->adv_fingerprint == fingerprint;
+}
+
 bool device_is_connectable(struct btd_device *device)
 {
 	if (!device)
@@ -7008,6 +7112,16 @@ struct bt_gatt_client *btd_device_get_gatt_client(struct btd_device *device)
 	return device->client;
 }
 
+int btd_device_add_gatt_notify_mux(struct btd_device *device,
+					const char *path,
+					struct btd_gatt_notify_mux *mux)
+{
+	if (!device)
+		return -ENOENT;
+
+	return btd_gatt_client_add_notify_mux(device->client_dbus, path, mux);
+}
+
 void *btd_device_get_attrib(struct btd_device *device)
 {
 	if (!device)
@@ -7291,11 +7405,29 @@ struct btd_service *btd_device_get_service(struct btd_device *dev,
 	return NULL;
 }
 
+static const char *adv_properties[] = {
+	"RSSI",
+	"TxPower",
+	"ManufacturerData",
+	"ServiceData",
+	"AdvertisingData",
+	NULL
+};
+
 void btd_device_init(void)
 {
+	const char **prop;
+
 	dbus_conn = btd_get_dbus_connection();
 	service_state_cb_id = btd_service_add_state_cb(
 						service_state_changed, NULL);
+
+	if (!btd_opts.prop_interval)
+		return;
+
+	for (prop = adv_properties; *prop; prop++)
+		g_dbus_set_property_interval(dbus_conn, DEVICE_INTERFACE,
+						*prop, btd_opts.prop_interval);
 }
 
 void btd_device_cleanup(void)
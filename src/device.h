@@ -12,6 +12,8 @@
 #define DEVICE_INTERFACE	"org.bluez.Device1"
 
 struct btd_device;
+struct eir_view;
+struct btd_gatt_notify_mux;
 
 struct btd_device *device_create(struct btd_adapter *adapter,
 				const bdaddr_t *address, uint8_t bdaddr_type);
@@ -63,6 +65,12 @@ struct gatt_primary *btd_device_get_primary(struct btd_device *device,
 GSList *btd_device_get_primaries(struct btd_device *device);
 struct gatt_db *btd_device_get_gatt_db(struct btd_device *device);
 struct bt_gatt_client *btd_device_get_gatt_client(struct btd_device *device);
+bool btd_device_has_property(const char *name);
+void btd_device_append_property(struct btd_device *device, const char *name,
+							DBusMessageIter *dict);
+int btd_device_add_gatt_notify_mux(struct btd_device *device,
+					const char *path,
+					struct btd_gatt_notify_mux *mux);
 struct bt_gatt_server *btd_device_get_gatt_server(struct btd_device *device);
 void *btd_device_get_attrib(struct btd_device *device);
 void btd_device_gatt_set_service_changed(struct btd_device *device,
@@ -70,11 +78,15 @@ void btd_device_gatt_set_service_changed(struct btd_device *device,
 bool device_attach_att(struct btd_device *dev, GIOChannel *io);
 void btd_device_add_uuid(struct btd_device *device, const char *uuid);
 void device_add_eir_uuids(struct btd_device *dev, GSList *uuids);
-void device_set_manufacturer_data(struct btd_device *dev, GSList *list,
-							bool duplicate);
-void device_set_service_data(struct btd_device *dev, GSList *list,
-							bool duplicate);
-void device_set_data(struct btd_device *dev, GSList *list,
+void device_add_eir_view_uuids(struct btd_device *dev,
+						const struct eir_view *view);
+void device_set_manufacturer_data(struct btd_device *dev,
+					const struct eir_view *view,
+					bool duplicate);
+void device_set_service_data(struct btd_device *dev,
+					const struct eir_view *view,
+					bool duplicate);
+void device_set_data(struct btd_device *dev, const struct eir_view *view,
 							bool duplicate);
 void device_probe_profile(gpointer a, gpointer b);
 void device_remove_profile(gpointer a, gpointer b);
@@ -98,6 +110,11 @@ void device_set_rssi_with_delta(struct btd_device *device, int8_t rssi,
 void device_set_rssi(struct btd_device *device, int8_t rssi);
 void device_set_tx_power(struct btd_device *device, int8_t tx_power);
 void device_set_flags(struct btd_device *device, uint8_t flags);
+uint8_t device_get_flags(struct btd_device *device);
+void device_set_adv_fingerprint(struct btd_device *device,
+							uint64_t fingerprint);
+bool device_match_adv_fingerprint(struct btd_device *device,
+							uint64_t fingerprint);
 bool btd_device_is_connected(struct btd_device *dev);
 uint8_t btd_device_get_bdaddr_type(struct btd_device *dev);
 bool device_is_retrying(struct btd_device *device);
@@ -124,16 +124,19 @@ static void eir_parse_uuid128(struct eir_data *eir, const uint8_t *data,
 	}
 }
 
-static char *name2utf8(const uint8_t *name, uint8_t len)
+static void name2utf8_buf(const uint8_t *name, uint8_t len, char *utf8_name,
+								size_t size)
 {
-	char utf8_name[HCI_MAX_NAME_LENGTH + 2];
 	int i;
 
-	if (g_utf8_validate((const char *) name, len, NULL))
-		return g_strndup((char *) name, len);
+	if (len > size - 1)
+		len = size - 1;
+
+	memcpy(utf8_name, name, len);
+	utf8_name[len] = '\0';
 
-	memset(utf8_name, 0, sizeof(utf8_name));
-	strncpy(utf8_name, (char *) name, len);
+	if (g_utf8_validate((const char *) name, len, NULL))
+		return;
 
 	/* Assume ASCII, and replace all non-ASCII with spaces */
 	for (i = 0; utf8_name[i] != '\0'; i++) {
@@ -143,6 +146,13 @@ static char *name2utf8(const uint8_t *name, uint8_t len)
 
 	/* Remove leading and trailing whitespace characters */
 	g_strstrip(utf8_name);
+}
+
+static char *name2utf8(const uint8_t *name, uint8_t len)
+{
+	char utf8_name[UINT8_MAX + 1];
+
+	name2utf8_buf(name, len, utf8_name, sizeof(utf8_name));
 
 	return g_strdup(utf8_name);
 }
@@ -367,6 +377,329 @@ void eir_parse(struct eir_data *eir, const uint8_t *eir_data, uint8_t eir_len)
 	}
 }
 
+static size_t uuid_list_size(uint8_t type)
+{
+	switch (type) {
+	case EIR_UUID16_SOME:
+	case EIR_UUID16_ALL:
+		return 2;
+	case EIR_UUID32_SOME:
+	case EIR_UUID32_ALL:
+		return 4;
+	case EIR_UUID128_SOME:
+	case EIR_UUID128_ALL:
+		return 16;
+	}
+
+	return 0;
+}
+
+static size_t svc_data_uuid_size(uint8_t type)
+{
+	switch (type) {
+	case EIR_SVC_DATA16:
+		return 2;
+	case EIR_SVC_DATA32:
+		return 4;
+	case EIR_SVC_DATA128:
+		return 16;
+	}
+
+	return 0;
+}
+
+void eir_view_parse(struct eir_view *view, const uint8_t *eir_data,
+							uint8_t eir_len)
+{
+	uint16_t len = 0;
+
+	memset(view, 0, sizeof(*view));
+	view->data = eir_data;
+	view->tx_power = 127;
+
+	/* No EIR data to parse */
+	if (eir_data == NULL)
+		return;
+
+	while (len < eir_len - 1) {
+		uint8_t field_len = eir_data[len];
+		struct eir_field *field;
+		const uint8_t *data;
+
+		/* Check for the end of EIR */
+		if (field_len == 0)
+			break;
+
+		/* Do not continue EIR Data parsing if got incorrect length */
+		if (len + field_len + 1 > eir_len)
+			break;
+
+		field = &view->fields[view->num_fields++];
+		field->type = eir_data[len + 1];
+		field->offset = len + 2;
+		field->len = field_len - 1;
+
+		len += field_len + 1;
+
+		data = &eir_data[field->offset];
+
+		switch (field->type) {
+		case EIR_UUID16_SOME:
+		case EIR_UUID16_ALL:
+		case EIR_UUID32_SOME:
+		case EIR_UUID32_ALL:
+		case EIR_UUID128_SOME:
+		case EIR_UUID128_ALL:
+		case EIR_SSP_HASH:
+		case EIR_SSP_RANDOMIZER:
+			break;
+
+		case EIR_FLAGS:
+			if (field->len > 0)
+				view->flags = *data;
+			break;
+
+		case EIR_NAME_SHORT:
+		case EIR_NAME_COMPLETE:
+			view->name = field;
+			view->name_complete = field->type == EIR_NAME_COMPLETE;
+			break;
+
+		case EIR_TX_POWER:
+			if (field->len < 1)
+				break;
+			view->tx_power = (int8_t) data[0];
+			break;
+
+		case EIR_CLASS_OF_DEV:
+			if (field->len < 3)
+				break;
+			view->class = data[0] | (data[1] << 8) |
+							(data[2] << 16);
+			break;
+
+		case EIR_GAP_APPEARANCE:
+			if (field->len < 2)
+				break;
+			view->appearance = get_le16(data);
+			break;
+
+		case EIR_DEVICE_ID:
+			if (field->len < 8)
+				break;
+
+			view->did_source = get_le16(&data[0]);
+			view->did_vendor = get_le16(&data[2]);
+			view->did_product = get_le16(&data[4]);
+			view->did_version = get_le16(&data[6]);
+			break;
+
+		case EIR_SVC_DATA16:
+		case EIR_SVC_DATA32:
+		case EIR_SVC_DATA128:
+			if (field->len < svc_data_uuid_size(field->type) ||
+					field->len > EIR_SD_MAX_LEN)
+				break;
+			view->has_sd = true;
+			break;
+
+		case EIR_MANUFACTURER_DATA:
+			if (field->len < 2 || field->len > 2 + EIR_MSD_MAX_LEN)
+				break;
+			view->has_msd = true;
+			break;
+
+		default:
+			view->has_data = true;
+			break;
+		}
+	}
+}
+
+/* Returns the last field of the given type, as that is the one that counts */
+const struct eir_field *eir_view_find(const struct eir_view *view,
+							uint8_t type)
+{
+	unsigned int i;
+
+	for (i = view->num_fields; i > 0; i--) {
+		if (view->fields[i - 1].type == type)
+			return &view->fields[i - 1];
+	}
+
+	return NULL;
+}
+
+/*
+ * Copies the name into a buffer of the given size, HCI_MAX_NAME_LENGTH + 1
+ * holds any valid name. Returns false if the data carries no name.
+ */
+bool eir_view_get_name(const struct eir_view *view, char *name, size_t size)
+{
+	const uint8_t *data;
+	uint8_t len;
+
+	if (!view->name || !size)
+		return false;
+
+	data = view->data + view->name->offset;
+	len = view->name->len;
+
+	/* Some vendors put a NUL byte terminator into the name */
+	while (len > 0 && data[len - 1] == '\0')
+		len--;
+
+	name2utf8_buf(data, len, name, size);
+
+	return true;
+}
+
+void eir_iter_init(struct eir_iter *iter, const struct eir_view *view)
+{
+	iter->view = view;
+	iter->field = 0;
+	iter->pos = 0;
+}
+
+static const struct eir_field *iter_next_field(struct eir_iter *iter)
+{
+	if (iter->field >= iter->view->num_fields)
+		return NULL;
+
+	return &iter->view->fields[iter->field++];
+}
+
+static void uuid_from_le(bt_uuid_t *uuid, const uint8_t *data, size_t size)
+{
+	uint128_t u128;
+	int k;
+
+	switch (size) {
+	case 2:
+		bt_uuid16_create(uuid, get_le16(data));
+		break;
+	case 4:
+		bt_uuid32_create(uuid, get_le32(data));
+		break;
+	case 16:
+		for (k = 0; k < 16; k++)
+			u128.data[k] = data[16 - k - 1];
+		bt_uuid128_create(uuid, u128);
+		break;
+	}
+}
+
+/* Iterates over the UUIDs of all service class UUID lists */
+bool eir_iter_next_uuid(struct eir_iter *iter, bt_uuid_t *uuid)
+{
+	const struct eir_view *view = iter->view;
+
+	while (iter->field < view->num_fields) {
+		const struct eir_field *field = &view->fields[iter->field];
+		size_t size = uuid_list_size(field->type);
+
+		if (!size || iter->pos + size > field->len) {
+			iter->field++;
+			iter->pos = 0;
+			continue;
+		}
+
+		uuid_from_le(uuid, view->data + field->offset + iter->pos,
+									size);
+		iter->pos += size;
+
+		return true;
+	}
+
+	return false;
+}
+
+bool eir_iter_next_msd(struct eir_iter *iter, uint16_t *company,
+					const uint8_t **data, uint8_t *len)
+{
+	const struct eir_field *field;
+
+	while ((field = iter_next_field(iter))) {
+		const uint8_t *msd = iter->view->data + field->offset;
+
+		if (field->type != EIR_MANUFACTURER_DATA)
+			continue;
+
+		if (field->len < 2 || field->len > 2 + EIR_MSD_MAX_LEN)
+			continue;
+
+		*company = get_le16(msd);
+		*data = msd + 2;
+		*len = field->len - 2;
+
+		return true;
+	}
+
+	return false;
+}
+
+bool eir_iter_next_sd(struct eir_iter *iter, bt_uuid_t *uuid,
+					const uint8_t **data, uint8_t *len)
+{
+	const struct eir_field *field;
+
+	while ((field = iter_next_field(iter))) {
+		const uint8_t *sd = iter->view->data + field->offset;
+		size_t size = svc_data_uuid_size(field->type);
+
+		if (!size || field->len < size || field->len > EIR_SD_MAX_LEN)
+			continue;
+
+		uuid_from_le(uuid, sd, size);
+		*data = sd + size;
+		*len = field->len - size;
+
+		return true;
+	}
+
+	return false;
+}
+
+/* Iterates over the fields that have no dedicated decoding */
+bool eir_iter_next_data(struct eir_iter *iter, uint8_t *type,
+					const uint8_t **data, uint8_t *len)
+{
+	const struct eir_field *field;
+
+	while ((field = iter_next_field(iter))) {
+		switch (field->type) {
+		case EIR_FLAGS:
+		case EIR_UUID16_SOME:
+		case EIR_UUID16_ALL:
+		case EIR_UUID32_SOME:
+		case EIR_UUID32_ALL:
+		case EIR_UUID128_SOME:
+		case EIR_UUID128_ALL:
+		case EIR_NAME_SHORT:
+		case EIR_NAME_COMPLETE:
+		case EIR_TX_POWER:
+		case EIR_CLASS_OF_DEV:
+		case EIR_SSP_HASH:
+		case EIR_SSP_RANDOMIZER:
+		case EIR_DEVICE_ID:
+		case EIR_GAP_APPEARANCE:
+		case EIR_SVC_DATA16:
+		case EIR_SVC_DATA32:
+		case EIR_SVC_DATA128:
+		case EIR_MANUFACTURER_DATA:
+			continue;
+		}
+
+		*type = field->type;
+		*data = iter->view->data + field->offset;
+		*len = field->len;
+
+		return true;
+	}
+
+	return false;
+}
+
 int eir_parse_oob(struct eir_data *eir, uint8_t *eir_data, uint16_t eir_len)
 {
 
@@ -12,6 +12,7 @@
 #include <glib.h>
 
 #include "lib/sdp.h"
+#include "lib/uuid.h"
 
 #define EIR_FLAGS                   0x01  /* flags */
 #define EIR_UUID16_SOME             0x02  /* 16-bit UUID, more available */
@@ -51,6 +52,8 @@
 #define EIR_SD_MAX_LEN              238  /* 240 (EIR) - 2 (len) */
 #define EIR_MSD_MAX_LEN             236  /* 240 (EIR) - 2 (len & type) - 2 */
 
+#define EIR_VIEW_MAX_FIELDS         128  /* 255 bytes of empty fields */
+
 struct eir_msd {
 	uint16_t company;
 	uint8_t data[EIR_MSD_MAX_LEN];
@@ -89,8 +92,61 @@ struct eir_data {
 	GSList *data_list;
 };
 
+/* A field of the parsed data, the offset is that of its data in the buffer */
+struct eir_field {
+	uint8_t type;
+	uint8_t offset;
+	uint8_t len;
+};
+
+/*
+ * Flat view of EIR/AD data. Fields point into the parsed buffer, which has
+ * to outlive the view, so parsing never allocates and the view can live on
+ * the stack.
+ */
+struct eir_view {
+	const uint8_t *data;
+	unsigned int num_fields;
+	struct eir_field fields[EIR_VIEW_MAX_FIELDS];
+	unsigned int flags;
+	const struct eir_field *name;
+	bool name_complete;
+	uint32_t class;
+	uint16_t appearance;
+	int8_t tx_power;
+	uint16_t did_vendor;
+	uint16_t did_product;
+	uint16_t did_version;
+	uint16_t did_source;
+	bool has_msd;
+	bool has_sd;
+	bool has_data;
+};
+
+struct eir_iter {
+	const struct eir_view *view;
+	unsigned int field;
+	unsigned int pos;
+};
+
 void eir_data_free(struct eir_data *eir);
 void eir_parse(struct eir_data *eir, const uint8_t *eir_data, uint8_t eir_len);
+
+void eir_view_parse(struct eir_view *view, const uint8_t *eir_data,
+							uint8_t eir_len);
+const struct eir_field *eir_view_find(const struct eir_view *view,
+							uint8_t type);
+bool eir_view_get_name(const struct eir_view *view, char *name, size_t size);
+
+void eir_iter_init(struct eir_iter *iter, const struct eir_view *view);
+bool eir_iter_next_uuid(struct eir_iter *iter, bt_uuid_t *uuid);
+bool eir_iter_next_msd(struct eir_iter *iter, uint16_t *company,
+					const uint8_t **data, uint8_t *len);
+bool eir_iter_next_sd(struct eir_iter *iter, bt_uuid_t *uuid,
+					const uint8_t **data, uint8_t *len);
+bool eir_iter_next_data(struct eir_iter *iter, uint8_t *type,
+					const uint8_t **data, uint8_t *len);
+
 int eir_parse_oob(struct eir_data *eir, uint8_t *eir_data, uint16_t eir_len);
 int eir_create_oob(const bdaddr_t *addr, const char *name, uint32_t cod,
 			const uint8_t *hash, const uint8_t *randomizer,
@@ -50,6 +50,14 @@
 #define GATT_CHARACTERISTIC_IFACE	"org.bluez.GattCharacteristic1"
 #define GATT_DESCRIPTOR_IFACE		"org.bluez.GattDescriptor1"
 
+/*
+ * Notification multiplexer records: address (6), address type (1),
+ * characteristic handle (2), value length (2) and the value itself. Several
+ * records are batched into a single datagram of at most NOTIFY_MUX_BUF_LEN.
+ */
+#define NOTIFY_RECORD_HDR_LEN		11
+#define NOTIFY_MUX_BUF_LEN		4096
+
 struct btd_gatt_client {
 	struct btd_device *device;
 	uint8_t features;
@@ -1288,18 +1296,32 @@ static DBusMessage *characteristic_acquire_write(DBusConnection *conn,
 	return create_sock(chrc, msg);
 }
 
+struct btd_gatt_notify_mux {
+	char *owner;
+	guint watch;
+	struct io *io;
+	struct queue *clients;
+	guint flush_id;
+	size_t len;
+	uint8_t buf[NOTIFY_MUX_BUF_LEN];
+};
+
 struct notify_client {
 	struct characteristic *chrc;
 	int ref_count;
 	char *owner;
 	guint watch;
 	unsigned int notify_id;
+	struct btd_gatt_notify_mux *mux;
 };
 
 static void notify_client_free(struct notify_client *client)
 {
 	DBG("owner %s", client->owner);
 
+	if (client->mux)
+		queue_remove(client->mux->clients, client);
+
 	g_dbus_remove_watch(btd_get_dbus_connection(), client->watch);
 	bt_gatt_client_unregister_notify(client->chrc->service->client->gatt,
 							client->notify_id);
@@ -1395,6 +1417,10 @@ static bool match_notify_sender(const void *a, const void *b)
 	const struct notify_client *client = a;
 	const char *sender = b;
 
+	/* Subscriptions of AcquireNotifications aren't StartNotify sessions */
+	if (client->mux)
+		return false;
+
 	return strcmp(client->owner, sender) == 0;
 }
 
@@ -1415,6 +1441,59 @@ static void notify_cb(uint16_t value_handle, const uint8_t *value,
 						write_characteristic_cb, chrc);
 }
 
+static void notify_mux_flush(struct btd_gatt_notify_mux *mux)
+{
+	if (!mux->len)
+		return;
+
+	if (send(io_get_fd(mux->io), mux->buf, mux->len, MSG_NOSIGNAL) < 0)
+		error("send: %s", strerror(errno));
+
+	mux->len = 0;
+}
+
+static gboolean notify_mux_flush_cb(gpointer user_data)
+{
+	struct btd_gatt_notify_mux *mux = user_data;
+
+	mux->flush_id = 0;
+	notify_mux_flush(mux);
+
+	return FALSE;
+}
+
+static void notify_mux_cb(uint16_t value_handle, const uint8_t *value,
+					uint16_t length, void *user_data)
+{
+	struct async_dbus_op *op = user_data;
+	struct notify_client *client = op->data;
+	struct btd_gatt_notify_mux *mux = client->mux;
+	struct btd_device *device = client->chrc->service->client->device;
+	uint8_t *rec;
+
+	if (!mux || NOTIFY_RECORD_HDR_LEN + length > sizeof(mux->buf))
+		return;
+
+	if (mux->len + NOTIFY_RECORD_HDR_LEN + length > sizeof(mux->buf))
+		notify_mux_flush(mux);
+
+	rec = mux->buf + mux->len;
+	bacpy((bdaddr_t *) rec, device_get_address(device));
+	rec[6] = btd_device_get_bdaddr_type(device);
+	put_le16(client->chrc->handle, rec + 7);
+	put_le16(length, rec + 9);
+	memcpy(rec + NOTIFY_RECORD_HDR_LEN, value, length);
+
+	mux->len += NOTIFY_RECORD_HDR_LEN + length;
+
+	/*
+	 * Defer the write so that notifications from every connection
+	 * handled in this main loop iteration end up in the same datagram.
+	 */
+	if (!mux->flush_id)
+		mux->flush_id = g_idle_add(notify_mux_flush_cb, mux);
+}
+
 static void create_notify_reply(struct async_dbus_op *op, bool success,
 							uint8_t att_ecode)
 {
@@ -1435,6 +1514,11 @@ static void register_notify_cb(uint16_t att_ecode, void *user_data)
 	struct characteristic *chrc = client->chrc;
 
 	if (att_ecode) {
+		/* There is no D-Bus reply to carry the error of a mux client */
+		if (client->mux)
+			error("Failed to subscribe %s for %s: 0x%02x",
+					chrc->path, client->owner, att_ecode);
+
 		queue_remove(chrc->notify_clients, client);
 		queue_remove(chrc->service->client->all_notify_clients, client);
 		notify_client_free(client);
@@ -2188,7 +2272,9 @@ static void register_notify(void *data, void *user_data)
 
 	notify_client->notify_id = bt_gatt_client_register_notify(client->gatt,
 					notify_client->chrc->value_handle,
-					register_notify_cb, notify_cb,
+					register_notify_cb,
+					notify_client->mux ? notify_mux_cb :
+								notify_cb,
 					op, async_dbus_op_free);
 	if (notify_client->notify_id)
 		return;
@@ -2424,3 +2510,197 @@ void btd_gatt_client_foreach_service(struct btd_gatt_client *client,
 
 	queue_foreach(client->services, client_service_foreach, &data);
 }
+
+static void notify_mux_remove_client(void *data)
+{
+	struct notify_client *client = data;
+	struct characteristic *chrc = client->chrc;
+
+	client->mux = NULL;
+
+	queue_remove(chrc->notify_clients, client);
+	queue_remove(chrc->service->client->all_notify_clients, client);
+	update_notifying(chrc);
+
+	notify_client_unref(client);
+}
+
+void btd_gatt_notify_mux_free(struct btd_gatt_notify_mux *mux)
+{
+	if (!mux)
+		return;
+
+	DBG("owner %s", mux->owner);
+
+	queue_destroy(mux->clients, notify_mux_remove_client);
+
+	if (mux->flush_id)
+		g_source_remove(mux->flush_id);
+
+	g_dbus_remove_watch(btd_get_dbus_connection(), mux->watch);
+	io_destroy(mux->io);
+	free(mux->owner);
+	free(mux);
+}
+
+static bool notify_mux_hup(struct io *io, void *user_data)
+{
+	struct btd_gatt_notify_mux *mux = user_data;
+
+	DBG("io %p", io);
+
+	btd_gatt_notify_mux_free(mux);
+
+	return false;
+}
+
+static void notify_mux_disconnect(DBusConnection *conn, void *user_data)
+{
+	struct btd_gatt_notify_mux *mux = user_data;
+
+	btd_gatt_notify_mux_free(mux);
+}
+
+struct btd_gatt_notify_mux *btd_gatt_notify_mux_new(const char *owner,
+								int *fd)
+{
+	struct btd_gatt_notify_mux *mux;
+	int fds[2];
+
+	if (socketpair(AF_LOCAL, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC,
+								0, fds) < 0)
+		return NULL;
+
+	mux = new0(struct btd_gatt_notify_mux, 1);
+	mux->clients = queue_new();
+	mux->io = io_new(fds[0]);
+	if (!mux->io) {
+		close(fds[0]);
+		goto fail;
+	}
+
+	io_set_close_on_destroy(mux->io, true);
+
+	if (!io_set_disconnect_handler(mux->io, notify_mux_hup, mux, NULL))
+		goto fail;
+
+	mux->owner = strdup(owner);
+	if (!mux->owner)
+		goto fail;
+
+	mux->watch = g_dbus_add_disconnect_watch(btd_get_dbus_connection(),
+						owner, notify_mux_disconnect,
+						mux, NULL);
+	if (!mux->watch)
+		goto fail;
+
+	*fd = fds[1];
+
+	return mux;
+
+fail:
+	close(fds[1]);
+	btd_gatt_notify_mux_free(mux);
+	return NULL;
+}
+
+static bool match_chrc_path(const void *a, const void *b)
+{
+	const struct characteristic *chrc = a;
+	const char *path = b;
+
+	return strcmp(chrc->path, path) == 0;
+}
+
+static struct characteristic *find_characteristic(
+					struct btd_gatt_client *client,
+					const char *path)
+{
+	const struct queue_entry *entry;
+
+	for (entry = queue_get_entries(client->services); entry;
+							entry = entry->next) {
+		struct service *service = entry->data;
+		struct characteristic *chrc;
+
+		chrc = queue_find(service->chrcs, match_chrc_path, path);
+		if (chrc)
+			return chrc;
+	}
+
+	return NULL;
+}
+
+static bool match_notify_mux(const void *a, const void *b)
+{
+	const struct notify_client *client = a;
+
+	return client->mux == b;
+}
+
+int btd_gatt_client_add_notify_mux(struct btd_gatt_client *client,
+					const char *path,
+					struct btd_gatt_notify_mux *mux)
+{
+	struct characteristic *chrc;
+	struct notify_client *ntfy_client;
+	struct async_dbus_op *op;
+
+	if (!client)
+		return -ENOENT;
+
+	chrc = find_characteristic(client, path);
+	if (!chrc)
+		return -ENOENT;
+
+	if (!(chrc->props & BT_GATT_CHRC_PROP_NOTIFY ||
+				chrc->props & BT_GATT_CHRC_PROP_INDICATE))
+		return -ENOTSUP;
+
+	if (chrc->notify_io)
+		return -EPERM;
+
+	if (queue_find(chrc->notify_clients, match_notify_mux, mux))
+		return 0;
+
+	ntfy_client = new0(struct notify_client, 1);
+	ntfy_client->chrc = chrc;
+	ntfy_client->mux = mux;
+	ntfy_client->owner = strdup(mux->owner);
+	if (!ntfy_client->owner) {
+		free(ntfy_client);
+		return -ENOMEM;
+	}
+
+	notify_client_ref(ntfy_client);
+
+	queue_push_tail(chrc->notify_clients, ntfy_client);
+	queue_push_tail(client->all_notify_clients, ntfy_client);
+	queue_push_tail(mux->clients, ntfy_client);
+
+	/*
+	 * Like StartNotify, the subscription survives disconnections and is
+	 * registered again once the GATT client becomes ready.
+	 */
+	if (!client->gatt)
+		return 0;
+
+	op = new0(struct async_dbus_op, 1);
+	op->data = ntfy_client;
+
+	ntfy_client->notify_id = bt_gatt_client_register_notify(client->gatt,
+						chrc->value_handle,
+						register_notify_cb,
+						notify_mux_cb, op,
+						async_dbus_op_free);
+	if (ntfy_client->notify_id)
+		return 0;
+
+	async_dbus_op_free(op);
+
+	queue_remove(chrc->notify_clients, ntfy_client);
+	queue_remove(client->all_notify_clients, ntfy_client);
+	notify_client_free(ntfy_client);
+
+	return -EIO;
+}
@@ -27,3 +27,12 @@ typedef void (*btd_gatt_client_service_path_t)(const char *service_path,
 void btd_gatt_client_foreach_service(struct btd_gatt_client *client,
 					btd_gatt_client_service_path_t func,
 					void *user_data);
+
+struct btd_gatt_notify_mux;
+
+struct btd_gatt_notify_mux *btd_gatt_notify_mux_new(const char *owner,
+								int *fd);
+void btd_gatt_notify_mux_free(struct btd_gatt_notify_mux *mux);
+int btd_gatt_client_add_notify_mux(struct btd_gatt_client *client,
+					const char *path,
+					struct btd_gatt_notify_mux *mux);
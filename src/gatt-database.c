@@ -126,6 +126,7 @@ struct external_chrc {
 	unsigned int ntfy_cnt;
 	bool prep_authorized;
 	bool req_prep_authorization;
+	bool cached_read;
 };
 
 struct external_desc {
@@ -139,6 +140,7 @@ struct external_desc {
 	struct queue *pending_writes;
 	bool prep_authorized;
 	bool req_prep_authorization;
+	bool cached_read;
 };
 
 struct pending_op {
@@ -1679,7 +1681,8 @@ static bool incr_attr_count(struct external_service *service, uint16_t incr)
 static bool parse_chrc_flags(DBusMessageIter *array, uint8_t *props,
 					uint8_t *ext_props, uint32_t *perm,
 					uint32_t *ccc_perm,
-					bool *req_prep_authorization)
+					bool *req_prep_authorization,
+					bool *cached_read)
 {
 	const char *flag;
 
@@ -1742,6 +1745,8 @@ static bool parse_chrc_flags(DBusMessageIter *array, uint8_t *props,
 			*perm |= BT_ATT_PERM_WRITE | BT_ATT_PERM_WRITE_SECURE;
 		} else if (!strcmp("authorize", flag)) {
 			*req_prep_authorization = true;
+		} else if (!strcmp("cached-read", flag)) {
+			*cached_read = true;
 		} else if (!strcmp("encrypt-notify", flag)) {
 			*ccc_perm |= BT_ATT_PERM_WRITE_ENCRYPT;
 			*props |= BT_GATT_CHRC_PROP_NOTIFY;
@@ -1773,7 +1778,8 @@ static bool parse_chrc_flags(DBusMessageIter *array, uint8_t *props,
 }
 
 static bool parse_desc_flags(DBusMessageIter *array, uint32_t *perm,
-						bool *req_prep_authorization)
+						bool *req_prep_authorization,
+						bool *cached_read)
 {
 	const char *flag;
 
@@ -1803,6 +1809,8 @@ static bool parse_desc_flags(DBusMessageIter *array, uint32_t *perm,
 			*perm |= BT_ATT_PERM_WRITE | BT_ATT_PERM_WRITE_SECURE;
 		else if (!strcmp("authorize", flag))
 			*req_prep_authorization = true;
+		else if (!strcmp("cached-read", flag))
+			*cached_read = true;
 		else {
 			error("Invalid descriptor flag: %s", flag);
 			return false;
@@ -1814,7 +1822,8 @@ static bool parse_desc_flags(DBusMessageIter *array, uint32_t *perm,
 
 static bool parse_flags(GDBusProxy *proxy, uint8_t *props, uint8_t *ext_props,
 					    uint32_t *perm, uint32_t *ccc_perm,
-					    bool *req_prep_authorization)
+					    bool *req_prep_authorization,
+					    bool *cached_read)
 {
 	DBusMessageIter iter, array;
 	const char *iface;
@@ -1829,10 +1838,11 @@ static bool parse_flags(GDBusProxy *proxy, uint8_t *props, uint8_t *ext_props,
 
 	iface = g_dbus_proxy_get_interface(proxy);
 	if (!strcmp(iface, GATT_DESC_IFACE))
-		return parse_desc_flags(&array, perm, req_prep_authorization);
+		return parse_desc_flags(&array, perm, req_prep_authorization,
+								cached_read);
 
 	return parse_chrc_flags(&array, props, ext_props, perm, ccc_perm,
-							req_prep_authorization);
+					req_prep_authorization, cached_read);
 }
 
 static struct external_chrc *chrc_create(struct gatt_app *app,
@@ -1881,7 +1891,8 @@ static struct external_chrc *chrc_create(struct gatt_app *app,
 	 * created.
 	 */
 	if (!parse_flags(proxy, &chrc->props, &chrc->ext_props, &chrc->perm,
-			&chrc->ccc_perm, &chrc->req_prep_authorization)) {
+			&chrc->ccc_perm, &chrc->req_prep_authorization,
+			&chrc->cached_read)) {
 		error("Failed to parse characteristic properties");
 		goto fail;
 	}
@@ -1964,7 +1975,8 @@ static struct external_desc *desc_create(struct gatt_app *app,
 	 * determine the permission the descriptor should have
 	 */
 	if (!parse_flags(proxy, NULL, NULL, &desc->perm, NULL,
-					&desc->req_prep_authorization)) {
+					&desc->req_prep_authorization,
+					&desc->cached_read)) {
 		error("Failed to parse characteristic properties");
 		goto fail;
 	}
@@ -2354,6 +2366,48 @@ static struct pending_op *send_read(struct bt_att *att,
 	return NULL;
 }
 
+/*
+ * Serves a read from the Value property, which the proxy keeps up to date
+ * from PropertiesChanged, instead of calling ReadValue. Returns false if
+ * there is no value to serve.
+ */
+static bool read_cached(struct gatt_db_attribute *attrib, GDBusProxy *proxy,
+					unsigned int id, uint16_t offset)
+{
+	DBusMessageIter iter, array;
+	uint8_t *value = NULL;
+	int len = 0;
+
+	if (!g_dbus_proxy_get_property(proxy, "Value", &iter))
+		return false;
+
+	if (dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_ARRAY)
+		return false;
+
+	dbus_message_iter_recurse(&iter, &array);
+	dbus_message_iter_get_fixed_array(&array, &value, &len);
+
+	if (len < 0)
+		return false;
+
+	/* Truncate the value if it's too large */
+	len = MIN(BT_ATT_MAX_VALUE_LEN, len);
+
+	if (offset > len) {
+		gatt_db_attribute_read_result(attrib, id,
+						BT_ATT_ERROR_INVALID_OFFSET,
+						NULL, 0);
+		return true;
+	}
+
+	len -= offset;
+
+	gatt_db_attribute_read_result(attrib, id, 0,
+					len ? value + offset : NULL, len);
+
+	return true;
+}
+
 static void write_setup_cb(DBusMessageIter *iter, void *user_data)
 {
 	struct pending_op *op = user_data;
@@ -2943,6 +2997,11 @@ static void desc_read_cb(struct gatt_db_attribute *attrib,
 		goto fail;
 	}
 
+	/* Let the application authorize reads itself */
+	if (desc->cached_read && !desc->req_prep_authorization &&
+			read_cached(attrib, desc->proxy, id, offset))
+		return;
+
 	if (send_read(att, attrib, desc->proxy, desc->pending_reads, id,
 					offset))
 		return;
@@ -3067,6 +3126,11 @@ static void chrc_read_cb(struct gatt_db_attribute *attrib,
 		goto fail;
 	}
 
+	/* Let the application authorize reads itself */
+	if (chrc->cached_read && !chrc->req_prep_authorization &&
+			read_cached(attrib, chrc->proxy, id, offset))
+		return;
+
 	if (send_read(att, attrib, chrc->proxy, chrc->pending_reads, id,
 	       offset))
 		return;
@@ -58,6 +58,11 @@
 #define DEFAULT_PAIRABLE_TIMEOUT           0 /* disabled */
 #define DEFAULT_DISCOVERABLE_TIMEOUT     180 /* 3 minutes */
 #define DEFAULT_TEMPORARY_TIMEOUT         30 /* 30 seconds */
+#define DEFAULT_TEMPORARY_CACHE_SIZE    1024
+#define MAX_TEMPORARY_CACHE_SIZE       65536
+#define DEFAULT_PASSIVE_REPORT_INTERVAL    0 /* disabled */
+#define MAX_PASSIVE_REPORT_INTERVAL    10000 /* 10 seconds */
+#define DEFAULT_PASSIVE_REPORT_RSSI_DELTA  5 /* 5 dB */
 #define DEFAULT_NAME_REQUEST_RETRY_DELAY 300 /* 5 minutes */
 
 #define SHUTDOWN_GRACE_SECONDS 10
@@ -83,6 +88,10 @@ static const char *supported_options[] = {
 	"Privacy",
 	"JustWorksRepairing",
 	"TemporaryTimeout",
+	"TemporaryCacheSize",
+	"DevicePropertyInterval",
+	"PassiveReportInterval",
+	"PassiveReportRSSIDelta",
 	"Experimental",
 	"RemoteNameRequestRetryDelay",
 	NULL
@@ -147,6 +156,7 @@ static const char *gatt_options[] = {
 static const char *avdtp_options[] = {
 	"SessionMode",
 	"StreamMode",
+	"StreamLatency",
 	NULL
 };
 
@@ -728,6 +738,50 @@ static void parse_config(GKeyFile *config)
 		btd_opts.tmpto = val;
 	}
 
+	val = g_key_file_get_integer(config, "General",
+						"TemporaryCacheSize", &err);
+	if (err) {
+		DBG("%s", err->message);
+		g_clear_error(&err);
+	} else {
+		val = MIN(MAX(val, 0), MAX_TEMPORARY_CACHE_SIZE);
+		DBG("tmp_cache_size=%d", val);
+		btd_opts.tmp_cache_size = val;
+	}
+
+	val = g_key_file_get_integer(config, "General",
+						"DevicePropertyInterval", &err);
+	if (err) {
+		DBG("%s", err->message);
+		g_clear_error(&err);
+	} else {
+		val = MAX(val, 0);
+		DBG("prop_interval=%d", val);
+		btd_opts.prop_interval = val;
+	}
+
+	val = g_key_file_get_integer(config, "General",
+						"PassiveReportInterval", &err);
+	if (err) {
+		DBG("%s", err->message);
+		g_clear_error(&err);
+	} else {
+		val = MIN(MAX(val, 0), MAX_PASSIVE_REPORT_INTERVAL);
+		DBG("report_interval=%d", val);
+		btd_opts.report_interval = val;
+	}
+
+	val = g_key_file_get_integer(config, "General",
+						"PassiveReportRSSIDelta", &err);
+	if (err) {
+		DBG("%s", err->message);
+		g_clear_error(&err);
+	} else {
+		val = MIN(MAX(val, 0), 0xFF);
+		DBG("report_rssi_delta=%d", val);
+		btd_opts.report_rssi_delta = val;
+	}
+
 	str = g_key_file_get_string(config, "General", "Name", &err);
 	if (err) {
 		DBG("%s", err->message);
@@ -926,6 +980,15 @@ static void parse_config(GKeyFile *config)
 		g_free(str);
 	}
 
+	val = g_key_file_get_integer(config, "AVDTP", "StreamLatency", &err);
+	if (err) {
+		DBG("%s", err->message);
+		g_clear_error(&err);
+	} else {
+		DBG("StreamLatency=%d", val);
+		btd_opts.avdtp.stream_latency = MIN(MAX(val, 0), 1000);
+	}
+
 	val = g_key_file_get_integer(config, "AdvMon", "RSSISamplingPeriod",
 									&err);
 	if (err) {
@@ -953,6 +1016,9 @@ static void init_defaults(void)
 	btd_opts.pairto = DEFAULT_PAIRABLE_TIMEOUT;
 	btd_opts.discovto = DEFAULT_DISCOVERABLE_TIMEOUT;
 	btd_opts.tmpto = DEFAULT_TEMPORARY_TIMEOUT;
+	btd_opts.tmp_cache_size = DEFAULT_TEMPORARY_CACHE_SIZE;
+	btd_opts.report_interval = DEFAULT_PASSIVE_REPORT_INTERVAL;
+	btd_opts.report_rssi_delta = DEFAULT_PASSIVE_REPORT_RSSI_DELTA;
 	btd_opts.reverse_discovery = TRUE;
 	btd_opts.name_resolv = TRUE;
 	btd_opts.debug_keys = FALSE;
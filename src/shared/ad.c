@@ -37,6 +37,45 @@ struct pattern_match_info {
 	struct bt_ad_pattern *matched_pattern;
 };
 
+struct matcher_entry {
+	uint8_t type;
+	uint8_t offset;
+	uint8_t len;
+	uint8_t data[BT_AD_MAX_DATA_LEN];
+	unsigned int item;
+};
+
+/* Entries of one AD type at one offset, sorted by their first byte */
+struct matcher_group {
+	uint8_t offset;
+	unsigned int start;
+	unsigned int end;
+};
+
+struct matcher_item {
+	void *match_data;
+	unsigned int generation;
+};
+
+/*
+ * Patterns of any number of users compiled into a single lookup structure:
+ * entries are sorted by AD type, offset and first byte so that every field
+ * of the data only visits the groups of its own type and, within a group,
+ * only the entries keyed on the byte found at that offset.
+ */
+struct bt_ad_matcher {
+	struct matcher_entry *entries;
+	unsigned int num_entries;
+	struct matcher_group *groups;
+	unsigned int num_groups;
+	/* Groups of type t are type_groups[t] to type_groups[t + 1] */
+	unsigned int type_groups[UINT8_MAX + 2];
+	struct matcher_item *items;
+	unsigned int num_items;
+	unsigned int generation;
+	bool compiled;
+};
+
 struct bt_ad *bt_ad_new(void)
 {
 	struct bt_ad *ad;
@@ -1160,3 +1199,205 @@ struct bt_ad_pattern *bt_ad_pattern_match(struct bt_ad *ad,
 
 	return info.matched_pattern;
 }
+
+struct bt_ad_matcher *bt_ad_matcher_new(void)
+{
+	return new0(struct bt_ad_matcher, 1);
+}
+
+void bt_ad_matcher_free(struct bt_ad_matcher *matcher)
+{
+	if (!matcher)
+		return;
+
+	free(matcher->entries);
+	free(matcher->groups);
+	free(matcher->items);
+	free(matcher);
+}
+
+/* Adds the patterns of a user, any of which matching reports match_data */
+bool bt_ad_matcher_add(struct bt_ad_matcher *matcher, struct queue *patterns,
+							void *match_data)
+{
+	const struct queue_entry *entry;
+	unsigned int count = queue_length(patterns);
+	struct matcher_entry *entries;
+	struct matcher_item *items;
+
+	if (!matcher || !count)
+		return false;
+
+	entries = realloc(matcher->entries, (matcher->num_entries + count) *
+						sizeof(*matcher->entries));
+	if (!entries)
+		return false;
+
+	matcher->entries = entries;
+
+	items = realloc(matcher->items, (matcher->num_items + 1) *
+						sizeof(*matcher->items));
+	if (!items)
+		return false;
+
+	matcher->items = items;
+	matcher->items[matcher->num_items].match_data = match_data;
+	matcher->items[matcher->num_items].generation = 0;
+
+	for (entry = queue_get_entries(patterns); entry; entry = entry->next) {
+		struct bt_ad_pattern *pattern = entry->data;
+		struct matcher_entry *e;
+
+		e = &matcher->entries[matcher->num_entries++];
+		e->type = pattern->type;
+		e->offset = pattern->offset;
+		e->len = pattern->len;
+		memcpy(e->data, pattern->data, pattern->len);
+		e->item = matcher->num_items;
+	}
+
+	matcher->num_items++;
+	matcher->compiled = false;
+
+	return true;
+}
+
+static int matcher_entry_cmp(const void *a, const void *b)
+{
+	const struct matcher_entry *e1 = a;
+	const struct matcher_entry *e2 = b;
+
+	if (e1->type != e2->type)
+		return e1->type - e2->type;
+
+	if (e1->offset != e2->offset)
+		return e1->offset - e2->offset;
+
+	return e1->data[0] - e2->data[0];
+}
+
+static void matcher_compile(struct bt_ad_matcher *matcher)
+{
+	struct matcher_group *group = NULL;
+	unsigned int i, type;
+
+	qsort(matcher->entries, matcher->num_entries,
+			sizeof(*matcher->entries), matcher_entry_cmp);
+
+	free(matcher->groups);
+	matcher->groups = new0(struct matcher_group, matcher->num_entries + 1);
+	matcher->num_groups = 0;
+
+	for (i = 0; i < matcher->num_entries; i++) {
+		const struct matcher_entry *entry = &matcher->entries[i];
+
+		if (!group || matcher->entries[group->start].type != entry->type
+					|| group->offset != entry->offset) {
+			group = &matcher->groups[matcher->num_groups++];
+			group->offset = entry->offset;
+			group->start = i;
+		}
+
+		group->end = i + 1;
+	}
+
+	for (type = 0, i = 0; type < UINT8_MAX + 2; type++) {
+		while (i < matcher->num_groups &&
+			matcher->entries[matcher->groups[i].start].type < type)
+			i++;
+
+		matcher->type_groups[type] = i;
+	}
+
+	matcher->compiled = true;
+}
+
+static void matcher_match_group(struct bt_ad_matcher *matcher,
+					const struct matcher_group *group,
+					const uint8_t *data, uint8_t len,
+					bt_ad_matcher_func_t func, void *user_data)
+{
+	unsigned int lo = group->start, hi = group->end;
+	uint8_t key;
+
+	if (group->offset >= len)
+		return;
+
+	key = data[group->offset];
+
+	/* Find the first entry keyed on the byte at this offset */
+	while (lo < hi) {
+		unsigned int mid = (lo + hi) / 2;
+
+		if (matcher->entries[mid].data[0] < key)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	for (; lo < group->end && matcher->entries[lo].data[0] == key; lo++) {
+		const struct matcher_entry *entry = &matcher->entries[lo];
+		struct matcher_item *item = &matcher->items[entry->item];
+
+		/* Report every user once, whichever pattern matched first */
+		if (item->generation == matcher->generation)
+			continue;
+
+		if (entry->offset + entry->len > len)
+			continue;
+
+		if (memcmp(data + entry->offset + 1, entry->data + 1,
+							entry->len - 1))
+			continue;
+
+		item->generation = matcher->generation;
+		func(item->match_data, user_data);
+	}
+}
+
+/*
+ * Calls func once for every user with a pattern matching any field of the
+ * data, in a single pass over the data. The matcher must not be modified
+ * from within func.
+ */
+void bt_ad_matcher_match(struct bt_ad_matcher *matcher, size_t len,
+					const uint8_t *data,
+					bt_ad_matcher_func_t func, void *user_data)
+{
+	size_t parsed_len = 0;
+	unsigned int i;
+
+	if (!matcher || !data || !func || !matcher->num_entries)
+		return;
+
+	if (!matcher->compiled)
+		matcher_compile(matcher);
+
+	if (!++matcher->generation) {
+		for (i = 0; i < matcher->num_items; i++)
+			matcher->items[i].generation = 0;
+
+		matcher->generation = 1;
+	}
+
+	while (parsed_len + 1 < len) {
+		uint8_t field_len = data[parsed_len];
+		uint8_t type;
+
+		if (field_len == 0)
+			break;
+
+		if (parsed_len + field_len + 1 > len)
+			break;
+
+		type = data[parsed_len + 1];
+
+		for (i = matcher->type_groups[type];
+				i < matcher->type_groups[type + 1]; i++)
+			matcher_match_group(matcher, &matcher->groups[i],
+						data + parsed_len + 2,
+						field_len - 1, func, user_data);
+
+		parsed_len += field_len + 1;
+	}
+}
@@ -174,3 +174,18 @@ struct bt_ad_pattern *bt_ad_pattern_new(uint8_t type, size_t offset,
 
 struct bt_ad_pattern *bt_ad_pattern_match(struct bt_ad *ad,
 							struct queue *patterns);
+
+struct bt_ad_matcher;
+
+typedef void (*bt_ad_matcher_func_t)(void *match_data, void *user_data);
+
+struct bt_ad_matcher *bt_ad_matcher_new(void);
+
+void bt_ad_matcher_free(struct bt_ad_matcher *matcher);
+
+bool bt_ad_matcher_add(struct bt_ad_matcher *matcher, struct queue *patterns,
+							void *match_data);
+
+void bt_ad_matcher_match(struct bt_ad_matcher *matcher, size_t len,
+					const uint8_t *data,
+					bt_ad_matcher_func_t func, void *user_data);
@@ -53,7 +53,6 @@ typedef struct {
 			0xB3EBBD55769886BCull, 0x5AC635D8AA3A93E7ull }
 
 static uint64_t curve_p[NUM_ECC_DIGITS] = CURVE_P_32;
-static struct ecc_point curve_g = CURVE_G_32;
 static uint64_t curve_n[NUM_ECC_DIGITS] = CURVE_N_32;
 static uint64_t curve_b[NUM_ECC_DIGITS] = CURVE_B_32;
 
@@ -259,6 +258,15 @@ static uint64_t vli_sub(uint64_t *result, const uint64_t *left,
 
 static uint128_t mul_64_64(uint64_t left, uint64_t right)
 {
+#if defined(__SIZEOF_INT128__)
+	unsigned __int128 m = (unsigned __int128) left * right;
+	uint128_t result;
+
+	result.m_low = m;
+	result.m_high = m >> 64;
+
+	return result;
+#else
 	uint64_t a0 = left & 0xffffffffull;
 	uint64_t a1 = left >> 32;
 	uint64_t b0 = right & 0xffffffffull;
@@ -280,6 +288,7 @@ static uint128_t mul_64_64(uint64_t left, uint64_t right)
 	result.m_high = m3 + (m2 >> 32);
 
 	return result;
+#endif
 }
 
 static uint128_t add_128_128(uint128_t a, uint128_t b)
@@ -770,6 +779,230 @@ static void ecc_point_mult(struct ecc_point *result,
 	vli_set(result->y, ry[0]);
 }
 
+/* Fixed-base comb for the generator, 4 teeth spaced 64 bits apart.
+ * comb_g[i] holds the sum of 2^(64 * j) * G over the bits j set in i, so
+ * k * G takes 64 doublings and 64 mixed additions instead of a full
+ * ladder. The table is indexed and the additions are completed without
+ * branching on the scalar.
+ */
+#define COMB_TEETH	4
+#define COMB_SPACING	(ECC_BYTES * 8 / COMB_TEETH)
+
+static const struct ecc_point comb_g[16] = {
+	{ { 0, 0, 0, 0 }, { 0, 0, 0, 0 } },
+	CURVE_G_32,
+	{
+		{	0x90E75CB48E14DB63ull, 0x29493BAAAD651F7Eull,
+			0x8492592E326E25DEull, 0x0FA822BC2811AAA5ull },
+		{	0xE41124545F462EE7ull, 0x34B1A65050FE82F5ull,
+			0x6F4AD4BCB3DF188Bull, 0xBFF44AE8F5DBA80Dull }
+	},
+	{
+		{	0x93391CE2097992AFull, 0xE96C98FD0D35F1FAull,
+			0xB257C0DE95E02789ull, 0x300A4BBC89D6726Full },
+		{	0xAA54A291C08127A0ull, 0x5BB1EEADA9D806A5ull,
+			0x7F1DDB25FF1E3C6Full, 0x72AAC7E0D09B4644ull }
+	},
+	{
+		{	0x57C84FC9D789BD85ull, 0xFC35FF7DC297EAC3ull,
+			0xFB982FD588C6766Eull, 0x447D739BEEDB5E67ull },
+		{	0x0C7E33C972E25B32ull, 0x3D349B95A7FAE500ull,
+			0xE12E9D953A4AAFF7ull, 0x2D4825AB834131EEull }
+	},
+	{
+		{	0x13949C932A1D367Full, 0xEF7FBD2B1A0A11B7ull,
+			0xDDC6068BB91DFC60ull, 0xEF9519328A9C72FFull },
+		{	0x196035A77376D8A8ull, 0x23183B0895CA1740ull,
+			0xC1EE9807022C219Cull, 0x611E9FC37DBB2C9Bull }
+	},
+	{
+		{	0xCAE2B1920B57F4BCull, 0x2936DF5EC6C9BC36ull,
+			0x7DEA6482E11238BFull, 0x550663797B51F5D8ull },
+		{	0x44FFE216348A964Cull, 0x9FB3D576DBDEFBE1ull,
+			0x0AFA40018D9D50E5ull, 0x157164848AECB851ull }
+	},
+	{
+		{	0xE48ECAFFFC5CDE01ull, 0x7CCD84E70D715F26ull,
+			0xA2E8F483F43E4391ull, 0xEB5D7745B21141EAull },
+		{	0xCAC917E2731A3479ull, 0x85F22CFE2844B645ull,
+			0x0990E6A158006CEEull, 0xEAFD72EBDBECC17Bull }
+	},
+	{
+		{	0x6CF20FFB313728BEull, 0x96439591A3C6B94Aull,
+			0x2736FF8344315FC5ull, 0xA6D39677A7849276ull },
+		{	0xF2BAB833C357F5F4ull, 0x824A920C2284059Bull,
+			0x66B8BABD2D27ECDFull, 0x674F84749B0B8816ull }
+	},
+	{
+		{	0x2DF48C04677C8A3Eull, 0x74E02F080203A56Bull,
+			0x31855F7DB8C7FEDBull, 0x4E769E7672C9DDADull },
+		{	0xA4C36165B824BBB0ull, 0xFB9AE16F3B9122A5ull,
+			0x1EC0057206947281ull, 0x42B99082DE830663ull }
+	},
+	{
+		{	0x6EF95150DDA868B9ull, 0xD1F89E799C0CE131ull,
+			0x7FDC1CA008A1C478ull, 0x78878EF61C6CE04Dull },
+		{	0x9C62B9121FE0D976ull, 0x6ACE570EBDE08D4Full,
+			0xDE53142C12309DEFull, 0xB6CB3F5D7B72C321ull }
+	},
+	{
+		{	0x7F991ED2C31A3573ull, 0x5B82DD5BD54FB496ull,
+			0x595C5220812FFCAEull, 0x0C88BC4D716B1287ull },
+		{	0x3A57BF635F48ACA8ull, 0x7C8181F4DF2564F3ull,
+			0x18D1B5B39C04E6AAull, 0xDD5DDEA3F3901DC6ull }
+	},
+	{
+		{	0xE96A79FB3E72AD0Cull, 0x43A0A28C42BA792Full,
+			0xEFE0A423083E49F3ull, 0x68F344AF6B317466ull },
+		{	0xCDFE17DB3FB24D4Aull, 0x668BFC2271F5C626ull,
+			0x604ED93C24D67FF3ull, 0x31B9C405F8540A20ull }
+	},
+	{
+		{	0xD36B4789A2582E7Full, 0x0D1A10144EC39C28ull,
+			0x663C62C3EDBAD7A0ull, 0x4052BF4B6F461DB9ull },
+		{	0x235A27C3188D25EBull, 0xE724F33999BFCC5Bull,
+			0x862BE6BD71D70CC8ull, 0xFECF4D5190B0FC61ull }
+	},
+	{
+		{	0x74346C10A1D4CFACull, 0xAFDF5CC08526A7A4ull,
+			0x123202A8F62BFF7Aull, 0x1EDDBAE2C802E41Aull },
+		{	0x8FA0AF2DD603F844ull, 0x36E06B7E4C701917ull,
+			0x0C45F45273DB33A0ull, 0x43104D86560EBCFCull }
+	},
+	{
+		{	0x9615B5110D1D78E5ull, 0x66B0DE3225C4744Bull,
+			0x0A4A46FB6AAF363Aull, 0xB48E26B484F7A21Cull },
+		{	0x06EBB0F621A01B2Dull, 0xC004E4048B7B0F98ull,
+			0x64131BCDFED6F668ull, 0xFAC015404D4D3DABull }
+	},
+};
+
+/* All ones if vli is zero, zero otherwise */
+static uint64_t vli_zero_mask(const uint64_t *vli)
+{
+	uint64_t acc = 0;
+	unsigned int i;
+
+	for (i = 0; i < NUM_ECC_DIGITS; i++)
+		acc |= vli[i];
+
+	return ((acc | (0 - acc)) >> 63) - 1;
+}
+
+/* dest = mask ? src : dest */
+static void vli_cmov(uint64_t *dest, const uint64_t *src, uint64_t mask)
+{
+	unsigned int i;
+
+	for (i = 0; i < NUM_ECC_DIGITS; i++)
+		dest[i] ^= (dest[i] ^ src[i]) & mask;
+}
+
+static void comb_lookup(struct ecc_point *point, unsigned int index)
+{
+	unsigned int i;
+
+	vli_clear(point->x);
+	vli_clear(point->y);
+
+	/* Touch every entry so the access pattern doesn't leak index */
+	for (i = 0; i < (1 << COMB_TEETH); i++) {
+		uint64_t mask = 0 - (uint64_t) (i == index);
+
+		vli_cmov(point->x, comb_g[i].x, mask);
+		vli_cmov(point->y, comb_g[i].y, mask);
+	}
+}
+
+/* (x1, y1, z1) += (x2, y2, 1), z1 == 0 being the point at infinity */
+static void ecc_point_add_mixed(uint64_t *x1, uint64_t *y1, uint64_t *z1,
+					const struct ecc_point *point,
+					uint64_t point_is_zero)
+{
+	uint64_t x3[NUM_ECC_DIGITS], y3[NUM_ECC_DIGITS], z3[NUM_ECC_DIGITS];
+	uint64_t xd[NUM_ECC_DIGITS], yd[NUM_ECC_DIGITS], zd[NUM_ECC_DIGITS];
+	uint64_t h[NUM_ECC_DIGITS], r[NUM_ECC_DIGITS];
+	uint64_t t1[NUM_ECC_DIGITS], t2[NUM_ECC_DIGITS];
+	uint64_t one[NUM_ECC_DIGITS] = { 1 };
+	uint64_t p1_is_zero, same;
+
+	p1_is_zero = vli_zero_mask(z1);
+
+	vli_mod_square_fast(t1, z1);		/* t1 = z1^2 */
+	vli_mod_mult_fast(t2, t1, z1);		/* t2 = z1^3 */
+	vli_mod_mult_fast(t1, t1, point->x);	/* t1 = x2*z1^2 = U2 */
+	vli_mod_mult_fast(t2, t2, point->y);	/* t2 = y2*z1^3 = S2 */
+	vli_mod_sub(h, t1, x1, curve_p);	/* h = U2 - x1 */
+	vli_mod_sub(r, t2, y1, curve_p);	/* r = S2 - y1 */
+
+	vli_mod_mult_fast(z3, z1, h);		/* z3 = z1*h */
+	vli_mod_square_fast(t1, h);		/* t1 = h^2 */
+	vli_mod_mult_fast(t2, t1, h);		/* t2 = h^3 */
+	vli_mod_mult_fast(t1, t1, x1);		/* t1 = x1*h^2 = V */
+	vli_mod_square_fast(x3, r);		/* x3 = r^2 */
+	vli_mod_sub(x3, x3, t2, curve_p);	/* x3 = r^2 - h^3 */
+	vli_mod_sub(x3, x3, t1, curve_p);
+	vli_mod_sub(x3, x3, t1, curve_p);	/* x3 = r^2 - h^3 - 2V */
+	vli_mod_sub(t1, t1, x3, curve_p);	/* t1 = V - x3 */
+	vli_mod_mult_fast(t1, t1, r);		/* t1 = r*(V - x3) */
+	vli_mod_mult_fast(t2, t2, y1);		/* t2 = y1*h^3 */
+	vli_mod_sub(y3, t1, t2, curve_p);	/* y3 = r*(V - x3) - y1*h^3 */
+
+	/* Both points equal, which the addition above can't handle */
+	vli_set(xd, x1);
+	vli_set(yd, y1);
+	vli_set(zd, z1);
+	ecc_point_double_jacobian(xd, yd, zd);
+
+	same = vli_zero_mask(h) & vli_zero_mask(r) & ~p1_is_zero &
+							~point_is_zero;
+	vli_cmov(x3, xd, same);
+	vli_cmov(y3, yd, same);
+	vli_cmov(z3, zd, same);
+
+	/* Infinity plus the point is the point */
+	vli_cmov(x3, point->x, p1_is_zero);
+	vli_cmov(y3, point->y, p1_is_zero);
+	vli_cmov(z3, one, p1_is_zero);
+
+	/* The point plus infinity leaves (x1, y1, z1) alone */
+	vli_cmov(x1, x3, ~point_is_zero);
+	vli_cmov(y1, y3, ~point_is_zero);
+	vli_cmov(z1, z3, ~point_is_zero);
+}
+
+static void ecc_point_mult_g(struct ecc_point *result, const uint64_t *scalar)
+{
+	uint64_t x[NUM_ECC_DIGITS], y[NUM_ECC_DIGITS], z[NUM_ECC_DIGITS];
+	struct ecc_point point;
+	int i, j;
+
+	vli_clear(x);
+	vli_clear(y);
+	vli_clear(z);
+
+	for (i = COMB_SPACING - 1; i >= 0; i--) {
+		unsigned int index = 0;
+
+		for (j = 0; j < COMB_TEETH; j++)
+			index |= !!vli_test_bit(scalar,
+						i + j * COMB_SPACING) << j;
+
+		ecc_point_double_jacobian(x, y, z);
+
+		comb_lookup(&point, index);
+		ecc_point_add_mixed(x, y, z, &point,
+					0 - (uint64_t) (index == 0));
+	}
+
+	/* Back to affine coordinates */
+	vli_mod_inv(z, z, curve_p);
+	apply_z(x, y, z);	/* (x * z^-2, y * z^-3) */
+
+	vli_set(result->x, x);
+	vli_set(result->y, y);
+}
+
 static bool ecc_valid_point(const struct ecc_point *point)
 {
 	uint64_t tmp1[NUM_ECC_DIGITS];
@@ -853,7 +1086,7 @@ bool ecc_make_public_key(const uint8_t private_key[32], uint8_t public_key[64])
 	if (vli_cmp(curve_n, priv) != 1)
 		return false;
 
-	ecc_point_mult(&pk, &curve_g, priv, NULL, vli_num_bits(priv));
+	ecc_point_mult_g(&pk, priv);
 
 	if (ecc_point_is_zero(&pk))
 		return false;
@@ -881,7 +1114,7 @@ bool ecc_make_key(uint8_t public_key[64], uint8_t private_key[32])
 		if (vli_cmp(curve_n, priv) != 1)
 			continue;
 
-		ecc_point_mult(&pk, &curve_g, priv, NULL, vli_num_bits(priv));
+		ecc_point_mult_g(&pk, priv);
 	} while (ecc_point_is_zero(&pk));
 
 	ecc_native2bytes(priv, private_key);
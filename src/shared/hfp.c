@@ -32,9 +32,12 @@ struct hfp_gw {
 	struct io *io;
 	struct ringbuf *read_buf;
 	struct ringbuf *write_buf;
-	struct queue *cmd_handlers;
+	size_t read_scan;
+	char *line_buf;
+	struct prefix_node *cmd_handlers;
 	bool writer_active;
 	bool result_pending;
+	bool in_process;
 	hfp_command_func_t command_callback;
 	hfp_destroy_func_t command_destroy;
 	void *command_data;
@@ -57,11 +60,13 @@ struct hfp_hf {
 	struct io *io;
 	struct ringbuf *read_buf;
 	struct ringbuf *write_buf;
+	size_t read_scan;
+	char *line_buf;
 
 	bool writer_active;
 	struct queue *cmd_queue;
 
-	struct queue *event_handlers;
+	struct prefix_node *event_handlers;
 
 	hfp_debug_func_t debug_callback;
 	hfp_destroy_func_t debug_destroy;
@@ -113,17 +118,195 @@ static void destroy_cmd_handler(void *data)
 	free(handler);
 }
 
-static bool match_handler_prefix(const void *a, const void *b)
+/*
+ * Handlers are dispatched through a prefix trie keyed on the command or
+ * result prefix. Siblings are kept sorted so a lookup walks each level at
+ * most once and stops at the first key that is larger than the input.
+ */
+struct prefix_node {
+	struct prefix_node *next;
+	struct prefix_node *child;
+	void *handler;
+	char key;
+};
+
+static struct prefix_node **prefix_find_slot(struct prefix_node **node,
+								char key)
 {
-	const struct cmd_handler *handler = a;
-	const char *prefix = b;
+	while (*node && (*node)->key < key)
+		node = &(*node)->next;
 
-	if (strcmp(handler->prefix, prefix) != 0)
+	return node;
+}
+
+static bool prefix_insert(struct prefix_node **root, const char *prefix,
+								void *handler)
+{
+	struct prefix_node **slot = root;
+	struct prefix_node *node = NULL;
+
+	if (!*prefix)
 		return false;
 
+	for (; *prefix; prefix++) {
+		slot = prefix_find_slot(slot, *prefix);
+		node = *slot;
+
+		if (!node || node->key != *prefix) {
+			node = new0(struct prefix_node, 1);
+			node->key = *prefix;
+			node->next = *slot;
+			*slot = node;
+		}
+
+		slot = &node->child;
+	}
+
+	if (node->handler)
+		return false;
+
+	node->handler = handler;
+
 	return true;
 }
 
+static void *prefix_lookup(const struct prefix_node *node, const char *str,
+								size_t len)
+{
+	const struct prefix_node *match = NULL;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		char key = toupper((unsigned char) str[i]);
+
+		while (node && node->key < key)
+			node = node->next;
+
+		if (!node || node->key != key)
+			return NULL;
+
+		match = node;
+		node = node->child;
+	}
+
+	return match ? match->handler : NULL;
+}
+
+static void *prefix_remove(struct prefix_node **slot, const char *prefix)
+{
+	struct prefix_node *node;
+	void *handler;
+
+	slot = prefix_find_slot(slot, *prefix);
+	node = *slot;
+
+	if (!node || node->key != *prefix)
+		return NULL;
+
+	if (prefix[1]) {
+		handler = prefix_remove(&node->child, prefix + 1);
+	} else {
+		handler = node->handler;
+		node->handler = NULL;
+	}
+
+	if (!node->child && !node->handler) {
+		*slot = node->next;
+		free(node);
+	}
+
+	return handler;
+}
+
+static void prefix_destroy(struct prefix_node *node,
+					void (*destroy)(void *handler))
+{
+	while (node) {
+		struct prefix_node *next = node->next;
+
+		prefix_destroy(node->child, destroy);
+
+		if (node->handler)
+			destroy(node->handler);
+
+		free(node);
+		node = next;
+	}
+}
+
+/*
+ * Look for the end of the next line in the read buffer. Scanning resumes at
+ * *scan so bytes of an incomplete line are only looked at once no matter in
+ * how many reads it arrives. With crlf set a lone '\r' is part of the line.
+ */
+static bool find_line_end(struct ringbuf *buf, size_t *scan, bool crlf)
+{
+	size_t total = ringbuf_len(buf);
+
+	while (*scan < total) {
+		size_t len, pos;
+		char *str, *ptr;
+
+		str = ringbuf_peek(buf, *scan, &len);
+		if (len > total - *scan)
+			len = total - *scan;
+
+		ptr = memchr(str, '\r', len);
+		if (!ptr) {
+			*scan += len;
+			continue;
+		}
+
+		pos = *scan + (ptr - str);
+		*scan = pos;
+
+		if (!crlf)
+			return true;
+
+		/* Wait for the next byte to tell if this is a <cr><lf> */
+		if (pos + 1 == total)
+			return false;
+
+		if (*(char *) ringbuf_peek(buf, pos + 1, NULL) == '\n')
+			return true;
+
+		*scan = pos + 1;
+	}
+
+	return false;
+}
+
+/*
+ * Return the line of the given length at the head of the read buffer as a
+ * NUL terminated string. The terminator is overwritten in place, so only a
+ * line wrapping around the end of the ring buffer needs to be copied.
+ */
+static char *get_line(struct ringbuf *buf, size_t count, char **line_buf)
+{
+	size_t len, len2;
+	char *str, *str2;
+
+	str = ringbuf_peek(buf, 0, &len);
+	if (count < len) {
+		str[count] = '\0';
+		return str;
+	}
+
+	if (!*line_buf) {
+		*line_buf = malloc(ringbuf_capacity(buf) + 1);
+		if (!*line_buf)
+			return NULL;
+	}
+
+	str2 = ringbuf_peek(buf, len, &len2);
+
+	memcpy(*line_buf, str, len);
+	memcpy(*line_buf + len, str2, count - len);
+	(*line_buf)[count] = '\0';
+
+	return *line_buf;
+}
+
 static void write_watch_destroy(void *user_data)
 {
 	struct hfp_gw *hfp = user_data;
@@ -184,10 +367,8 @@ static bool handle_at_command(struct hfp_gw *hfp, const char *data)
 	const char *separators = ";?=\0";
 	struct hfp_context context;
 	enum hfp_gw_cmd_type type;
-	char lookup_prefix[18];
-	uint8_t pref_len = 0;
+	uint8_t pref_len;
 	const char *prefix;
-	int i;
 
 	context.offset = 0;
 	context.data = data;
@@ -205,20 +386,16 @@ static bool handle_at_command(struct hfp_gw *hfp, const char *data)
 	prefix = data + context.offset;
 
 	if (isalpha(prefix[0])) {
-		lookup_prefix[pref_len++] = toupper(prefix[0]);
+		pref_len = 1;
 	} else {
 		pref_len = strcspn(prefix, separators);
 		if (pref_len > 17 || pref_len < 2)
 			return false;
-
-		for (i = 0; i < pref_len; i++)
-			lookup_prefix[i] = toupper(prefix[i]);
 	}
 
-	lookup_prefix[pref_len] = '\0';
 	context.offset += pref_len;
 
-	if (lookup_prefix[0] == 'D') {
+	if (pref_len == 1 && toupper(prefix[0]) == 'D') {
 		type = HFP_GW_CMD_TYPE_SET;
 		goto done;
 	}
@@ -244,8 +421,7 @@ static bool handle_at_command(struct hfp_gw *hfp, const char *data)
 
 done:
 
-	handler = queue_find(hfp->cmd_handlers, match_handler_prefix,
-								lookup_prefix);
+	handler = prefix_lookup(hfp->cmd_handlers, prefix, pref_len);
 	if (!handler) {
 		handle_unknown_at_command(hfp, data);
 		return true;
@@ -462,52 +638,32 @@ failed:
 
 static void process_input(struct hfp_gw *hfp)
 {
-	char *str, *ptr;
-	size_t len, count;
-	bool free_ptr = false;
+	char *str;
 	bool read_again;
 
-	do {
-		str = ringbuf_peek(hfp->read_buf, 0, &len);
-		if (!str)
-			return;
-
-		ptr = memchr(str, '\r', len);
-		if (!ptr) {
-			char *str2;
-			size_t len2;
-
-			/*
-			 * If there is no more data in ringbuffer,
-			 * it's just an incomplete command.
-			 */
-			if (len == ringbuf_len(hfp->read_buf))
-				return;
-
-			str2 = ringbuf_peek(hfp->read_buf, len, &len2);
-			if (!str2)
-				return;
-
-			ptr = memchr(str2, '\r', len2);
-			if (!ptr)
-				return;
+	/*
+	 * A handler replying synchronously ends up here again, let the
+	 * outer loop pick up the next command instead of recursing.
+	 */
+	if (hfp->in_process)
+		return;
 
-			*ptr = '\0';
+	hfp->in_process = true;
 
-			count = len2 + len;
-			ptr = malloc(count);
-			if (!ptr)
-				return;
+	do {
+		if (!find_line_end(hfp->read_buf, &hfp->read_scan, false))
+			break;
 
-			memcpy(ptr, str, len);
-			memcpy(ptr + len, str2, len2);
+		str = get_line(hfp->read_buf, hfp->read_scan, &hfp->line_buf);
+		if (!str)
+			break;
 
-			free_ptr = true;
-			str = ptr;
-		} else {
-			count = ptr - str;
-			*ptr = '\0';
-		}
+		/*
+		 * The line stays valid until the next read from the socket,
+		 * so it can be released before the handler runs.
+		 */
+		ringbuf_drain(hfp->read_buf, hfp->read_scan + 1);
+		hfp->read_scan = 0;
 
 		if (!handle_at_command(hfp, str))
 			/*
@@ -525,13 +681,9 @@ static void process_input(struct hfp_gw *hfp)
 			 * should be empty but lets just look there.
 			 */
 			read_again = !hfp->result_pending;
-
-		ringbuf_drain(hfp->read_buf, count + 1);
-
-		if (free_ptr)
-			free(ptr);
-
 	} while (read_again);
+
+	hfp->in_process = false;
 }
 
 static void read_watch_destroy(void *user_data)
@@ -587,11 +739,8 @@ struct hfp_gw *hfp_gw_new(int fd)
 		return NULL;
 	}
 
-	hfp->cmd_handlers = queue_new();
-
 	if (!io_set_read_handler(hfp->io, can_read_data, hfp,
 							read_watch_destroy)) {
-		queue_destroy(hfp->cmd_handlers, destroy_cmd_handler);
 		io_destroy(hfp->io);
 		ringbuf_free(hfp->write_buf);
 		ringbuf_free(hfp->read_buf);
@@ -643,7 +792,10 @@ void hfp_gw_unref(struct hfp_gw *hfp)
 	ringbuf_free(hfp->write_buf);
 	hfp->write_buf = NULL;
 
-	queue_destroy(hfp->cmd_handlers, destroy_cmd_handler);
+	free(hfp->line_buf);
+	hfp->line_buf = NULL;
+
+	prefix_destroy(hfp->cmd_handlers, destroy_cmd_handler);
 	hfp->cmd_handlers = NULL;
 
 	if (!hfp->in_disconnect) {
@@ -831,30 +983,24 @@ bool hfp_gw_register(struct hfp_gw *hfp, hfp_result_func_t callback,
 		return false;
 	}
 
-	if (queue_find(hfp->cmd_handlers, match_handler_prefix,
-							handler->prefix)) {
+	if (!prefix_insert(&hfp->cmd_handlers, handler->prefix, handler)) {
 		destroy_cmd_handler(handler);
 		return false;
 	}
 
 	handler->destroy = destroy;
 
-	return queue_push_tail(hfp->cmd_handlers, handler);
+	return true;
 }
 
 bool hfp_gw_unregister(struct hfp_gw *hfp, const char *prefix)
 {
 	struct cmd_handler *handler;
-	char *lookup_prefix;
 
-	lookup_prefix = strdup(prefix);
-	if (!lookup_prefix)
+	if (!prefix || !*prefix)
 		return false;
 
-	handler = queue_remove_if(hfp->cmd_handlers, match_handler_prefix,
-								lookup_prefix);
-	free(lookup_prefix);
-
+	handler = prefix_remove(&hfp->cmd_handlers, prefix);
 	if (!handler)
 		return false;
 
@@ -922,17 +1068,6 @@ bool hfp_gw_disconnect(struct hfp_gw *hfp)
 	return io_shutdown(hfp->io);
 }
 
-static bool match_handler_event_prefix(const void *a, const void *b)
-{
-	const struct event_handler *handler = a;
-	const char *prefix = b;
-
-	if (strcmp(handler->prefix, prefix) != 0)
-		return false;
-
-	return true;
-}
-
 static void destroy_event_handler(void *data)
 {
 	struct event_handler *handler = data;
@@ -973,71 +1108,58 @@ static void hf_skip_whitespace(struct hfp_context *context)
 		context->offset++;
 }
 
-static bool is_response(const char *prefix, enum hfp_result *result,
+static const struct {
+	const char *prefix;
+	size_t len;
+	enum hfp_result result;
+} final_results[] = {
+	{ "OK",		2,	HFP_RESULT_OK		},
+	{ "ERROR",	5,	HFP_RESULT_ERROR	},
+	{ "NO CARRIER",	10,	HFP_RESULT_NO_CARRIER	},
+	{ "NO ANSWER",	9,	HFP_RESULT_NO_ANSWER	},
+	{ "BUSY",	4,	HFP_RESULT_BUSY		},
+	{ "DELAYED",	7,	HFP_RESULT_DELAYED	},
+	{ "BLACKLISTED", 11,	HFP_RESULT_REJECTED	},
+	{ "+CME ERROR",	10,	HFP_RESULT_CME_ERROR	},
+};
+
+static bool is_response(const char *prefix, size_t len,
+						enum hfp_result *result,
 						enum hfp_error *cme_err,
 						struct hfp_context *context)
 {
-	if (strcmp(prefix, "OK") == 0) {
-		*result = HFP_RESULT_OK;
-		/*
-		 * Set cme_err to 0 as this is not valid when result is not
-		 * CME ERROR
-		 */
-		*cme_err = 0;
-		return true;
-	}
-
-	if (strcmp(prefix, "ERROR") == 0) {
-		*result = HFP_RESULT_ERROR;
-		*cme_err = 0;
-		return true;
-	}
+	uint32_t val;
+	size_t i;
 
-	if (strcmp(prefix, "NO CARRIER") == 0) {
-		*result = HFP_RESULT_NO_CARRIER;
-		*cme_err = 0;
-		return true;
-	}
+	for (i = 0; i < ARRAY_SIZE(final_results); i++) {
+		if (final_results[i].len != len)
+			continue;
 
-	if (strcmp(prefix, "NO ANSWER") == 0) {
-		*result = HFP_RESULT_NO_ANSWER;
-		*cme_err = 0;
-		return true;
+		if (!strncasecmp(prefix, final_results[i].prefix, len))
+			break;
 	}
 
-	if (strcmp(prefix, "BUSY") == 0) {
-		*result = HFP_RESULT_BUSY;
-		*cme_err = 0;
-		return true;
-	}
+	if (i == ARRAY_SIZE(final_results))
+		return false;
 
-	if (strcmp(prefix, "DELAYED") == 0) {
-		*result = HFP_RESULT_DELAYED;
-		*cme_err = 0;
-		return true;
-	}
+	*result = final_results[i].result;
 
-	if (strcmp(prefix, "BLACKLISTED") == 0) {
-		*result = HFP_RESULT_REJECTED;
+	/*
+	 * Set cme_err to 0 as this is not valid when result is not
+	 * CME ERROR
+	 */
+	if (*result != HFP_RESULT_CME_ERROR) {
 		*cme_err = 0;
 		return true;
 	}
 
-	if (strcmp(prefix, "+CME ERROR") == 0) {
-		uint32_t val;
-
-		*result = HFP_RESULT_CME_ERROR;
-
-		if (hfp_context_get_number(context, &val) &&
-					val <= HFP_ERROR_NETWORK_NOT_ALLOWED)
-			*cme_err = val;
-		else
-			*cme_err = HFP_ERROR_AG_FAILURE;
-
-		return true;
-	}
+	if (hfp_context_get_number(context, &val) &&
+				val <= HFP_ERROR_NETWORK_NOT_ALLOWED)
+		*cme_err = val;
+	else
+		*cme_err = HFP_ERROR_AG_FAILURE;
 
-	return false;
+	return true;
 }
 
 static void hf_wakeup_writer(struct hfp_hf *hfp)
@@ -1062,10 +1184,8 @@ static void hf_call_prefix_handler(struct hfp_hf *hfp, const char *data)
 	struct hfp_context context;
 	enum hfp_result result;
 	enum hfp_error cme_err;
-	char lookup_prefix[18] = {};
-	uint8_t pref_len = 0;
+	uint8_t pref_len;
 	const char *prefix;
-	int i;
 
 	context.offset = 0;
 	context.data = data;
@@ -1081,13 +1201,9 @@ static void hf_call_prefix_handler(struct hfp_hf *hfp, const char *data)
 	if (pref_len > 17 || pref_len < 2)
 		return;
 
-	for (i = 0; i < pref_len; i++)
-		lookup_prefix[i] = toupper(prefix[i]);
-
-	lookup_prefix[pref_len] = '\0';
 	context.offset += pref_len + 1;
 
-	if (is_response(lookup_prefix, &result, &cme_err, &context)) {
+	if (is_response(prefix, pref_len, &result, &cme_err, &context)) {
 		struct cmd_response *cmd;
 
 		cmd = queue_peek_head(hfp->cmd_queue);
@@ -1103,116 +1219,32 @@ static void hf_call_prefix_handler(struct hfp_hf *hfp, const char *data)
 		return;
 	}
 
-	handler = queue_find(hfp->event_handlers, match_handler_event_prefix,
-								lookup_prefix);
+	handler = prefix_lookup(hfp->event_handlers, prefix, pref_len);
 	if (!handler)
 		return;
 
 	handler->callback(&context, handler->user_data);
 }
 
-static char *find_cr_lf(char *str, size_t len)
-{
-	char *ptr;
-	size_t count, offset;
-
-	offset = 0;
-
-	ptr = memchr(str, '\r', len);
-	while (ptr) {
-		/*
-		 * Check if there is more data after '\r'. If so check for
-		 * '\n'
-		 */
-		count = ptr - str;
-		if ((count < (len - 1)) && *(ptr + 1) == '\n')
-			return ptr;
-
-		/* There is only '\r'? Let's try to find next one */
-		offset += count + 1;
-
-		if (offset >= len)
-			return NULL;
-
-		ptr = memchr(str + offset, '\r', len - offset);
-	}
-
-	return NULL;
-}
-
 static void hf_process_input(struct hfp_hf *hfp)
 {
-	char *str, *ptr, *str2, *tmp;
-	size_t len, count, offset, len2;
-	bool free_tmp = false;
-
-	str = ringbuf_peek(hfp->read_buf, 0, &len);
-	if (!str)
-		return;
-
-	offset = 0;
+	char *str;
+
+	while (find_line_end(hfp->read_buf, &hfp->read_scan, true)) {
+		/* Skip empty lines between <cr><lf> pairs */
+		if (hfp->read_scan) {
+			str = get_line(hfp->read_buf, hfp->read_scan,
+							&hfp->line_buf);
+			if (!str)
+				return;
 
-	ptr = find_cr_lf(str, len);
-	while (ptr) {
-		count = ptr - (str + offset);
-		if (count == 0) {
-			/* 2 is for <cr><lf> */
-			offset += 2;
-		} else {
-			*ptr = '\0';
-			hf_call_prefix_handler(hfp, str + offset);
-			offset += count + 2;
+			hf_call_prefix_handler(hfp, str);
 		}
 
-		ptr = find_cr_lf(str + offset, len - offset);
+		/* 2 is for <cr><lf> */
+		ringbuf_drain(hfp->read_buf, hfp->read_scan + 2);
+		hfp->read_scan = 0;
 	}
-
-	/*
-	 * Just check if there is no wrapped data in ring buffer.
-	 * Should not happen too often
-	 */
-	if (len == ringbuf_len(hfp->read_buf))
-		goto done;
-
-	str2 = ringbuf_peek(hfp->read_buf, len, &len2);
-	if (!str2)
-		goto done;
-
-	ptr = find_cr_lf(str2, len2);
-	if (!ptr) {
-		/* Might happen that we wrap between \r and \n */
-		ptr = memchr(str2, '\n', len2);
-		if (!ptr)
-			goto done;
-	}
-
-	count = ptr - str2;
-
-	if (count) {
-		*ptr = '\0';
-
-		tmp = malloc(len + count);
-		if (!tmp)
-			goto done;
-
-		/* "str" here is not a string so we need to use memcpy */
-		memcpy(tmp, str, len);
-		memcpy(tmp + len, str2, count);
-
-		free_tmp = true;
-	} else {
-		str[len-1] = '\0';
-		tmp = str;
-	}
-
-	hf_call_prefix_handler(hfp, tmp);
-	offset += count;
-
-done:
-	ringbuf_drain(hfp->read_buf, offset);
-
-	if (free_tmp)
-		free(tmp);
 }
 
 static bool hf_can_read_data(struct io *io, void *user_data)
@@ -1261,14 +1293,12 @@ struct hfp_hf *hfp_hf_new(int fd)
 		return NULL;
 	}
 
-	hfp->event_handlers = queue_new();
 	hfp->cmd_queue = queue_new();
 	hfp->writer_active = false;
 
 	if (!io_set_read_handler(hfp->io, hf_can_read_data, hfp,
 							read_watch_destroy)) {
-		queue_destroy(hfp->event_handlers,
-						destroy_event_handler);
+		queue_destroy(hfp->cmd_queue, NULL);
 		io_destroy(hfp->io);
 		ringbuf_free(hfp->write_buf);
 		ringbuf_free(hfp->read_buf);
@@ -1315,7 +1345,10 @@ void hfp_hf_unref(struct hfp_hf *hfp)
 	ringbuf_free(hfp->write_buf);
 	hfp->write_buf = NULL;
 
-	queue_destroy(hfp->event_handlers, destroy_event_handler);
+	free(hfp->line_buf);
+	hfp->line_buf = NULL;
+
+	prefix_destroy(hfp->event_handlers, destroy_event_handler);
 	hfp->event_handlers = NULL;
 
 	queue_destroy(hfp->cmd_queue, free);
@@ -1441,26 +1474,24 @@ bool hfp_hf_register(struct hfp_hf *hfp, hfp_hf_result_func_t callback,
 		return false;
 	}
 
-	if (queue_find(hfp->event_handlers, match_handler_event_prefix,
-							handler->prefix)) {
+	if (!prefix_insert(&hfp->event_handlers, handler->prefix, handler)) {
 		destroy_event_handler(handler);
 		return false;
 	}
 
 	handler->destroy = destroy;
 
-	return queue_push_tail(hfp->event_handlers, handler);
+	return true;
 }
 
 bool hfp_hf_unregister(struct hfp_hf *hfp, const char *prefix)
 {
-	struct cmd_handler *handler;
+	struct event_handler *handler;
 
-	/* Cast to void as queue_remove needs that */
-	handler = queue_remove_if(hfp->event_handlers,
-						match_handler_event_prefix,
-						(void *) prefix);
+	if (!prefix || !*prefix)
+		return false;
 
+	handler = prefix_remove(&hfp->event_handlers, prefix);
 	if (!handler)
 		return false;
 
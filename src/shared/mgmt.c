@@ -16,6 +16,7 @@
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
 
 #include "lib/bluetooth.h"
 #include "lib/mgmt.h"
@@ -27,6 +28,13 @@
 #include "src/shared/mgmt.h"
 #include "src/shared/timeout.h"
 
+/* Must be powers of two */
+#define PENDING_BUCKETS		16
+#define NOTIFY_BUCKETS		64
+
+/* Upper limit of commands written without waiting for their completion */
+#define MAX_PIPELINED		16
+
 struct mgmt {
 	int ref_count;
 	int fd;
@@ -35,8 +43,10 @@ struct mgmt {
 	bool writer_active;
 	struct queue *request_queue;
 	struct queue *reply_queue;
-	struct queue *pending_list;
-	struct queue *notify_list;
+	struct queue *pending_table[PENDING_BUCKETS];
+	unsigned int num_pending;
+	unsigned int num_serial;
+	struct queue *notify_table[NOTIFY_BUCKETS];
 	unsigned int next_request_id;
 	unsigned int next_notify_id;
 	bool need_notify_cleanup;
@@ -47,6 +57,8 @@ struct mgmt {
 	mgmt_debug_func_t debug_callback;
 	mgmt_destroy_func_t debug_destroy;
 	void *debug_data;
+	struct mgmt_stats stats;
+	uint64_t total_latency;
 };
 
 struct mgmt_request {
@@ -61,6 +73,8 @@ struct mgmt_request {
 	void *user_data;
 	int timeout;
 	unsigned int timeout_id;
+	bool pipelined;
+	uint64_t sent_time;
 };
 
 struct mgmt_notify {
@@ -108,6 +122,131 @@ static bool match_request_index(const void *a, const void *b)
 	return request->index == index;
 }
 
+static uint64_t get_time_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+}
+
+/*
+ * Commands the kernel completes before returning from the write. Any number
+ * of them can be in flight at once since none of them leave a pending
+ * operation behind that could make a following command fail as busy.
+ */
+static const uint16_t pipelined_opcodes[] = {
+	MGMT_OP_READ_VERSION,
+	MGMT_OP_READ_COMMANDS,
+	MGMT_OP_READ_INDEX_LIST,
+	MGMT_OP_READ_INFO,
+	MGMT_OP_LOAD_LINK_KEYS,
+	MGMT_OP_LOAD_LONG_TERM_KEYS,
+	MGMT_OP_LOAD_IRKS,
+	MGMT_OP_LOAD_CONN_PARAM,
+	MGMT_OP_READ_UNCONF_INDEX_LIST,
+	MGMT_OP_READ_CONFIG_INFO,
+	MGMT_OP_READ_EXT_INDEX_LIST,
+	MGMT_OP_READ_ADV_FEATURES,
+	MGMT_OP_READ_EXT_INFO,
+	MGMT_OP_SET_BLOCKED_KEYS,
+	MGMT_OP_READ_CONTROLLER_CAP,
+	MGMT_OP_READ_EXP_FEATURES_INFO,
+	MGMT_OP_READ_DEF_SYSTEM_CONFIG,
+	MGMT_OP_SET_DEF_SYSTEM_CONFIG,
+	MGMT_OP_READ_DEF_RUNTIME_CONFIG,
+	MGMT_OP_SET_DEF_RUNTIME_CONFIG,
+	MGMT_OP_GET_DEVICE_FLAGS,
+	MGMT_OP_SET_DEVICE_FLAGS,
+	MGMT_OP_READ_ADV_MONITOR_FEATURES,
+};
+
+static bool is_pipelined(uint16_t opcode)
+{
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(pipelined_opcodes); i++) {
+		if (pipelined_opcodes[i] == opcode)
+			return true;
+	}
+
+	return false;
+}
+
+static struct queue *pending_bucket(struct mgmt *mgmt, uint16_t opcode,
+							uint16_t index)
+{
+	return mgmt->pending_table[(opcode ^ index) & (PENDING_BUCKETS - 1)];
+}
+
+static void pending_add(struct mgmt *mgmt, struct mgmt_request *request)
+{
+	queue_push_tail(pending_bucket(mgmt, request->opcode, request->index),
+								request);
+
+	mgmt->num_pending++;
+	if (!request->pipelined)
+		mgmt->num_serial++;
+
+	mgmt->stats.sent++;
+	mgmt->stats.in_flight = mgmt->num_pending;
+	if (mgmt->num_pending > mgmt->stats.max_in_flight)
+		mgmt->stats.max_in_flight = mgmt->num_pending;
+}
+
+/* Account for a request that was taken out of the pending table */
+static void pending_removed(struct mgmt *mgmt, struct mgmt_request *request)
+{
+	mgmt->num_pending--;
+	if (!request->pipelined)
+		mgmt->num_serial--;
+
+	mgmt->stats.in_flight = mgmt->num_pending;
+}
+
+static void destroy_pending(void *data)
+{
+	struct mgmt_request *request = data;
+
+	pending_removed(request->mgmt, request);
+	destroy_request(request);
+}
+
+static struct mgmt_request *pending_remove_if(struct mgmt *mgmt,
+					queue_match_func_t function,
+					const void *match_data)
+{
+	struct mgmt_request *request;
+	int i;
+
+	for (i = 0; i < PENDING_BUCKETS; i++) {
+		request = queue_remove_if(mgmt->pending_table[i], function,
+							(void *) match_data);
+		if (request) {
+			pending_removed(mgmt, request);
+			return request;
+		}
+	}
+
+	return NULL;
+}
+
+static void pending_remove_all(struct mgmt *mgmt, queue_match_func_t function,
+						const void *match_data)
+{
+	int i;
+
+	for (i = 0; i < PENDING_BUCKETS; i++)
+		queue_remove_all(mgmt->pending_table[i], function,
+					(void *) match_data, destroy_pending);
+}
+
+static struct queue *notify_bucket(struct mgmt *mgmt, uint16_t event)
+{
+	return mgmt->notify_table[event & (NOTIFY_BUCKETS - 1)];
+}
+
 static void destroy_notify(void *data)
 {
 	struct mgmt_notify *notify = data;
@@ -141,6 +280,25 @@ static bool match_notify_removed(const void *a, const void *b)
 	return notify->removed;
 }
 
+static void notify_remove_all(struct mgmt *mgmt, queue_match_func_t function,
+						const void *match_data)
+{
+	int i;
+
+	for (i = 0; i < NOTIFY_BUCKETS; i++)
+		queue_remove_all(mgmt->notify_table[i], function,
+					(void *) match_data, destroy_notify);
+}
+
+static void notify_foreach(struct mgmt *mgmt, queue_foreach_func_t function,
+							void *user_data)
+{
+	int i;
+
+	for (i = 0; i < NOTIFY_BUCKETS; i++)
+		queue_foreach(mgmt->notify_table[i], function, user_data);
+}
+
 static void mark_notify_removed(void *data , void *user_data)
 {
 	struct mgmt_notify *notify = data;
@@ -166,7 +324,9 @@ static bool request_timeout(void *data)
 
 	request->timeout_id = 0;
 
-	queue_remove_if(request->mgmt->pending_list, NULL, request);
+	if (queue_remove(pending_bucket(request->mgmt, request->opcode,
+						request->index), request))
+		pending_removed(request->mgmt, request);
 
 	if (request->callback)
 		request->callback(MGMT_STATUS_TIMEOUT, 0, NULL,
@@ -209,44 +369,81 @@ static bool send_request(struct mgmt *mgmt, struct mgmt_request *request)
 	util_hexdump('<', request->buf, ret, mgmt->debug_callback,
 							mgmt->debug_data);
 
-	queue_push_tail(mgmt->pending_list, request);
+	request->sent_time = get_time_us();
+
+	pending_add(mgmt, request);
 
 	return true;
 }
 
+struct opcode_index {
+	uint16_t opcode;
+	uint16_t index;
+};
+
+static bool match_request_opcode_index(const void *a, const void *b)
+{
+	const struct mgmt_request *request = a;
+	const struct opcode_index *match = b;
+
+	return request->opcode == match->opcode &&
+					request->index == match->index;
+}
+
+/*
+ * Commands are written in order. A command that may leave a pending operation
+ * behind in the kernel is only written once nothing else is in flight, and
+ * nothing else is written until it completes. Responses carry no more than
+ * opcode and index, so only one command per opcode and index can be pending.
+ */
+static bool can_send_request(struct mgmt *mgmt, struct mgmt_request *request)
+{
+	struct opcode_index match = { .opcode = request->opcode,
+						.index = request->index };
+
+	if (!mgmt->num_pending)
+		return true;
+
+	if (mgmt->num_serial || !request->pipelined ||
+					mgmt->num_pending >= MAX_PIPELINED)
+		return false;
+
+	return !queue_find(pending_bucket(mgmt, request->opcode,
+						request->index),
+					match_request_opcode_index, &match);
+}
+
 static bool can_write_data(struct io *io, void *user_data)
 {
 	struct mgmt *mgmt = user_data;
 	struct mgmt_request *request;
-	bool can_write;
 
-	request = queue_pop_head(mgmt->reply_queue);
-	if (!request) {
-		/* only reply commands can jump the queue */
-		if (!queue_isempty(mgmt->pending_list))
-			return false;
-
-		request = queue_pop_head(mgmt->request_queue);
-		if (!request)
-			return false;
-
-		can_write = false;
-	} else {
-		/* allow multiple replies to jump the queue */
-		can_write = !queue_isempty(mgmt->reply_queue);
+	mgmt_ref(mgmt);
+
+	/* Reply commands can jump the queue */
+	while ((request = queue_pop_head(mgmt->reply_queue)))
+		send_request(mgmt, request);
+
+	while ((request = queue_peek_head(mgmt->request_queue))) {
+		if (!can_send_request(mgmt, request))
+			break;
+
+		queue_pop_head(mgmt->request_queue);
+		send_request(mgmt, request);
 	}
 
-	if (!send_request(mgmt, request))
-		return true;
+	mgmt_unref(mgmt);
 
-	return can_write;
+	return false;
 }
 
 static void wakeup_writer(struct mgmt *mgmt)
 {
-	if (!queue_isempty(mgmt->pending_list)) {
-		/* only queued reply commands trigger wakeup */
-		if (queue_isempty(mgmt->reply_queue))
+	struct mgmt_request *request;
+
+	if (queue_isempty(mgmt->reply_queue)) {
+		request = queue_peek_head(mgmt->request_queue);
+		if (!request || !can_send_request(mgmt, request))
 			return;
 	}
 
@@ -259,47 +456,42 @@ static void wakeup_writer(struct mgmt *mgmt)
 						write_watch_destroy);
 }
 
-struct opcode_index {
-	uint16_t opcode;
-	uint16_t index;
-};
-
-static bool match_request_opcode_index(const void *a, const void *b)
-{
-	const struct mgmt_request *request = a;
-	const struct opcode_index *match = b;
-
-	return request->opcode == match->opcode &&
-					request->index == match->index;
-}
-
 static void request_complete(struct mgmt *mgmt, uint8_t status,
 					uint16_t opcode, uint16_t index,
 					uint16_t length, const void *param)
 {
 	struct opcode_index match = { .opcode = opcode, .index = index };
 	struct mgmt_request *request;
+	uint64_t latency;
 
-	request = queue_remove_if(mgmt->pending_list,
+	/*
+	 * With several requests of one index in flight only the opcode tells
+	 * them apart, so never complete a request of another opcode.
+	 */
+	request = queue_remove_if(pending_bucket(mgmt, opcode, index),
 					match_request_opcode_index, &match);
 	if (!request) {
 		util_debug(mgmt->debug_callback, mgmt->debug_data,
 				"Unable to find request for opcode 0x%04x",
 				opcode);
-
-		/* Attempt to remove with no opcode */
-		request = queue_remove_if(mgmt->pending_list,
-						match_request_index,
-						UINT_TO_PTR(index));
+		return;
 	}
 
-	if (request) {
-		if (request->callback)
-			request->callback(status, length, param,
-							request->user_data);
+	pending_removed(mgmt, request);
 
-		destroy_request(request);
-	}
+	latency = get_time_us() - request->sent_time;
+
+	mgmt->stats.completed++;
+	mgmt->total_latency += latency;
+	mgmt->stats.avg_latency = mgmt->total_latency / mgmt->stats.completed;
+
+	if (latency > mgmt->stats.max_latency)
+		mgmt->stats.max_latency = latency;
+
+	if (request->callback)
+		request->callback(status, length, param, request->user_data);
+
+	destroy_request(request);
 
 	wakeup_writer(mgmt);
 }
@@ -338,13 +530,12 @@ static void process_notify(struct mgmt *mgmt, uint16_t event, uint16_t index,
 
 	mgmt->in_notify = true;
 
-	queue_foreach(mgmt->notify_list, notify_handler, &match);
+	queue_foreach(notify_bucket(mgmt, event), notify_handler, &match);
 
 	mgmt->in_notify = false;
 
 	if (mgmt->need_notify_cleanup) {
-		queue_remove_all(mgmt->notify_list, match_notify_removed,
-							NULL, destroy_notify);
+		notify_remove_all(mgmt, match_notify_removed, NULL);
 		mgmt->need_notify_cleanup = false;
 	}
 }
@@ -440,9 +631,21 @@ static void mgmt_set_mtu(struct mgmt *mgmt)
 	}
 }
 
+static void destroy_tables(struct mgmt *mgmt)
+{
+	int i;
+
+	for (i = 0; i < PENDING_BUCKETS; i++)
+		queue_destroy(mgmt->pending_table[i], NULL);
+
+	for (i = 0; i < NOTIFY_BUCKETS; i++)
+		queue_destroy(mgmt->notify_table[i], NULL);
+}
+
 struct mgmt *mgmt_new(int fd)
 {
 	struct mgmt *mgmt;
+	int i;
 
 	if (fd < 0)
 		return NULL;
@@ -467,12 +670,15 @@ struct mgmt *mgmt_new(int fd)
 
 	mgmt->request_queue = queue_new();
 	mgmt->reply_queue = queue_new();
-	mgmt->pending_list = queue_new();
-	mgmt->notify_list = queue_new();
+
+	for (i = 0; i < PENDING_BUCKETS; i++)
+		mgmt->pending_table[i] = queue_new();
+
+	for (i = 0; i < NOTIFY_BUCKETS; i++)
+		mgmt->notify_table[i] = queue_new();
 
 	if (!io_set_read_handler(mgmt->io, can_read_data, mgmt, NULL)) {
-		queue_destroy(mgmt->notify_list, NULL);
-		queue_destroy(mgmt->pending_list, NULL);
+		destroy_tables(mgmt);
 		queue_destroy(mgmt->reply_queue, NULL);
 		queue_destroy(mgmt->request_queue, NULL);
 		io_destroy(mgmt->io);
@@ -563,8 +769,7 @@ void mgmt_unref(struct mgmt *mgmt)
 	mgmt->buf = NULL;
 
 	if (!mgmt->in_notify) {
-		queue_destroy(mgmt->notify_list, NULL);
-		queue_destroy(mgmt->pending_list, NULL);
+		destroy_tables(mgmt);
 		free(mgmt);
 		return;
 	}
@@ -795,6 +1000,7 @@ unsigned int mgmt_send_timeout(struct mgmt *mgmt, uint16_t opcode,
 		mgmt->next_request_id = 1;
 
 	request->id = mgmt->next_request_id++;
+	request->pipelined = is_pipelined(opcode);
 
 	if (!queue_push_tail(mgmt->request_queue, request)) {
 		free(request->buf);
@@ -836,6 +1042,7 @@ unsigned int mgmt_send_nowait(struct mgmt *mgmt, uint16_t opcode, uint16_t index
 		mgmt->next_request_id = 1;
 
 	request->id = mgmt->next_request_id++;
+	request->pipelined = is_pipelined(opcode);
 
 	if (!send_request(mgmt, request))
 		return 0;
@@ -901,8 +1108,7 @@ bool mgmt_cancel(struct mgmt *mgmt, unsigned int id)
 	if (request)
 		goto done;
 
-	request = queue_remove_if(mgmt->pending_list, match_request_id,
-							UINT_TO_PTR(id));
+	request = pending_remove_if(mgmt, match_request_id, UINT_TO_PTR(id));
 	if (!request)
 		return false;
 
@@ -923,8 +1129,7 @@ bool mgmt_cancel_index(struct mgmt *mgmt, uint16_t index)
 					UINT_TO_PTR(index), destroy_request);
 	queue_remove_all(mgmt->reply_queue, match_request_index,
 					UINT_TO_PTR(index), destroy_request);
-	queue_remove_all(mgmt->pending_list, match_request_index,
-					UINT_TO_PTR(index), destroy_request);
+	pending_remove_all(mgmt, match_request_index, UINT_TO_PTR(index));
 
 	return true;
 }
@@ -934,7 +1139,7 @@ bool mgmt_cancel_all(struct mgmt *mgmt)
 	if (!mgmt)
 		return false;
 
-	queue_remove_all(mgmt->pending_list, NULL, NULL, destroy_request);
+	pending_remove_all(mgmt, NULL, NULL);
 	queue_remove_all(mgmt->reply_queue, NULL, NULL, destroy_request);
 	queue_remove_all(mgmt->request_queue, NULL, NULL, destroy_request);
 
@@ -963,7 +1168,7 @@ unsigned int mgmt_register(struct mgmt *mgmt, uint16_t event, uint16_t index,
 
 	notify->id = mgmt->next_notify_id++;
 
-	if (!queue_push_tail(mgmt->notify_list, notify)) {
+	if (!queue_push_tail(notify_bucket(mgmt, event), notify)) {
 		free(notify);
 		return 0;
 	}
@@ -974,12 +1179,15 @@ unsigned int mgmt_register(struct mgmt *mgmt, uint16_t event, uint16_t index,
 bool mgmt_unregister(struct mgmt *mgmt, unsigned int id)
 {
 	struct mgmt_notify *notify;
+	int i;
 
 	if (!mgmt || !id)
 		return false;
 
-	notify = queue_remove_if(mgmt->notify_list, match_notify_id,
-							UINT_TO_PTR(id));
+	for (i = 0, notify = NULL; i < NOTIFY_BUCKETS && !notify; i++)
+		notify = queue_remove_if(mgmt->notify_table[i],
+					match_notify_id, UINT_TO_PTR(id));
+
 	if (!notify)
 		return false;
 
@@ -1000,12 +1208,11 @@ bool mgmt_unregister_index(struct mgmt *mgmt, uint16_t index)
 		return false;
 
 	if (mgmt->in_notify) {
-		queue_foreach(mgmt->notify_list, mark_notify_removed,
-							UINT_TO_PTR(index));
+		notify_foreach(mgmt, mark_notify_removed, UINT_TO_PTR(index));
 		mgmt->need_notify_cleanup = true;
 	} else
-		queue_remove_all(mgmt->notify_list, match_notify_index,
-					UINT_TO_PTR(index), destroy_notify);
+		notify_remove_all(mgmt, match_notify_index,
+						UINT_TO_PTR(index));
 
 	return true;
 }
@@ -1016,11 +1223,11 @@ bool mgmt_unregister_all(struct mgmt *mgmt)
 		return false;
 
 	if (mgmt->in_notify) {
-		queue_foreach(mgmt->notify_list, mark_notify_removed,
+		notify_foreach(mgmt, mark_notify_removed,
 						UINT_TO_PTR(MGMT_INDEX_NONE));
 		mgmt->need_notify_cleanup = true;
 	} else
-		queue_remove_all(mgmt->notify_list, NULL, NULL, destroy_notify);
+		notify_remove_all(mgmt, NULL, NULL);
 
 	return true;
 }
@@ -1032,3 +1239,13 @@ uint16_t mgmt_get_mtu(struct mgmt *mgmt)
 
 	return mgmt->mtu;
 }
+
+bool mgmt_get_stats(struct mgmt *mgmt, struct mgmt_stats *stats)
+{
+	if (!mgmt || !stats)
+		return false;
+
+	*stats = mgmt->stats;
+
+	return true;
+}
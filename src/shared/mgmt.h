@@ -18,6 +18,15 @@ typedef void (*mgmt_destroy_func_t)(void *user_data);
 struct mgmt;
 struct mgmt_tlv_list;
 
+struct mgmt_stats {
+	unsigned int sent;		/* Commands written */
+	unsigned int completed;		/* Commands answered by the kernel */
+	unsigned int in_flight;
+	unsigned int max_in_flight;
+	unsigned int avg_latency;	/* Microseconds */
+	unsigned int max_latency;	/* Microseconds */
+};
+
 struct mgmt *mgmt_new(int fd);
 struct mgmt *mgmt_new_default(void);
 
@@ -88,3 +97,4 @@ bool mgmt_unregister_index(struct mgmt *mgmt, uint16_t index);
 bool mgmt_unregister_all(struct mgmt *mgmt);
 
 uint16_t mgmt_get_mtu(struct mgmt *mgmt);
+bool mgmt_get_stats(struct mgmt *mgmt, struct mgmt_stats *stats);
@@ -15,6 +15,7 @@
 #define _GNU_SOURCE
 #include <stdio.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <syslog.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -22,6 +23,7 @@
 #include <signal.h>
 #include <sys/signalfd.h>
 #include <sys/socket.h>
+#include <sys/wait.h>
 
 #include <glib.h>
 
@@ -87,6 +89,7 @@ struct test_case {
 	tester_data_func_t teardown_func;
 	tester_data_func_t post_teardown_func;
 	gdouble start_time;
+	gdouble setup_time;
 	gdouble end_time;
 	unsigned int timeout;
 	unsigned int timeout_id;
@@ -95,6 +98,20 @@ struct test_case {
 	void *user_data;
 };
 
+/* A test case running in its own forked process */
+struct test_worker {
+	struct test_case *test;
+	pid_t pid;
+	int fd;
+	FILE *out;
+};
+
+struct test_report {
+	enum test_result result;
+	gdouble setup_time;
+	gdouble exec_time;
+};
+
 static char *tester_name;
 
 static GList *test_list;
@@ -106,8 +123,13 @@ static gboolean option_quiet = FALSE;
 static gboolean option_debug = FALSE;
 static gboolean option_monitor = FALSE;
 static gboolean option_list = FALSE;
+static gboolean option_perf = FALSE;
+static gboolean option_timing = FALSE;
 static const char *option_prefix = NULL;
 static const char *option_string = NULL;
+static gint option_jobs = 1;
+
+static volatile sig_atomic_t workers_terminated;
 
 struct monitor_hdr {
 	uint16_t opcode;
@@ -361,7 +383,7 @@ void *tester_get_data(void)
 static int tester_summarize(void)
 {
 	unsigned int not_run = 0, passed = 0, failed = 0;
-	gdouble execution_time;
+	gdouble execution_time, test_time = 0, setup_time = 0;
 	GList *list;
 
 	tester_log("");
@@ -375,6 +397,11 @@ static int tester_summarize(void)
 
 		exec_time = test->end_time - test->start_time;
 
+		if (test->result != TEST_RESULT_NOT_RUN) {
+			test_time += exec_time;
+			setup_time += test->setup_time;
+		}
+
 		switch (test->result) {
 		case TEST_RESULT_NOT_RUN:
 			print_summary(test->name, COLOR_YELLOW, "Not Run", "");
@@ -410,6 +437,15 @@ static int tester_summarize(void)
 	execution_time = g_timer_elapsed(test_timer, NULL);
 	tester_log("Overall execution time: %.3g seconds", execution_time);
 
+	if (option_jobs > 1)
+		tester_log("Sum of test times: %.3g seconds in %d jobs",
+						test_time, option_jobs);
+
+	if (option_timing)
+		tester_log("Setup time: %.3g seconds (%.1f%% of test time)",
+				setup_time, test_time > 0 ?
+				setup_time * 100 / test_time : 0);
+
 	return failed;
 }
 
@@ -510,7 +546,12 @@ static gboolean done_callback(gpointer user_data)
 
 	test->end_time = g_timer_elapsed(test_timer, NULL);
 
-	print_progress(test->name, COLOR_BLACK, "done");
+	if (option_timing)
+		print_progress(test->name, COLOR_BLACK, "done (%.3f seconds)",
+					test->end_time - test->start_time);
+	else
+		print_progress(test->name, COLOR_BLACK, "done");
+
 	next_test_case();
 
 	return FALSE;
@@ -565,6 +606,9 @@ void tester_setup_complete(void)
 	if (test->stage != TEST_STAGE_SETUP)
 		return;
 
+	test->setup_time = g_timer_elapsed(test_timer, NULL) -
+							test->start_time;
+
 	print_progress(test->name, COLOR_BLUE, "setup complete");
 
 	g_idle_add(run_callback, test);
@@ -795,6 +839,181 @@ static void signal_callback(int signum, void *user_data)
 	}
 }
 
+static void run_worker(struct test_case *test, int fd, FILE *out)
+{
+	struct test_report report;
+
+	if (dup2(fileno(out), STDOUT_FILENO) < 0)
+		_exit(EXIT_FAILURE);
+
+	/* Run this test case only, the parent owns the rest */
+	test_list = g_list_append(NULL, test);
+	test_current = NULL;
+
+	g_idle_add(start_tester, NULL);
+
+	mainloop_run_with_signal(signal_callback, NULL);
+
+	report.result = test->result;
+	report.setup_time = test->setup_time;
+	report.exec_time = test->end_time - test->start_time;
+
+	fflush(stdout);
+
+	if (write(fd, &report, sizeof(report)) != sizeof(report))
+		_exit(EXIT_FAILURE);
+
+	_exit(EXIT_SUCCESS);
+}
+
+static bool start_worker(struct test_worker *worker, struct test_case *test)
+{
+	int fds[2];
+	FILE *out;
+	pid_t pid;
+
+	/* Buffer output so parallel tests don't interleave their logs */
+	out = tmpfile();
+	if (!out)
+		return false;
+
+	if (pipe2(fds, O_CLOEXEC) < 0) {
+		fclose(out);
+		return false;
+	}
+
+	fflush(stdout);
+
+	pid = fork();
+	if (pid < 0) {
+		close(fds[0]);
+		close(fds[1]);
+		fclose(out);
+		return false;
+	}
+
+	if (!pid) {
+		close(fds[0]);
+		run_worker(test, fds[1], out);
+	}
+
+	close(fds[1]);
+
+	worker->test = test;
+	worker->pid = pid;
+	worker->fd = fds[0];
+	worker->out = out;
+
+	return true;
+}
+
+static void finish_worker(struct test_worker *worker, int status)
+{
+	struct test_case *test = worker->test;
+	struct test_report report;
+	char buf[4096];
+	size_t len;
+	bool reported;
+
+	reported = read(worker->fd, &report, sizeof(report)) ==
+							sizeof(report);
+
+	rewind(worker->out);
+
+	while ((len = fread(buf, 1, sizeof(buf), worker->out)) > 0)
+		fwrite(buf, 1, len, stdout);
+
+	if (reported) {
+		test->result = report.result;
+		test->start_time = 0;
+		test->setup_time = report.setup_time;
+		test->end_time = report.exec_time;
+	} else {
+		test->result = TEST_RESULT_FAILED;
+		print_progress(test->name, COLOR_RED,
+					"worker exited without result (%d)",
+					status);
+	}
+
+	fflush(stdout);
+
+	fclose(worker->out);
+	close(worker->fd);
+
+	worker->pid = 0;
+}
+
+static void worker_signal(int signum)
+{
+	workers_terminated = 1;
+}
+
+static void run_parallel(void)
+{
+	struct test_worker *workers;
+	struct sigaction sa, old_int, old_term;
+	GList *next = test_list;
+	unsigned int running = 0;
+	int i;
+
+	workers = new0(struct test_worker, option_jobs);
+
+	/* Stop starting tests, the workers see the signal themselves */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = worker_signal;
+	sigaction(SIGINT, &sa, &old_int);
+	sigaction(SIGTERM, &sa, &old_term);
+
+	test_timer = g_timer_new();
+
+	while (running || (next && !workers_terminated)) {
+		pid_t pid;
+		int status;
+
+		for (i = 0; i < option_jobs && next && !workers_terminated;
+									i++) {
+			if (workers[i].pid)
+				continue;
+
+			if (!start_worker(&workers[i], next->data)) {
+				tester_warn("Failed to start worker: %s",
+							strerror(errno));
+				workers_terminated = 1;
+				break;
+			}
+
+			next = g_list_next(next);
+			running++;
+		}
+
+		if (!running)
+			break;
+
+		pid = waitpid(-1, &status, 0);
+		if (pid < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		for (i = 0; i < option_jobs; i++) {
+			if (workers[i].pid != pid)
+				continue;
+
+			finish_worker(&workers[i], status);
+			running--;
+			break;
+		}
+	}
+
+	g_timer_stop(test_timer);
+
+	sigaction(SIGINT, &old_int, NULL);
+	sigaction(SIGTERM, &old_term, NULL);
+
+	free(workers);
+}
+
 bool tester_use_quiet(void)
 {
 	return option_quiet == TRUE ? true : false;
@@ -805,6 +1024,11 @@ bool tester_use_debug(void)
 	return option_debug == TRUE ? true : false;
 }
 
+bool tester_use_perf(void)
+{
+	return option_perf == TRUE ? true : false;
+}
+
 static GOptionEntry options[] = {
 	{ "version", 'v', 0, G_OPTION_ARG_NONE, &option_version,
 				"Show version information and exit" },
@@ -820,6 +1044,12 @@ static GOptionEntry options[] = {
 				"Run tests matching provided prefix" },
 	{ "string", 's', 0, G_OPTION_ARG_STRING, &option_string,
 				"Run tests matching provided string" },
+	{ "jobs", 'j', 0, G_OPTION_ARG_INT, &option_jobs,
+				"Run tests in parallel, 0 for one per CPU" },
+	{ "perf", 'P', 0, G_OPTION_ARG_NONE, &option_perf,
+				"Also run performance tests" },
+	{ "timing", 't', 0, G_OPTION_ARG_NONE, &option_timing,
+				"Show test and setup durations" },
 	{ NULL },
 };
 
@@ -847,6 +1077,12 @@ void tester_init(int *argc, char ***argv)
 		exit(EXIT_SUCCESS);
 	}
 
+	if (option_jobs <= 0)
+		option_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (option_jobs <= 0)
+		option_jobs = 1;
+
 	mainloop_init();
 
 	tester_name = strrchr(*argv[0], '/');
@@ -868,9 +1104,12 @@ int tester_run(void)
 		return EXIT_SUCCESS;
 	}
 
-	g_idle_add(start_tester, NULL);
-
-	mainloop_run_with_signal(signal_callback, NULL);
+	if (option_jobs > 1)
+		run_parallel();
+	else {
+		g_idle_add(start_tester, NULL);
+		mainloop_run_with_signal(signal_callback, NULL);
+	}
 
 	ret = tester_summarize();
 
@@ -14,6 +14,7 @@
 
 #define _GNU_SOURCE
 #include <stdio.h>
+#include <stddef.h>
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
@@ -233,3 +234,40 @@ int bt_uhid_send(struct bt_uhid *uhid, const struct uhid_event *ev)
 	/* uHID kernel driver does not handle partial writes */
 	return len != sizeof(*ev) ? -EIO : 0;
 }
+
+/*
+ * Send an input report using UHID_INPUT2, which carries the size ahead of the
+ * data so only the used part of the event needs to be filled and written.
+ */
+int bt_uhid_input(struct bt_uhid *uhid, uint8_t number, const void *data,
+								size_t size)
+{
+	struct uhid_event ev;
+	struct uhid_input2_req *req = &ev.u.input2;
+	struct iovec iov;
+	size_t len = 0;
+	ssize_t ret;
+
+	if (!uhid->io)
+		return -ENOTCONN;
+
+	ev.type = UHID_INPUT2;
+
+	if (number)
+		req->data[len++] = number;
+
+	if (size > sizeof(req->data) - len)
+		size = sizeof(req->data) - len;
+
+	memcpy(req->data + len, data, size);
+	req->size = len + size;
+
+	iov.iov_base = &ev;
+	iov.iov_len = offsetof(struct uhid_event, u.input2.data) + req->size;
+
+	ret = io_send(uhid->io, &iov, 1);
+	if (ret < 0)
+		return -errno;
+
+	return (size_t) ret != iov.iov_len ? -EIO : 0;
+}
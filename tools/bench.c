@@ -0,0 +1,657 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "lib/bluetooth.h"
+
+#include "src/shared/util.h"
+
+#include "bench.h"
+
+/*
+ * Every benchmark connection starts with a fixed size header from the
+ * client telling the server which test runs and the message size, so
+ * that the server can keep message boundaries on stream sockets too:
+ *
+ *	magic (le32) | test (u8) | reserved (3 octets) | size (le32)
+ */
+#define BENCH_MAGIC		0x484e4542	/* "BENH" */
+#define BENCH_HDR_SIZE		12
+
+#define BENCH_MAX_BATCH		64
+#define BENCH_MAX_MSG_SIZE	65535
+#define BENCH_DEFAULT_TIME	10
+
+/* Log-linear histogram: 16 buckets per power of two, ~6% resolution */
+#define HIST_SUB_BITS		4
+#define HIST_SUB		(1 << HIST_SUB_BITS)
+#define HIST_BUCKETS		((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+struct bench_hist {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+	uint64_t buckets[HIST_BUCKETS];
+};
+
+struct bench_result {
+	const char *tool;
+	const char *role;
+	enum bench_test test;
+	unsigned int size;
+	unsigned int batch;
+	uint64_t bytes;
+	uint64_t msgs;
+	uint64_t elapsed;		/* usec */
+	uint64_t cpu;			/* usec */
+	struct bench_hist *rtt;
+	bool json;
+};
+
+static const char *test_str[] = {
+	[BENCH_THROUGHPUT] = "throughput",
+	[BENCH_RTT] = "rtt",
+};
+
+static uint64_t now_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+}
+
+static uint64_t cpu_usec(void)
+{
+	struct rusage ru;
+
+	if (getrusage(RUSAGE_SELF, &ru) < 0)
+		return 0;
+
+	return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000ull +
+				ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+static unsigned int hist_index(uint64_t value)
+{
+	unsigned int shift;
+
+	if (value < HIST_SUB)
+		return value;
+
+	shift = 63 - __builtin_clzll(value) - HIST_SUB_BITS;
+
+	return (shift + 1) * HIST_SUB + ((value >> shift) & (HIST_SUB - 1));
+}
+
+static uint64_t hist_value(unsigned int index)
+{
+	unsigned int shift;
+
+	if (index < HIST_SUB)
+		return index;
+
+	shift = index / HIST_SUB - 1;
+
+	return (uint64_t) (HIST_SUB + index % HIST_SUB) << shift;
+}
+
+static void hist_add(struct bench_hist *hist, uint64_t value)
+{
+	if (!hist->count || value < hist->min)
+		hist->min = value;
+
+	if (value > hist->max)
+		hist->max = value;
+
+	hist->count++;
+	hist->sum += value;
+	hist->buckets[hist_index(value)]++;
+}
+
+static uint64_t hist_percentile(const struct bench_hist *hist,
+							unsigned int permille)
+{
+	uint64_t target, seen = 0;
+	unsigned int i;
+
+	if (!hist->count)
+		return 0;
+
+	target = (hist->count * permille + 999) / 1000;
+
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		seen += hist->buckets[i];
+		if (seen < target)
+			continue;
+
+		/* Report the bucket's lower bound within the seen range */
+		if (hist_value(i) < hist->min)
+			return hist->min;
+
+		return hist_value(i);
+	}
+
+	return hist->max;
+}
+
+static bool parse_sizes(struct bench_config *config, const char *arg)
+{
+	char *str, *tok, *saveptr = NULL;
+	bool result = true;
+
+	str = strdup(arg);
+	if (!str)
+		return false;
+
+	config->num_sizes = 0;
+
+	for (tok = strtok_r(str, ",", &saveptr); tok;
+				tok = strtok_r(NULL, ",", &saveptr)) {
+		unsigned long size = strtoul(tok, NULL, 0);
+
+		if (!size || size > BENCH_MAX_MSG_SIZE ||
+				config->num_sizes == BENCH_MAX_SIZES) {
+			result = false;
+			break;
+		}
+
+		config->sizes[config->num_sizes++] = size;
+	}
+
+	free(str);
+
+	return result && config->num_sizes;
+}
+
+bool bench_parse_opt(struct bench_config *config, int opt, const char *arg)
+{
+	switch (opt) {
+	case BENCH_OPT_RTT:
+		config->test = BENCH_RTT;
+		return true;
+	case BENCH_OPT_TIME:
+		config->duration = atoi(arg);
+		return true;
+	case BENCH_OPT_TOTAL:
+		config->total = strtoull(arg, NULL, 0);
+		return true;
+	case BENCH_OPT_BATCH:
+		config->batch = atoi(arg);
+		return config->batch > 0 && config->batch <= BENCH_MAX_BATCH;
+	case BENCH_OPT_SWEEP:
+		return parse_sizes(config, arg);
+	case BENCH_OPT_JSON:
+		config->json = true;
+		return true;
+	}
+
+	return false;
+}
+
+void bench_usage(const char *sweep)
+{
+	printf("Benchmark options:\n"
+		"\t[--rtt] measure ping-pong round trip time\n"
+		"\t[--time seconds] run for seconds (default = %u)\n"
+		"\t[--total bytes] stop after sending bytes\n"
+		"\t[--batch num] messages per sendmmsg/recvmmsg (max %u)\n"
+		"\t[--sweep size,...] run once for each %s\n"
+		"\t[--json] print results as JSON, one object per run\n",
+		BENCH_DEFAULT_TIME, BENCH_MAX_BATCH, sweep);
+}
+
+static void report(const struct bench_result *res)
+{
+	const struct bench_hist *hist = res->rtt;
+	double secs = res->elapsed ? res->elapsed / 1000000.0 : 1;
+	double kbytes = res->bytes / 1024.0;
+
+	if (!hist || !hist->count)
+		hist = NULL;
+
+	if (!res->json) {
+		syslog(LOG_INFO, "%s %s %u bytes: %" PRIu64 " bytes in "
+				"%.2f sec, %.2f kB/s, %.0f msg/s", res->role,
+				test_str[res->test], res->size, res->bytes,
+				secs, kbytes / secs, res->msgs / secs);
+		syslog(LOG_INFO, "CPU %.1f%%, %.2f usec/kB",
+				res->cpu / (secs * 10000.0),
+				kbytes ? res->cpu / kbytes : 0);
+
+		if (hist)
+			syslog(LOG_INFO, "RTT usec: min %" PRIu64 " avg %"
+				PRIu64 " p50 %" PRIu64 " p90 %" PRIu64
+				" p99 %" PRIu64 " p99.9 %" PRIu64
+				" max %" PRIu64, hist->min,
+				hist->sum / hist->count,
+				hist_percentile(hist, 500),
+				hist_percentile(hist, 900),
+				hist_percentile(hist, 990),
+				hist_percentile(hist, 999), hist->max);
+		return;
+	}
+
+	printf("{\"tool\":\"%s\",\"test\":\"%s\",\"role\":\"%s\","
+		"\"size\":%u,\"batch\":%u,\"bytes\":%" PRIu64 ","
+		"\"messages\":%" PRIu64 ",\"elapsed_us\":%" PRIu64 ","
+		"\"kbytes_per_sec\":%.2f,\"cpu_us\":%" PRIu64,
+		res->tool, test_str[res->test], res->role, res->size,
+		res->batch, res->bytes, res->msgs, res->elapsed,
+		kbytes / secs, res->cpu);
+
+	if (hist)
+		printf(",\"rtt_us\":{\"samples\":%" PRIu64 ",\"min\":%" PRIu64
+			",\"mean\":%" PRIu64 ",\"p50\":%" PRIu64
+			",\"p90\":%" PRIu64 ",\"p99\":%" PRIu64
+			",\"p999\":%" PRIu64 ",\"max\":%" PRIu64 "}",
+			hist->count, hist->min, hist->sum / hist->count,
+			hist_percentile(hist, 500),
+			hist_percentile(hist, 900),
+			hist_percentile(hist, 990),
+			hist_percentile(hist, 999), hist->max);
+
+	printf("}\n");
+	fflush(stdout);
+}
+
+static void init_msgs(struct mmsghdr *msgs, struct iovec *iov,
+				unsigned int num, void *data, size_t len)
+{
+	unsigned int i;
+
+	memset(msgs, 0, num * sizeof(*msgs));
+
+	/* The payload is never looked at, so all messages share a buffer */
+	for (i = 0; i < num; i++) {
+		iov[i].iov_base = data;
+		iov[i].iov_len = len;
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+}
+
+static int recv_full(int sk, uint8_t *data, size_t len)
+{
+	size_t got = 0;
+
+	while (got < len) {
+		ssize_t ret;
+
+		ret = recv(sk, data + got, len - got, 0);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+
+		if (!ret)
+			return -ECONNRESET;
+
+		got += ret;
+	}
+
+	return 0;
+}
+
+static int send_full(int sk, const uint8_t *data, size_t len)
+{
+	size_t sent = 0;
+
+	while (sent < len) {
+		ssize_t ret;
+
+		ret = send(sk, data + sent, len - sent, 0);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+
+		sent += ret;
+	}
+
+	return 0;
+}
+
+static bool limit_reached(const struct bench_config *config,
+				const struct bench_result *res, uint64_t start)
+{
+	if (config->total && res->bytes >= config->total)
+		return true;
+
+	if (config->duration &&
+			now_usec() - start >= config->duration * 1000000ull)
+		return true;
+
+	return false;
+}
+
+/* Wait until the socket no longer holds data the controller hasn't taken */
+static void wait_drained(int sk)
+{
+	struct sockaddr_storage addr;
+	socklen_t len = sizeof(addr);
+	int sndbuf, outq, i;
+
+	/* Only Bluetooth sockets report free space through TIOCOUTQ */
+	if (getsockname(sk, (struct sockaddr *) &addr, &len) < 0 ||
+					addr.ss_family != AF_BLUETOOTH)
+		return;
+
+	len = sizeof(sndbuf);
+
+	if (getsockopt(sk, SOL_SOCKET, SO_SNDBUF, &sndbuf, &len) < 0)
+		return;
+
+	for (i = 0; i < 5000; i++) {
+		if (ioctl(sk, TIOCOUTQ, &outq) < 0 || outq >= sndbuf)
+			return;
+
+		usleep(1000);
+	}
+}
+
+static int client_throughput(int sk, const struct bench_config *config,
+						struct bench_result *res)
+{
+	struct mmsghdr msgs[BENCH_MAX_BATCH];
+	struct iovec iov[BENCH_MAX_BATCH];
+	uint64_t start, cpu;
+	uint8_t *data;
+	int err = 0;
+
+	data = malloc(res->size);
+	if (!data)
+		return -ENOMEM;
+
+	memset(data, 0x7f, res->size);
+	init_msgs(msgs, iov, config->batch, data, res->size);
+
+	start = now_usec();
+	cpu = cpu_usec();
+
+	while (!limit_reached(config, res, start)) {
+		int i, num;
+
+		num = sendmmsg(sk, msgs, config->batch, 0);
+		if (num < 0) {
+			if (errno == EINTR)
+				continue;
+			err = -errno;
+			break;
+		}
+
+		for (i = 0; i < num; i++)
+			res->bytes += msgs[i].msg_len;
+
+		res->msgs += num;
+	}
+
+	wait_drained(sk);
+
+	res->elapsed = now_usec() - start;
+	res->cpu = cpu_usec() - cpu;
+
+	free(data);
+
+	return err;
+}
+
+static int client_rtt(int sk, const struct bench_config *config,
+						struct bench_result *res)
+{
+	struct mmsghdr msgs[BENCH_MAX_BATCH];
+	struct iovec iov[BENCH_MAX_BATCH];
+	uint64_t start, cpu;
+	uint8_t *data, *reply;
+	int err = 0;
+
+	res->rtt = calloc(1, sizeof(*res->rtt));
+	data = malloc(res->size);
+	reply = malloc(res->size);
+	if (!res->rtt || !data || !reply) {
+		err = -ENOMEM;
+		goto done;
+	}
+
+	memset(data, 0x7f, res->size);
+	init_msgs(msgs, iov, config->batch, data, res->size);
+
+	start = now_usec();
+	cpu = cpu_usec();
+
+	while (!err && !limit_reached(config, res, start)) {
+		uint64_t sent;
+		int i, num;
+
+		sent = now_usec();
+
+		num = sendmmsg(sk, msgs, config->batch, 0);
+		if (num < 0) {
+			if (errno == EINTR)
+				continue;
+			err = -errno;
+			break;
+		}
+
+		/* Each ping is answered by an echo of the same size */
+		for (i = 0; i < num; i++) {
+			err = recv_full(sk, reply, msgs[i].msg_len);
+			if (err < 0)
+				break;
+
+			hist_add(res->rtt, now_usec() - sent);
+
+			res->bytes += msgs[i].msg_len;
+			res->msgs++;
+		}
+	}
+
+	res->elapsed = now_usec() - start;
+	res->cpu = cpu_usec() - cpu;
+
+done:
+	free(reply);
+	free(data);
+
+	return err;
+}
+
+int bench_client(int sk, const char *tool, unsigned int size,
+					const struct bench_config *config)
+{
+	struct bench_config cfg = *config;
+	struct bench_result res;
+	uint8_t hdr[BENCH_HDR_SIZE];
+	int err;
+
+	if (!size || size > BENCH_MAX_MSG_SIZE)
+		return -EINVAL;
+
+	if (!cfg.duration && !cfg.total)
+		cfg.duration = BENCH_DEFAULT_TIME;
+
+	if (!cfg.batch)
+		cfg.batch = 1;
+
+	memset(hdr, 0, sizeof(hdr));
+	put_le32(BENCH_MAGIC, hdr);
+	hdr[4] = cfg.test;
+	put_le32(size, hdr + 8);
+
+	err = send_full(sk, hdr, sizeof(hdr));
+	if (err < 0) {
+		syslog(LOG_ERR, "Can't start benchmark: %s (%d)",
+							strerror(-err), -err);
+		return err;
+	}
+
+	memset(&res, 0, sizeof(res));
+	res.tool = tool;
+	res.role = "client";
+	res.test = cfg.test;
+	res.size = size;
+	res.batch = cfg.batch;
+	res.json = cfg.json;
+
+	syslog(LOG_INFO, "Running %s benchmark with %u byte messages ...",
+						test_str[cfg.test], size);
+
+	if (cfg.test == BENCH_RTT)
+		err = client_rtt(sk, &cfg, &res);
+	else
+		err = client_throughput(sk, &cfg, &res);
+
+	if (err < 0)
+		syslog(LOG_ERR, "Benchmark failed: %s (%d)", strerror(-err),
+									-err);
+
+	report(&res);
+
+	free(res.rtt);
+
+	return err;
+}
+
+static void server_sink(int sk, struct bench_result *res)
+{
+	struct mmsghdr msgs[BENCH_MAX_BATCH];
+	struct iovec iov[BENCH_MAX_BATCH];
+	uint64_t start = 0, last = 0;
+	uint8_t *data;
+
+	data = malloc(res->size);
+	if (!data)
+		return;
+
+	init_msgs(msgs, iov, res->batch, data, res->size);
+
+	while (1) {
+		uint64_t bytes = 0;
+		int i, num;
+
+		num = recvmmsg(sk, msgs, res->batch, MSG_WAITFORONE, NULL);
+		if (num < 0 && errno == EINTR)
+			continue;
+
+		if (num <= 0)
+			break;
+
+		for (i = 0; i < num; i++)
+			bytes += msgs[i].msg_len;
+
+		/* Orderly shutdown of a stream socket */
+		if (!bytes)
+			break;
+
+		last = now_usec();
+		if (!start)
+			start = last;
+
+		res->bytes += bytes;
+		res->msgs += num;
+	}
+
+	/* From the first to the last message, disconnect isn't data */
+	res->elapsed = last - start;
+
+	free(data);
+}
+
+static void server_echo(int sk, struct bench_result *res)
+{
+	uint64_t start = 0, last = 0;
+	uint8_t *data;
+
+	data = malloc(res->size);
+	if (!data)
+		return;
+
+	while (!recv_full(sk, data, res->size)) {
+		if (!start)
+			start = now_usec();
+
+		if (send_full(sk, data, res->size) < 0)
+			break;
+
+		last = now_usec();
+		res->bytes += res->size;
+		res->msgs++;
+	}
+
+	res->elapsed = last - start;
+
+	free(data);
+}
+
+int bench_server(int sk, const char *tool, const struct bench_config *config)
+{
+	struct bench_result res;
+	uint8_t hdr[BENCH_HDR_SIZE];
+	uint64_t cpu;
+	int err;
+
+	err = recv_full(sk, hdr, sizeof(hdr));
+	if (err < 0) {
+		syslog(LOG_ERR, "Can't read benchmark header: %s (%d)",
+							strerror(-err), -err);
+		return err;
+	}
+
+	memset(&res, 0, sizeof(res));
+	res.tool = tool;
+	res.role = "server";
+	res.test = hdr[4];
+	res.size = get_le32(hdr + 8);
+	res.batch = config->batch ? config->batch : 1;
+	res.json = config->json;
+
+	if (get_le32(hdr) != BENCH_MAGIC || res.test > BENCH_RTT ||
+				!res.size || res.size > BENCH_MAX_MSG_SIZE) {
+		syslog(LOG_ERR, "Invalid benchmark header");
+		return -EPROTO;
+	}
+
+	syslog(LOG_INFO, "Serving %s benchmark with %u byte messages ...",
+						test_str[res.test], res.size);
+
+	cpu = cpu_usec();
+
+	if (res.test == BENCH_RTT)
+		server_echo(sk, &res);
+	else
+		server_sink(sk, &res);
+
+	res.cpu = cpu_usec() - cpu;
+
+	report(&res);
+
+	return 0;
+}
@@ -0,0 +1,49 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#define BENCH_MAX_SIZES		16
+
+enum bench_test {
+	BENCH_THROUGHPUT,
+	BENCH_RTT,
+};
+
+struct bench_config {
+	enum bench_test test;
+	unsigned int duration;		/* Seconds, 0 for no limit */
+	uint64_t total;			/* Bytes, 0 for no limit */
+	unsigned int batch;		/* Messages per system call */
+	unsigned int sizes[BENCH_MAX_SIZES];
+	unsigned int num_sizes;
+	bool json;
+};
+
+/* Long only options, shared by l2test and rctest */
+enum {
+	BENCH_OPT_RTT = 256,
+	BENCH_OPT_TIME,
+	BENCH_OPT_TOTAL,
+	BENCH_OPT_BATCH,
+	BENCH_OPT_SWEEP,
+	BENCH_OPT_JSON,
+};
+
+#define BENCH_LONG_OPTIONS \
+	{ "rtt",	0, 0, BENCH_OPT_RTT }, \
+	{ "time",	1, 0, BENCH_OPT_TIME }, \
+	{ "total",	1, 0, BENCH_OPT_TOTAL }, \
+	{ "batch",	1, 0, BENCH_OPT_BATCH }, \
+	{ "sweep",	1, 0, BENCH_OPT_SWEEP }, \
+	{ "json",	0, 0, BENCH_OPT_JSON }
+
+bool bench_parse_opt(struct bench_config *config, int opt, const char *arg);
+void bench_usage(const char *sweep);
+
+int bench_client(int sk, const char *tool, unsigned int size,
+					const struct bench_config *config);
+int bench_server(int sk, const char *tool, const struct bench_config *config);
@@ -132,6 +132,9 @@ static void read_info_callback(uint8_t status, uint16_t length,
 	tester_pre_setup_complete();
 }
 
+/* Spare controllers registered ahead of the test cases needing them */
+static struct hciemu_pool *pool;
+
 static void index_added_callback(uint16_t index, uint16_t length,
 					const void *param, void *user_data)
 {
@@ -140,6 +143,9 @@ static void index_added_callback(uint16_t index, uint16_t length,
 	tester_print("Index Added callback");
 	tester_print("  Index: 0x%04x", index);
 
+	if (!hciemu_owns_index(data->hciemu, index))
+		return;
+
 	data->mgmt_index = index;
 
 	mgmt_send(data->mgmt, MGMT_OP_READ_INFO, data->mgmt_index, 0, NULL,
@@ -184,16 +190,22 @@ static void read_index_list_callback(uint8_t status, uint16_t length,
 	mgmt_register(data->mgmt, MGMT_EV_INDEX_REMOVED, MGMT_INDEX_NONE,
 					index_removed_callback, NULL, NULL);
 
-	data->hciemu = hciemu_new(data->hciemu_type);
+	data->hciemu = hciemu_pool_get(pool, data->hciemu_type);
 	if (!data->hciemu) {
 		tester_warn("Failed to setup HCI emulation");
 		tester_pre_setup_failed();
+		return;
 	}
 
 	if (tester_use_debug())
 		hciemu_set_debug(data->hciemu, print_debug, "hciemu: ", NULL);
 
 	tester_print("New hciemu instance created");
+
+	/* A pre-warmed controller has already been announced */
+	if (hciemu_index_listed(data->hciemu, param, length))
+		index_added_callback(hciemu_get_index(data->hciemu), 0, NULL,
+									NULL);
 }
 
 static void test_pre_setup(const void *test_data)
@@ -1922,8 +1934,12 @@ done:
 
 int main(int argc, char *argv[])
 {
+	int ret;
+
 	tester_init(&argc, &argv);
 
+	pool = hciemu_pool_new(2);
+
 	test_l2cap_bredr("Basic L2CAP Socket - Success", NULL,
 					setup_powered_client, test_basic);
 	test_l2cap_bredr("Non-connected getpeername - Failure", NULL,
@@ -2072,5 +2088,10 @@ int main(int argc, char *argv[])
 				&le_att_server_success_test_1,
 				setup_powered_server, test_server);
 
-	return tester_run();
+	ret = tester_run();
+
+	hciemu_pool_print_stats(pool, print_debug, "");
+	hciemu_pool_free(pool);
+
+	return ret;
 }
@@ -38,6 +38,8 @@
 #include "src/shared/util.h"
 #include "monitor/display.h"
 
+#include "bench.h"
+
 #define NIBBLE_TO_ASCII(c)  ((c) < 0x0a ? (c) + 0x30 : (c) + 0x57)
 
 #define BREDR_DEFAULT_PSM	0x1011
@@ -63,6 +65,8 @@ enum {
 	CSENDRECV,
 	INFOREQ,
 	PAIRING,
+	BENCH,
+	LBENCH,
 };
 
 static unsigned char *buf;
@@ -124,6 +128,8 @@ static int rcvbuf = 0;
 static int chan_policy = -1;
 static int bdaddr_type = 0;
 
+static struct bench_config bench;
+
 struct lookup_table {
 	const char *name;
 	int flag;
@@ -1086,6 +1092,39 @@ static void multi_connect_mode(int argc, char *argv[])
 	}
 }
 
+static void bench_mode(int sk)
+{
+	bench_server(sk, "l2test", &bench);
+}
+
+static void bench_connect_mode(char *svr)
+{
+	unsigned int i, num = bench.num_sizes ? bench.num_sizes : 1;
+
+	for (i = 0; i < num; i++) {
+		unsigned int size;
+		int sk;
+
+		/* Sweep the MTU, the whole SDU is sent as one message */
+		if (bench.num_sizes)
+			imtu = omtu = bench.sizes[i];
+
+		sk = do_connect(svr);
+		if (sk < 0)
+			exit(1);
+
+		if (bench.num_sizes || data_size < 0 || data_size > omtu)
+			size = omtu;
+		else
+			size = data_size;
+
+		if (bench_client(sk, "l2test", size, &bench) < 0)
+			exit(1);
+
+		close(sk);
+	}
+}
+
 static void info_request(char *svr)
 {
 	unsigned char buf[48];
@@ -1297,7 +1336,9 @@ static void usage(void)
 		"\t-c connect, disconnect, connect, ...\n"
 		"\t-m multiple connects\n"
 		"\t-p trigger dedicated bonding\n"
-		"\t-z information request\n");
+		"\t-z information request\n"
+		"\t-l listen and serve benchmarks\n"
+		"\t-k connect and run benchmark\n");
 
 	printf("Options:\n"
 		"\t[-b bytes] [-i device] [-P psm] [-J cid]\n"
@@ -1327,17 +1368,26 @@ static void usage(void)
 		"\t[-T] enable timestamps\n"
 		"\t[-V type] address type (help for list, default = bredr)\n"
 		"\t[-e seq] initial sequence value (default = 0)\n");
+
+	bench_usage("MTU, the listener needs a large enough -I");
 }
 
+static struct option main_options[] = {
+	BENCH_LONG_OPTIONS,
+	{ 0, 0, 0, 0 }
+};
+
 int main(int argc, char *argv[])
 {
 	struct sigaction sa;
 	int opt, sk, mode = RECV, need_addr = 0;
+	unsigned int i;
 
 	bacpy(&bdaddr, BDADDR_ANY);
 
-	while ((opt = getopt(argc, argv, "a:b:cde:g:i:mnpqrstuwxyz"
-		"AB:C:D:EF:GH:I:J:K:L:MN:O:P:Q:RSTUV:W:X:Y:Z:")) != EOF) {
+	while ((opt = getopt_long(argc, argv, "a:b:cde:g:i:klmnpqrstuwxyz"
+		"AB:C:D:EF:GH:I:J:K:L:MN:O:P:Q:RSTUV:W:X:Y:Z:",
+		main_options, NULL)) != EOF) {
 		switch (opt) {
 		case 'r':
 			mode = RECV;
@@ -1403,6 +1453,15 @@ int main(int argc, char *argv[])
 			need_addr = 1;
 			break;
 
+		case 'k':
+			mode = BENCH;
+			need_addr = 1;
+			break;
+
+		case 'l':
+			mode = LBENCH;
+			break;
+
 		case 'b':
 			data_size = atoi(optarg);
 			break;
@@ -1552,6 +1611,9 @@ int main(int argc, char *argv[])
 			break;
 
 		default:
+			if (bench_parse_opt(&bench, opt, optarg))
+				break;
+
 			usage();
 			exit(1);
 		}
@@ -1574,6 +1636,11 @@ int main(int argc, char *argv[])
 	else
 		buffer_size = data_size;
 
+	for (i = 0; i < bench.num_sizes; i++) {
+		if (bench.sizes[i] > buffer_size)
+			buffer_size = bench.sizes[i];
+	}
+
 	if (!(buf = malloc(buffer_size))) {
 		perror("Can't allocate data buffer");
 		exit(1);
@@ -1655,6 +1722,14 @@ int main(int argc, char *argv[])
 		case PAIRING:
 			do_pairing(argv[optind]);
 			exit(0);
+
+		case BENCH:
+			bench_connect_mode(argv[optind]);
+			break;
+
+		case LBENCH:
+			do_listen(bench_mode);
+			break;
 	}
 
 	syslog(LOG_INFO, "Exit");
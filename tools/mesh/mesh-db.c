@@ -28,6 +28,7 @@
 
 #include "mesh/mesh-defs.h"
 #include "mesh/util.h"
+#include "mesh/json-journal.h"
 
 #include "tools/mesh/keys.h"
 #include "tools/mesh/remote.h"
@@ -41,6 +42,8 @@
 struct mesh_db {
 	json_object *jcfg;
 	char *cfg_fname;
+	struct json_journal *journal;
+	bool compact_pending;
 	uint8_t token[8];
 };
 
@@ -133,27 +136,80 @@ static bool save_config(void)
 	l_free(fname_tmp);
 	l_free(fname_bak);
 
+	/* The snapshot now holds everything the journal recorded */
+	if (result && !json_journal_reset(cfg->journal))
+		l_warn("Failed to reset journal for %s", fname_cfg);
+
 	return result;
 }
 
+static void compact_config(void *user_data)
+{
+	if (!cfg)
+		return;
+
+	cfg->compact_pending = false;
+	save_config();
+}
+
+/*
+ * Append a single change to the journal instead of rewriting the whole
+ * database: either a top level member (idx < 0) or one entry of a top level
+ * array. The database is rewritten in the background once the journal
+ * grows past the snapshot size, or right away if appending fails.
+ */
+static bool save_record(const char *key, int idx, bool del)
+{
+	bool result;
+
+	set_timestamp(cfg->jcfg);
+
+	if (!json_journal_set_member(cfg->journal, cfg->jcfg, "timestamp"))
+		return save_config();
+
+	if (idx < 0)
+		result = json_journal_set_member(cfg->journal, cfg->jcfg, key);
+	else if (del)
+		result = json_journal_del_entry(cfg->journal, key, idx);
+	else
+		result = json_journal_set_entry(cfg->journal, cfg->jcfg, key,
+									idx);
+
+	if (!result)
+		return save_config();
+
+	if (json_journal_need_compact(cfg->journal) && !cfg->compact_pending) {
+		cfg->compact_pending = true;
+		l_idle_oneshot(compact_config, NULL, NULL);
+	}
+
+	return true;
+}
+
+static bool save_member(const char *key)
+{
+	return save_record(key, -1, false);
+}
+
 static void release_config(void)
 {
+	json_journal_close(cfg->journal);
 	l_free(cfg->cfg_fname);
 	json_object_put(cfg->jcfg);
 	l_free(cfg);
 	cfg = NULL;
 }
 
-static json_object *get_node_by_unicast(json_object *jcfg, uint16_t unicast)
+static int get_node_idx(json_object *jcfg, uint16_t unicast)
 {
 	json_object *jarray;
 	int i, sz;
 
 	if (!json_object_object_get_ex(jcfg, "nodes", &jarray))
-		return NULL;
+		return -1;
 
 	if (!jarray || json_object_get_type(jarray) != json_type_array)
-		return NULL;
+		return -1;
 
 	sz = json_object_array_length(jarray);
 
@@ -165,17 +221,42 @@ static json_object *get_node_by_unicast(json_object *jcfg, uint16_t unicast)
 		jentry = json_object_array_get_idx(jarray, i);
 		if (!json_object_object_get_ex(jentry, "unicastAddress",
 								&jval))
-			return NULL;
+			return -1;
 
 		str = json_object_get_string(jval);
 		if (sscanf(str, "%04hx", &addr) != 1)
 			continue;
 
 		if (addr == unicast)
-			return jentry;
+			return i;
 	}
 
-	return NULL;
+	return -1;
+}
+
+static json_object *get_node_by_unicast(json_object *jcfg, uint16_t unicast)
+{
+	json_object *jarray;
+	int idx;
+
+	idx = get_node_idx(jcfg, unicast);
+	if (idx < 0)
+		return NULL;
+
+	json_object_object_get_ex(jcfg, "nodes", &jarray);
+
+	return json_object_array_get_idx(jarray, idx);
+}
+
+static bool save_node(uint16_t unicast)
+{
+	int idx;
+
+	idx = get_node_idx(cfg->jcfg, unicast);
+	if (idx < 0)
+		return false;
+
+	return save_record("nodes", idx, false);
 }
 
 static bool get_int(json_object *jobj, const char *keyword, int *value)
@@ -650,7 +731,7 @@ static bool add_node_key(json_object *jobj, const char *desc, uint16_t idx)
 
 	json_object_array_add(jarray, jkey);
 
-	return save_config();
+	return true;
 
 fail:
 	json_object_put(jkey);
@@ -671,7 +752,7 @@ bool mesh_db_node_set_ttl(uint16_t unicast, uint8_t ttl)
 	if (!write_int(jnode, "defaultTTL", ttl))
 		return false;
 
-	return save_config();
+	return save_node(unicast);
 }
 
 static bool add_transmit_info(json_object *jobj, int cnt, int interval,
@@ -711,7 +792,7 @@ bool mesh_db_node_set_net_transmit(uint16_t unicast, uint8_t cnt,
 	if (!add_transmit_info(jnode, cnt, interval, "networkTransmit"))
 		return false;
 
-	return save_config();
+	return save_node(unicast);
 }
 
 static bool set_feature(json_object *jnode, const char *desc, uint8_t feature)
@@ -730,7 +811,7 @@ static bool set_feature(json_object *jnode, const char *desc, uint8_t feature)
 	if (!write_int(jobj, desc, feature))
 		return false;
 
-	return save_config();
+	return true;
 }
 
 bool mesh_db_node_set_relay(uint16_t unicast, uint8_t relay, uint8_t cnt,
@@ -749,7 +830,10 @@ bool mesh_db_node_set_relay(uint16_t unicast, uint8_t relay, uint8_t cnt,
 		!add_transmit_info(jnode, cnt, interval, "relayRetransmit"))
 		return false;
 
-	return set_feature(jnode, "relay", relay);
+	if (!set_feature(jnode, "relay", relay))
+		return false;
+
+	return save_node(unicast);
 }
 
 bool mesh_db_node_set_proxy(uint16_t unicast, uint8_t proxy)
@@ -763,7 +847,10 @@ bool mesh_db_node_set_proxy(uint16_t unicast, uint8_t proxy)
 	if (!jnode)
 		return false;
 
-	return set_feature(jnode, "proxy", proxy);
+	if (!set_feature(jnode, "proxy", proxy))
+		return false;
+
+	return save_node(unicast);
 }
 
 bool mesh_db_node_set_friend(uint16_t unicast, uint8_t friend)
@@ -777,7 +864,10 @@ bool mesh_db_node_set_friend(uint16_t unicast, uint8_t friend)
 	if (!jnode)
 		return false;
 
-	return set_feature(jnode, "friend", friend);
+	if (!set_feature(jnode, "friend", friend))
+		return false;
+
+	return save_node(unicast);
 }
 
 bool mesh_db_node_set_beacon(uint16_t unicast, bool enabled)
@@ -794,7 +884,7 @@ bool mesh_db_node_set_beacon(uint16_t unicast, bool enabled)
 	if (!write_bool(jnode, "secureNetworkBeacon", enabled))
 		return false;
 
-	return save_config();
+	return save_node(unicast);
 }
 
 static json_object *get_element(uint16_t unicast, uint16_t ele_addr)
@@ -928,7 +1018,7 @@ static bool update_model_int_array(uint16_t unicast, uint16_t ele_addr,
 
 	json_object_array_add(jarray, jvalue);
 
-	return save_config();
+	return save_node(unicast);
 }
 
 bool mesh_db_node_model_bind(uint16_t unicast, uint16_t ele_addr, bool vendor,
@@ -1012,7 +1102,7 @@ static bool update_model_string_array(uint16_t unicast, uint16_t ele_addr,
 	if (!add_array_string(jarray, str))
 		return false;
 
-	return save_config();
+	return save_node(unicast);
 }
 
 bool mesh_db_node_model_add_sub(uint16_t unicast, uint16_t ele, bool vendor,
@@ -1092,7 +1182,7 @@ bool mesh_db_node_model_del_sub_all(uint16_t unicast, uint16_t ele, bool vendor,
 	if (!delete_subs(unicast, ele, vendor, mod_id))
 		return false;
 
-	return save_config();
+	return save_node(unicast);
 }
 
 static bool sub_overwrite(uint16_t unicast, uint16_t ele, bool vendor,
@@ -1110,7 +1200,7 @@ static bool sub_overwrite(uint16_t unicast, uint16_t ele, bool vendor,
 
 	json_object_array_add(jarray, jstring);
 
-	return save_config();
+	return save_node(unicast);
 }
 
 bool mesh_db_node_model_overwrt_sub(uint16_t unicast, uint16_t ele, bool vendor,
@@ -1187,7 +1277,7 @@ bool mesh_db_node_model_set_pub(uint16_t unicast, uint16_t ele_addr,
 	json_object_object_del(jmod, "publish");
 	json_object_object_add(jmod, "publish", jpub);
 
-	return save_config();
+	return save_node(unicast);
 
 fail:
 	if (jobj)
@@ -1252,7 +1342,7 @@ bool mesh_db_node_set_hb_pub(uint16_t unicast, uint16_t dst, uint16_t net_idx,
 	json_object_object_del(jnode, "heartbeatPub");
 	json_object_object_add(jnode, "heartbeatPub", jpub);
 
-	return save_config();
+	return save_node(unicast);
 
 fail:
 	if (jarray)
@@ -1284,7 +1374,7 @@ bool mesh_db_node_set_hb_sub(uint16_t unicast, uint16_t src, uint16_t dst)
 	json_object_object_del(jnode, "heartbeatSub");
 	json_object_object_add(jnode, "heartbeatSub", jsub);
 
-	return save_config();
+	return save_node(unicast);
 
 fail:
 	json_object_put(jsub);
@@ -1321,7 +1411,7 @@ static bool delete_key(json_object *jobj, const char *desc, uint16_t idx)
 
 	jarray_key_del(jarray, idx);
 
-	return save_config();
+	return true;
 }
 
 bool mesh_db_node_add_net_key(uint16_t unicast, uint16_t idx)
@@ -1335,7 +1425,10 @@ bool mesh_db_node_add_net_key(uint16_t unicast, uint16_t idx)
 	if (!jnode)
 		return false;
 
-	return add_node_key(jnode, "netKeys", idx);
+	if (!add_node_key(jnode, "netKeys", idx))
+		return false;
+
+	return save_node(unicast);
 }
 
 bool mesh_db_node_del_net_key(uint16_t unicast, uint16_t net_idx)
@@ -1349,7 +1442,10 @@ bool mesh_db_node_del_net_key(uint16_t unicast, uint16_t net_idx)
 	if (!jnode)
 		return false;
 
-	return delete_key(jnode, "netKeys", net_idx);
+	if (!delete_key(jnode, "netKeys", net_idx))
+		return false;
+
+	return save_node(unicast);
 }
 
 static bool key_update(uint16_t unicast, int16_t idx, bool updated,
@@ -1380,7 +1476,7 @@ static bool key_update(uint16_t unicast, int16_t idx, bool updated,
 			continue;
 
 		if ((val == idx) && write_bool(jentry, "updated", updated))
-			return save_config();
+			return save_node(unicast);
 	}
 
 	return false;
@@ -1402,7 +1498,10 @@ bool mesh_db_node_add_app_key(uint16_t unicast, uint16_t idx)
 	if (!jnode)
 		return false;
 
-	return add_node_key(jnode, "appKeys", idx);
+	if (!add_node_key(jnode, "appKeys", idx))
+		return false;
+
+	return save_node(unicast);
 }
 
 bool mesh_db_node_del_app_key(uint16_t unicast, uint16_t idx)
@@ -1416,7 +1515,10 @@ bool mesh_db_node_del_app_key(uint16_t unicast, uint16_t idx)
 	if (!jnode)
 		return false;
 
-	return delete_key(jnode, "appKeys", idx);
+	if (!delete_key(jnode, "appKeys", idx))
+		return false;
+
+	return save_node(unicast);
 }
 
 bool mesh_db_node_update_app_key(uint16_t unicast, uint16_t idx, bool updated)
@@ -1514,7 +1616,7 @@ bool mesh_db_add_net_key(uint16_t net_idx)
 
 	json_object_array_add(jarray, jkey);
 
-	return save_config();
+	return save_member("netKeys");
 
 fail:
 	json_object_put(jkey);
@@ -1526,7 +1628,10 @@ bool mesh_db_del_net_key(uint16_t net_idx)
 	if (!cfg || !cfg->jcfg)
 		return false;
 
-	return delete_key(cfg->jcfg, "netKeys", net_idx);
+	if (!delete_key(cfg->jcfg, "netKeys", net_idx))
+		return false;
+
+	return save_member("netKeys");
 }
 
 bool mesh_db_set_net_key_phase(uint16_t net_idx, uint8_t phase)
@@ -1550,7 +1655,7 @@ bool mesh_db_set_net_key_phase(uint16_t net_idx, uint8_t phase)
 
 	json_object_object_add(jkey, "phase", jval);
 
-	return save_config();
+	return save_member("netKeys");
 }
 
 bool mesh_db_add_app_key(uint16_t net_idx, uint16_t app_idx)
@@ -1561,7 +1666,7 @@ bool mesh_db_add_app_key(uint16_t net_idx, uint16_t app_idx)
 	if (!add_app_key(cfg->jcfg, net_idx, app_idx))
 		return false;
 
-	return save_config();
+	return save_member("appKeys");
 }
 
 bool mesh_db_del_app_key(uint16_t app_idx)
@@ -1569,7 +1674,10 @@ bool mesh_db_del_app_key(uint16_t app_idx)
 	if (!cfg || !cfg->jcfg)
 		return false;
 
-	return delete_key(cfg->jcfg, "appKeys", app_idx);
+	if (!delete_key(cfg->jcfg, "appKeys", app_idx))
+		return false;
+
+	return save_member("appKeys");
 }
 
 bool mesh_db_add_group(struct mesh_group *grp)
@@ -1605,7 +1713,7 @@ bool mesh_db_add_group(struct mesh_group *grp)
 
 	json_object_array_add(jgroups, jgroup);
 
-	return save_config();
+	return save_member("groups");
 
 fail:
 	json_object_put(jgroup);
@@ -1764,7 +1872,7 @@ bool mesh_db_add_node(uint8_t uuid[16], uint8_t num_els, uint16_t unicast,
 
 	json_object_array_add(jnodes, jnode);
 
-	return save_config();
+	return save_node(unicast);
 
 fail:
 	json_object_put(jnode);
@@ -1807,7 +1915,7 @@ bool mesh_db_del_node(uint16_t unicast)
 
 	json_object_array_del_idx(jarray, i, 1);
 
-	return save_config();
+	return save_record("nodes", i, true);
 }
 
 static json_object *init_model(uint16_t mod_id)
@@ -1979,7 +2087,7 @@ bool mesh_db_node_set_composition(uint16_t unicast, uint8_t *data, uint16_t len)
 	if (!load_composition(jnode, unicast))
 		goto fail;
 
-	return save_config();
+	return save_node(unicast);
 
 fail:
 	/* Reset elements array */
@@ -2115,7 +2223,7 @@ bool mesh_db_add_provisioner(const char *name, uint8_t uuid[16],
 
 	json_object_array_add(jprovs, jprov);
 
-	return save_config();
+	return save_member("provisioners");
 
 fail:
 	json_object_put(jprov);
@@ -2142,7 +2250,7 @@ bool mesh_db_set_iv_index(uint32_t ivi)
 
 	write_int(cfg->jcfg, "ivIndex", ivi);
 
-	return save_config();
+	return save_member("ivIndex");
 }
 
 static int get_rejected_by_iv_index(json_object *jarray, uint32_t iv_index)
@@ -2252,7 +2360,7 @@ bool mesh_db_add_rejected_addr(uint16_t unicast, uint32_t iv_index)
 	if (idx < 0)
 		json_object_array_add(jarray, jobj);
 
-	return save_config();
+	return save_member("networkExclusions");
 
 fail:
 	json_object_put(jobj);
@@ -2277,7 +2385,7 @@ bool mesh_db_clear_rejected(uint32_t iv_index)
 
 	json_object_array_del_idx(jarray, idx, 1);
 
-	return save_config();
+	return save_member("networkExclusions");
 }
 
 bool mesh_db_create(const char *fname, const uint8_t token[8],
@@ -2300,6 +2408,7 @@ bool mesh_db_create(const char *fname, const uint8_t token[8],
 	cfg = l_new(struct mesh_db, 1);
 	cfg->jcfg = jcfg;
 	cfg->cfg_fname = l_strdup(fname);
+	cfg->journal = json_journal_open(fname, NULL);
 	memcpy(cfg->token, token, 8);
 
 	if (!add_u8_8(jcfg, "token", token))
@@ -2401,6 +2510,9 @@ bool mesh_db_load(const char *fname)
 	cfg->jcfg = jcfg;
 	cfg->cfg_fname = l_strdup(fname);
 
+	/* Bring the snapshot up to date before loading from it */
+	cfg->journal = json_journal_open(fname, jcfg);
+
 	if (!get_token(jcfg, cfg->token)) {
 		l_error("Configuration file missing token");
 		goto fail;
@@ -221,6 +221,9 @@ static void read_info_callback(uint8_t status, uint16_t length,
 	bthost_notify_ready(bthost, tester_pre_setup_complete);
 }
 
+/* Spare controllers registered ahead of the test cases needing them */
+static struct hciemu_pool *pool;
+
 static void index_added_callback(uint16_t index, uint16_t length,
 					const void *param, void *user_data)
 {
@@ -229,6 +232,9 @@ static void index_added_callback(uint16_t index, uint16_t length,
 	tester_print("Index Added callback");
 	tester_print("  Index: 0x%04x", index);
 
+	if (!hciemu_owns_index(data->hciemu, index))
+		return;
+
 	data->mgmt_index = index;
 
 	mgmt_send(data->mgmt, MGMT_OP_READ_INFO, data->mgmt_index, 0, NULL,
@@ -376,10 +382,16 @@ static void read_index_list_callback(uint8_t status, uint16_t length,
 	mgmt_register(data->mgmt, MGMT_EV_INDEX_REMOVED, MGMT_INDEX_NONE,
 					index_removed_callback, NULL, NULL);
 
-	data->hciemu = hciemu_new(data->hciemu_type);
+	/* LE states are read by the kernel while it sets up the controller */
+	if (test && test->setup_le_states)
+		data->hciemu = hciemu_new(data->hciemu_type);
+	else
+		data->hciemu = hciemu_pool_get(pool, data->hciemu_type);
+
 	if (!data->hciemu) {
 		tester_warn("Failed to setup HCI emulation");
 		test_pre_setup_failed();
+		return;
 	}
 
 	if (tester_use_debug())
@@ -387,6 +399,11 @@ static void read_index_list_callback(uint8_t status, uint16_t length,
 
 	if (test && test->setup_le_states)
 		hciemu_set_central_le_states(data->hciemu, test->le_states);
+
+	/* A pre-warmed controller has already been announced */
+	if (hciemu_index_listed(data->hciemu, param, length))
+		index_added_callback(hciemu_get_index(data->hciemu), 0, NULL,
+									NULL);
 }
 
 static void test_pre_setup(const void *test_data)
@@ -12363,8 +12380,12 @@ static void test_suspend_resume_success_10(const void *test_data)
 
 int main(int argc, char *argv[])
 {
+	int ret;
+
 	tester_init(&argc, &argv);
 
+	pool = hciemu_pool_new(2);
+
 	test_bredrle("Controller setup",
 				NULL, NULL, controller_setup);
 	test_bredr("Controller setup (BR/EDR-only)",
@@ -14494,5 +14515,10 @@ int main(int argc, char *argv[])
 				setup_ll_privacy_add_device,
 				test_command_generic);
 
-	return tester_run();
+	ret = tester_run();
+
+	hciemu_pool_print_stats(pool, print_debug, "");
+	hciemu_pool_free(pool);
+
+	return ret;
 }
@@ -15,6 +15,7 @@
 
 #define _GNU_SOURCE
 #include <stdio.h>
+#include <stdbool.h>
 #include <errno.h>
 #include <ctype.h>
 #include <fcntl.h>
@@ -37,6 +38,8 @@
 
 #include "src/shared/util.h"
 
+#include "bench.h"
+
 #ifndef SIOCGSTAMP_OLD
 #define SIOCGSTAMP_OLD SIOCGSTAMP
 #endif
@@ -52,6 +55,8 @@ enum {
 	CRECV,
 	LSEND,
 	AUTO,
+	BENCH,
+	LBENCH,
 };
 
 static unsigned char *buf;
@@ -86,6 +91,8 @@ static int timestamp = 0;
 static int defer_setup = 0;
 static int priority = -1;
 
+static struct bench_config bench;
+
 static float tv2fl(struct timeval tv)
 {
 	return (float)tv.tv_sec + (float)(tv.tv_usec/1000000.0);
@@ -647,6 +654,34 @@ static void automated_send_recv()
 	}
 }
 
+static void bench_mode(int sk)
+{
+	bench_server(sk, "rctest", &bench);
+}
+
+static void bench_connect_mode(const char *svr)
+{
+	unsigned int i, num = bench.num_sizes ? bench.num_sizes : 1;
+
+	for (i = 0; i < num; i++) {
+		unsigned int size = data_size;
+		int sk;
+
+		/* RFCOMM is a stream, only the write size can be swept */
+		if (bench.num_sizes)
+			size = bench.sizes[i];
+
+		sk = do_connect(svr);
+		if (sk < 0)
+			exit(1);
+
+		if (bench_client(sk, "rctest", size, &bench) < 0)
+			exit(1);
+
+		close(sk);
+	}
+}
+
 static void sig_child_exit(int code)
 {
 	if (save_fd >= 0)
@@ -670,7 +705,9 @@ static void usage(void)
 		"\t-n connect and be silent\n"
 		"\t-c connect, disconnect, connect, ...\n"
 		"\t-m multiple connects\n"
-		"\t-a automated test (receive hcix as parameter)\n");
+		"\t-a automated test (receive hcix as parameter)\n"
+		"\t-l listen and serve benchmarks\n"
+		"\t-k connect and run benchmark\n");
 
 	printf("Options:\n"
 		"\t[-b bytes] [-i device] [-P channel] [-U uuid]\n"
@@ -687,8 +724,15 @@ static void usage(void)
 		"\t[-S] secure connection\n"
 		"\t[-M] become central\n"
 		"\t[-T] enable timestamps\n");
+
+	bench_usage("write size");
 }
 
+static struct option main_options[] = {
+	BENCH_LONG_OPTIONS,
+	{ 0, 0, 0, 0 }
+};
+
 int main(int argc, char *argv[])
 {
 	struct sigaction sa;
@@ -697,8 +741,9 @@ int main(int argc, char *argv[])
 	bacpy(&bdaddr, BDADDR_ANY);
 	bacpy(&auto_bdaddr, BDADDR_ANY);
 
-	while ((opt = getopt(argc, argv,
-			"rdscuwmna:b:i:P:U:B:O:N:MAESL:W:C:D:Y:T")) != EOF) {
+	while ((opt = getopt_long(argc, argv,
+			"rdscuwmnkla:b:i:P:U:B:O:N:MAESL:W:C:D:Y:T",
+			main_options, NULL)) != EOF) {
 		switch (opt) {
 		case 'r':
 			mode = RECV;
@@ -737,6 +782,15 @@ int main(int argc, char *argv[])
 			need_addr = 1;
 			break;
 
+		case 'k':
+			mode = BENCH;
+			need_addr = 1;
+			break;
+
+		case 'l':
+			mode = LBENCH;
+			break;
+
 		case 'a':
 			mode = AUTO;
 
@@ -823,6 +877,9 @@ int main(int argc, char *argv[])
 			break;
 
 		default:
+			if (bench_parse_opt(&bench, opt, optarg))
+				break;
+
 			usage();
 			exit(1);
 		}
@@ -893,6 +950,14 @@ int main(int argc, char *argv[])
 		case AUTO:
 			automated_send_recv();
 			break;
+
+		case BENCH:
+			bench_connect_mode(argv[optind]);
+			break;
+
+		case LBENCH:
+			do_listen(bench_mode);
+			break;
 	}
 
 	syslog(LOG_INFO, "Exit");
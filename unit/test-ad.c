@@ -0,0 +1,246 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include <glib.h>
+
+#include "src/shared/ad.h"
+#include "src/shared/queue.h"
+#include "src/shared/tester.h"
+#include "src/shared/util.h"
+
+static const uint8_t macbookair_data[] = {
+		0x17, 0x09, 0x4d, 0x61, 0x72, 0x63, 0x65, 0x6c,
+		0xe2, 0x80, 0x99, 0x73, 0x20, 0x4d, 0x61, 0x63,
+		0x42, 0x6f, 0x6f, 0x6b, 0x20, 0x41, 0x69, 0x72,
+		0x11, 0x03, 0x12, 0x11, 0x0c, 0x11, 0x0a, 0x11,
+		0x1f, 0x11, 0x01, 0x11, 0x00, 0x10, 0x0a, 0x11,
+		0x17, 0x11, 0x11, 0xff, 0x4c, 0x00, 0x01, 0x4d,
+		0x61, 0x63, 0x42, 0x6f, 0x6f, 0x6b, 0x41, 0x69,
+		0x72, 0x33, 0x2c, 0x31,
+};
+
+struct matcher_test {
+	uint8_t type;
+	uint8_t offset;
+	uint8_t len;
+	uint8_t data[4];
+	int monitor;
+};
+
+static const struct matcher_test matcher_patterns[] = {
+	/* Manufacturer data of Apple */
+	{ 0xff, 0, 2, { 0x4c, 0x00 }, 0 },
+	{ 0x09, 0, 4, { 'M', 'a', 'r', 'c' }, 1 },
+	{ 0xff, 0, 1, { 0x4c }, 1 },
+	{ 0xff, 2, 1, { 0x02 }, 2 },
+	/* Second UUID in the 16-bit UUID list */
+	{ 0x03, 2, 2, { 0x0c, 0x11 }, 3 },
+	{ 0x09, 20, 4, { 'A', 'i', 'r', '!' }, 4 },
+};
+
+static void matcher_count(void *match_data, void *user_data)
+{
+	int *matches = user_data;
+
+	matches[PTR_TO_INT(match_data)]++;
+}
+
+static void test_matcher(const void *data)
+{
+	struct bt_ad_matcher *matcher;
+	struct queue *patterns[5];
+	int matches[5] = { 0 };
+	size_t i;
+
+	matcher = bt_ad_matcher_new();
+
+	for (i = 0; i < 5; i++)
+		patterns[i] = queue_new();
+
+	for (i = 0; i < G_N_ELEMENTS(matcher_patterns); i++) {
+		const struct matcher_test *t = &matcher_patterns[i];
+
+		queue_push_tail(patterns[t->monitor],
+				bt_ad_pattern_new(t->type, t->offset, t->len,
+								t->data));
+	}
+
+	for (i = 0; i < 5; i++)
+		g_assert(bt_ad_matcher_add(matcher, patterns[i],
+							INT_TO_PTR(i)));
+
+	bt_ad_matcher_match(matcher, sizeof(macbookair_data),
+				macbookair_data, matcher_count, matches);
+
+	g_assert_cmpint(matches[0], ==, 1);
+	g_assert_cmpint(matches[1], ==, 1);
+	g_assert_cmpint(matches[2], ==, 0);
+	g_assert_cmpint(matches[3], ==, 1);
+	g_assert_cmpint(matches[4], ==, 0);
+
+	/* Every match reports each monitor again */
+	bt_ad_matcher_match(matcher, sizeof(macbookair_data),
+				macbookair_data, matcher_count, matches);
+
+	g_assert_cmpint(matches[0], ==, 2);
+	g_assert_cmpint(matches[1], ==, 2);
+
+	for (i = 0; i < 5; i++)
+		queue_destroy(patterns[i], free);
+
+	bt_ad_matcher_free(matcher);
+
+	tester_test_passed();
+}
+
+#define MATCHER_MONITORS 100
+#define MATCHER_COUNT 10000
+
+static const uint8_t matcher_adv[] = {
+	0x02, 0x01, 0x06,
+	0x07, 0xff, 0x32, 0x01, 0xbe, 0xac, 0x00, 0x01,
+	0x05, 0x16, 0x32, 0x18, 0x55, 0x66,
+	0x05, 0x09, 'T', 'e', 's', 't',
+};
+
+static struct bt_ad_matcher *matcher_many_new(struct queue **patterns)
+{
+	struct bt_ad_matcher *matcher;
+	int i;
+
+	matcher = bt_ad_matcher_new();
+
+	/* Each monitor watches a company and a 16-bit service UUID */
+	for (i = 0; i < MATCHER_MONITORS; i++) {
+		uint8_t msd[4] = { 0x00, 0x01, 0xbe, 0xac };
+		uint8_t sd[2] = { 0x00, 0x18 };
+
+		put_le16(0x0100 + i, msd);
+		put_le16(0x1800 + i, sd);
+
+		patterns[i] = queue_new();
+		queue_push_tail(patterns[i], bt_ad_pattern_new(0xff, 0,
+							sizeof(msd), msd));
+		queue_push_tail(patterns[i], bt_ad_pattern_new(0x16, 0,
+							sizeof(sd), sd));
+
+		g_assert(bt_ad_matcher_add(matcher, patterns[i],
+							INT_TO_PTR(i)));
+	}
+
+	return matcher;
+}
+
+static void test_matcher_many(const void *data)
+{
+	struct bt_ad_matcher *matcher;
+	struct queue *patterns[MATCHER_MONITORS];
+	struct bt_ad *ad;
+	int matches[MATCHER_MONITORS] = { 0 };
+	int i;
+
+	matcher = matcher_many_new(patterns);
+
+	bt_ad_matcher_match(matcher, sizeof(matcher_adv), matcher_adv,
+						matcher_count, matches);
+
+	/* The compiled matcher agrees with matching each monitor in turn */
+	ad = bt_ad_new_with_data(sizeof(matcher_adv), matcher_adv);
+	g_assert(ad);
+
+	for (i = 0; i < MATCHER_MONITORS; i++) {
+		bool match = bt_ad_pattern_match(ad, patterns[i]);
+
+		g_assert_cmpint(matches[i], ==, match);
+		queue_destroy(patterns[i], free);
+	}
+
+	bt_ad_unref(ad);
+
+	/* Company 0x0132 and service 0x1832 are both monitor 50 */
+	g_assert_cmpint(matches[50], ==, 1);
+
+	bt_ad_matcher_free(matcher);
+
+	tester_test_passed();
+}
+
+static void test_matcher_benchmark(const void *data)
+{
+	struct bt_ad_matcher *matcher;
+	struct queue *patterns[MATCHER_MONITORS];
+	struct bt_ad *ad;
+	gint64 start, elapsed;
+	int matches[MATCHER_MONITORS] = { 0 };
+	int linear = 0, compiled = 0;
+	int i, j;
+
+	matcher = matcher_many_new(patterns);
+
+	start = g_get_monotonic_time();
+
+	for (i = 0; i < MATCHER_COUNT; i++) {
+		ad = bt_ad_new_with_data(sizeof(matcher_adv), matcher_adv);
+
+		for (j = 0; j < MATCHER_MONITORS; j++) {
+			if (bt_ad_pattern_match(ad, patterns[j]))
+				linear++;
+		}
+
+		bt_ad_unref(ad);
+	}
+
+	elapsed = g_get_monotonic_time() - start;
+	tester_print("bt_ad_pattern_match: %" G_GINT64_FORMAT " reports/sec",
+				(gint64) MATCHER_COUNT * G_USEC_PER_SEC /
+								MAX(elapsed, 1));
+
+	start = g_get_monotonic_time();
+
+	for (i = 0; i < MATCHER_COUNT; i++)
+		bt_ad_matcher_match(matcher, sizeof(matcher_adv), matcher_adv,
+						matcher_count, matches);
+
+	elapsed = g_get_monotonic_time() - start;
+	tester_print("bt_ad_matcher_match: %" G_GINT64_FORMAT " reports/sec",
+				(gint64) MATCHER_COUNT * G_USEC_PER_SEC /
+								MAX(elapsed, 1));
+
+	for (i = 0; i < MATCHER_MONITORS; i++) {
+		compiled += matches[i];
+		queue_destroy(patterns[i], free);
+	}
+
+	g_assert_cmpint(matches[50], ==, MATCHER_COUNT);
+	g_assert_cmpint(compiled, ==, linear);
+
+	bt_ad_matcher_free(matcher);
+
+	tester_test_passed();
+}
+
+int main(int argc, char *argv[])
+{
+	tester_init(&argc, &argv);
+
+	tester_add("/ad/matcher", NULL, NULL, test_matcher, NULL);
+	tester_add("/ad/matcher/many", NULL, NULL, test_matcher_many, NULL);
+
+	if (tester_use_perf())
+		tester_add("/ad/matcher/benchmark", NULL, NULL,
+						test_matcher_benchmark, NULL);
+
+	return tester_run();
+}
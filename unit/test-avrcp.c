@@ -30,6 +30,7 @@
 
 #include "android/avctp.h"
 #include "android/avrcp-lib.h"
+#include "profiles/audio/item-cache.h"
 
 struct test_pdu {
 	bool valid;
@@ -986,6 +987,127 @@ static void test_client(gconstpointer data)
 		avrcp_send_passthrough(context->session, 0, AVC_FAST_FORWARD);
 }
 
+#define CACHE_PAGE_SIZE		64
+#define CACHE_MAX_PAGES		32
+#define LIBRARY_SIZE		50000
+
+struct cache_refs {
+	unsigned int taken;
+	unsigned int dropped;
+};
+
+static void cache_ref(void *item, void *user_data)
+{
+	struct cache_refs *refs = user_data;
+
+	refs->taken++;
+}
+
+static void cache_unref(void *item, void *user_data)
+{
+	struct cache_refs *refs = user_data;
+
+	refs->dropped++;
+}
+
+static void cache_fill(struct item_cache *cache, uint32_t *library,
+				uint32_t start, uint32_t end,
+				unsigned int *stored)
+{
+	uint32_t i;
+
+	for (i = start; i <= end; i++) {
+		g_assert(item_cache_set(cache, i, &library[i]));
+		(*stored)++;
+	}
+}
+
+static void test_item_cache(gconstpointer data)
+{
+	struct item_cache *cache;
+	uint32_t *library;
+	struct cache_refs refs = { 0, 0 };
+	unsigned int stored = 0, hits = 0;
+	uint32_t start, end, i;
+	gint64 begin;
+
+	library = g_new(uint32_t, LIBRARY_SIZE);
+	for (i = 0; i < LIBRARY_SIZE; i++)
+		library[i] = i;
+
+	cache = item_cache_new(CACHE_PAGE_SIZE, CACHE_MAX_PAGES,
+					cache_ref, cache_unref, &refs);
+	g_assert(cache);
+
+	begin = g_get_monotonic_time();
+
+	/* Scroll through the library one page at a time with prefetch */
+	for (start = 0; start < LIBRARY_SIZE; start += CACHE_PAGE_SIZE) {
+		uint32_t pf_start, pf_end;
+
+		end = MIN(start + CACHE_PAGE_SIZE - 1, LIBRARY_SIZE - 1);
+
+		if (item_cache_contains(cache, start, end))
+			hits++;
+		else
+			cache_fill(cache, library, start, end, &stored);
+
+		for (i = start; i <= end; i++)
+			g_assert(item_cache_get(cache, i) == &library[i]);
+
+		if (item_cache_next_page(cache, end, LIBRARY_SIZE, &pf_start,
+								&pf_end)) {
+			g_assert_cmpuint(pf_start, ==, end + 1);
+			cache_fill(cache, library, pf_start, pf_end, &stored);
+		}
+
+		g_assert_cmpuint(item_cache_get_num_pages(cache), <=,
+							CACHE_MAX_PAGES);
+	}
+
+	tester_debug("%u items scrolled in %" PRId64 " us, %u prefetch hits",
+			LIBRARY_SIZE, g_get_monotonic_time() - begin, hits);
+
+	/* Every page but the first was prefetched */
+	g_assert_cmpuint(hits, ==, LIBRARY_SIZE / CACHE_PAGE_SIZE);
+	g_assert_cmpuint(stored, ==, LIBRARY_SIZE);
+	g_assert_cmpuint(refs.taken, ==, stored);
+	g_assert_cmpuint(refs.dropped, ==,
+				LIBRARY_SIZE - (LIBRARY_SIZE % CACHE_PAGE_SIZE) -
+				(CACHE_MAX_PAGES - 1) * CACHE_PAGE_SIZE);
+
+	/* Nothing past the end of the library is prefetched */
+	g_assert(!item_cache_next_page(cache, LIBRARY_SIZE - 1, LIBRARY_SIZE,
+								&start, &end));
+
+	/* Early pages were evicted, jumping back refetches them */
+	g_assert(!item_cache_contains(cache, 0, CACHE_PAGE_SIZE - 1));
+	g_assert(!item_cache_get(cache, 0));
+	cache_fill(cache, library, 0, CACHE_PAGE_SIZE - 1, &stored);
+	g_assert(item_cache_contains(cache, 0, CACHE_PAGE_SIZE - 1));
+
+	/* The least recently used page goes first */
+	start = (LIBRARY_SIZE / CACHE_PAGE_SIZE - (CACHE_MAX_PAGES - 1)) *
+							CACHE_PAGE_SIZE;
+	g_assert(!item_cache_get(cache, start));
+	start += CACHE_PAGE_SIZE;
+	g_assert(item_cache_get(cache, start) == &library[start]);
+
+	/* Ranges larger than the cache can't be served from it */
+	g_assert(!item_cache_contains(cache, 0,
+				CACHE_MAX_PAGES * CACHE_PAGE_SIZE));
+
+	item_cache_flush(cache);
+	g_assert_cmpuint(item_cache_get_num_pages(cache), ==, 0);
+	g_assert_cmpuint(refs.taken, ==, stored);
+	g_assert_cmpuint(refs.dropped, ==, refs.taken);
+
+	item_cache_free(cache);
+	g_free(library);
+
+	tester_test_passed();
+}
+
 int main(int argc, char *argv[])
 {
 	tester_init(&argc, &argv);
@@ -2080,5 +2202,9 @@ int main(int argc, char *argv[])
 				0x00, 0x19, 0x58, AVRCP_ABORT_CONTINUING,
 				0x00, 0x00, 0x00));
 
+	/* Browsing item cache */
+	tester_add("/avrcp/item-cache/large-library", NULL, NULL,
+						test_item_cache, NULL);
+
 	return tester_run();
 }
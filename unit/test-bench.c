@@ -0,0 +1,210 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "tools/bench.c"
+
+#include <sys/wait.h>
+
+#include <glib.h>
+
+#include "src/shared/tester.h"
+
+static void test_hist_index(const void *data)
+{
+	uint64_t value;
+	unsigned int last = 0;
+	int bit;
+
+	/* Small values get a bucket each */
+	for (value = 0; value < HIST_SUB; value++) {
+		g_assert_cmpuint(hist_index(value), ==, value);
+		g_assert_cmpuint(hist_value(value), ==, value);
+	}
+
+	/* Every value lies within its bucket, buckets never go backwards */
+	for (bit = HIST_SUB_BITS; bit < 64; bit++) {
+		uint64_t base = 1ull << bit;
+		uint64_t values[] = { base, base + 1, base + base / 3,
+						base + base / 2, base * 2 - 1 };
+		unsigned int i;
+
+		for (i = 0; i < G_N_ELEMENTS(values); i++) {
+			unsigned int index = hist_index(values[i]);
+
+			g_assert_cmpuint(index, <, HIST_BUCKETS);
+			g_assert_cmpuint(index, >=, last);
+			g_assert_cmpuint(hist_value(index), <=, values[i]);
+
+			if (index + 1 < HIST_BUCKETS)
+				g_assert_cmpuint(values[i], <,
+						hist_value(index + 1));
+
+			last = index;
+		}
+	}
+
+	g_assert_cmpuint(hist_index(UINT64_MAX), ==, HIST_BUCKETS - 1);
+
+	tester_test_passed();
+}
+
+static void test_hist_percentile(const void *data)
+{
+	struct bench_hist hist;
+	uint64_t value, p50, p99;
+
+	memset(&hist, 0, sizeof(hist));
+
+	g_assert_cmpuint(hist_percentile(&hist, 500), ==, 0);
+
+	/* A single sample is every percentile */
+	hist_add(&hist, 1234);
+	g_assert_cmpuint(hist.min, ==, 1234);
+	g_assert_cmpuint(hist.max, ==, 1234);
+	g_assert_cmpuint(hist_percentile(&hist, 1), ==, 1234);
+	g_assert_cmpuint(hist_percentile(&hist, 999), ==, 1234);
+
+	/* Uniform samples land within the ~6% bucket resolution */
+	memset(&hist, 0, sizeof(hist));
+
+	for (value = 1; value <= 10000; value++)
+		hist_add(&hist, value);
+
+	g_assert_cmpuint(hist.count, ==, 10000);
+	g_assert_cmpuint(hist.sum / hist.count, ==, 5000);
+
+	p50 = hist_percentile(&hist, 500);
+	g_assert_cmpuint(p50, <=, 5000);
+	g_assert_cmpuint(p50, >=, 5000 - 5000 / HIST_SUB);
+
+	p99 = hist_percentile(&hist, 990);
+	g_assert_cmpuint(p99, <=, 9900);
+	g_assert_cmpuint(p99, >=, 9900 - 9900 / HIST_SUB);
+
+	g_assert_cmpuint(hist_percentile(&hist, 0), ==, hist.min);
+	g_assert_cmpuint(hist_percentile(&hist, 1000), <=, hist.max);
+	g_assert_cmpuint(p50, <=, p99);
+
+	/* One outlier only shows in the highest percentiles */
+	hist_add(&hist, 1000000);
+	g_assert_cmpuint(hist_percentile(&hist, 990), ==, p99);
+	g_assert_cmpuint(hist_percentile(&hist, 1000), >=,
+						1000000 - 1000000 / HIST_SUB);
+
+	tester_test_passed();
+}
+
+/*
+ * Run a benchmark end to end over a local socket pair, the listener
+ * side in a child process like the forked l2test and rctest servers.
+ */
+static void run_bench(int type, enum bench_test test, unsigned int size,
+							unsigned int batch)
+{
+	struct bench_config config;
+	int sv[2], status;
+	pid_t pid;
+
+	memset(&config, 0, sizeof(config));
+	config.test = test;
+	config.total = 256 * 1024;
+	config.batch = batch;
+
+	g_assert(!socketpair(AF_UNIX, type | SOCK_CLOEXEC, 0, sv));
+
+	pid = fork();
+	g_assert(pid >= 0);
+
+	if (!pid) {
+		close(sv[0]);
+		_exit(bench_server(sv[1], "test-bench", &config) < 0);
+	}
+
+	close(sv[1]);
+
+	g_assert_cmpint(bench_client(sv[0], "test-bench", size, &config),
+									==, 0);
+	close(sv[0]);
+
+	g_assert(waitpid(pid, &status, 0) == pid);
+	g_assert(WIFEXITED(status) && !WEXITSTATUS(status));
+}
+
+static void test_throughput(const void *data)
+{
+	run_bench(SOCK_SEQPACKET, BENCH_THROUGHPUT, 672, 1);
+
+	tester_test_passed();
+}
+
+static void test_throughput_batch(const void *data)
+{
+	run_bench(SOCK_SEQPACKET, BENCH_THROUGHPUT, 48, 16);
+
+	tester_test_passed();
+}
+
+static void test_rtt(const void *data)
+{
+	run_bench(SOCK_SEQPACKET, BENCH_RTT, 64, 1);
+
+	tester_test_passed();
+}
+
+static void test_rtt_stream(const void *data)
+{
+	run_bench(SOCK_STREAM, BENCH_RTT, 127, 1);
+
+	tester_test_passed();
+}
+
+static void test_invalid_header(const void *data)
+{
+	struct bench_config config;
+	uint8_t hdr[BENCH_HDR_SIZE];
+	int sv[2];
+
+	memset(&config, 0, sizeof(config));
+	memset(hdr, 0, sizeof(hdr));
+	put_le32(BENCH_MAGIC, hdr);
+	hdr[4] = BENCH_RTT + 1;
+	put_le32(64, hdr + 8);
+
+	g_assert(!socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv));
+	g_assert(send(sv[0], hdr, sizeof(hdr), 0) == sizeof(hdr));
+
+	g_assert_cmpint(bench_server(sv[1], "test-bench", &config), ==,
+								-EPROTO);
+
+	close(sv[0]);
+	close(sv[1]);
+
+	tester_test_passed();
+}
+
+int main(int argc, char *argv[])
+{
+	tester_init(&argc, &argv);
+
+	tester_add("/bench/hist/index", NULL, NULL, test_hist_index, NULL);
+	tester_add("/bench/hist/percentile", NULL, NULL,
+						test_hist_percentile, NULL);
+	tester_add("/bench/throughput", NULL, NULL, test_throughput, NULL);
+	tester_add("/bench/throughput/batch", NULL, NULL,
+						test_throughput_batch, NULL);
+	tester_add("/bench/rtt", NULL, NULL, test_rtt, NULL);
+	tester_add("/bench/rtt/stream", NULL, NULL, test_rtt_stream, NULL);
+	tester_add("/bench/invalid-header", NULL, NULL, test_invalid_header,
+									NULL);
+
+	return tester_run();
+}
@@ -261,6 +261,136 @@ static void test_invalid_pub(const void *data)
 	tester_test_passed();
 }
 
+/* Generator and group order, LSB first */
+static const uint8_t gen_point[64] = {
+	0x96, 0xc2, 0x98, 0xd8, 0x45, 0x39, 0xa1, 0xf4,
+	0xa0, 0x33, 0xeb, 0x2d, 0x81, 0x7d, 0x03, 0x77,
+	0xf2, 0x40, 0xa4, 0x63, 0xe5, 0xe6, 0xbc, 0xf8,
+	0x47, 0x42, 0x2c, 0xe1, 0xf2, 0xd1, 0x17, 0x6b,
+
+	0xf5, 0x51, 0xbf, 0x37, 0x68, 0x40, 0xb6, 0xcb,
+	0xce, 0x5e, 0x31, 0x6b, 0x57, 0x33, 0xce, 0x2b,
+	0x16, 0x9e, 0x0f, 0x7c, 0x4a, 0xeb, 0xe7, 0x8e,
+	0x9b, 0x7f, 0x1a, 0xfe, 0xe2, 0x42, 0xe3, 0x4f,
+};
+
+static const uint8_t order_minus_1[32] = {
+	0x50, 0x25, 0x63, 0xfc, 0xc2, 0xca, 0xb9, 0xf3,
+	0x84, 0x9e, 0x17, 0xa7, 0xad, 0xfa, 0xe6, 0xbc,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0x00, 0x00, 0x00, 0x00, 0xff, 0xff, 0xff, 0xff,
+};
+
+static int check_public_key(const uint8_t priv[32])
+{
+	uint8_t pub[64], dhkey[32];
+
+	if (!ecc_make_public_key(priv, pub))
+		return 1;
+
+	if (!ecc_valid_public_key(pub))
+		return 1;
+
+	/* Fixed-base comb against the variable-base ladder */
+	if (!ecdh_shared_secret(gen_point, priv, dhkey))
+		return 1;
+
+	if (memcmp(pub, dhkey, 32)) {
+		print_buf("Private key = ", (uint8_t *) priv, 32);
+		print_buf("Public key X = ", pub, 32);
+		print_buf("k * G X = ", dhkey, 32);
+		return 1;
+	}
+
+	return 0;
+}
+
+#define COMB_COUNT 200
+
+static void test_comb(const void *data)
+{
+	uint8_t priv[32], pub[64];
+	int fails = 0;
+	int i;
+
+	/* Single teeth set, sparse columns */
+	memset(priv, 0, sizeof(priv));
+	priv[0] = 0x02;
+	fails += check_public_key(priv);
+
+	memset(priv, 0, sizeof(priv));
+	priv[8] = 0x01;
+	fails += check_public_key(priv);
+
+	memset(priv, 0, sizeof(priv));
+	priv[0] = 0x03;
+	priv[8] = 0x03;
+	priv[16] = 0x03;
+	priv[24] = 0x03;
+	fails += check_public_key(priv);
+
+	memset(priv, 0xff, 24);
+	memset(priv + 24, 0, 8);
+	fails += check_public_key(priv);
+
+	/*
+	 * 1 * G and (n - 1) * G = -G, which the ladder can't compute as its
+	 * last step would add P and -P.
+	 */
+	memset(priv, 0, sizeof(priv));
+	priv[0] = 0x01;
+	g_assert(ecc_make_public_key(priv, pub));
+	g_assert(!memcmp(pub, gen_point, 64));
+
+	g_assert(ecc_make_public_key(order_minus_1, pub));
+	g_assert(!memcmp(pub, gen_point, 32));
+	g_assert(memcmp(pub + 32, gen_point + 32, 32));
+
+	for (i = 0; i < COMB_COUNT; i++) {
+		ecc_make_key(pub, priv);
+		fails += check_public_key(priv);
+	}
+
+	g_assert(fails == 0);
+
+	tester_test_passed();
+}
+
+#define BENCH_COUNT 200
+
+static void test_benchmark(const void *data)
+{
+	uint8_t public1[64], public2[64];
+	uint8_t private1[32], private2[32];
+	uint8_t shared[32];
+	gint64 start, elapsed;
+	int i;
+
+	g_assert(ecc_make_key(public1, private1));
+	g_assert(ecc_make_key(public2, private2));
+
+	/* Fixed private key so that only the comb is timed, not the RNG */
+	start = g_get_monotonic_time();
+
+	for (i = 0; i < BENCH_COUNT; i++)
+		g_assert(ecc_make_public_key(private1, public1));
+
+	elapsed = g_get_monotonic_time() - start;
+	tester_print("Key generation: %" G_GINT64_FORMAT " ops/sec",
+				BENCH_COUNT * G_USEC_PER_SEC / MAX(elapsed, 1));
+
+	start = g_get_monotonic_time();
+
+	for (i = 0; i < BENCH_COUNT; i++)
+		g_assert(ecdh_shared_secret(public2, private1, shared));
+
+	elapsed = g_get_monotonic_time() - start;
+	tester_print("Shared secret: %" G_GINT64_FORMAT " ops/sec",
+				BENCH_COUNT * G_USEC_PER_SEC / MAX(elapsed, 1));
+
+	tester_test_passed();
+}
+
 int main(int argc, char *argv[])
 {
 	tester_init(&argc, &argv);
@@ -273,5 +403,10 @@ int main(int argc, char *argv[])
 
 	tester_add("/ecdh/invalid", NULL, NULL, test_invalid_pub, NULL);
 
+	tester_add("/ecdh/comb", NULL, NULL, test_comb, NULL);
+
+	if (tester_use_perf())
+		tester_add("/ecdh/benchmark", NULL, NULL, test_benchmark, NULL);
+
 	return tester_run();
 }
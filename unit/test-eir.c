@@ -19,6 +19,7 @@
 #include "lib/bluetooth.h"
 #include "lib/hci.h"
 #include "lib/sdp.h"
+#include "lib/uuid.h"
 #include "src/shared/tester.h"
 #include "src/shared/util.h"
 #include "src/eir.h"
@@ -539,6 +540,72 @@ static void print_debug(const char *str, void *user_data)
 	tester_debug("%s%s", prefix, str);
 }
 
+/* The flat view has to decode exactly what eir_parse() does */
+static void check_view(const struct test_data *test, struct eir_data *eir)
+{
+	struct eir_view view;
+	struct eir_iter iter;
+	char name[HCI_MAX_NAME_LENGTH + 1];
+	char str[MAX_LEN_UUID_STR];
+	bt_uuid_t uuid;
+	uint16_t company;
+	const uint8_t *data;
+	uint8_t len;
+	GSList *list;
+
+	eir_view_parse(&view, test->eir_data, test->eir_size);
+
+	g_assert_cmpint(view.flags, ==, eir->flags);
+	g_assert(view.tx_power == eir->tx_power);
+	g_assert(view.has_msd == (eir->msd_list != NULL));
+	g_assert(view.has_sd == (eir->sd_list != NULL));
+
+	if (eir->name) {
+		g_assert(eir_view_get_name(&view, name, sizeof(name)));
+		g_assert_cmpstr(name, ==, eir->name);
+		g_assert(view.name_complete == eir->name_complete);
+	} else {
+		g_assert(!eir_view_get_name(&view, name, sizeof(name)));
+	}
+
+	eir_iter_init(&iter, &view);
+
+	for (list = eir->services; list; list = list->next) {
+		g_assert(eir_iter_next_uuid(&iter, &uuid));
+		bt_uuid_to_string(&uuid, str, sizeof(str));
+		g_assert_cmpstr(str, ==, list->data);
+	}
+
+	g_assert(!eir_iter_next_uuid(&iter, &uuid));
+
+	eir_iter_init(&iter, &view);
+
+	for (list = eir->msd_list; list; list = list->next) {
+		struct eir_msd *msd = list->data;
+
+		g_assert(eir_iter_next_msd(&iter, &company, &data, &len));
+		g_assert_cmpint(company, ==, msd->company);
+		g_assert_cmpint(len, ==, msd->data_len);
+		g_assert(!memcmp(data, msd->data, len));
+	}
+
+	g_assert(!eir_iter_next_msd(&iter, &company, &data, &len));
+
+	eir_iter_init(&iter, &view);
+
+	for (list = eir->sd_list; list; list = list->next) {
+		struct eir_sd *sd = list->data;
+
+		g_assert(eir_iter_next_sd(&iter, &uuid, &data, &len));
+		bt_uuid_to_string(&uuid, str, sizeof(str));
+		g_assert_cmpstr(str, ==, sd->uuid);
+		g_assert_cmpint(len, ==, sd->data_len);
+		g_assert(!memcmp(data, sd->data, len));
+	}
+
+	g_assert(!eir_iter_next_sd(&iter, &uuid, &data, &len));
+}
+
 static void test_parsing(gconstpointer data)
 {
 	const struct test_data *test = data;
@@ -599,6 +666,8 @@ static void test_parsing(gconstpointer data)
 							"Service Data:");
 	}
 
+	check_view(test, &eir);
+
 	eir_data_free(&eir);
 
 	tester_test_passed();
@@ -641,6 +710,58 @@ static const struct test_data uri_beacon_test = {
 	.uuid = uri_beacon_uuid,
 };
 
+#define BENCH_COUNT 100000
+
+static void test_benchmark(const void *data)
+{
+	const struct test_data *test = &macbookair_test;
+	struct eir_data eir;
+	struct eir_view view;
+	struct eir_iter iter;
+	char name[HCI_MAX_NAME_LENGTH + 1];
+	bt_uuid_t uuid;
+	uint16_t company;
+	const uint8_t *msd;
+	uint8_t len;
+	gint64 start, elapsed;
+	int i;
+
+	start = g_get_monotonic_time();
+
+	for (i = 0; i < BENCH_COUNT; i++) {
+		memset(&eir, 0, sizeof(eir));
+		eir_parse(&eir, test->eir_data, test->eir_size);
+		eir_data_free(&eir);
+	}
+
+	elapsed = g_get_monotonic_time() - start;
+	tester_print("eir_parse: %" G_GINT64_FORMAT " reports/sec",
+				(gint64) BENCH_COUNT * G_USEC_PER_SEC /
+								MAX(elapsed, 1));
+
+	start = g_get_monotonic_time();
+
+	for (i = 0; i < BENCH_COUNT; i++) {
+		eir_view_parse(&view, test->eir_data, test->eir_size);
+		eir_view_get_name(&view, name, sizeof(name));
+
+		eir_iter_init(&iter, &view);
+		while (eir_iter_next_uuid(&iter, &uuid))
+			;
+
+		eir_iter_init(&iter, &view);
+		while (eir_iter_next_msd(&iter, &company, &msd, &len))
+			;
+	}
+
+	elapsed = g_get_monotonic_time() - start;
+	tester_print("eir_view_parse: %" G_GINT64_FORMAT " reports/sec",
+				(gint64) BENCH_COUNT * G_USEC_PER_SEC /
+								MAX(elapsed, 1));
+
+	tester_test_passed();
+}
+
 int main(int argc, char *argv[])
 {
 	tester_init(&argc, &argv);
@@ -667,5 +788,8 @@ int main(int argc, char *argv[])
 	tester_add("ad/g-tag", &gigaset_gtag_test, NULL, test_parsing, NULL);
 	tester_add("ad/uri-beacon", &uri_beacon_test, NULL, test_parsing, NULL);
 
+	if (tester_use_perf())
+		tester_add("/eir/benchmark", NULL, NULL, test_benchmark, NULL);
+
 	return tester_run();
 }
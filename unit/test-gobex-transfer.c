@@ -2394,6 +2394,410 @@ static void test_conn_put_req_seq_srm(void)
 	g_assert_no_error(d.err);
 }
 
+static int body_fd = -1;
+
+static int create_body_file(const void *data, gsize len)
+{
+	char *path;
+	int fd;
+
+	fd = g_file_open_tmp("test-gobex-XXXXXX", &path, NULL);
+	g_assert(fd >= 0);
+
+	unlink(path);
+	g_free(path);
+
+	if (len > 0)
+		g_assert_cmpint(write(fd, data, len), ==, len);
+
+	return fd;
+}
+
+static gssize provide_fd(int *fd, off_t *offset, gsize len,
+							gpointer user_data)
+{
+	struct test_data *d = user_data;
+
+	if (d->total > 0)
+		return 0;
+
+	if (len < sizeof(body_data)) {
+		g_set_error(&d->err, TEST_ERROR, TEST_ERROR_UNEXPECTED,
+				"Got data request for only %zu bytes", len);
+		g_main_loop_quit(d->mainloop);
+		return -1;
+	}
+
+	*fd = body_fd;
+	*offset = 0;
+
+	d->total += sizeof(body_data);
+
+	return sizeof(body_data);
+}
+
+static void handle_get_fd(GObex *obex, GObexPacket *req, gpointer user_data)
+{
+	struct test_data *d = user_data;
+	guint8 op = g_obex_packet_get_operation(req, NULL);
+	GObexPacket *rsp;
+	guint id;
+
+	if (op != G_OBEX_OP_GET) {
+		d->err = g_error_new(TEST_ERROR, TEST_ERROR_UNEXPECTED,
+					"Unexpected opcode 0x%02x", op);
+		g_main_loop_quit(d->mainloop);
+		return;
+	}
+
+	rsp = g_obex_packet_new(G_OBEX_RSP_CONTINUE, TRUE, G_OBEX_HDR_INVALID);
+
+	id = g_obex_get_rsp_pkt_fd(obex, rsp, provide_fd, transfer_complete,
+								d, &d->err);
+	if (id == 0)
+		g_main_loop_quit(d->mainloop);
+}
+
+static void test_get_rsp_fd(int sock_type)
+{
+	GIOChannel *io;
+	GIOCondition cond;
+	GObex *obex;
+	struct test_data d = { 0, NULL, {
+				{ get_rsp_first, sizeof(get_rsp_first) },
+				{ get_rsp_last, sizeof(get_rsp_last) } }, {
+				{ get_req_last, sizeof(get_req_last) },
+				{ NULL, 0 } } };
+
+	body_fd = create_body_file(body_data, sizeof(body_data));
+
+	create_endpoints(&obex, &io, sock_type);
+
+	cond = G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL;
+	d.io_id = g_io_add_watch(io, cond, test_io_cb, &d);
+
+	d.mainloop = g_main_loop_new(NULL, FALSE);
+
+	d.timer_id = g_timeout_add_seconds(1, test_timeout, &d);
+
+	g_obex_add_request_function(obex, G_OBEX_OP_GET, handle_get_fd, &d);
+
+	g_io_channel_write_chars(io, (char *) get_req_first,
+					sizeof(get_req_first), NULL, &d.err);
+	g_assert_no_error(d.err);
+
+	g_main_loop_run(d.mainloop);
+
+	g_assert_cmpuint(d.count, ==, 1);
+
+	g_main_loop_unref(d.mainloop);
+
+	if (d.timer_id > 0)
+		g_source_remove(d.timer_id);
+	if (d.io_id > 0)
+		g_source_remove(d.io_id);
+
+	g_io_channel_unref(io);
+	g_obex_unref(obex);
+
+	close(body_fd);
+	body_fd = -1;
+
+	g_assert_no_error(d.err);
+}
+
+static void test_stream_get_rsp_fd(void)
+{
+	test_get_rsp_fd(SOCK_STREAM);
+}
+
+static void test_packet_get_rsp_fd(void)
+{
+	test_get_rsp_fd(SOCK_SEQPACKET);
+}
+
+static int lowest_free_fd(void)
+{
+	int fd;
+
+	fd = dup(body_fd);
+	g_assert(fd >= 0);
+	close(fd);
+
+	return fd;
+}
+
+static void test_put_req_fd(int sock_type)
+{
+	GIOChannel *io;
+	GIOCondition cond;
+	GObexPacket *req;
+	GObex *obex;
+	int free_fd;
+	struct test_data d = { 0, NULL, {
+				{ put_req_first, sizeof(put_req_first) },
+				{ put_req_last, sizeof(put_req_last) } }, {
+				{ put_rsp_first, sizeof(put_rsp_first) },
+				{ put_rsp_last, sizeof(put_rsp_last) } } };
+
+	body_fd = create_body_file(body_data, sizeof(body_data));
+
+	create_endpoints(&obex, &io, sock_type);
+
+	cond = G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL;
+	d.io_id = g_io_add_watch(io, cond, test_io_cb, &d);
+
+	d.mainloop = g_main_loop_new(NULL, FALSE);
+
+	d.timer_id = g_timeout_add_seconds(1, test_timeout, &d);
+
+	req = g_obex_packet_new(G_OBEX_OP_PUT, FALSE,
+				G_OBEX_HDR_TYPE, hdr_type, sizeof(hdr_type),
+				G_OBEX_HDR_NAME, "file.txt",
+				G_OBEX_HDR_INVALID);
+
+	free_fd = lowest_free_fd();
+
+	g_obex_put_req_pkt_fd(obex, req, provide_fd, transfer_complete, &d,
+								&d.err);
+	g_assert_no_error(d.err);
+
+	g_main_loop_run(d.mainloop);
+
+	g_assert_cmpuint(d.count, ==, 2);
+
+	/* The copy of the body fd is gone with the transfer */
+	g_assert_cmpint(lowest_free_fd(), ==, free_fd);
+
+	g_main_loop_unref(d.mainloop);
+
+	if (d.timer_id > 0)
+		g_source_remove(d.timer_id);
+	if (d.io_id > 0)
+		g_source_remove(d.io_id);
+
+	g_io_channel_unref(io);
+	g_obex_unref(obex);
+
+	close(body_fd);
+	body_fd = -1;
+
+	g_assert_no_error(d.err);
+}
+
+static void test_stream_put_req_fd(void)
+{
+	test_put_req_fd(SOCK_STREAM);
+}
+
+static void test_packet_put_req_fd(void)
+{
+	test_put_req_fd(SOCK_SEQPACKET);
+}
+
+#define BENCH_MTU	65535
+#define BENCH_SIZE	(64 * 1024 * 1024)
+
+struct bench_data {
+	GMainLoop *mainloop;
+	GObex *server;
+	GObex *client;
+	gboolean use_fd;
+	int fd;
+	off_t offset;
+	gsize received;
+	GError *err;
+};
+
+static gssize bench_provide_data(void *buf, gsize len, gpointer user_data)
+{
+	struct bench_data *b = user_data;
+	ssize_t ret;
+
+	ret = read(b->fd, buf, len);
+	if (ret < 0)
+		return -errno;
+
+	return ret;
+}
+
+static gssize bench_provide_fd(int *fd, off_t *offset, gsize len,
+							gpointer user_data)
+{
+	struct bench_data *b = user_data;
+
+	len = MIN(len, (gsize) (BENCH_SIZE - b->offset));
+
+	*fd = b->fd;
+	*offset = b->offset;
+
+	b->offset += len;
+
+	return len;
+}
+
+static gboolean bench_consume(const void *buf, gsize len,
+							gpointer user_data)
+{
+	struct bench_data *b = user_data;
+
+	b->received += len;
+
+	return TRUE;
+}
+
+static void bench_rsp_complete(GObex *obex, GError *err, gpointer user_data)
+{
+	struct bench_data *b = user_data;
+
+	if (err != NULL && b->err == NULL)
+		b->err = g_error_copy(err);
+}
+
+static void bench_req_complete(GObex *obex, GError *err, gpointer user_data)
+{
+	struct bench_data *b = user_data;
+
+	if (err != NULL && b->err == NULL)
+		b->err = g_error_copy(err);
+
+	g_main_loop_quit(b->mainloop);
+}
+
+static void bench_handle_conn(GObex *obex, GObexPacket *req,
+							gpointer user_data)
+{
+	struct bench_data *b = user_data;
+	GObexPacket *rsp;
+
+	rsp = g_obex_packet_new(G_OBEX_RSP_SUCCESS, TRUE, G_OBEX_HDR_INVALID);
+	g_obex_send(obex, rsp, &b->err);
+}
+
+static void bench_handle_get(GObex *obex, GObexPacket *req,
+							gpointer user_data)
+{
+	struct bench_data *b = user_data;
+	GObexPacket *rsp;
+
+	rsp = g_obex_packet_new(G_OBEX_RSP_CONTINUE, TRUE, G_OBEX_HDR_INVALID);
+
+	if (b->use_fd)
+		g_obex_get_rsp_pkt_fd(obex, rsp, bench_provide_fd,
+					bench_rsp_complete, b, &b->err);
+	else
+		g_obex_get_rsp_pkt(obex, rsp, bench_provide_data,
+					bench_rsp_complete, b, &b->err);
+}
+
+static void bench_connected(GObex *obex, GError *err, GObexPacket *rsp,
+							gpointer user_data)
+{
+	struct bench_data *b = user_data;
+
+	if (err != NULL) {
+		b->err = g_error_copy(err);
+		g_main_loop_quit(b->mainloop);
+		return;
+	}
+
+	g_test_timer_start();
+
+	g_obex_get_req(obex, bench_consume, bench_req_complete, b, &b->err,
+					G_OBEX_HDR_TYPE, hdr_type, sizeof(hdr_type),
+					G_OBEX_HDR_INVALID);
+}
+
+static GObex *bench_gobex(int fd, GObexTransportType transport_type)
+{
+	GIOChannel *io;
+	GObex *obex;
+
+	io = g_io_channel_unix_new(fd);
+	g_io_channel_set_close_on_unref(io, TRUE);
+
+	obex = g_obex_new(io, transport_type, BENCH_MTU, BENCH_MTU);
+	g_io_channel_unref(io);
+	g_assert(obex != NULL);
+
+	return obex;
+}
+
+static void bench_get(int sock_type, gboolean use_fd)
+{
+	struct bench_data b;
+	GObexTransportType transport_type;
+	void *data;
+	double elapsed;
+	int sv[2];
+
+	memset(&b, 0, sizeof(b));
+	b.use_fd = use_fd;
+
+	data = g_malloc0(BENCH_SIZE);
+	b.fd = create_body_file(data, BENCH_SIZE);
+	g_free(data);
+	lseek(b.fd, 0, SEEK_SET);
+
+	g_assert(socketpair(AF_UNIX, sock_type | SOCK_NONBLOCK, 0, sv) == 0);
+
+	if (sock_type == SOCK_STREAM)
+		transport_type = G_OBEX_TRANSPORT_STREAM;
+	else
+		transport_type = G_OBEX_TRANSPORT_PACKET;
+
+	b.server = bench_gobex(sv[0], transport_type);
+	b.client = bench_gobex(sv[1], transport_type);
+
+	g_obex_add_request_function(b.server, G_OBEX_OP_CONNECT,
+						bench_handle_conn, &b);
+	g_obex_add_request_function(b.server, G_OBEX_OP_GET,
+						bench_handle_get, &b);
+
+	b.mainloop = g_main_loop_new(NULL, FALSE);
+
+	g_obex_connect(b.client, bench_connected, &b, &b.err,
+						G_OBEX_HDR_INVALID);
+	g_assert_no_error(b.err);
+
+	g_main_loop_run(b.mainloop);
+
+	elapsed = g_test_timer_elapsed();
+
+	g_assert_no_error(b.err);
+	g_assert_cmpuint(b.received, ==, BENCH_SIZE);
+
+	g_test_minimized_result(elapsed, "%s %s: %.1f MiB/s",
+			sock_type == SOCK_STREAM ? "stream" : "packet",
+			use_fd ? "fd" : "copy",
+			BENCH_SIZE / elapsed / (1024 * 1024));
+
+	g_main_loop_unref(b.mainloop);
+	g_obex_unref(b.client);
+	g_obex_unref(b.server);
+	close(b.fd);
+}
+
+static void bench_stream_get_copy(void)
+{
+	bench_get(SOCK_STREAM, FALSE);
+}
+
+static void bench_stream_get_fd(void)
+{
+	bench_get(SOCK_STREAM, TRUE);
+}
+
+static void bench_packet_get_copy(void)
+{
+	bench_get(SOCK_SEQPACKET, FALSE);
+}
+
+static void bench_packet_get_fd(void)
+{
+	bench_get(SOCK_SEQPACKET, TRUE);
+}
+
 int main(int argc, char *argv[])
 {
 	g_test_init(&argc, &argv, NULL);
@@ -2467,5 +2871,25 @@ int main(int argc, char *argv[])
 	g_test_add_func("/gobex/test_conn_put_req_seq_srm",
 						test_conn_put_req_seq_srm);
 
+	g_test_add_func("/gobex/test_stream_get_rsp_fd",
+						test_stream_get_rsp_fd);
+	g_test_add_func("/gobex/test_packet_get_rsp_fd",
+						test_packet_get_rsp_fd);
+	g_test_add_func("/gobex/test_stream_put_req_fd",
+						test_stream_put_req_fd);
+	g_test_add_func("/gobex/test_packet_put_req_fd",
+						test_packet_put_req_fd);
+
+	if (g_test_perf()) {
+		g_test_add_func("/gobex/bench_stream_get_copy",
+						bench_stream_get_copy);
+		g_test_add_func("/gobex/bench_stream_get_fd",
+						bench_stream_get_fd);
+		g_test_add_func("/gobex/bench_packet_get_copy",
+						bench_packet_get_copy);
+		g_test_add_func("/gobex/bench_packet_get_fd",
+						bench_packet_get_fd);
+	}
+
 	return g_test_run();
 }
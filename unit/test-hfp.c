@@ -680,6 +680,144 @@ static void test_hf_robustness(gconstpointer data)
 	context_quit(context);
 }
 
+/* Enough batches to exercise split reads, small enough for make check */
+#define PERF_COMMANDS	1024
+#define PERF_BATCH	32
+
+static const char *perf_prefixes[] = {
+	"+BRSF", "+BAC", "+CIND", "+CMER", "+CHLD", "+BIND", "+CMEE",
+	"+CLIP", "+CCWA", "+VGS", "+VGM", "+NREC", "+BVRA", "+CLCC",
+	"+COPS", "+CNUM", "+BIA", "+BCC", "+BCS", "+BTRH", "+BINP",
+	"+BLDN", "+VTS", "+CKPD", "+CHUP", "A", "D",
+};
+
+static const char *perf_commands[] = {
+	"AT+CLCC\r", "AT+VGS=10\r", "AT+BIA=1,1,0,0,0,1,1\r", "AT+CIND?\r",
+	"AT+CHLD=?\r", "ATD1234567;\r", "AT+BTRH?\r", "AT+NREC=0\r",
+};
+
+struct perf_context {
+	struct hfp_gw *hfp;
+	guint watch_id;
+	int fd_server;
+	unsigned int sent;
+	unsigned int handled;
+	unsigned int responses;
+	gint64 start;
+};
+
+static void perf_handler(struct hfp_context *result,
+				enum hfp_gw_cmd_type type, void *user_data)
+{
+	struct perf_context *context = user_data;
+
+	context->handled++;
+
+	hfp_gw_send_result(context->hfp, HFP_RESULT_OK);
+}
+
+static void perf_send_batch(struct perf_context *context)
+{
+	char buf[PERF_BATCH * 32];
+	size_t len = 0;
+	ssize_t written;
+	int i;
+
+	for (i = 0; i < PERF_BATCH; i++) {
+		const char *cmd = perf_commands[(context->sent + i) %
+						G_N_ELEMENTS(perf_commands)];
+
+		memcpy(buf + len, cmd, strlen(cmd));
+		len += strlen(cmd);
+	}
+
+	written = write(context->fd_server, buf, len);
+	g_assert_cmpint(written, ==, len);
+
+	context->sent += PERF_BATCH;
+}
+
+static gboolean perf_read(GIOChannel *channel, GIOCondition cond,
+							gpointer user_data)
+{
+	struct perf_context *context = user_data;
+	char buf[4096];
+	gint64 elapsed;
+	ssize_t len, i;
+
+	if (cond & (G_IO_HUP | G_IO_ERR | G_IO_NVAL)) {
+		tester_test_failed();
+		return FALSE;
+	}
+
+	len = read(context->fd_server, buf, sizeof(buf));
+	g_assert(len > 0);
+
+	/* Every result is framed by two <cr><lf> pairs */
+	for (i = 0; i < len; i++)
+		if (buf[i] == '\n')
+			context->responses++;
+
+	if (context->responses / 2 < context->sent)
+		return TRUE;
+
+	if (context->sent < PERF_COMMANDS) {
+		perf_send_batch(context);
+		return TRUE;
+	}
+
+	elapsed = g_get_monotonic_time() - context->start;
+
+	g_assert_cmpuint(context->handled, ==, context->sent);
+	g_assert_cmpuint(context->responses / 2, ==, context->sent);
+
+	tester_print("%u commands in %" G_GINT64_FORMAT " us (%.0f commands/s)",
+				context->sent, elapsed,
+				context->sent * 1000000.0 / MAX(elapsed, 1));
+
+	context->watch_id = 0;
+	hfp_gw_unref(context->hfp);
+	g_free(context);
+
+	tester_test_passed();
+
+	return FALSE;
+}
+
+static void test_throughput(gconstpointer data)
+{
+	struct perf_context *context = g_new0(struct perf_context, 1);
+	GIOChannel *channel;
+	int err, sv[2];
+	unsigned int i;
+
+	err = socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv);
+	g_assert(err == 0);
+
+	context->hfp = hfp_gw_new(sv[0]);
+	g_assert(context->hfp);
+	g_assert(hfp_gw_set_close_on_unref(context->hfp, true));
+
+	for (i = 0; i < G_N_ELEMENTS(perf_prefixes); i++)
+		g_assert(hfp_gw_register(context->hfp, perf_handler,
+					perf_prefixes[i], context, NULL));
+
+	channel = g_io_channel_unix_new(sv[1]);
+	g_io_channel_set_close_on_unref(channel, TRUE);
+	g_io_channel_set_encoding(channel, NULL, NULL);
+	g_io_channel_set_buffered(channel, FALSE);
+
+	context->watch_id = g_io_add_watch(channel,
+				G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
+				perf_read, context);
+	g_io_channel_unref(channel);
+
+	context->fd_server = sv[1];
+	context->start = g_get_monotonic_time();
+
+	perf_send_batch(context);
+}
+
 int main(int argc, char *argv[])
 {
 	tester_init(&argc, &argv);
@@ -754,6 +892,7 @@ int main(int argc, char *argv[])
 	define_test("/hfp/test_empty", test_send_and_close, NULL,
 			raw_pdu('\r'),
 			data_end());
+	tester_add("/hfp/test_throughput", NULL, NULL, test_throughput, NULL);
 	define_hf_test("/hfp_hf/test_init", test_hf_init, NULL, NULL,
 			data_end());
 	define_hf_test("/hfp_hf/test_send_command_1", test_hf_send_command,
@@ -0,0 +1,252 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "mesh/json-journal.c"
+
+/*
+ * Every test works on a snapshot file in a private directory and checks
+ * that replaying the journal on top of the snapshot read back from disk
+ * gives the object the changes were recorded from.
+ */
+
+static char dir[] = "/tmp/test-json-journal-XXXXXX";
+static char *cfg_fname;
+
+static void check(bool cond, const char *label)
+{
+	l_info("%-40s %s", label, cond ? "PASS" : "FAIL");
+
+	if (!cond)
+		exit(EXIT_FAILURE);
+}
+
+/* Replace the snapshot the way mesh-config-json does, with a new inode */
+static void write_snapshot(json_object *jroot)
+{
+	char *fname_tmp = l_strdup_printf("%s%s", cfg_fname, tmp_ext);
+
+	check(!json_object_to_file_ext(fname_tmp, jroot,
+					JSON_C_TO_STRING_PLAIN), "snapshot");
+	check(!rename(fname_tmp, cfg_fname), "snapshot rename");
+
+	l_free(fname_tmp);
+}
+
+static struct json_journal *replay_snapshot(json_object **jload)
+{
+	*jload = json_object_from_file(cfg_fname);
+	check(*jload != NULL, "snapshot load");
+
+	return json_journal_open(cfg_fname, *jload);
+}
+
+static void set_int(json_object *jobj, const char *key, int value)
+{
+	json_object_object_del(jobj, key);
+	json_object_object_add(jobj, key, json_object_new_int(value));
+}
+
+static void append_torn(void)
+{
+	static const char torn[] = "{\"key\":\"defaultTTL\",\"va";
+	char *fname = l_strdup_printf("%s%s", cfg_fname, journal_ext);
+	int fd;
+
+	fd = open(fname, O_WRONLY | O_APPEND);
+	check(fd >= 0, "journal open");
+	check(write(fd, torn, strlen(torn)) == (ssize_t) strlen(torn),
+								"torn write");
+	close(fd);
+
+	l_free(fname);
+}
+
+static const char *iv_keys[] = { "IVindex", "IVupdate", NULL };
+
+static json_object *test_replay_order(void)
+{
+	struct json_journal *journal;
+	json_object *jroot, *jload, *jarray;
+
+	jroot = json_tokener_parse("{\"defaultTTL\":7,\"IVindex\":0,"
+				"\"IVupdate\":0,\"elements\":"
+				"[{\"index\":0},{\"index\":1},{\"index\":2}]}");
+	write_snapshot(jroot);
+
+	journal = json_journal_open(cfg_fname, NULL);
+	json_object_object_get_ex(jroot, "elements", &jarray);
+
+	set_int(jroot, "defaultTTL", 5);
+	check(json_journal_set_member(journal, jroot, "defaultTTL"),
+								"set member");
+
+	set_int(json_object_array_get_idx(jarray, 1), "index", 10);
+	check(json_journal_set_entry(journal, jroot, "elements", 1),
+								"set entry");
+
+	json_object_array_add(jarray, json_tokener_parse("{\"index\":3}"));
+	check(json_journal_set_entry(journal, jroot, "elements", 3),
+								"append entry");
+
+	/* Later records refer to the indices left by this one */
+	json_object_array_del_idx(jarray, 0, 1);
+	check(json_journal_del_entry(journal, "elements", 0), "del entry");
+
+	set_int(json_object_array_get_idx(jarray, 0), "index", 11);
+	check(json_journal_set_entry(journal, jroot, "elements", 0),
+							"set moved entry");
+
+	set_int(jroot, "IVindex", 5);
+	set_int(jroot, "IVupdate", 1);
+	check(json_journal_set_members(journal, jroot, iv_keys),
+								"set members");
+
+	json_object_object_del(jroot, "defaultTTL");
+	check(json_journal_set_member(journal, jroot, "defaultTTL"),
+								"del member");
+
+	check(journal->records == 7, "records appended");
+	check(journal->sync != NULL, "sync deferred");
+
+	l_main_iterate(0);
+	check(journal->sync == NULL, "synced from idle");
+
+	json_journal_close(journal);
+
+	journal = replay_snapshot(&jload);
+	check(journal->records == 7, "records replayed");
+	check(json_object_equal(jload, jroot), "replayed in order");
+	json_journal_close(journal);
+	json_object_put(jload);
+
+	return jroot;
+}
+
+static void test_torn_tail(json_object *jroot)
+{
+	struct json_journal *journal;
+	json_object *jload;
+
+	append_torn();
+
+	journal = replay_snapshot(&jload);
+	check(journal->records == 7, "torn record skipped");
+	check(json_object_equal(jload, jroot), "torn replay");
+
+	/* The next record replaces the torn one */
+	set_int(jroot, "defaultTTL", 3);
+	set_int(jload, "defaultTTL", 3);
+	check(json_journal_set_member(journal, jload, "defaultTTL"),
+							"append after torn");
+	json_journal_close(journal);
+	json_object_put(jload);
+
+	journal = replay_snapshot(&jload);
+	check(journal->records == 8, "record after torn replayed");
+	check(json_object_equal(jload, jroot), "replay after torn");
+	json_journal_close(journal);
+	json_object_put(jload);
+}
+
+static void test_compact(json_object *jroot)
+{
+	struct json_journal *journal;
+	json_object *jload;
+	int seq = 0;
+
+	journal = replay_snapshot(&jload);
+	check(!json_journal_need_compact(journal), "no compaction");
+
+	while (!json_journal_need_compact(journal)) {
+		set_int(jload, "sequenceNumber", ++seq);
+		check(json_journal_set_member(journal, jload,
+					"sequenceNumber"), "append");
+	}
+
+	check(journal->size > JOURNAL_MIN_COMPACT, "compaction due");
+
+	/* A new snapshot holds every change and empties the journal */
+	write_snapshot(jload);
+	check(json_journal_reset(journal), "reset");
+	check(!json_journal_need_compact(journal), "compacted");
+	check(journal->records == 0, "journal emptied");
+	json_journal_close(journal);
+
+	set_int(jroot, "sequenceNumber", seq);
+	json_object_put(jload);
+
+	journal = replay_snapshot(&jload);
+	check(journal->records == 0, "nothing replayed");
+	check(json_object_equal(jload, jroot), "compacted snapshot");
+	json_journal_close(journal);
+	json_object_put(jload);
+}
+
+static void test_stale_header(void)
+{
+	struct json_journal *journal;
+	json_object *jold, *jload;
+
+	jold = json_tokener_parse("{\"defaultTTL\":9}");
+
+	journal = replay_snapshot(&jload);
+	set_int(jload, "defaultTTL", 1);
+	check(json_journal_set_member(journal, jload, "defaultTTL"),
+							"record on snapshot");
+	json_journal_close(journal);
+	json_object_put(jload);
+
+	/* A journal left over for another snapshot is never replayed */
+	write_snapshot(jold);
+
+	journal = replay_snapshot(&jload);
+	check(journal->records == 0, "stale journal ignored");
+	check(json_object_equal(jload, jold), "stale replay");
+	json_journal_close(journal);
+	json_object_put(jload);
+	json_object_put(jold);
+}
+
+int main(int argc, char *argv[])
+{
+	json_object *jroot;
+	char *fname;
+
+	l_log_set_stderr();
+
+	if (!l_main_init())
+		return EXIT_FAILURE;
+
+	check(mkdtemp(dir) != NULL, "temp dir");
+	cfg_fname = l_strdup_printf("%s/node.json", dir);
+
+	jroot = test_replay_order();
+	test_torn_tail(jroot);
+	test_compact(jroot);
+	test_stale_header();
+
+	json_object_put(jroot);
+
+	fname = l_strdup_printf("%s%s", cfg_fname, journal_ext);
+	remove(fname);
+	l_free(fname);
+	remove(cfg_fname);
+	rmdir(dir);
+	l_free(cfg_fname);
+
+	l_main_exit();
+
+	return EXIT_SUCCESS;
+}
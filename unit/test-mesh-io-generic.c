@@ -0,0 +1,483 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "mesh/mesh-io-generic.c"
+
+/*
+ * The generic io is driven against a fake controller: the bt_hci calls it
+ * makes are answered from idle context, every command is logged with the
+ * time it was sent, and LE Meta events are injected by the test.
+ *
+ * btdev is not used: it only ends an advertising set once its duration
+ * runs out, never after max_events, and the tests need to choose when
+ * a set ends.
+ */
+
+struct bt_hci {
+	int ref_count;
+};
+
+struct fake_cmd {
+	uint16_t opcode;
+	uint8_t data[255];
+	uint8_t size;
+	uint32_t instant;
+	bt_hci_callback_func_t callback;
+	void *user_data;
+	bt_hci_destroy_func_t destroy;
+};
+
+static struct bt_hci fake_hci;
+static struct l_queue *cmd_queue;
+static struct l_queue *cmd_log;
+static bt_hci_callback_func_t meta_callback;
+static void *meta_user_data;
+static bool responding;
+static uint8_t num_adv_sets;
+static uint8_t enable_status;
+static bool auto_terminate;
+static unsigned int pdus_enabled;
+static bool io_ready;
+
+static void set_terminated(uint8_t handle);
+
+static void respond_cmds(void *user_data)
+{
+	uint8_t handles[256];
+	unsigned int i, num = 0;
+	struct fake_cmd *cmd;
+
+	responding = false;
+
+	while ((cmd = l_queue_pop_head(cmd_queue))) {
+		uint8_t rsp[65];
+
+		memset(rsp, 0, sizeof(rsp));
+
+		switch (cmd->opcode) {
+		case BT_HCI_CMD_READ_LOCAL_COMMANDS:
+			rsp[1 + 36] = 0xae;
+			rsp[1 + 37] = 0x60;
+			break;
+		case BT_HCI_CMD_LE_READ_NUM_SUPPORTED_ADV_SETS:
+			rsp[1] = num_adv_sets;
+			break;
+		case BT_HCI_CMD_LE_SET_EXT_ADV_ENABLE:
+			if (!cmd->data[0])
+				break;
+
+			rsp[0] = enable_status;
+			enable_status = 0;
+
+			if (!auto_terminate || rsp[0])
+				break;
+
+			/* Each set runs its single event and terminates */
+			for (i = 0; i < cmd->data[1]; i++)
+				handles[num++] = cmd->data[2 + i * 4];
+
+			break;
+		}
+
+		if (cmd->callback)
+			cmd->callback(rsp, sizeof(rsp), cmd->user_data);
+
+		if (cmd->destroy)
+			cmd->destroy(cmd->user_data);
+
+		cmd->destroy = NULL;
+	}
+
+	for (i = 0; i < num; i++)
+		set_terminated(handles[i]);
+}
+
+struct bt_hci *bt_hci_new_user_channel(uint16_t index)
+{
+	fake_hci.ref_count = 1;
+
+	return &fake_hci;
+}
+
+void bt_hci_unref(struct bt_hci *hci)
+{
+	struct fake_cmd *cmd;
+
+	if (--hci->ref_count)
+		return;
+
+	while ((cmd = l_queue_pop_head(cmd_queue))) {
+		if (cmd->destroy)
+			cmd->destroy(cmd->user_data);
+
+		cmd->destroy = NULL;
+	}
+
+	meta_callback = NULL;
+}
+
+unsigned int bt_hci_send(struct bt_hci *hci, uint16_t opcode,
+				const void *data, uint8_t size,
+				bt_hci_callback_func_t callback,
+				void *user_data, bt_hci_destroy_func_t destroy)
+{
+	struct fake_cmd *cmd;
+
+	cmd = l_new(struct fake_cmd, 1);
+	cmd->opcode = opcode;
+	cmd->size = size;
+	cmd->instant = get_instant();
+	cmd->callback = callback;
+	cmd->user_data = user_data;
+	cmd->destroy = destroy;
+
+	if (size)
+		memcpy(cmd->data, data, size);
+
+	if (opcode == BT_HCI_CMD_LE_SET_EXT_ADV_ENABLE && cmd->data[0])
+		pdus_enabled += cmd->data[1];
+
+	l_queue_push_tail(cmd_log, cmd);
+	l_queue_push_tail(cmd_queue, cmd);
+
+	if (!responding) {
+		responding = true;
+		l_idle_oneshot(respond_cmds, NULL, NULL);
+	}
+
+	return l_queue_length(cmd_log);
+}
+
+unsigned int bt_hci_register(struct bt_hci *hci, uint8_t event,
+				bt_hci_callback_func_t callback,
+				void *user_data, bt_hci_destroy_func_t destroy)
+{
+	if (event == BT_HCI_EVT_LE_META_EVENT) {
+		meta_callback = callback;
+		meta_user_data = user_data;
+	}
+
+	return 1;
+}
+
+bool mesh_mgmt_list(mesh_mgmt_read_info_func_t cb, void *user_data)
+{
+	return false;
+}
+
+static void check(bool cond, const char *label)
+{
+	l_info("%-40s %s", label, cond ? "PASS" : "FAIL");
+
+	if (!cond)
+		exit(EXIT_FAILURE);
+}
+
+static bool match_enable(const void *a, const void *b)
+{
+	const struct fake_cmd *cmd = a;
+
+	return cmd->opcode == BT_HCI_CMD_LE_SET_EXT_ADV_ENABLE &&
+								cmd->data[0];
+}
+
+static struct fake_cmd *nth_enable(unsigned int n)
+{
+	const struct l_queue_entry *entry;
+
+	for (entry = l_queue_get_entries(cmd_log); entry;
+							entry = entry->next) {
+		if (match_enable(entry->data, NULL) && !n--)
+			return entry->data;
+	}
+
+	return NULL;
+}
+
+static unsigned int count_enables(void)
+{
+	const struct l_queue_entry *entry;
+	unsigned int count = 0;
+
+	for (entry = l_queue_get_entries(cmd_log); entry;
+							entry = entry->next)
+		count += match_enable(entry->data, NULL);
+
+	return count;
+}
+
+/* Run the main loop until cond() holds or ms have passed */
+static bool wait_until(bool (*cond)(void *), void *data, uint32_t ms)
+{
+	uint32_t start = get_instant();
+
+	while (!cond(data)) {
+		if (get_instant() - start > ms)
+			return false;
+
+		l_main_iterate(10);
+	}
+
+	return true;
+}
+
+static bool is_ready(void *data)
+{
+	return io_ready;
+}
+
+static bool has_enables(void *data)
+{
+	return count_enables() >= L_PTR_TO_UINT(data);
+}
+
+static bool set_is_free(void *data)
+{
+	struct mesh_io *io = data;
+
+	return io->pvt->sets[0].tx == NULL;
+}
+
+#define PERF_PDUS 10000
+
+static bool tx_drained(void *data)
+{
+	struct mesh_io *io = data;
+
+	return pdus_enabled >= PERF_PDUS &&
+				l_queue_isempty(io->pvt->tx_pkts) &&
+				sets_idle(io->pvt);
+}
+
+static bool never(void *data)
+{
+	return false;
+}
+
+static void ready_cb(void *user_data, bool result)
+{
+	io_ready = result;
+}
+
+static void setup(struct mesh_io *io, uint8_t sets)
+{
+	int index = 0;
+
+	memset(io, 0, sizeof(*io));
+	cmd_queue = l_queue_new();
+	cmd_log = l_queue_new();
+	num_adv_sets = sets;
+	enable_status = 0;
+	pdus_enabled = 0;
+	io_ready = false;
+
+	check(mesh_io_generic.init(io, &index, ready_cb, NULL), "init");
+	check(wait_until(is_ready, NULL, 1000), "ready");
+	check(io->pvt->ext_adv && io->pvt->num_sets == sets,
+						"extended advertising sets");
+}
+
+static void teardown(struct mesh_io *io)
+{
+	/* Let pending idle work run before the io goes away */
+	wait_until(never, NULL, 20);
+
+	mesh_io_generic.destroy(io);
+
+	l_queue_destroy(cmd_queue, NULL);
+	l_queue_destroy(cmd_log, l_free);
+	cmd_queue = NULL;
+	cmd_log = NULL;
+}
+
+static void send_general(struct mesh_io *io, uint8_t delay, uint8_t id)
+{
+	struct mesh_io_send_info info;
+	uint8_t pkt[] = { MESH_AD_TYPE_NETWORK, id };
+
+	memset(&info, 0, sizeof(info));
+	info.type = MESH_IO_TIMING_TYPE_GENERAL;
+	info.u.gen.interval = 20;
+	info.u.gen.cnt = 1;
+	info.u.gen.min_delay = delay;
+	info.u.gen.max_delay = delay;
+
+	check(mesh_io_generic.send(io, &info, pkt, sizeof(pkt)), "send");
+}
+
+static void set_terminated(uint8_t handle)
+{
+	uint8_t evt[1 + sizeof(struct bt_hci_evt_le_adv_set_term)];
+	struct bt_hci_evt_le_adv_set_term *term = (void *) (evt + 1);
+
+	memset(evt, 0, sizeof(evt));
+	evt[0] = BT_HCI_EVT_LE_ADV_SET_TERM;
+	term->handle = handle;
+	term->num_evts = 1;
+
+	meta_callback(evt, sizeof(evt), meta_user_data);
+}
+
+static void test_poll_rsp_delay(void)
+{
+	struct mesh_io io;
+	struct mesh_io_send_info info;
+	uint8_t pkt[] = { MESH_AD_TYPE_NETWORK, 0x01 };
+	uint32_t start;
+
+	l_info("Poll response waits for instant + delay");
+	setup(&io, 2);
+
+	memset(&info, 0, sizeof(info));
+	info.type = MESH_IO_TIMING_TYPE_POLL_RSP;
+	info.u.poll_rsp.instant = get_instant();
+	info.u.poll_rsp.delay = 100;
+	start = info.u.poll_rsp.instant;
+
+	check(mesh_io_generic.send(&io, &info, pkt, sizeof(pkt)), "send");
+	check(wait_until(has_enables, L_UINT_TO_PTR(1), 1000), "enabled");
+	check(nth_enable(0)->instant - start >= 90, "not before delay");
+
+	teardown(&io);
+}
+
+static void test_general_delay(void)
+{
+	struct mesh_io io;
+	uint32_t start;
+
+	l_info("General packet waits for its transmit delay");
+	setup(&io, 2);
+
+	start = get_instant();
+	send_general(&io, 50, 0x01);
+
+	check(wait_until(has_enables, L_UINT_TO_PTR(1), 1000), "enabled");
+	check(nth_enable(0)->instant - start >= 45, "not before delay");
+
+	teardown(&io);
+}
+
+static void test_set_refill(void)
+{
+	struct mesh_io io;
+
+	l_info("Queued packet waits for a set to terminate");
+	setup(&io, 1);
+
+	send_general(&io, 0, 0x01);
+	send_general(&io, 0, 0x02);
+
+	check(wait_until(has_enables, L_UINT_TO_PTR(1), 1000), "first");
+	check(!wait_until(has_enables, L_UINT_TO_PTR(2), 50),
+						"second waits for the set");
+
+	set_terminated(0);
+
+	check(wait_until(has_enables, L_UINT_TO_PTR(2), 1000), "second");
+
+	teardown(&io);
+}
+
+static void test_enable_failure(void)
+{
+	struct mesh_io io;
+
+	l_info("Failed enable releases the set");
+	setup(&io, 1);
+
+	/* Command Disallowed */
+	enable_status = 0x0c;
+	send_general(&io, 0, 0x01);
+
+	check(wait_until(has_enables, L_UINT_TO_PTR(1), 1000), "first");
+	check(wait_until(set_is_free, &io, 1000), "set released");
+
+	send_general(&io, 0, 0x02);
+
+	check(wait_until(has_enables, L_UINT_TO_PTR(2), 1000), "second");
+
+	teardown(&io);
+}
+
+static void test_throughput(void)
+{
+	struct mesh_io io;
+	struct mesh_io_send_info info;
+	uint8_t pkt[] = { MESH_AD_TYPE_NETWORK, 0x00, 0x00 };
+	unsigned int i, cmds;
+	uint32_t start, elapsed;
+	bool sent = true;
+
+	l_info("Transmit throughput over %u sets", MAX_ADV_SETS);
+	setup(&io, MAX_ADV_SETS);
+
+	memset(&info, 0, sizeof(info));
+	info.type = MESH_IO_TIMING_TYPE_GENERAL;
+	info.u.gen.interval = 20;
+	info.u.gen.cnt = 1;
+
+	auto_terminate = true;
+	cmds = l_queue_length(cmd_log);
+	start = get_instant();
+
+	for (i = 0; i < PERF_PDUS; i++) {
+		l_put_le16(i, pkt + 1);
+		sent &= mesh_io_generic.send(&io, &info, pkt, sizeof(pkt));
+	}
+
+	check(sent, "send");
+	check(wait_until(tx_drained, &io, 60000), "drained");
+
+	elapsed = get_instant() - start;
+	cmds = l_queue_length(cmd_log) - cmds;
+
+	l_info("%u PDUs in %u ms (%u PDU/s), %u HCI cmds (%u.%02u per PDU)",
+			pdus_enabled, elapsed,
+			elapsed ? pdus_enabled * 1000 / elapsed : 0, cmds,
+			cmds / pdus_enabled, cmds * 100 / pdus_enabled % 100);
+
+	auto_terminate = false;
+	teardown(&io);
+}
+
+int main(int argc, char *argv[])
+{
+	bool perf = false;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-P") || !strcmp(argv[i], "--perf"))
+			perf = true;
+	}
+
+	l_log_set_stderr();
+
+	if (!l_main_init())
+		return EXIT_FAILURE;
+
+	test_poll_rsp_delay();
+	test_general_delay();
+	test_set_refill();
+	test_enable_failure();
+
+	/* Only timed on request, like the tester -P/--perf option */
+	if (perf)
+		test_throughput();
+
+	l_main_exit();
+
+	return EXIT_SUCCESS;
+}
@@ -416,6 +416,138 @@ static void test_destroy(gconstpointer data)
 	execute_context(context);
 }
 
+static const unsigned char read_commands_command[] =
+				{ 0x02, 0x00, 0xff, 0xff, 0x00, 0x00 };
+static const unsigned char read_commands_response[] =
+				{ 0x01, 0x00, 0xff, 0xff, 0x03, 0x00,
+				0x02, 0x00, 0x00 };
+static const unsigned char read_index_list_command[] =
+				{ 0x03, 0x00, 0xff, 0xff, 0x00, 0x00 };
+static const unsigned char read_index_list_response[] =
+				{ 0x01, 0x00, 0xff, 0xff, 0x03, 0x00,
+				0x03, 0x00, 0x00 };
+
+static void test_pipeline(gconstpointer data)
+{
+	struct context *context = create_context();
+
+	/* None of the commands is answered, yet all of them are written */
+	add_action(context, read_version_command,
+				sizeof(read_version_command), NULL, 0, 0,
+				false, ACTION_IGNORE);
+	add_action(context, read_commands_command,
+				sizeof(read_commands_command), NULL, 0, 0,
+				false, ACTION_IGNORE);
+	add_action(context, read_index_list_command,
+				sizeof(read_index_list_command), NULL, 0, 0,
+				false, ACTION_PASSED);
+
+	mgmt_send(context->mgmt_client, MGMT_OP_READ_VERSION, MGMT_INDEX_NONE,
+						0, NULL, NULL, NULL, NULL);
+	mgmt_send(context->mgmt_client, MGMT_OP_READ_COMMANDS, MGMT_INDEX_NONE,
+						0, NULL, NULL, NULL, NULL);
+	mgmt_send(context->mgmt_client, MGMT_OP_READ_INDEX_LIST,
+				MGMT_INDEX_NONE, 0, NULL, NULL, NULL, NULL);
+
+	execute_context(context);
+}
+
+static void pipeline_response_cb(uint8_t status, uint16_t length,
+					const void *param, void *user_data)
+{
+	struct context *context = user_data;
+	struct mgmt_stats stats;
+
+	g_assert_cmpint(status, ==, MGMT_STATUS_SUCCESS);
+
+	g_assert(mgmt_get_stats(context->mgmt_client, &stats));
+
+	if (stats.completed < 3)
+		return;
+
+	g_assert_cmpint(stats.sent, ==, 3);
+	g_assert_cmpint(stats.in_flight, ==, 0);
+	g_assert_cmpint(stats.max_in_flight, ==, 3);
+
+	context_quit(context);
+}
+
+static void test_pipeline_response(gconstpointer data)
+{
+	struct context *context = create_context();
+
+	add_action(context, read_version_command,
+				sizeof(read_version_command),
+				read_version_response,
+				sizeof(read_version_response), 0,
+				false, ACTION_RESPOND);
+	add_action(context, read_commands_command,
+				sizeof(read_commands_command),
+				read_commands_response,
+				sizeof(read_commands_response), 0,
+				false, ACTION_RESPOND);
+	add_action(context, read_index_list_command,
+				sizeof(read_index_list_command),
+				read_index_list_response,
+				sizeof(read_index_list_response), 0,
+				false, ACTION_RESPOND);
+
+	mgmt_send(context->mgmt_client, MGMT_OP_READ_VERSION, MGMT_INDEX_NONE,
+				0, NULL, pipeline_response_cb, context, NULL);
+	mgmt_send(context->mgmt_client, MGMT_OP_READ_COMMANDS, MGMT_INDEX_NONE,
+				0, NULL, pipeline_response_cb, context, NULL);
+	mgmt_send(context->mgmt_client, MGMT_OP_READ_INDEX_LIST,
+				MGMT_INDEX_NONE, 0, NULL, pipeline_response_cb,
+				context, NULL);
+
+	execute_context(context);
+}
+
+static void unanswered_cb(uint8_t status, uint16_t length,
+					const void *param, void *user_data)
+{
+	g_assert_not_reached();
+}
+
+static void stray_response_cb(uint8_t status, uint16_t length,
+					const void *param, void *user_data)
+{
+	struct context *context = user_data;
+	struct mgmt_stats stats;
+
+	g_assert_cmpint(status, ==, MGMT_STATUS_SUCCESS);
+
+	g_assert(mgmt_get_stats(context->mgmt_client, &stats));
+	g_assert_cmpint(stats.completed, ==, 1);
+	g_assert_cmpint(stats.in_flight, ==, 1);
+
+	context_quit(context);
+}
+
+static void test_pipeline_stray_response(gconstpointer data)
+{
+	struct context *context = create_context();
+
+	/* Read Version is answered for an opcode that was never sent */
+	add_action(context, read_version_command,
+				sizeof(read_version_command),
+				read_index_list_response,
+				sizeof(read_index_list_response), 0,
+				false, ACTION_RESPOND);
+	add_action(context, read_commands_command,
+				sizeof(read_commands_command),
+				read_commands_response,
+				sizeof(read_commands_response), 0,
+				false, ACTION_RESPOND);
+
+	mgmt_send(context->mgmt_client, MGMT_OP_READ_VERSION, MGMT_INDEX_NONE,
+				0, NULL, unanswered_cb, context, NULL);
+	mgmt_send(context->mgmt_client, MGMT_OP_READ_COMMANDS, MGMT_INDEX_NONE,
+				0, NULL, stray_response_cb, context, NULL);
+
+	execute_context(context);
+}
+
 int main(int argc, char *argv[])
 {
 	g_test_init(&argc, &argv, NULL);
@@ -438,5 +570,11 @@ int main(int argc, char *argv[])
 
 	g_test_add_data_func("/mgmt/destroy/1", &event_test_1, test_destroy);
 
+	g_test_add_data_func("/mgmt/pipeline/1", NULL, test_pipeline);
+	g_test_add_data_func("/mgmt/pipeline/2", NULL,
+						test_pipeline_response);
+	g_test_add_data_func("/mgmt/pipeline/3", NULL,
+					test_pipeline_stray_response);
+
 	return g_test_run();
 }
@@ -0,0 +1,374 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <glib.h>
+#include <dbus/dbus.h>
+
+#include "gdbus/gdbus.h"
+
+#include "src/log.h"
+#include "src/dbus-common.h"
+#include "src/shared/tester.h"
+
+#include "profiles/audio/player.h"
+
+#define DEVICE_PATH	"/org/bluez/unit/test_player"
+#define PLAYER_PATH	DEVICE_PATH "/player0"
+#define FOLDER_NAME	"/Filesystem"
+
+/*
+ * The library is twice the folder cache and only has LIBRARY_UIDS distinct
+ * items, so the first items are listed again at the end while the middle
+ * ones are only ever listed by pages that get evicted.
+ */
+#define PAGE_SIZE	64
+#define CACHE_SIZE	2048
+#define LIBRARY_SIZE	4096
+#define LIBRARY_UIDS	3000
+
+struct context {
+	DBusConnection *conn;
+	DBusConnection *client;
+	struct media_player *mp;
+	uint32_t fetch_start;
+	uint32_t fetch_end;
+	guint fetch_id;
+	unsigned int fetches;
+	uint32_t start;
+	unsigned int step;
+};
+
+static gboolean list_complete(gpointer user_data)
+{
+	struct context *context = user_data;
+	GPtrArray *items;
+	uint32_t i, end;
+
+	context->fetch_id = 0;
+
+	end = MIN(context->fetch_end, LIBRARY_SIZE - 1);
+	items = g_ptr_array_sized_new(end - context->fetch_start + 1);
+
+	for (i = context->fetch_start; i <= end; i++) {
+		uint64_t uid = i % LIBRARY_UIDS + 1;
+		struct media_item *item;
+		char name[32];
+
+		snprintf(name, sizeof(name), "Track %" PRIu64, uid);
+
+		item = media_player_create_item(context->mp, name,
+						PLAYER_ITEM_TYPE_AUDIO, uid);
+		g_assert(item);
+
+		g_ptr_array_add(items, item);
+	}
+
+	media_player_list_complete(context->mp, items, 0);
+	g_ptr_array_free(items, TRUE);
+
+	return FALSE;
+}
+
+static int list_items(struct media_player *mp, const char *name,
+				uint32_t start, uint32_t end, void *user_data)
+{
+	struct context *context = user_data;
+
+	/* The player never has more than one listing in flight */
+	g_assert(!context->fetch_id);
+
+	context->fetch_start = start;
+	context->fetch_end = end;
+	context->fetches++;
+	context->fetch_id = g_idle_add(list_complete, context);
+
+	return 0;
+}
+
+static const struct media_player_callback player_cbs = {
+	.list_items = list_items,
+};
+
+static void check_properties(DBusMessageIter *iter, uint32_t index)
+{
+	DBusMessageIter dict;
+	char expected[32];
+	bool found = false;
+
+	snprintf(expected, sizeof(expected), "Track %u",
+						index % LIBRARY_UIDS + 1);
+
+	g_assert(dbus_message_iter_get_arg_type(iter) == DBUS_TYPE_ARRAY);
+	dbus_message_iter_recurse(iter, &dict);
+
+	while (dbus_message_iter_get_arg_type(&dict) == DBUS_TYPE_DICT_ENTRY) {
+		DBusMessageIter entry, var;
+		const char *key, *value;
+
+		dbus_message_iter_recurse(&dict, &entry);
+		dbus_message_iter_get_basic(&entry, &key);
+		dbus_message_iter_next(&entry);
+		dbus_message_iter_recurse(&entry, &var);
+
+		if (!strcmp(key, "Name")) {
+			dbus_message_iter_get_basic(&var, &value);
+			g_assert_cmpstr(value, ==, expected);
+			found = true;
+		}
+
+		dbus_message_iter_next(&dict);
+	}
+
+	g_assert(found);
+}
+
+static bool is_registered(struct context *context, const char *path)
+{
+	void *data = NULL;
+
+	g_assert(dbus_connection_get_object_path_data(context->conn, path,
+								&data));
+
+	return data != NULL;
+}
+
+static void check_registered(struct context *context, const char *path)
+{
+	g_assert(is_registered(context, path));
+}
+
+static void check_library(struct context *context, unsigned int first,
+					unsigned int last, bool registered)
+{
+	unsigned int uid;
+
+	for (uid = first; uid <= last; uid++) {
+		char path[64];
+
+		snprintf(path, sizeof(path), "%s%s/item%u", PLAYER_PATH,
+							FOLDER_NAME, uid);
+		g_assert(is_registered(context, path) == registered);
+	}
+}
+
+static void check_items(struct context *context, DBusMessage *reply)
+{
+	DBusMessageIter iter, array;
+	uint32_t index = context->start;
+
+	if (dbus_message_get_type(reply) == DBUS_MESSAGE_TYPE_ERROR) {
+		tester_debug("ListItems failed: %s",
+					dbus_message_get_error_name(reply));
+		g_assert_not_reached();
+	}
+
+	dbus_message_iter_init(reply, &iter);
+	g_assert(dbus_message_iter_get_arg_type(&iter) == DBUS_TYPE_ARRAY);
+	dbus_message_iter_recurse(&iter, &array);
+
+	while (dbus_message_iter_get_arg_type(&array) ==
+						DBUS_TYPE_DICT_ENTRY) {
+		DBusMessageIter entry;
+		const char *path;
+
+		dbus_message_iter_recurse(&array, &entry);
+		dbus_message_iter_get_basic(&entry, &path);
+		dbus_message_iter_next(&entry);
+
+		check_properties(&entry, index);
+		check_registered(context, path);
+
+		index++;
+		dbus_message_iter_next(&array);
+	}
+
+	g_assert_cmpuint(index, ==, context->start + PAGE_SIZE);
+}
+
+static void list_page(struct context *context, uint32_t start);
+
+static void destroy_context(struct context *context)
+{
+	if (context->fetch_id)
+		g_source_remove(context->fetch_id);
+
+	media_player_destroy(context->mp);
+
+	dbus_connection_close(context->client);
+	dbus_connection_unref(context->client);
+	dbus_connection_close(context->conn);
+	dbus_connection_unref(context->conn);
+
+	g_free(context);
+}
+
+static void next_step(struct context *context)
+{
+	unsigned int pages = LIBRARY_SIZE / PAGE_SIZE;
+
+	context->step++;
+
+	/* Scroll through the whole library */
+	if (context->step < pages) {
+		list_page(context, context->step * PAGE_SIZE);
+		return;
+	}
+
+	/*
+	 * Only the last CACHE_SIZE indexes are resident: items also listed
+	 * there survive, items only listed by evicted pages are dropped.
+	 */
+	if (context->step == pages) {
+		unsigned int first = LIBRARY_SIZE - CACHE_SIZE + 1;
+
+		check_library(context, 1, LIBRARY_SIZE - LIBRARY_UIDS, true);
+		check_library(context, LIBRARY_SIZE - LIBRARY_UIDS + 1,
+							first - 1, false);
+		check_library(context, first, LIBRARY_UIDS, true);
+
+		/* The first page was evicted long ago and is fetched again */
+		context->fetches = 0;
+		list_page(context, 0);
+		return;
+	}
+
+	/* Flushing, as done on UIDs Changed, drops every listed object */
+	if (context->step == pages + 1) {
+		g_assert_cmpuint(context->fetches, >, 0);
+
+		media_player_flush_items(context->mp);
+		check_library(context, 1, LIBRARY_UIDS, false);
+
+		list_page(context, PAGE_SIZE);
+		return;
+	}
+
+	check_library(context, PAGE_SIZE + 1, 2 * PAGE_SIZE, true);
+
+	destroy_context(context);
+	tester_test_passed();
+}
+
+static void list_reply(DBusPendingCall *call, void *user_data)
+{
+	struct context *context = user_data;
+	DBusMessage *reply;
+
+	reply = dbus_pending_call_steal_reply(call);
+	check_items(context, reply);
+	dbus_message_unref(reply);
+
+	next_step(context);
+}
+
+static void list_page(struct context *context, uint32_t start)
+{
+	DBusMessage *msg;
+	DBusMessageIter iter, dict;
+	DBusPendingCall *call;
+	uint32_t end = start + PAGE_SIZE - 1;
+
+	context->start = start;
+
+	msg = dbus_message_new_method_call(
+				dbus_bus_get_unique_name(context->conn),
+				PLAYER_PATH, "org.bluez.MediaFolder1",
+				"ListItems");
+	g_assert(msg);
+
+	dbus_message_iter_init_append(msg, &iter);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+					DBUS_TYPE_STRING_AS_STRING
+					DBUS_TYPE_VARIANT_AS_STRING
+					DBUS_DICT_ENTRY_END_CHAR_AS_STRING,
+					&dict);
+	dict_append_entry(&dict, "Start", DBUS_TYPE_UINT32, &start);
+	dict_append_entry(&dict, "End", DBUS_TYPE_UINT32, &end);
+	dbus_message_iter_close_container(&iter, &dict);
+
+	g_assert(dbus_connection_send_with_reply(context->client, msg, &call,
+								-1));
+	dbus_pending_call_set_notify(call, list_reply, context, NULL);
+	dbus_pending_call_unref(call);
+	dbus_message_unref(msg);
+}
+
+static DBusConnection *setup_connection(void)
+{
+	DBusConnection *conn;
+	DBusError err;
+
+	dbus_error_init(&err);
+
+	conn = g_dbus_setup_private(DBUS_BUS_SESSION, NULL, &err);
+	if (!conn) {
+		if (dbus_error_is_set(&err)) {
+			tester_debug("D-Bus setup failed: %s", err.message);
+			dbus_error_free(&err);
+		}
+
+		return NULL;
+	}
+
+	dbus_connection_set_exit_on_disconnect(conn, FALSE);
+
+	return conn;
+}
+
+static void test_list_items(const void *data)
+{
+	struct context *context;
+
+	context = g_new0(struct context, 1);
+
+	context->conn = setup_connection();
+	context->client = setup_connection();
+	if (!context->conn || !context->client) {
+		if (context->conn)
+			dbus_connection_unref(context->conn);
+		if (context->client)
+			dbus_connection_unref(context->client);
+		g_free(context);
+		tester_test_abort();
+		return;
+	}
+
+	set_dbus_connection(context->conn);
+
+	context->mp = media_player_controller_create(DEVICE_PATH, 0);
+	g_assert(context->mp);
+
+	media_player_set_callbacks(context->mp, &player_cbs, context);
+	g_assert(media_player_create_folder(context->mp, FOLDER_NAME,
+					PLAYER_FOLDER_TYPE_MIXED, 0));
+	media_player_set_folder(context->mp, FOLDER_NAME, LIBRARY_SIZE);
+
+	list_page(context, 0);
+}
+
+int main(int argc, char *argv[])
+{
+	tester_init(&argc, &argv);
+
+	__btd_log_init("*", 0);
+
+	tester_add("/player/list_items", NULL, NULL, test_list_items, NULL);
+
+	return tester_run();
+}
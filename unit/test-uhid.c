@@ -217,6 +217,12 @@ static const struct uhid_event ev_input = {
 	.type = UHID_INPUT,
 };
 
+static const uint8_t ev_input2[] = {
+	UHID_INPUT2, 0x00, 0x00, 0x00,	/* type */
+	0x04, 0x00,			/* size */
+	0x01, 0xaa, 0xbb, 0xcc,		/* report number and data */
+};
+
 static const struct uhid_event ev_output = {
 	.type = UHID_OUTPUT,
 };
@@ -242,6 +248,9 @@ static void test_client(gconstpointer data)
 	if (g_str_equal(context->data->test_name, "/uhid/command/input"))
 		bt_uhid_send(context->uhid, &ev_input);
 
+	if (g_str_equal(context->data->test_name, "/uhid/command/input2"))
+		bt_uhid_input(context->uhid, 0x01, ev_input2 + 7, 3);
+
 	context_quit(context);
 }
 
@@ -278,6 +287,7 @@ int main(int argc, char *argv[])
 	define_test("/uhid/command/feature_answer", test_client,
 						event(&ev_feature_answer));
 	define_test("/uhid/command/input", test_client, event(&ev_input));
+	define_test("/uhid/command/input2", test_client, event(&ev_input2));
 
 	define_test("/uhid/event/output", test_server, event(&ev_output));
 	define_test("/uhid/event/feature", test_server, event(&ev_feature));